@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_DAT_PACK_H_
+#define _FA_DAT_PACK_H_
+
+#include "FAConfig.h"
+#include "FASetImageA.h"
+
+///
+/// This class interprets the double-array trie dump created by FADatPack,
+/// see FADatPack for the details of representation.
+///
+/// A transition is one Iw --> Code lookup and one unit lookup, the unit
+/// keeps the finality bit, the Key of the final node is in its terminal
+/// unit. The methods are inline, since they are called for every character.
+///
+
+class FADat_pack : public FASetImageA {
+
+public:
+    FADat_pack ();
+
+public:
+    /// sets up image dump
+    void SetImage (const unsigned char * pImage);
+
+    /// returns the root node
+    inline const int GetRoot () const
+    {
+        return 0;
+    }
+
+    /// returns the child of the Node by the Iw, -1 if there is no child
+    inline const int GetDest (const int Node, const int Iw) const
+    {
+        DebugLogAssert (0 <= Node && Node < m_UnitCount);
+
+        unsigned int Code;
+
+        if ((unsigned int) Iw < m_DirectCount) {
+            Code = m_pDirect [Iw];
+        } else if ((unsigned int) Iw <= m_MaxIw) {
+            Code = m_pBlocks [m_pTop [(Iw >> 8) - m_TopBase] + (Iw & 0xff)];
+        } else {
+            return -1;
+        }
+
+        // the units are padded, so any Base + Code is a valid unit
+        const int Dst = (m_pUnits [Node << 1] >> 1) + Code;
+        DebugLogAssert (Dst < m_UnitCount);
+
+        if (Node == m_pUnits [(Dst << 1) + 1]) {
+            return Dst;
+        }
+        return -1;
+    }
+
+    /// returns true if the Node is final
+    inline const bool IsFinal (const int Node) const
+    {
+        DebugLogAssert (0 <= Node && Node < m_UnitCount);
+        return 0 != (1 & m_pUnits [Node << 1]);
+    }
+
+    /// returns the Key of the final Node
+    inline const int GetKey (const int Node) const
+    {
+        DebugLogAssert (IsFinal (Node));
+        const int Term = (m_pUnits [Node << 1] >> 1) + 1;
+        return m_pUnits [Term << 1];
+    }
+
+    /// returns the number of Keys, the Keys are [0, GetKeyCount ())
+    const int GetKeyCount () const;
+    /// returns the Id of the Key
+    const int GetId (const int Key) const;
+    /// returns the Score of the Key
+    const float GetScore (const int Key) const;
+
+private:
+    // Iw --> Code, for Iws < m_DirectCount
+    const unsigned short * m_pDirect;
+    unsigned int m_DirectCount;
+    // Iw >> 8 --> block offset, for Iws in [m_DirectCount, m_MaxIw]
+    const int * m_pTop;
+    unsigned int m_TopBase;
+    const unsigned short * m_pBlocks;
+    unsigned int m_MaxIw;
+    // <Base << 1 | IsFinal, Check> pairs
+    const int * m_pUnits;
+    int m_UnitCount;
+    // <Id, Score> pairs
+    const int * m_pTerms;
+    int m_KeyCount;
+};
+
+#endif
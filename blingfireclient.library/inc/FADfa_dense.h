@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_DFA_DENSE_H_
+#define _FA_DFA_DENSE_H_
+
+#include "FAConfig.h"
+#include "FARSDfaCA.h"
+#include "FAMealyDfaCA.h"
+#include "FASecurity.h"
+
+///
+/// Load-time accelerator for the packed automata. Keeps the hot states as
+/// dense [State][IwClass] tables and falls back to the original automaton
+/// for other states and Iws.
+///
+/// Notes:
+///
+/// 1. The hot states are the states closest to the initial one, they are
+///    selected in the breadth-first order over the Iws [0, DenseIwCount)
+///    until the memory budget is exhausted.
+///
+/// 2. The Iws [0, DenseIwCount) which lead to the same destinations (and
+///    Ows) from all the hot states share one column of the table.
+///
+/// 3. If the Mealy automaton is set up then the tables keep its transitions
+///    and outputs and are used by GetDestOw only, the Rabin-Scott automaton
+///    is used for the initial state then.
+///
+/// 4. The object only reads the automata, it should be initialized before
+///    it is shared among threads.
+///
+/// 5. The tables can be saved and then used from the dump instead of being
+///    built again, e.g. from the FARuntimeCache file, the dump is valid only
+///    for the same automata, memory budget and DenseIwCount.
+///
+
+class FADfa_dense : public FARSDfaCA,
+                    public FAMealyDfaCA {
+
+public:
+    FADfa_dense ();
+    ~FADfa_dense ();
+
+public:
+    /// sets up the Rabin-Scott automaton, required
+    void SetRsDfa (const FARSDfaCA * pDfa);
+    /// sets up the Mealy automaton, optional
+    void SetMealyDfa (const FAMealyDfaCA * pMealy);
+    /// sets up the memory budget in bytes, 0 means no tables are built
+    void SetMaxMemory (const int MaxMemory);
+    /// sets up the number of Iws which are looked up in the tables
+    void SetDenseIwCount (const int DenseIwCount);
+    /// builds the tables
+    void Process ();
+    /// returns object into the initial state
+    void Clear ();
+    /// returns the number of bytes used by the tables
+    const int GetMemorySize () const;
+    /// returns the number of the hot states
+    const int GetStateCount () const;
+
+    /// returns the size of the tables dump in bytes
+    const size_t GetDumpSize () const;
+    /// writes the tables into pDump of GetDumpSize () bytes
+    void Save (unsigned char * pDump) const;
+    /// uses the tables from the dump made by Save instead of building them,
+    /// the dump is not copied, returns false if the dump was made for a
+    /// different memory budget or DenseIwCount
+    const bool SetDump (const unsigned char * pDump, const size_t Size);
+    /// returns true if the tables are used from the dump set by SetDump
+    const bool IsFromDump () const;
+
+/// FARSDfaCA
+public:
+    const int GetInitial () const;
+    const bool IsFinal (const int State) const;
+    const int GetDest (const int State, const int Iw) const;
+    const int GetIWs (
+            __out_ecount_opt (MaxIwCount) int * pIws,
+            const int MaxIwCount
+        ) const;
+
+/// FAMealyDfaCA
+public:
+    const int GetDestOw (
+            const int State,
+            const int Iw,
+            int * pOw
+        ) const;
+
+private:
+    /// returns the table row of the State, -1 if the State is not hot
+    inline const int GetRow (const int State) const;
+    /// returns the State's destination and Ow from the original automaton
+    inline const int GetOrigDestOw (
+            const int State,
+            const int Iw,
+            int * pOw
+        ) const;
+    /// frees the tables
+    void FreeTables ();
+
+private:
+    // input automata
+    const FARSDfaCA * m_pDfa;
+    const FAMealyDfaCA * m_pMealy;
+    // memory budget in bytes
+    int m_MaxMemory;
+    // Iws [0, m_DenseIwCount) are looked up in the tables
+    int m_DenseIwCount;
+    // Iw --> column
+    const int * m_pIw2Class;
+    int m_ClassCount;
+    // the number of rows, hot states
+    int m_RowCount;
+    // [Row][Class] --> Dst
+    const int * m_pDsts;
+    // [Row][Class] --> Ow, for the Mealy automaton only
+    const int * m_pOws;
+    // open addressing hash of < State, Row > pairs
+    const int * m_pState2Row;
+    unsigned int m_HashMask;
+    // true if the tables are allocated by Process, false if they are in a dump
+    bool m_fOwnTables;
+
+    enum {
+        DefDenseIwCount = 256,
+        MaxDenseIwCount = 0x10000,
+        DumpHeaderSize = 6, // the number of ints before the tables in a dump
+    };
+};
+
+
+inline const int FADfa_dense::GetRow (const int State) const
+{
+    DebugLogAssert (0 <= State && m_pState2Row);
+
+    unsigned int i = ((unsigned int) State * 2654435761U) & m_HashMask;
+
+    while (true) {
+        const int * pPair = m_pState2Row + (i << 1);
+        if (State == pPair [0]) {
+            return pPair [1];
+        } else if (-1 == pPair [0]) {
+            return -1;
+        }
+        i = (i + 1) & m_HashMask;
+    }
+}
+
+#endif
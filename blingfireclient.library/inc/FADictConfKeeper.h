@@ -11,6 +11,7 @@
 
 class FALDB;
 class FARSDfa_pack_triv;
+class FAIwMap_pack;
 class FAMealyDfa_pack_triv;
 class FAState2Ow_pack_triv;
 class FAArray_pack;
@@ -22,6 +23,9 @@ class FAArrayCA;
 class FAMultiMapCA;
 class FAState2OwCA;
 class FAMultiMap_pack_fixed;
+class FAGetIWs_pack_triv;
+class FAGetIWsCA;
+class FADat_pack;
 
 ///
 /// Keeps dictionary object configuration and common containers.
@@ -55,6 +59,16 @@ public:
     const int GetDirection () const;
     const FAMultiMapCA * GetCharMap () const;
     const int GetTokAlgo () const;
+    /// returns NULL if the automaton's Iws are remapped
+    const FAGetIWsCA * GetIws () const;
+    /// returns the double-array trie of the dictionary, NULL if not present
+    const FADat_pack * GetDat () const;
+    /// returns the Iw map of the automaton, NULL if not loaded
+    const FAIwMap_pack * GetIwMap () const;
+
+public:
+    /// overrides the Mealy automaton from the LDB
+    void SetMphMealy (const FAMealyDfaCA * pMealy);
 
 private:
     // input LDB
@@ -63,7 +77,9 @@ private:
     int m_FsmType;
     FARSDfa_pack_triv * m_pRsDfa;
     FAMealyDfa_pack_triv * m_pMealy;
+    const FAMealyDfaCA * m_pMealyA;
     FAState2Ow_pack_triv * m_pState2Ow;
+    FAGetIWs_pack_triv * m_pIws;
     // K2I: packed array
     FAArray_pack * m_pK2I;
     // I2Info: multi-map
@@ -71,6 +87,8 @@ private:
     FAMultiMap_pack_mph * m_pI2Info_mph;
     FAMultiMap_pack_fixed * m_pI2Info_fixed;
     const FAMultiMapCA * m_pI2Info;
+    // W2K and I2Info as one double-array trie, optional
+    FADat_pack * m_pDat;
     // configuration options
     bool m_IgnoreCase;
     bool m_NoTrUse;
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_DUMPREGISTRY_H_
+#define _FA_DUMPREGISTRY_H_
+
+#include "FAConfig.h"
+
+#include <mutex>
+#include <unordered_map>
+
+///
+/// A content-addressed storage of the read-only LDB dumps, so the identical
+/// dumps of several LDBs (e.g. the same charmap or the same pre-tokenizer
+/// automaton of different models) are kept in memory once, see
+/// FALDB::ShareDumps.
+///
+/// Notes:
+///
+/// 1. The dumps are looked up by the CRC32 and the size and are compared
+///    byte by byte, the stored copies are aligned as the LDB v2 sections.
+///
+/// 2. A stored dump is reference counted, it is freed when the last LDB
+///    releases it.
+///
+/// 3. All the methods are thread safe.
+///
+
+class FADumpRegistry {
+
+public:
+    FADumpRegistry ();
+    ~FADumpRegistry ();
+
+public:
+    /// returns the stored dump identical to the pDump, stores a copy if there
+    /// is no such dump, the returned dump should be released by Release
+    const unsigned char * Add (
+            const unsigned char * pDump,
+            const size_t Size,
+            const unsigned int Crc
+        );
+    /// releases the dump returned by Add
+    void Release (const unsigned char * pDump);
+
+    /// returns the number of the users of the dump returned by Add, 0 if
+    /// the dump is not stored
+    const int GetRefCount (const unsigned char * pDump) const;
+
+    /// returns the number of the stored dumps
+    const size_t GetCount () const;
+    /// returns the total size of the stored dumps
+    const size_t GetSize () const;
+
+private:
+    struct _TEntry {
+        unsigned char * _pHeap;  // the allocated memory
+        size_t _Size;            // the dump size
+        unsigned int _Crc;       // the dump CRC32
+        int _RefCount;           // the number of users
+    };
+
+    // the aligned dump --> entry
+    std::unordered_map < const unsigned char *, _TEntry > m_Entries;
+    // CRC32 --> the aligned dumps with this CRC32
+    std::unordered_multimap < unsigned int, const unsigned char * > m_ByCrc;
+    // the total size of the stored dumps
+    size_t m_Size;
+    // guards all the data
+    mutable std::mutex m_Lock;
+};
+
+#endif
@@ -26,6 +26,7 @@ public:
         TYPE_MEALY_DFA,
         TYPE_ARRAY,
         TYPE_FLOAT_ARRAY,
+        TYPE_DAT,
         TYPE_COUNT,
     };
 
@@ -259,6 +260,8 @@ public:
         PARAM_MAX_LENGTH,  // maximum length, e.g. maximum token length
         PARAM_VERIFY_LDB_BIN, // if specified, requires a CRC32-like check for the LDB file to pass
         PARAM_TOKENIZATION_TYPE, // specifies which tokenization runtime should be used
+        PARAM_UTF8_INPUT,  // the automaton reads UTF-8 bytes rather than code points
+        PARAM_DAT,         // double-array trie of the dictionary, see FADatPack
         PARAM_COUNT,
     };
 
@@ -381,6 +384,54 @@ public:
         VALIDATION_COUNT,
     };
 
+    // LDB bin container version 2, see FALDB
+    enum {
+        LDB_V2_MAGIC = 0x3242444C, // "LDB2", never a valid version 1 dump count
+        LDB_V2_VERSION = 2,
+        LDB_V2_ALIGNMENT = 64,     // section offsets are multiples of it
+        LDB_V2_HEADER_SIZE = 24,   // the header size in bytes
+        LDB_V2_ENTRY_SIZE = 32,    // the section directory entry size in bytes
+    };
+
+    // LDB bin version 2 section types
+    enum {
+        LDB_SECTION_CONF = 0,  // the configuration, always the first section
+        LDB_SECTION_DATA,      // a resource dump
+    };
+
+    // LDB bin version 2 section codecs, see FALzDecompress
+    enum {
+        LDB_CODEC_NONE = 0,       // the section is stored as is
+        LDB_CODEC_LZ,             // the section is LZ compressed
+        LDB_LZ_BLOCK_SIZE = 1 << 20, // the sections are compressed by blocks
+        LDB_LZ_HEADER_SIZE = 16,  // the compressed section header size in bytes
+    };
+
+    // LDB bin verification modes, see FALDB::SetVerifyMode
+    enum {
+        LDB_VERIFY_EAGER = 0,  // SetImage verifies all the sections
+        LDB_VERIFY_PARALLEL,   // SetImage verifies the sections in parallel
+        LDB_VERIFY_LAZY,       // GetDump verifies its section the first time
+        LDB_VERIFY_BACKGROUND, // a thread verifies the sections, GetDump waits
+        LDB_VERIFY_COUNT,
+    };
+
+    // runtime cache file, see FARuntimeCache
+    enum {
+        RTC_MAGIC = 0x43544642,  // "BFTC"
+        RTC_VERSION = 2,         // changes if any of the cached data change
+        RTC_ALIGNMENT = 64,      // section offsets are multiples of it
+        RTC_HEADER_SIZE = 48,    // the header size in bytes
+        RTC_ENTRY_SIZE = 24,     // the section directory entry size in bytes
+    };
+
+    // runtime cache sections
+    enum {
+        RTC_WBD_DENSE = 1,   // FADfa_dense tables of the [wbd] automaton
+        RTC_DICT_DENSE,      // FADfa_dense tables of the [pos-dict] Mealy automaton
+        RTC_WORD_BOUNDED,    // FAIsDelimBounded of the [pos-dict] automaton
+    };
+
     // character normalization method
     enum {
         NORMALIZE_DEFAULT = 0,
@@ -397,6 +448,8 @@ public:
         TOKENIZE_BPE = 3,
         TOKENIZE_BPE_OPT = 4,     // optimized version of the BPE, prefers a single token match over
                                   //  subtoken, assumes tokens are delimited with U+x2581 
+        TOKENIZE_BPE_MERGE = 5,   // reference BPE, merges the adjacent pair with the smallest
+                                  //  id first, the leftmost one if there are several
         TOKENIZE_COUNT,
     };
 
@@ -20,12 +20,18 @@ public:
     ~FAImageDump ();
 
 public:
-    // loads image dump from file, entire file is used as single image
+    // loads image dump from file, entire file is used as single image,
+    // the file is memory mapped if fUseMemMapping is true, the compressed
+    // LDB images are expanded into the heap
     void Load (const char * pFileName, const bool fUseMemMapping = false);
     // sets up image dump from the external pointer
     void SetImageDump (const unsigned char * pImageDump);
     // returns pointer to the image dump
     const unsigned char * GetImageDump () const;
+    // returns the image size, 0 if not known
+    const size_t GetSize () const;
+    // returns true if the image is memory mapped
+    const bool IsMapped () const;
 
 private:
     // load file into the heap
@@ -36,10 +42,18 @@ private:
     void FALoadMm (const char * pFileName);
     // returns all memory map related resources back
     void FAFreeMm ();
+    // allocates m_pHeap, returns the aligned pointer within it
+    unsigned char * FAAllocHeap (const size_t Size);
+    // replaces the compressed LDB image with the expanded one
+    void FAExpand ();
 
 private:
     /// pointer to the data
     unsigned char * m_pImageDump;
+    /// the heap memory, m_pImageDump is aligned within it
+    unsigned char * m_pHeap;
+    /// the image size, 0 if not known
+    size_t m_Size;
     /// true if the memory should be returned to heap
     bool m_MustDelete;
     /// not 0, if data are loaded thru the memory mapped file
@@ -15,6 +15,11 @@
 ///
 /// This class interprets dump created by FAIwMapPack
 ///
+/// Note: OldIws up to MaxTableIw are mapped with a multi-stage table with
+///  8/8/5 bits of the OldIw per stage, the identical blocks are stored once.
+///  The tables are shared among all the objects with the same map dump, the
+///  dump is looked up by the CRC32 of its intervals before a table is built.
+///
 
 class FAIwMap_pack : public FASetImageA {
 
@@ -27,6 +32,28 @@ public:
     void SetImage (const unsigned char * pImage);
     /// returns NewIw for the given OldIw
     inline const int GetNewIw (const int OldIw) const;
+    /// returns the size of the multi-stage table in bytes, 0 if there is none
+    const size_t GetTableSize () const;
+    /// returns the number of the objects sharing the multi-stage table
+    const int GetTableShareCount () const;
+
+private:
+    // returns NewIw for the OldIw from the IntervalIdx interval
+    inline const int DecodeNewIw (const int IntervalIdx, const int OldIw) const;
+    // sets up the multi-stage table, an identical one is used if there is
+    void SetTable (const unsigned char * pImage);
+    // builds the multi-stage table
+    struct _TTable;
+    _TTable * BuildTable () const;
+    // returns the table made from the same map dump and adds a reference,
+    // NULL if there is no such table, should be called under the lock
+    static _TTable * FindTable (
+            const unsigned char * pDump,
+            const size_t Size,
+            const unsigned int Crc
+        );
+    // releases the multi-stage table
+    void ReleaseTable ();
 
 private:
     // interval count
@@ -42,10 +69,22 @@ private:
 
     // constants
     enum {
-        MaxCacheSize = 0xFFFF,
+        MaxTableIw = 0x10FFFF,
+        Stage1Shift = 13,
+        Stage2Shift = 5,
+        Stage2Mask = 0xFF,
+        Stage3Mask = 0x1F,
     };
-    int m_CacheSize;
-    int * m_pIw2IwCache;
+    // the multi-stage table covers OldIws [0, m_TableSize)
+    int m_TableSize;
+    // OldIw >> 13 --> offset of the stage 2 block
+    const int * m_pStage1;
+    // (OldIw >> 5) & 0xFF --> offset of the stage 3 block
+    const int * m_pStage2;
+    // OldIw & 0x1F --> NewIw
+    const int * m_pStage3;
+    // shared table object
+    _TTable * m_pTable;
 };
 
 
@@ -55,15 +94,14 @@ inline const int FAIwMap_pack::GetNewIw (const int OldIw) const
     DebugLogAssert (0 < m_IntervalCount);
     DebugLogAssert (m_pArrFromIw && m_pArrToIwOffset && m_pNewIws);
 
-    // get the Iw from the cache
-    if (0 <= OldIw && OldIw < m_CacheSize) {
-        DebugLogAssert (m_pIw2IwCache);
-        return m_pIw2IwCache [OldIw];
+    // get the Iw from the table
+    if ((unsigned int) OldIw < (unsigned int) m_TableSize) {
+        DebugLogAssert (m_pStage1 && m_pStage2 && m_pStage3);
+        const int Block = m_pStage2 [m_pStage1 [OldIw >> Stage1Shift] + \
+            ((OldIw >> Stage2Shift) & Stage2Mask)];
+        return m_pStage3 [Block + (OldIw & Stage3Mask)];
     }
 
-    // decode the Iw
-    unsigned int NewIw;
-
     const int IntervalIdx = \
         ::FAFindEqualOrLess_log (m_pArrFromIw, m_IntervalCount, OldIw);
 
@@ -72,6 +110,18 @@ inline const int FAIwMap_pack::GetNewIw (const int OldIw) const
         return -1;
     }
 
+    return DecodeNewIw (IntervalIdx, OldIw);
+}
+
+
+inline const int FAIwMap_pack::
+    DecodeNewIw (const int IntervalIdx, const int OldIw) const
+{
+    DebugLogAssert (0 <= IntervalIdx && IntervalIdx < m_IntervalCount);
+
+    // decode the Iw
+    unsigned int NewIw;
+
     // get beginning of the interval
     const int FromIw = m_pArrFromIw [IntervalIdx];
     DebugLogAssert (FromIw <= OldIw);
@@ -12,9 +12,53 @@
 #include "FAMultiMap_pack.h"
 #include "FALimits.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class FADumpRegistry;
+
 ///
 /// Base class for keeping linguistic resources.
 ///
+/// Two LDB bin formats are read:
+///
+/// Version 1: int Count, int Offsets [Count], followed by the dumps, the last
+///   dump keeps the validation data (see FAFsmConst::VALIDATION_*).
+///
+/// Version 2 (all integers are little endian):
+///   header, 24 bytes:
+///     uint32 Magic (FAFsmConst::LDB_V2_MAGIC)
+///     uint32 Version (FAFsmConst::LDB_V2_VERSION)
+///     uint32 Count
+///     uint32 Alignment
+///     uint64 ImageSize
+///   section directory, Count entries of 32 bytes:
+///     uint32 Type (FAFsmConst::LDB_SECTION_*)
+///     uint32 Alignment
+///     uint64 Offset
+///     uint64 Size
+///     uint32 Crc32
+///     uint32 Codec (FAFsmConst::LDB_CODEC_*)
+///   followed by the sections, each starts at the offset which is a multiple
+///   of its alignment (64 bytes), the gaps are filled with 0s.
+///
+/// The images with the compressed sections should be expanded by
+///   FALzDecompress first, FAImageDump::Load does it.
+///
+/// In both versions the dump 0 is the configuration.
+///
+/// If the configuration asks for the verification (verify-ldb-bin) the
+/// version 2 sections are checked against their CRC32s, as selected by
+/// SetVerifyMode. In the lazy and the background modes GetDump does not
+/// return a section before it is verified, so the corruption is still
+/// reported before the data are used. Version 1 images are always verified
+/// by SetImage, since they have one checksum for all the dumps.
+///
+/// ShareDumps moves the dumps into the FADumpRegistry, so the identical dumps
+/// of several LDBs are kept once and the image can be freed.
+///
 
 class FALDB : public FASetImageA {
 
@@ -23,7 +67,24 @@ public:
     virtual ~FALDB ();
 
 public:
+    // sets up the verification mode, FAFsmConst::LDB_VERIFY_*, should be
+    // called before SetImage
+    void SetVerifyMode (const int VerifyMode);
+
     void SetImage (const unsigned char * pImgDump);
+    // the same as above, but the header, the offsets and the sizes of the
+    // image are checked to fit into its ImageSize bytes, 0 if not known
+    void SetImage (const unsigned char * pImgDump, const size_t ImageSize);
+
+    // replaces the dumps with their shared copies from the pRegistry, waits
+    // for the verification, after the call the image of ImageSize bytes is
+    // not used and can be freed
+    void ShareDumps (FADumpRegistry * pRegistry, const size_t ImageSize);
+
+    // returns the checksum of the dumps of the image of ImageSize bytes,
+    // it uses the stored CRC32 values, so it is cheap for the version 2
+    // images and after ShareDumps
+    const unsigned int GetChecksum (const size_t ImageSize) const;
 
 public:
     // returns configuration multi map, it contain runtime initialization
@@ -36,6 +97,16 @@ public:
     // returns pointer to the image dump memory by its index
     const unsigned char * GetDump (const int Num) const;
 
+    // returns the size of the dump by its index, ImageSize is the size of
+    // the image, it is needed for the last version 1 dump only
+    const size_t GetDumpSize (const int Num, const size_t ImageSize) const;
+
+    // returns the registry the dumps are shared in, NULL if they are not
+    const FADumpRegistry * GetRegistry () const;
+
+    // returns the version of the image format, 1 or 2
+    const int GetVersion () const;
+
     // returns true if the parameter found, false otherwise
     // *pValue will contain parameter's value from the given section
     // it will be 1 if the parameter is boolean
@@ -43,9 +114,31 @@ public:
 
 private:
     static inline const bool IsBooleanParam (const int Parameter);
+    // reads a little endian 64-bit value stored as two ints
+    static inline const unsigned long long GetUInt64 (const unsigned int * pArr);
+
+    // sets up version 1 image, ImageSize is 0 if not known
+    void SetImageV1 (const unsigned char * pImgDump, const size_t ImageSize);
+    // sets up version 2 image, ImageSize is 0 if not known
+    void SetImageV2 (const unsigned char * pImgDump, const size_t ImageSize);
 
     // validates LDB bin file if the validation information is available
     const bool IsValidBinary ();
+    // validates the version 1 image
+    const bool IsValidV1 () const;
+    // validates the version 2 image, as the verification mode says
+    const bool IsValidV2 ();
+
+    // returns true if the version 2 dump matches its CRC32
+    const bool IsValidDump (const int Num) const;
+    // verifies the dumps [Num, m_DumpCount) with the Step, sets m_States
+    void VerifyDumps (const int Num, const int Step);
+    // makes sure the dump Num is verified, waits or verifies it if needed
+    void EnsureValid (const int Num) const;
+    // waits for the background verification to finish
+    void JoinVerifier ();
+    // releases the shared dumps, if any
+    void ReleaseDumps ();
 
 protected:
     // keeps configuration
@@ -54,12 +147,39 @@ protected:
     // keeps the array of resource dumps
     const unsigned char * m_Dumps [FALimits::MaxLdbDumpCount];
 
-    // and array of offsets where the dumps start
-    unsigned int m_Offsets [FALimits::MaxLdbDumpCount];
+    // and array of the dump sizes, unknown (0) for the last version 1 dump
+    size_t m_Sizes [FALimits::MaxLdbDumpCount];
+
+    // the dump CRC32 values, version 2 only or after ShareDumps
+    unsigned int m_Crcs [FALimits::MaxLdbDumpCount];
 
     // number of dumps
     int m_DumpCount;
 
+    // LDB format version, 1 or 2
+    int m_Version;
+    // the image
+    const unsigned char * m_pImage;
+    // the registry of the shared dumps, NULL if the dumps are not shared
+    FADumpRegistry * m_pRegistry;
+
+    // verification mode
+    int m_VerifyMode;
+    // true if GetDump has to check the verification state
+    bool m_fVerifyOnAccess;
+    // verification state of the dumps, see the DUMP_* constants
+    mutable std::atomic < int > m_States [FALimits::MaxLdbDumpCount];
+    // the background verification thread and its notification
+    std::thread m_Verifier;
+    mutable std::mutex m_Lock;
+    mutable std::condition_variable m_Verified;
+
+    enum {
+        DUMP_UNKNOWN = 0,
+        DUMP_VALID,
+        DUMP_INVALID,
+    };
+
 };
 
 #endif
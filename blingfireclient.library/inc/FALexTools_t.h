@@ -17,6 +17,8 @@
 #include "FALimits.h"
 #include "FASecurity.h"
 
+#include <vector>
+
 ///
 /// Lexical analyzer runtime. 
 ///
@@ -44,6 +46,27 @@
 ///  the values can be predefined (and frozen) in the tagset.txt file of the
 ///  the corresponding grammar.
 ///
+/// 3. If Ty is a byte type then the input is a valid UTF-8 text and the
+///  automaton should be converted with fa_fsm2fsm_pack --utf8-dfa. Contexts
+///  and the maximum token length are counted in characters, the output
+///  positions are the first and the last bytes of the token.
+///
+/// 4. Once the scans of the whole input have read it MemoMinRatio times
+///  over, the following scans remember where they have stopped and the
+///  (State, Position) pairs they have passed after their last final state.
+///  A scan from a later start position which arrives at such a pair either
+///  stops or jumps directly to where the earlier scan has stopped since no
+///  final state can be met in between. The output does not change, but runs
+///  of the text which no rule matches are scanned in (nearly) linear time
+///  instead of O(n * MaxTokenLength). The text where the scans stop soon
+///  does not pay for the memo.
+///
+/// 5. The _function calls are made with an explicit stack, it moves to the
+///  heap if the calls are deeper than MaxLocalDepth. The outputs
+///  of the recent calls are remembered and a call of the same function for
+///  the same text (e.g. a repeated word) copies the earlier output instead of
+///  lexing the text.
+///
 
 template < class Ty >
 class FALexTools_t {
@@ -76,18 +99,124 @@ private:
     /// validates consitensy between data structures
     inline void Validate () const;
 
+    /// returns the first byte of the character which is Count characters
+    /// away from the character starting at Pos, for a code point input
+    /// returns Pos + Count
+    inline static const int MoveBegin (
+            const Ty * pIn,
+            const int InSize,
+            int Pos,
+            int Count
+        );
+
+    /// returns the last byte of the character which is Count characters
+    /// away from the character ending at Pos, for a code point input
+    /// returns Pos + Count
+    inline static const int MoveEnd (
+            const Ty * pIn,
+            const int InSize,
+            int Pos,
+            int Count
+        );
+
     // internal processing function, returns the size of the output array
     const int Process_int (
             const int Initial,
-            const int Offset,
             const Ty * pIn,
             const int InSize,
             __out_ecount(MaxOutSize) int * pOut,
             const int MaxOutSize,
-            const int RecDepth,
             const bool fOnce = false
         ) const;
 
+    /// finds the longest match starting from FromPos, returns its last
+    /// position or -1 if there is no match, *pEndPos is where the scan has
+    /// stopped, the scan with fMemo reads and updates the memo
+    template < const bool fMemo >
+    inline const int Match (
+            const int Initial,
+            const Ty * pIn,
+            const int InSize,
+            const int FromPos,
+            int * pMemo,
+            int * pFinalState,
+            int * pEndPos
+        ) const;
+
+    /// sets up the memo for the input, returns a pointer to it
+    inline static int * InitMemo (
+            std::vector < int > & Memo,
+            const Ty * pIn,
+            const int InSize
+        );
+
+    /// computes the token boundaries of the match [FromPos, FinalPos]
+    inline static void GetSpan (
+            const Ty * pIn,
+            const int InSize,
+            const int FromPos,
+            const int FinalPos,
+            const int LeftCx,
+            const int RightCx,
+            int * pFromPos2,
+            int * pToPos,
+            int * pToPos2
+        );
+
+    /// returns a hash key of the function call, reads no more than
+    /// 2 * MaxHashSpan input elements
+    inline static const unsigned int GetCallHash (
+            const int FnIni,
+            const int RecDepth,
+            const bool fOnce,
+            const Ty * pIn,
+            const int InSize
+        );
+
+private:
+    // a completed function call, the output is kept in the output array
+    struct _TCall {
+
+        unsigned int _Hash; // the hash key
+        int _FnIni;         // the initial state of the function
+        int _RecDepth;      // the depth of the call
+        bool _fOnce;        // the "once" flag
+        int _Offset;        // the input offset
+        int _InSize;        // the input size
+        int _OutOffset;     // the output offset
+        int _OutSize;       // the output size
+    };
+
+    // a function call in progress
+    struct _TFrame {
+
+        int _Initial;       // the initial state of the function
+        int _Offset;        // the input offset
+        int _InSize;        // the input size
+        int _OutOffset;     // the output offset
+        int _MaxOutSize;    // the output size limit
+        bool _fOnce;        // stop after the first match
+        bool _fFull;        // the output has been cut
+        int _OutSize;       // the output size so far
+        int _FromPos;       // the current start position
+        const int * _pAct;  // the action being applied, NULL if none
+        int _ActSize;       // the action size
+        int _FnIdx;         // the next function in the action to call
+        bool _fFnOnce;      // the "once" flag for the called functions
+        int _FnFrom;        // the input start of the next function
+        int _ToPos;         // the last position of the match
+        int _ToPos2;        // the same, clipped by the input
+        _TCall * _pCall;    // where to remember the call being made
+        unsigned int _Hash; // its hash key
+    };
+
+    /// adds the output of a function call to the caller's output
+    inline static void AddFnOutput (
+            _TFrame * pF,
+            const int * pOut,
+            const int FnOutSize
+        );
+
 private:
     /// input objects
     const FARSDfaCA * m_pDfa;
@@ -105,6 +234,11 @@ private:
         DefMaxDepth = 2,
         MinActSize = 3,
         DefSubIw = FAFsmConst::IW_EPSILON,
+        MemoArrCount = 6,
+        MemoMinRatio = 8,
+        MaxLocalDepth = 16,
+        MaxCallCount = 64,
+        MaxHashSpan = 16,
     };
 };
 
@@ -147,6 +281,11 @@ void FALexTools_t< Ty >::SetConf (const FAWbdConfKeeper * pWbdConf)
         m_MaxTokenLength = FALimits::MaxWordLen;
     }
 
+    // the automaton should read the same kind of input as this object
+    LogAssert (!pWbdConf || (1 == sizeof (Ty)) == pWbdConf->GetUtf8Input ());
+    // case folding is not possible for UTF-8 bytes
+    LogAssert (1 != sizeof (Ty) || !m_IgnoreCase);
+
     Validate ();
 }
 
@@ -200,200 +339,649 @@ inline void FALexTools_t< Ty >::Validate () const
 
 
 template < class Ty >
-const int FALexTools_t< Ty >::
-    Process_int (
-            const int Initial,
-            const int Offset,
+inline const int FALexTools_t< Ty >::
+    MoveBegin (
             const Ty * pIn,
             const int InSize,
-            __out_ecount(MaxOutSize) int * pOut,
-            const int MaxOutSize,
-            const int RecDepth,
-            const bool fOnce
-        ) const
+            int Pos,
+            int Count
+        )
 {
-    int OutSize = 0;
-    int Iw;
-    int Dst;
+    if (1 != sizeof (Ty)) {
+        return Pos + Count;
+    }
+    for (; 0 < Count && Pos < InSize; --Count) {
+        Pos++;
+        while (Pos < InSize && 0x80 == (0xC0 & pIn [Pos])) {
+            Pos++;
+        }
+    }
+    for (; 0 > Count && 0 <= Pos; ++Count) {
+        Pos--;
+        while (0 < Pos && 0x80 == (0xC0 & pIn [Pos])) {
+            Pos--;
+        }
+    }
+    return Pos;
+}
 
-    if (m_MaxDepth < RecDepth) {
-        return 0;
+
+template < class Ty >
+inline const int FALexTools_t< Ty >::
+    MoveEnd (
+            const Ty * pIn,
+            const int InSize,
+            int Pos,
+            int Count
+        )
+{
+    if (1 != sizeof (Ty)) {
+        return Pos + Count;
     }
+    for (; 0 > Count && 0 <= Pos; ++Count) {
+        while (0 < Pos && Pos < InSize && 0x80 == (0xC0 & pIn [Pos])) {
+            Pos--;
+        }
+        Pos--;
+    }
+    for (; 0 < Count && Pos < InSize; --Count) {
+        Pos++;
+        while (Pos + 1 < InSize && 0x80 == (0xC0 & pIn [Pos + 1])) {
+            Pos++;
+        }
+    }
+    return Pos;
+}
 
-    const int MaxTokenLength = m_MaxTokenLength;
 
-    /// iterate thru all possible start positions
-    for (int FromPos = -1; FromPos < InSize; ++FromPos) {
+template < class Ty >
+inline void FALexTools_t< Ty >::
+    GetSpan (
+            const Ty * pIn,
+            const int InSize,
+            const int FromPos,
+            const int FinalPos,
+            const int LeftCx,
+            const int RightCx,
+            int * pFromPos2,
+            int * pToPos,
+            int * pToPos2
+        )
+{
+    // From position in the data 
+    int FromPos2 = MoveBegin (pIn, InSize, FromPos, LeftCx);
+    if (0 > FromPos2)
+    {
+        FromPos2 = 0;
+    }
+    else if (InSize <= FromPos2)
+    {
+        FromPos2 = MoveBegin (pIn, InSize, InSize, -1);
+    }
 
-        int State = Initial;
-        int FinalState = -1;
-        int FinalPos = -1;
+    // To position in the data 
+    const int ToPos = MoveEnd (pIn, InSize, FinalPos, -RightCx);
+    int ToPos2 = ToPos;
+    if (0 > ToPos2)
+    {
+        ToPos2 = MoveEnd (pIn, InSize, -1, 1);
+    }
+    else if (InSize <= ToPos2)
+    {
+        ToPos2 = InSize - 1;
+    }
 
-        int j = FromPos;
+    *pFromPos2 = FromPos2;
+    *pToPos = ToPos;
+    *pToPos2 = ToPos2;
+}
 
-        // maximum token length bounds j
-        int LengthBound = FromPos + MaxTokenLength;
-        if (InSize < LengthBound) {
-            LengthBound = InSize;
-        }
 
-        /// feed the left anchor, if appropriate
-        if (-1 == j) {
-            State = m_pDfa->GetDest (Initial, FAFsmConst::IW_L_ANCHOR);
+template < class Ty >
+template < const bool fMemo >
+inline const int FALexTools_t< Ty >::
+    Match (
+            const int Initial,
+            const Ty * pIn,
+            const int InSize,
+            const int FromPos,
+            int * pMemo,
+            int * pFinalState,
+            int * pEndPos
+        ) const
+{
+    int Iw;
+    int Dst;
+
+    int State = Initial;
+    int FinalState = -1;
+    int FinalPos = -1;
+
+    int j = FromPos;
+
+    // maximum token length bounds j, for the UTF-8 input the
+    // characters are counted while reading
+    int LengthBound = FromPos + m_MaxTokenLength;
+    if (1 == sizeof (Ty) || InSize < LengthBound) {
+        LengthBound = InSize;
+    }
+    int CharsLeft = -1 == FromPos ? m_MaxTokenLength - 1 : m_MaxTokenLength;
+
+    /// feed the left anchor, if appropriate
+    if (-1 == j) {
+        State = m_pDfa->GetDest (Initial, FAFsmConst::IW_L_ANCHOR);
+        if (-1 == State) {
+            State = m_pDfa->GetDest (Initial, FAFsmConst::IW_ANY);
             if (-1 == State) {
-                State = m_pDfa->GetDest (Initial, FAFsmConst::IW_ANY);
-                if (-1 == State)
-                    continue;
+                *pEndPos = j;
+                return -1;
             }
-            j++;
         }
+        j++;
+    }
 
-        /// feed the letters
-        for (; j < LengthBound; ++j) {
+    // see Process_int for the memo layout
+    int * pMemoState = pMemo;
+    int * pMemoScan = NULL;
+    int * pScan2Failed = NULL;
+    int * pScan2EndPos = NULL;
+    int * pScan2EndState = NULL;
+    int * pCharIdx = NULL;
+
+    if (fMemo) {
+        pMemoScan = pMemoState + InSize + 1;
+        pScan2Failed = pMemoScan + InSize + 1;
+        pScan2EndPos = pScan2Failed + InSize + 1;
+        pScan2EndState = pScan2EndPos + InSize + 1;
+        pCharIdx = pScan2EndState + InSize + 1;
+        // nothing is known about this scan yet
+        pScan2Failed [FromPos + 1] = InSize + 1;
+    }
 
-            Iw = pIn [j];
-            // prevent regular input weights to match control input weights
-            if (FAFsmConst::IW_EPSILON > Iw) {
-                Iw = DefSubIw;
-            }
-            if (m_IgnoreCase) {
-                Iw = ::FAUtf32ToLower (Iw);
+    // set to true if the automaton has stopped, not the length bound
+    bool fDead = false;
+
+    /// feed the letters
+    while (j < LengthBound) {
+
+        if (fMemo) {
+            const int Scan = pMemoScan [j];
+            // see if an earlier scan has been here in the same State and
+            // has not met any final state after that
+            if (State == pMemoState [j] && pScan2Failed [Scan] <= j) {
+                const int EndState = pScan2EndState [Scan];
+                if (-1 == EndState) {
+                    fDead = true;
+                    break;
+                }
+                // the length bound of this scan is further, so continue
+                // from where the earlier scan has stopped
+                const int EndPos = pScan2EndPos [Scan];
+                if (EndPos > j) {
+                    CharsLeft -= (pCharIdx [EndPos] - pCharIdx [j]);
+                    State = EndState;
+                    j = EndPos;
+                    continue;
+                }
             }
-            Dst = m_pDfa->GetDest (State, Iw);
-            if (-1 == Dst) {
-                Dst = m_pDfa->GetDest (State, FAFsmConst::IW_ANY);
-                if (-1 == Dst)
+            pMemoState [j] = State;
+            pMemoScan [j] = FromPos + 1;
+        }
+        if (1 == sizeof (Ty)) {
+            Iw = (unsigned char) pIn [j];
+            // a new character starts
+            if (0x80 != (0xC0 & Iw)) {
+                if (0 >= CharsLeft)
                     break;
+                CharsLeft--;
             }
-            if (m_pDfa->IsFinal (Dst)) {
-                FinalState = Dst;
-                FinalPos = j;
+        } else {
+            Iw = pIn [j];
+        }
+        // prevent regular input weights to match control input weights
+        if (FAFsmConst::IW_EPSILON > Iw) {
+            Iw = DefSubIw;
+        }
+        if (m_IgnoreCase) {
+            Iw = ::FAUtf32ToLower (Iw);
+        }
+        Dst = m_pDfa->GetDest (State, Iw);
+        if (-1 == Dst) {
+            Dst = m_pDfa->GetDest (State, FAFsmConst::IW_ANY);
+            if (-1 == Dst) {
+                fDead = true;
+                break;
             }
-            State = Dst;
+        }
+        if (m_pDfa->IsFinal (Dst)) {
+            FinalState = Dst;
+            FinalPos = j;
+        }
+        State = Dst;
+        j++;
+
+    } // of while (j < LengthBound) ...
+
+    if (fMemo && InSize == j && !fDead) {
+        // a scan reaching the end is never stopped by the length bound
+        if (State == pMemoState [j] && pScan2Failed [pMemoScan [j]] <= j) {
+            DebugLogAssert (-1 == pScan2EndState [pMemoScan [j]]);
+            fDead = true;
+        } else {
+            pMemoState [j] = State;
+            pMemoScan [j] = FromPos + 1;
+        }
+    }
 
-        } // of for (; j < InSize; ...
+    /// feed the right anchor, if appropriate
+    if (InSize == j && !fDead) {
+        DebugLogAssert (-1 != State);
+        Dst = m_pDfa->GetDest (State, FAFsmConst::IW_R_ANCHOR);
+        if (-1 == Dst) {
+            Dst = m_pDfa->GetDest (State, FAFsmConst::IW_ANY);
+        }
+        if (-1 != Dst && m_pDfa->IsFinal (Dst)) {
+            FinalState = Dst;
+            FinalPos = j;
+        }
+        fDead = true;
+    }
 
-        /// feed the right anchor, if appropriate
-        if (InSize == j) {
-            DebugLogAssert (-1 != State);
-            Dst = m_pDfa->GetDest (State, FAFsmConst::IW_R_ANCHOR);
-            if (-1 == Dst) {
-                Dst = m_pDfa->GetDest (State, FAFsmConst::IW_ANY);
-            }
-            if (-1 != Dst && m_pDfa->IsFinal (Dst)) {
-                FinalState = Dst;
-                FinalPos = j;
-            }
+    // no final state is met after the pairs seen after the last final
+    if (fMemo) {
+        pScan2Failed [FromPos + 1] = FinalPos + 1;
+        pScan2EndPos [FromPos + 1] = j;
+        pScan2EndState [FromPos + 1] = fDead ? -1 : State;
+    }
+
+    *pFinalState = FinalState;
+    *pEndPos = j;
+    return FinalPos;
+}
+
+
+template < class Ty >
+inline const unsigned int FALexTools_t< Ty >::
+    GetCallHash (
+            const int FnIni,
+            const int RecDepth,
+            const bool fOnce,
+            const Ty * pIn,
+            const int InSize
+        )
+{
+    unsigned int Hash = 2166136261U;
+
+    // the beginning and the end of the text, the equal calls are found by
+    // comparing the texts, so the hash does not need to read all of it
+    int i = 0;
+    int EndPos = InSize < MaxHashSpan ? InSize : MaxHashSpan;
+
+    for (; i < EndPos; ++i) {
+        Hash = (Hash ^ (unsigned int) pIn [i]) * 16777619U;
+    }
+    if (InSize - MaxHashSpan > i) {
+        i = InSize - MaxHashSpan;
+    }
+    for (; i < InSize; ++i) {
+        Hash = (Hash ^ (unsigned int) pIn [i]) * 16777619U;
+    }
+
+    Hash = (Hash ^ (unsigned int) InSize) * 16777619U;
+
+    Hash = (Hash ^ (unsigned int) FnIni) * 16777619U;
+    Hash = (Hash ^ (unsigned int) ((RecDepth << 1) | (fOnce ? 1 : 0))) * 16777619U;
+
+    return Hash;
+}
+
+
+template < class Ty >
+inline int * FALexTools_t< Ty >::
+    InitMemo (
+            std::vector < int > & Memo,
+            const Ty * pIn,
+            const int InSize
+        )
+{
+    // the memo is made of MemoArrCount arrays of InSize + 1 elements:
+    //  Position --> State, the last State seen at the Position
+    //  Position --> Scan, the scan which has seen it, FromPos + 1
+    //  Scan --> Position, no final state is met after this Position
+    //  Scan --> Position, where the Scan has stopped
+    //  Scan --> State, the State the Scan has stopped in, -1 if dead
+    //  Position --> the number of characters before the Position
+    Memo.resize (MemoArrCount * (InSize + 1));
+
+    int * pMemo = Memo.data ();
+    int * pMemoState = pMemo;
+    int * pCharIdx = pMemo + ((MemoArrCount - 1) * (InSize + 1));
+
+    int CharCount = 0;
+    for (int i = 0; i <= InSize; ++i) {
+        pMemoState [i] = -1;
+        pCharIdx [i] = CharCount;
+        if (i < InSize && (1 != sizeof (Ty) || 0x80 != (0xC0 & pIn [i]))) {
+            CharCount++;
         }
+    }
 
-        // use the FinalState and the deepest FinalPos(ition)
-        if (-1 != FinalPos) {
-            DebugLogAssert (-1 != FinalState);
-            DebugLogAssert (FinalPos >= FromPos);
+    return pMemo;
+}
 
-            const int Ow = m_pState2Ow->GetOw (FinalState);
 
-            const int * pAct;
-            const int ActSize = m_pActs->Get (Ow, &pAct);
-            DebugLogAssert (MinActSize <= ActSize && pAct);
+template < class Ty >
+const int FALexTools_t< Ty >::
+    Process_int (
+            const int Initial,
+            const Ty * pIn,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            const bool fOnce
+        ) const
+{
+    if (m_MaxDepth < 1) {
+        return 0;
+    }
 
-            const int LeftCx = pAct [0];
-            const int RightCx = pAct [1];
-            const int Tag = pAct [2];
+    // the memo of the scans of the whole input, see note 4, it is set up
+    // once ScanLength is over MemoMinRatio times of the input size
+    std::vector < int > Memo;
+    int * pMemo = NULL;
+    long long ScanLength = 0;
+
+    // the function calls made so far, a direct-mapped cache, the bit i of
+    // the CallMask is set if Calls [i] is used
+    _TCall Calls [MaxCallCount];
+    unsigned long long CallMask = 0;
+    static_assert (MaxCallCount <= 8 * sizeof (CallMask), "too many calls");
+
+    // the stack of the active calls, the bottom one is for the whole input,
+    // it moves to the heap if more than MaxLocalDepth calls are active
+    _TFrame LocalStack [MaxLocalDepth];
+    std::vector < _TFrame > HeapStack;
+    _TFrame * Stack = LocalStack;
+    int StackSize = MaxLocalDepth;
+    int Depth = 0;
+
+    _TFrame * pF = Stack;
+    pF->_Initial = Initial;
+    pF->_Offset = 0;
+    pF->_InSize = InSize;
+    pF->_OutOffset = 0;
+    pF->_MaxOutSize = MaxOutSize;
+    pF->_fOnce = fOnce;
+    pF->_fFull = false;
+    pF->_OutSize = 0;
+    pF->_FromPos = -1;
+    pF->_pAct = NULL;
+
+    while (true) {
+
+        pF = Stack + Depth;
+
+        // the input and the output of the current call
+        const Ty * pFrIn = pIn + pF->_Offset;
+        const int FrInSize = pF->_InSize;
+        int * pFrOut = pOut + pF->_OutOffset;
+
+        bool fReturn = false;
+
+        /// find the next match, if no action is being applied
+        if (!pF->_pAct) {
+
+            int FinalState = -1;
+            int FinalPos = -1;
+            int FromPos = pF->_FromPos;
+
+            /// iterate thru all possible start positions
+            for (; FromPos < FrInSize; ++FromPos) {
+
+                // UTF-8 tokens start at the character boundaries only
+                if (1 == sizeof (Ty) && 0 <= FromPos && 0x80 == (0xC0 & pFrIn [FromPos])) {
+                    continue;
+                }
 
-            // From position in the data 
-            int FromPos2 = FromPos + LeftCx;
-            if (0 > FromPos2)
-            {
-                FromPos2 = 0;
-            }
-            else if (InSize <= FromPos2)
-            {
-                FromPos2 = InSize - 1;
+                int EndPos;
+
+                if (pMemo && 0 == Depth) {
+                    FinalPos = Match < true > (pF->_Initial, pFrIn, FrInSize, \
+                        FromPos, pMemo, &FinalState, &EndPos);
+                } else {
+                    FinalPos = Match < false > (pF->_Initial, pFrIn, FrInSize, \
+                        FromPos, NULL, &FinalState, &EndPos);
+                    if (0 == Depth) {
+                        ScanLength += EndPos - FromPos;
+                        if (ScanLength > MemoMinRatio * (long long) (InSize + 1)) {
+                            pMemo = InitMemo (Memo, pIn, InSize);
+                        }
+                    }
+                }
+
+                if (-1 != FinalPos) {
+                    break;
+                }
             }
 
-            // To position in the data 
-            int ToPos2 = FinalPos - RightCx;
-            if (0 > ToPos2)
-            {
-                ToPos2 = 0;
+            pF->_FromPos = FromPos;
+
+            // use the FinalState and the deepest FinalPos(ition)
+            if (-1 != FinalPos) {
+
+                DebugLogAssert (-1 != FinalState);
+                DebugLogAssert (FinalPos >= FromPos);
+
+                const int Ow = m_pState2Ow->GetOw (FinalState);
+
+                const int * pAct;
+                const int ActSize = m_pActs->Get (Ow, &pAct);
+                DebugLogAssert (MinActSize <= ActSize && pAct);
+
+                const int LeftCx = pAct [0];
+                const int RightCx = pAct [1];
+                const int Tag = pAct [2];
+
+                int FromPos2;
+                int ToPos;
+                int ToPos2;
+
+                GetSpan (pFrIn, FrInSize, FromPos, FinalPos, LeftCx, RightCx, \
+                    &FromPos2, &ToPos, &ToPos2);
+
+                int FnIdx = MinActSize;
+
+                // create the token, if Tag is specified
+                if (0 != Tag) {
+                    if (pF->_OutSize + 3 <= pF->_MaxOutSize) {
+                        pFrOut [pF->_OutSize++] = Tag;
+                        pFrOut [pF->_OutSize++] = FromPos2 + pF->_Offset;
+                        pFrOut [pF->_OutSize++] = ToPos2 + pF->_Offset;
+                    } else {
+                        // stop processing, the output buffer is not enough
+                        pF->_fFull = true;
+                        fReturn = true;
+                    }
+                    FnIdx = MinActSize + 1;
+                }
+
+                // functions are applied from the next iterations
+                pF->_pAct = pAct;
+                pF->_ActSize = ActSize;
+                pF->_FnIdx = FnIdx;
+                // set "once" flag for called functions, if there is more than one
+                pF->_fFnOnce = 1 < (ActSize - FnIdx);
+                // functions' starting position
+                pF->_FnFrom = FromPos2;
+                pF->_ToPos = ToPos;
+                pF->_ToPos2 = ToPos2;
+
+            } else {
+                // all the input is processed
+                fReturn = true;
             }
-            else if (InSize <= ToPos2)
-            {
-                ToPos2 = InSize - 1;
+
+        /// apply the next function, if any
+        } else if (pF->_FnIdx < pF->_ActSize) {
+
+            const int FnId = pF->_pAct [pF->_FnIdx];
+            DebugLogAssert (0 <= FnId && (unsigned) FnId < m_Fn2IniSize);
+
+            const int FnIni = m_pFn2Ini [FnId];
+            DebugLogAssert (-1 != FnIni);
+
+            const int FnFrom = pF->_FnFrom;
+            const int FnInSize = pF->_ToPos2 - FnFrom + 1;
+            const int FnOutOffset = pF->_OutOffset + pF->_OutSize;
+            const int FnMaxOutSize = pF->_MaxOutSize - pF->_OutSize;
+            const bool fFnOnce = 0 == FnId ? false : pF->_fFnOnce;
+            // the depth of the call, the bottom one has the depth 1
+            const int FnRecDepth = Depth + 2;
+
+            if (m_MaxDepth < FnRecDepth) {
+                // too deep, no output
+                pF->_FnIdx++;
+                continue;
             }
+            DebugLogAssert (Depth + 1 < m_MaxDepth);
+
+            const unsigned int Hash = GetCallHash (FnIni, FnRecDepth, \
+                fFnOnce, pFrIn + FnFrom, FnInSize);
+            const int CallIdx = Hash & (MaxCallCount - 1);
+            _TCall * pCall = Calls + CallIdx;
+
+            // see if the same function has been called for the same text
+            if (0 < FnInSize && 0 != (1 & (CallMask >> CallIdx)) && \
+                pCall->_Hash == Hash && \
+                pCall->_InSize == FnInSize && \
+                pCall->_FnIni == FnIni && pCall->_RecDepth == FnRecDepth && \
+                pCall->_fOnce == fFnOnce && \
+                0 == memcmp (pIn + pCall->_Offset, pFrIn + FnFrom, \
+                    sizeof (Ty) * FnInSize)) {
+
+                // copy its output with the positions shifted
+                const int Shift = (pF->_Offset + FnFrom) - pCall->_Offset;
+                int FnOutSize = pCall->_OutSize;
+                if (FnOutSize > FnMaxOutSize) {
+                    FnOutSize = FnMaxOutSize - (FnMaxOutSize % 3);
+                    pF->_fFull = true;
+                }
 
-            int FnIdx = MinActSize;
+                const int * pSrc = pOut + pCall->_OutOffset;
+                int * pDst = pOut + FnOutOffset;
 
-            // create the token, if Tag is specified
-            if (0 != Tag) {
-                if (OutSize + 3 <= MaxOutSize) {
-                    pOut [OutSize++] = Tag;
-                    pOut [OutSize++] = FromPos2 + Offset;
-                    pOut [OutSize++] = ToPos2 + Offset;
-                } else {
-                    // stop processing, the output buffer is not enough
-                    return OutSize;
+                for (int i = 0; i < FnOutSize; i += 3) {
+                    pDst [i] = pSrc [i];
+                    pDst [i + 1] = pSrc [i + 1] + Shift;
+                    pDst [i + 2] = pSrc [i + 2] + Shift;
                 }
-                FnIdx = MinActSize + 1;
+
+                AddFnOutput (pF, pOut, FnOutSize);
+                continue;
             }
 
-            // set "once" flag for called functions, if there is more than one
-            const bool fFnOnce = 1 < (ActSize - FnIdx);
-            // functions' starting position
-            int FnFrom = FromPos2;
-
-            // apply functions, if any
-            for (; FnIdx < ActSize; ++FnIdx) {
-
-                const int FnId = pAct [FnIdx];
-                DebugLogAssert (0 <= FnId && (unsigned) FnId < m_Fn2IniSize);
-
-                const int FnIni = m_pFn2Ini [FnId];
-                DebugLogAssert (-1 != FnIni);
-
-                const Ty * pFnIn = pIn + FnFrom;
-                const int FnInSize = ToPos2 - FnFrom + 1;
-                int * pFnOut = pOut + OutSize;
-                const int FnMaxOutSize = MaxOutSize - OutSize;
-
-                const int FnOutSize = Process_int (FnIni, FnFrom + Offset, \
-                  pFnIn, FnInSize, pFnOut, FnMaxOutSize, RecDepth + 1, \
-                  0 == FnId ? false : fFnOnce);
-                DebugLogAssert (0 == FnOutSize % 3);
-
-                DebugLogAssert (FnOutSize <= FnMaxOutSize);
-                __analysis_assume (FnOutSize <= FnMaxOutSize);
-
-                // see if any tokens have been extracted
-                if (0 < FnOutSize) {
-                    // updated the total output count
-                    OutSize += FnOutSize;
-                    // next function starts from the last token's To + 1
-                    FnFrom = pOut [OutSize - 1] + 1 - Offset;
-                    // see if no text is left
-                    if (FnFrom > ToPos2) {
-                        break;
-                    }
+            // remember the call, the output is known when it returns
+            pF->_pCall = pCall;
+            pF->_Hash = Hash;
+
+            // grow the stack, pF is not used after this
+            if (Depth + 1 == StackSize) {
+                StackSize *= 2;
+                if (Stack == LocalStack) {
+                    HeapStack.assign (LocalStack, LocalStack + MaxLocalDepth);
                 }
-            } // of for (; FnIdx < ActSize; ...
+                HeapStack.resize (StackSize);
+                Stack = HeapStack.data ();
+            }
+
+            // make the call
+            _TFrame * pFn = Stack + (++Depth);
+            pFn->_Initial = FnIni;
+            pFn->_Offset = pF->_Offset + FnFrom;
+            pFn->_InSize = FnInSize;
+            pFn->_OutOffset = FnOutOffset;
+            pFn->_MaxOutSize = FnMaxOutSize;
+            pFn->_fOnce = fFnOnce;
+            pFn->_fFull = false;
+            pFn->_OutSize = 0;
+            pFn->_FromPos = -1;
+            pFn->_pAct = NULL;
+            continue;
+
+        /// the action is applied
+        } else {
+
+            pF->_pAct = NULL;
 
             // check if the function is supposed to be called once
-            if (fOnce) {
-                return OutSize;
+            if (pF->_fOnce) {
+                fReturn = true;
+            } else {
+                // see if we can move the FromPos to the right more than one step
+                if (pF->_ToPos > pF->_FromPos) {
+                    pF->_FromPos = pF->_ToPos;
+                }
+                pF->_FromPos++;
             }
+        }
+
+        /// return from the call
+        if (fReturn) {
 
-            // see if we can move the FromPos to the right more than one step
-            if (FinalPos - RightCx > FromPos)
-            {
-                FromPos = FinalPos - RightCx;
+            const int FnOutSize = pF->_OutSize;
+            DebugLogAssert (0 == FnOutSize % 3);
+            DebugLogAssert (FnOutSize <= pF->_MaxOutSize);
+
+            if (0 == Depth) {
+                return FnOutSize;
             }
 
-        } // of if (-1 != FinalPos)
+            _TFrame * pCaller = Stack + (--Depth);
+
+            // remember the complete output only
+            if (!pF->_fFull) {
+                _TCall * pCall = pCaller->_pCall;
+                CallMask |= 1ULL << (pCall - Calls);
+                pCall->_Hash = pCaller->_Hash;
+                pCall->_FnIni = pF->_Initial;
+                pCall->_RecDepth = Depth + 2;
+                pCall->_fOnce = pF->_fOnce;
+                pCall->_Offset = pF->_Offset;
+                pCall->_InSize = pF->_InSize;
+                pCall->_OutOffset = pF->_OutOffset;
+                pCall->_OutSize = FnOutSize;
+            } else {
+                pCaller->_fFull = true;
+            }
 
-    } // of for (FromPos = 0;
+            AddFnOutput (pCaller, pOut, FnOutSize);
+        }
 
-    return OutSize;
+    } // of while (true) ...
+}
+
+
+template < class Ty >
+inline void FALexTools_t< Ty >::
+    AddFnOutput (
+            _TFrame * pF,
+            const int * pOut,
+            const int FnOutSize
+        )
+{
+    // see if any tokens have been extracted
+    if (0 < FnOutSize) {
+        // updated the total output count
+        pF->_OutSize += FnOutSize;
+        // next function starts from the last token's To + 1
+        pF->_FnFrom = pOut [pF->_OutOffset + pF->_OutSize - 1] + 1 - pF->_Offset;
+        // see if no text is left
+        if (pF->_FnFrom > pF->_ToPos2) {
+            pF->_FnIdx = pF->_ActSize;
+            return;
+        }
+    }
+    pF->_FnIdx++;
 }
 
 
@@ -412,7 +1000,7 @@ const int FALexTools_t< Ty >::
 
     const int Initial = m_pDfa->GetInitial ();
 
-    const int OutSize = Process_int (Initial, 0, pIn, InSize, pOut, MaxOutSize, 1);
+    const int OutSize = Process_int (Initial, pIn, InSize, pOut, MaxOutSize);
 
     return OutSize;
 }
@@ -435,7 +1023,7 @@ const int FALexTools_t< Ty >::
     if (0 == FnTag) {
 
         const int Initial = m_pDfa->GetInitial ();
-        const int OutSize = Process_int (Initial, 0, pIn, InSize, pOut, MaxOutSize, 1);
+        const int OutSize = Process_int (Initial, pIn, InSize, pOut, MaxOutSize);
         return OutSize;
 
     } else if (0 < FnTag && (unsigned int) FnTag < m_Fn2IniSize) {
@@ -445,7 +1033,7 @@ const int FALexTools_t< Ty >::
             // the function tag is unknown
             return -1;
         }
-        const int OutSize = Process_int (FnIni, 0, pIn, InSize, pOut, MaxOutSize, 1);
+        const int OutSize = Process_int (FnIni, pIn, InSize, pOut, MaxOutSize);
         return OutSize;
 
     }
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_LZDECOMPRESS_H_
+#define _FA_LZDECOMPRESS_H_
+
+#include "FAConfig.h"
+
+#include <vector>
+
+///
+/// Expands the LDB v2 image with the compressed sections into the regular
+/// LDB v2 image, see FALDB and FALzCompress.
+///
+/// A compressed section (FAFsmConst::LDB_CODEC_LZ) is stored as:
+///   uint64 RawSize - the size of the section
+///   uint32 RawCrc32 - the CRC32 of the section
+///   uint32 BlockCount
+///   uint32 BlockSizes [BlockCount] - the compressed block sizes
+///   the blocks
+///
+/// Each block is FAFsmConst::LDB_LZ_BLOCK_SIZE bytes of the section (except
+/// the last one) compressed independently, so all the blocks of all the
+/// sections are expanded in parallel. A block is a sequence of:
+///   token: the literal count (high 4 bits), the match length - 4 (low 4)
+///   [the literal count - 15, as 255-bytes and the rest, if the count >= 15]
+///   literals
+///   uint16 match offset, 1..65535 bytes back
+///   [the match length - 19, as 255-bytes and the rest, if the length >= 19]
+/// The last sequence has literals only.
+///
+/// The expanded directory keeps RawCrc32, so the verification checks the
+/// expanded data.
+///
+
+class FALzDecompress {
+
+public:
+    FALzDecompress ();
+
+public:
+    /// returns true if the LDB image of the ImageSize bytes has compressed
+    /// sections
+    static const bool IsCompressed (
+            const unsigned char * pImage,
+            const size_t ImageSize
+        );
+
+    /// sets up the compressed image of the ImageSize bytes
+    void SetImage (const unsigned char * pImage, const size_t ImageSize);
+
+    /// returns the size of the expanded image
+    const size_t GetSize () const;
+
+    /// writes the expanded image of GetSize () bytes into pOut
+    void Process (unsigned char * pOut) const;
+
+    /// expands one block, returns false if the block is corrupted
+    static const bool DecodeBlock (
+            const unsigned char * pIn,
+            const size_t InSize,
+            unsigned char * pOut,
+            const size_t OutSize
+        );
+
+private:
+    // expands the blocks [Num, m_Blocks.size ()) with the Step
+    void DecodeBlocks (
+            unsigned char * pOut,
+            const int Num,
+            const int Step,
+            int * pErrorCount
+        ) const;
+
+private:
+    // the compressed image
+    const unsigned char * m_pImage;
+    // the expanded image size
+    size_t m_Size;
+
+    struct _TBlock {
+        size_t _InOffset;   // compressed block offset in m_pImage
+        size_t _InSize;     // compressed block size
+        size_t _OutOffset;  // expanded block offset
+        size_t _OutSize;    // expanded block size
+        bool _fRaw;         // true if the block is copied as is
+    };
+    // the blocks of all the sections
+    std::vector < _TBlock > m_Blocks;
+
+    // the expanded image header and the section directory
+    std::vector < unsigned int > m_Header;
+};
+
+#endif
@@ -36,6 +36,10 @@ public:
     const bool IsFinal (const int State) const;
     const int GetDest (const int State, const int Iw) const;
 
+public:
+    /// returns the Iw map of the automaton
+    const FAIwMap_pack * GetIwMap () const;
+
 private:
     // interprets iw2iw map dump, if any
     FAIwMap_pack m_iw2iw;
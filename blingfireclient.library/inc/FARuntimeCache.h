@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_RUNTIMECACHE_H_
+#define _FA_RUNTIMECACHE_H_
+
+#include "FAConfig.h"
+#include "FAImageDump.h"
+#include "FALDB.h"
+
+#include <vector>
+
+///
+/// Keeps the data derived from a model at load time (e.g. FADfa_dense
+/// tables) in a sidecar file, so the next load can map the file instead of
+/// computing them again.
+///
+/// The file is:
+///   uint32 Magic - FAFsmConst::RTC_MAGIC
+///   uint32 Version - FAFsmConst::RTC_VERSION
+///   uint32 Count - the number of sections
+///   uint32 Crc32 - the CRC32 of the bytes after the header
+///   uint32 ModelCrc32 - the checksum of the version 2 model, see
+///     FALDB::GetChecksum, 0 for the version 1 model
+///   uint32 reserved, 0
+///   uint64 ModelSize - the size of the model file
+///   uint64 ModelTime - the last write time of the model file
+///   uint64 FileSize
+///   Count x { uint32 Key, uint32 reserved, uint64 Offset, uint64 Size }
+///   the sections, aligned at FAFsmConst::RTC_ALIGNMENT
+///
+/// Notes:
+///
+/// 1. The file is used only if it was made for the model file of the same
+///    size and last write time (and the same checksum, for the version 2
+///    models, since it is kept in the model header), otherwise Load returns
+///    false and the data should be computed as if there was no file. So Load
+///    reads the headers only, the CRC32 of the file is computed by Save and
+///    is not checked by Load.
+///
+/// 2. Save writes a temporary file and replaces the cache file with it, so a
+///    process loading the model never sees a partially written file. The
+///    file mapped by another process cannot be replaced on Windows, then Save
+///    fails and the file is made by the next load.
+///
+/// 3. The sections are mapped read-only, the object should live as long as
+///    the data are used.
+///
+
+class FARuntimeCache {
+
+public:
+    FARuntimeCache ();
+
+public:
+    /// maps the cache file of the model file pModelFileName, pLdb is set up
+    /// with its image of ModelSize bytes, returns false if there is no such
+    /// file or it was made for a different model
+    const bool Load (
+            const char * pFileName,
+            const char * pModelFileName,
+            const FALDB * pLdb,
+            const size_t ModelSize
+        );
+    /// returns the loaded section by the Key, NULL if there is no such section
+    const unsigned char * Get (const int Key, size_t * pSize) const;
+    /// returns the size of the loaded file, 0 if nothing is loaded
+    const size_t GetSize () const;
+    /// returns true if the loaded file is memory mapped
+    const bool IsMapped () const;
+
+    /// adds a section of Size bytes to be saved, returns the memory to
+    /// write the section into
+    unsigned char * Add (const int Key, const size_t Size);
+    /// writes the added sections into the cache file of the model file
+    /// pModelFileName, returns false if the file cannot be written
+    const bool Save (
+            const char * pFileName,
+            const char * pModelFileName,
+            const FALDB * pLdb,
+            const size_t ModelSize
+        ) const;
+
+    /// returns object into the initial state
+    void Clear ();
+
+private:
+    // returns 64-bit value from the pair of 32-bit values
+    inline static const unsigned long long GetUInt64 (const unsigned int * pArr);
+    // gets the size and the last write time of the file, returns false if
+    // the file cannot be read
+    static const bool GetFileStamp (
+            const char * pFileName,
+            unsigned long long * pSize,
+            unsigned long long * pTime
+        );
+    // returns the checksum of the model kept in the header, 0 if computing
+    // it would read the whole model
+    static const unsigned int GetModelCrc (const FALDB * pLdb, const size_t ModelSize);
+
+private:
+    // the mapped file
+    FAImageDump m_Img;
+    // the directory of the loaded file, NULL if nothing is loaded
+    const unsigned int * m_pEntries;
+    int m_Count;
+
+    // the added sections
+    std::vector < int > m_Keys;
+    std::vector < std::vector < unsigned char > > m_Sections;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_TOKENLATTICE_H_
+#define _FA_TOKENLATTICE_H_
+
+#include "FAConfig.h"
+#include "FASecurity.h"
+
+#include <vector>
+
+///
+/// Keeps all the segments of an input, as found by the unigram LM
+/// segmentation (see FATokenSegmentationTools_1best_t::BuildLattice), so
+/// several segmentations can be taken from one dictionary pass.
+///
+/// The output of GetNBest and Sample is the paths written one after another,
+/// each path is an array of tuples <TokenId, From, To> as in
+/// FATokenSegmentationTools_1best_t::Process, the size of each path is
+/// written into pPathSizes. Consecutive unknown segments are merged into one.
+///
+/// Notes:
+///
+/// 1. GetNBest runs Viterbi keeping up to N best partial paths for every
+///    position, the first path is the same as the 1-best one.
+///
+/// 2. Sample computes the forward log-probabilities once and then samples
+///    every path backwards (forward-filtering / backward-sampling), the
+///    probability of a path is proportional to exp (Alpha * Score), as in
+///    the sentence piece subword regularization.
+///
+/// 3. The object is not thread safe, one lattice per thread should be used.
+///
+
+class FATokenLattice {
+
+public:
+    FATokenLattice ();
+
+public:
+    /// starts a new lattice for the input of InSize characters
+    void Reset (const int InSize);
+    /// adds a segment [From, To] of the input, Id -1 is an unknown segment,
+    /// the segments should be added in the ascending order of From
+    void AddArc (const int From, const int To, const int Id, const float Score);
+    /// should be called after the last segment is added
+    void Finish ();
+
+    /// returns the input size
+    const int GetSize () const;
+    /// returns the number of segments
+    const int GetArcCount () const;
+
+    /// writes up to N best paths into pOut, returns the number of paths or
+    ///  -1 if pOut is too small
+    const int GetNBest (
+            const int N,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            __out_ecount(N) int * pPathSizes,
+            const int UnkId
+        ) const;
+
+    /// writes Count sampled paths into pOut, *pSeed is the state of the
+    ///  random numbers generator, returns the number of paths or -1 if pOut
+    ///  is too small
+    const int Sample (
+            const int Count,
+            const float Alpha,
+            unsigned int * pSeed,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            __out_ecount(Count) int * pPathSizes,
+            const int UnkId
+        ) const;
+
+private:
+    // writes the path of the arcs in the reverse order into pOut, returns
+    // the output size or -1 if it does not fit
+    static const int PutPath (
+            const int * pRevArcs,
+            const int ArcCount,
+            const int * pFroms,
+            const int * pTos,
+            const int * pIds,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            const int UnkId
+        );
+
+    // returns a random number in [0, 1)
+    inline static const double GetRandom (unsigned int * pSeed);
+
+private:
+    // the input size
+    int m_InSize;
+    // the segments, in the order of From
+    std::vector < int > m_Froms;
+    std::vector < int > m_Tos;
+    std::vector < int > m_Ids;
+    std::vector < float > m_Scores;
+    // the segments which end at the position i - 1 are
+    // m_ByEnd [m_EndFrom [i], m_EndFrom [i + 1]), in the order of From
+    std::vector < int > m_EndFrom;
+    std::vector < int > m_ByEnd;
+};
+
+#endif
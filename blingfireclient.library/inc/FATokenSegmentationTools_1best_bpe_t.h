@@ -12,10 +12,14 @@
 #include "FAArrayCA.h"
 #include "FAMultiMapCA.h"
 #include "FADictConfKeeper.h"
+#include "FADat_pack.h"
 #include "FALimits.h"
 #include "FASecurity.h"
 #include <cstdlib>
 #include <vector>
+#include <queue>
+#include <functional>
+#include <utility>
 #include <stdio.h>
 
 ///
@@ -24,6 +28,15 @@
 /// Input:  sequence of characters
 /// Output: array of tuples <TokenId, From, To>
 ///
+/// If the model is built with "tokalgo bpe-merge" then the reference BPE
+/// merge order is used: starting from the characters the adjacent pair of
+/// segments which makes the smallest id is merged first, the leftmost one if
+/// there are several. The pairs are kept in a priority queue and the segments
+/// in a linked list so a word of n characters takes O(n log n).
+///
+/// If the configuration has the double-array trie (see FADatPack) then the
+/// segments are looked up in it, rather than in the automaton.
+///
 
 template < class Ty >
 class FATokenSegmentationTools_1best_bpe_t {
@@ -34,6 +47,9 @@ public:
 public:
     /// initializes from the valid configuration object
     void SetConf (const FADictConfKeeper * pConf);
+    /// returns the number of bytes used by the ids copied from the
+    /// configuration
+    const size_t GetMemorySize () const;
 
     /// writes an array of tuples <TokenId, From, To> into pOut
     /// returns the actual / needed size of the array to fit all the tuples or
@@ -46,6 +62,28 @@ public:
             const int UnkId
         ) const;
 
+private:
+    /// Process for the reference BPE merge order
+    const int ProcessMerge (
+            const Ty * pIn,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            const int UnkId
+        ) const;
+
+    /// continues the lookup of a segment from the State over [From, To]
+    /// returns the Mealy state, or -1 if there is no transition, the id of
+    /// the segment is returned in *pId or -1 if it is not a known segment
+    inline const int Lookup (
+            const Ty * pIn,
+            const int From,
+            const int To,
+            int State,
+            int * pSumOw,
+            int * pId
+        ) const;
+
 private:
     // Mealy DFA keeping a map from a known segment to idx and
     // and MultiMap keeping a realtion between idx and <ID, Score> pair
@@ -53,7 +91,12 @@ private:
     const FAMealyDfaCA * m_pMealy;
     const FAArrayCA * m_pK2I;     // note this is an identify since we don't have duplicate ID's
     const FAMultiMapCA * m_pI2Info;
+    // the double-array trie of the dictionary, if the model has it
+    const FADat_pack * m_pDat;
+    // the ID for each key, copied from m_pI2Info
+    std::vector < int > m_Ids;
     bool m_fFastBpe;
+    bool m_fMergeBpe;
 
     // to keep track of arc data (note we use ID as a score for BPE since it follows strict ordering)
     struct _TArc {
@@ -77,6 +120,31 @@ private:
 
     };
 
+    // an adjacent pair of segments in the merge order
+    struct _TPair {
+
+        int _Id;        // ID of the merged segment, the merge rank
+        int _Start;     // the beginning position of the left segment
+        int _End;       // the ending position of the right segment
+        int _State;     // the Mealy state after the merged segment
+        int _SumOw;     // the sum of outputs after the merged segment
+
+    public:
+        _TPair (int id, int b, int e, int state, int sumow):
+            _Id(id),
+            _Start(b),
+            _End(e),
+            _State(state),
+            _SumOw(sumow)
+        {}
+
+        // smaller ids first, if ids are the same left-most first
+        inline const bool operator > (const _TPair & p) const
+        {
+            return _Id > p._Id || (_Id == p._Id && _Start > p._Start);
+        }
+    };
+
 };
 
 
@@ -87,7 +155,9 @@ FATokenSegmentationTools_1best_bpe_t < Ty >::
         m_pMealy (NULL),
         m_pK2I (NULL),
         m_pI2Info (NULL),
-        m_fFastBpe (false)
+        m_pDat (NULL),
+        m_fFastBpe (false),
+        m_fMergeBpe (false)
 {}
 
 
@@ -101,13 +171,44 @@ void FATokenSegmentationTools_1best_bpe_t < Ty >::
     // allows to use optimizations such as:
     //  1. whole word will be always prefered over the pieces
     m_fFastBpe = FAFsmConst::TOKENIZE_BPE_OPT == pConf->GetTokAlgo ();
+    m_fMergeBpe = FAFsmConst::TOKENIZE_BPE_MERGE == pConf->GetTokAlgo ();
 
     m_pDfa = pConf->GetRsDfa ();
     m_pMealy = pConf->GetMphMealy ();
     m_pK2I = pConf->GetK2I ();
     m_pI2Info = pConf->GetI2Info ();
+    m_pDat = pConf->GetDat ();
+
+    const int KeyCount = m_pK2I->GetCount ();
+    LogAssert(0 < KeyCount);
+
+    // keep the IDs in a plain array, the scores are not used
+    m_Ids.resize (KeyCount);
+
+    if (m_pDat) {
+        LogAssert (KeyCount == m_pDat->GetKeyCount ());
+        for (int Key = 0; Key < KeyCount; ++Key) {
+            m_Ids [Key] = m_pDat->GetId (Key);
+        }
+        return;
+    }
+
+    for (int Key = 0; Key < KeyCount; ++Key) {
+
+        const int * pValues = NULL;
+        const int Count = m_pI2Info->Get (Key, &pValues);
+        LogAssert (1 <= Count && NULL != pValues);
 
-    LogAssert(0 < m_pK2I->GetCount ());
+        m_Ids [Key] = pValues [0];
+    }
+}
+
+
+template < class Ty >
+const size_t FATokenSegmentationTools_1best_bpe_t < Ty >::
+    GetMemorySize () const
+{
+    return m_Ids.capacity () * sizeof (int);
 }
 
 // SENTENCE PIECE DELIMITER, used if m_fFastBpe is enabled
@@ -132,12 +233,16 @@ const int FATokenSegmentationTools_1best_bpe_t < Ty >::
 
     LogAssert (pIn && InSize <= FALimits::MaxArrSize);
 
+    if (m_fMergeBpe) {
+        return ProcessMerge (pIn, InSize, pOut, MaxOutSize, UnkId);
+    }
+
     // allocate storage for all segments found in the text
     std::vector <_TArc> arcs;
     arcs.reserve(InSize);
 
-    // get the initial state
-    const int InitialState = m_pDfa->GetInitial ();
+    // get the initial state, the root if the double-array trie is used
+    const int InitialState = m_pDat ? m_pDat->GetRoot () : m_pDfa->GetInitial ();
 
     // populate the arcs
     for (int start = 0; start < InSize; ++start) {
@@ -156,26 +261,43 @@ const int FATokenSegmentationTools_1best_bpe_t < Ty >::
         for (int i = start; i < InSize; ++i) {
 
             const Ty Iw = pIn [i];
-            State = m_pMealy->GetDestOw (State, Iw, &Ow);
+            int Key = -1;
 
-            // see if the does not have a transition
-            if (-1 == State) {
-                break;
-            }
+            if (m_pDat) {
 
-            SumOw += Ow;
-            DebugLogAssert (0 <= Ow);
+                State = m_pDat->GetDest (State, Iw);
 
-            // see if the destination state is a final state
-            if (m_pDfa->IsFinal (State)) {
+                // see if the does not have a transition
+                if (-1 == State) {
+                    break;
+                }
+                if (m_pDat->IsFinal (State)) {
+                    Key = m_pDat->GetKey (State);
+                }
+
+            } else {
+
+                State = m_pMealy->GetDestOw (State, Iw, &Ow);
 
-                // look up the id of the segment, we ignore the score if it is there
-                const int * pValues = NULL;
-                const int Count = m_pI2Info->Get (SumOw, &pValues);
-                LogAssert (1 <= Count && NULL != pValues);
+                // see if the does not have a transition
+                if (-1 == State) {
+                    break;
+                }
+
+                SumOw += Ow;
+                DebugLogAssert (0 <= Ow);
+
+                if (m_pDfa->IsFinal (State)) {
+                    Key = SumOw;
+                }
+            }
+
+            // see if the destination state is a final state
+            if (-1 != Key) {
 
-                // get the ID
-                const int id = pValues [0];
+                // get the ID of the segment
+                DebugLogAssert (0 <= Key && (unsigned int) Key < m_Ids.size ());
+                const int id = m_Ids [Key];
 
                 // see if the optimization should be applied
                 const bool fApplyOpt = m_fFastBpe && fTokenStart && \
@@ -307,4 +429,177 @@ const int FATokenSegmentationTools_1best_bpe_t < Ty >::
     return ActualOutSize;
 }
 
+
+template < class Ty >
+inline const int FATokenSegmentationTools_1best_bpe_t < Ty >::
+    Lookup (
+        const Ty * pIn,
+        const int From,
+        const int To,
+        int State,
+        int * pSumOw,
+        int * pId
+    ) const
+{
+    DebugLogAssert (pSumOw && pId);
+
+    int SumOw = *pSumOw;
+    int Ow = 0;
+
+    *pId = -1;
+
+    // the State is the trie node, the SumOw is not used
+    if (m_pDat) {
+
+        for (int i = From; i <= To && -1 != State; ++i) {
+            State = m_pDat->GetDest (State, pIn [i]);
+        }
+        if (-1 != State && m_pDat->IsFinal (State)) {
+            *pId = m_Ids [m_pDat->GetKey (State)];
+        }
+        return State;
+    }
+
+    for (int i = From; i <= To && -1 != State; ++i) {
+        State = m_pMealy->GetDestOw (State, pIn [i], &Ow);
+        SumOw += Ow;
+    }
+
+    if (-1 != State && m_pDfa->IsFinal (State)) {
+        // get the ID of the segment
+        DebugLogAssert (0 <= SumOw && (unsigned int) SumOw < m_Ids.size ());
+        *pId = m_Ids [SumOw];
+    }
+
+    *pSumOw = SumOw;
+    return State;
+}
+
+
+template < class Ty >
+const int FATokenSegmentationTools_1best_bpe_t < Ty >::
+    ProcessMerge (
+        const Ty * pIn, 
+        const int InSize, 
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+    ) const
+{
+    // the segments are kept by their beginning positions:
+    //  from --> to, -1 if the position is not a beginning of a segment
+    //  from --> the beginning of the previous segment
+    //  from --> id, -1 if the segment is not known
+    //  from --> Mealy state after the segment, -1 if cannot be continued
+    //  from --> the sum of the outputs after the segment
+    std::vector <int> segs (InSize * 5);
+
+    int * pTos = segs.data ();
+    int * pPrevs = pTos + InSize;
+    int * pIds = pPrevs + InSize;
+    int * pStates = pIds + InSize;
+    int * pSumOws = pStates + InSize;
+
+    const int InitialState = m_pDat ? m_pDat->GetRoot () : m_pDfa->GetInitial ();
+
+    // start from the single characters
+    for (int i = 0; i < InSize; ++i) {
+        pTos [i] = i;
+        pPrevs [i] = i - 1;
+        pSumOws [i] = 0;
+        pStates [i] = Lookup (pIn, i, i, InitialState, pSumOws + i, pIds + i);
+    }
+
+    // the pairs of the adjacent segments which make a known segment
+    std::vector <_TPair> pairs_storage;
+    pairs_storage.reserve (InSize);
+    std::priority_queue <_TPair, std::vector <_TPair>, std::greater <_TPair> > \
+        pairs (std::greater <_TPair> (), std::move (pairs_storage));
+
+    for (int i = 0; i + 1 < InSize; ++i) {
+        if (-1 != pStates [i]) {
+            int SumOw = pSumOws [i];
+            int Id;
+            const int State = Lookup (pIn, i + 1, i + 1, pStates [i], &SumOw, &Id);
+            if (-1 != Id) {
+                pairs.push (_TPair (Id, i, i + 1, State, SumOw));
+            }
+        }
+    }
+
+    // merge the pairs in order
+    while (!pairs.empty ()) {
+
+        const _TPair p = pairs.top ();
+        pairs.pop ();
+
+        // see if the left segment is still there
+        const int Start = p._Start;
+        const int Mid = pTos [Start] + 1;
+        if (-1 == pTos [Start] || InSize <= Mid) {
+            continue;
+        }
+        // see if the right segment is still the same
+        const int End = p._End;
+        if (pTos [Mid] != End) {
+            continue;
+        }
+
+        // merge
+        pTos [Start] = End;
+        pIds [Start] = p._Id;
+        pStates [Start] = p._State;
+        pSumOws [Start] = p._SumOw;
+        pTos [Mid] = -1;
+        if (End + 1 < InSize) {
+            pPrevs [End + 1] = Start;
+        }
+
+        // add the pair with the previous segment
+        const int Prev = pPrevs [Start];
+        if (0 <= Prev && -1 != pStates [Prev]) {
+            int SumOw = pSumOws [Prev];
+            int Id;
+            const int State = Lookup (pIn, Start, End, pStates [Prev], &SumOw, &Id);
+            if (-1 != Id) {
+                pairs.push (_TPair (Id, Prev, End, State, SumOw));
+            }
+        }
+        // add the pair with the next segment
+        if (End + 1 < InSize && -1 != p._State) {
+            int SumOw = p._SumOw;
+            int Id;
+            const int State = Lookup (pIn, End + 1, pTos [End + 1], p._State, &SumOw, &Id);
+            if (-1 != Id) {
+                pairs.push (_TPair (Id, Start, pTos [End + 1], State, SumOw));
+            }
+        }
+    }
+
+    // copy the results, join the adjacent unknown segments
+    int ActualOutSize = 0;
+    for (int start = 0; start < InSize; start++) {
+
+        int end = pTos [start];
+        const int id = -1 == pIds [start] ? UnkId : pIds [start];
+
+        if (UnkId == id) {
+            while (end + 1 < InSize && -1 == pIds [end + 1]) {
+                end = pTos [end + 1];
+            }
+        }
+
+        if (ActualOutSize + 3 <= MaxOutSize) {
+            pOut [ActualOutSize] = id;
+            pOut [ActualOutSize + 1] = start;
+            pOut [ActualOutSize + 2] = end;
+        }
+        ActualOutSize += 3;
+
+        start = end; // and +1 will be added by the for loop
+    }
+
+    return ActualOutSize;
+}
+
 #endif
@@ -12,11 +12,16 @@
 #include "FAArrayCA.h"
 #include "FAMultiMapCA.h"
 #include "FADictConfKeeper.h"
+#include "FADat_pack.h"
+#include "FATokenLattice.h"
 #include "FALimits.h"
 #include "FASecurity.h"
 #include <vector>
 #include <float.h>
 
+// SENTENCE PIECE DELIMITER, used in the word bounded mode
+#define __FASpDelimiter__ 0x2581
+
 ///
 /// Splits input sequence into segments with smaller number of segments 
 ///   and maximum sum of weights.
@@ -27,6 +32,23 @@
 /// If input sequence contains a subsequence of unknown characters then
 ///   this subsequence is treated as one unknown segment.
 ///
+/// If the word bounded mode is on then Process runs Viterbi for every word
+///   separately, where a word starts with U+2581, so the lattice is not
+///   longer than a word. This gives the same results only if no segment has
+///   U+2581 after the first position, see FAIsDelimBounded.
+///
+/// If the configuration has the double-array trie (see FADatPack) then
+///   Process looks up the segments in it, rather than in the automaton.
+///
+/// The best paths are kept as separate arrays of scores, beginnings and ids,
+///   the matches found from one start position are collected first and then
+///   relaxed in one loop without branches, so the relaxation reads and writes
+///   consecutive memory and the working set is small for the long inputs.
+///
+/// BuildLattice keeps all the segments rather than the best ones, so the
+///   N-best and the sampled segmentations can be taken from one dictionary
+///   pass, see FATokenLattice.
+///
 
 template < class Ty >
 class FATokenSegmentationTools_1best_t {
@@ -37,6 +59,11 @@ public:
 public:
     /// initializes from the valid configuration object
     void SetConf (const FADictConfKeeper * pConf);
+    /// sets up the word bounded mode, false by default
+    void SetWordBounded (const bool fWordBounded);
+    /// returns the number of bytes used by the ids and scores copied from
+    /// the configuration
+    const size_t GetMemorySize () const;
 
     /// writes an array of tuples <TokenId, From, To> into pOut
     /// returns the actual / needed size of the array to fit all the tuples or
@@ -49,6 +76,14 @@ public:
             const int UnkId
         ) const;
 
+    /// adds all the segments of the input into the lattice, the unknown
+    /// characters are the segments with the id -1
+    void BuildLattice (
+            const Ty * pIn,
+            const int InSize,
+            FATokenLattice * pLattice
+        ) const;
+
 private:
     // Mealy DFA keeping a map from a known segment to idx and
     // and MultiMap keeping a realtion between idx and <ID, Score> pair
@@ -56,30 +91,68 @@ private:
     const FAMealyDfaCA * m_pMealy;
     const FAArrayCA * m_pK2I;     // note this is an identify since we don't have duplicate ID's
     const FAMultiMapCA * m_pI2Info;
+    // the ID and the score for each key, copied from m_pI2Info
+    std::vector < int > m_Ids;
+    std::vector < float > m_Scores;
+    // the double-array trie or NULL, keeps the same Keys as the automaton
+    const FADat_pack * m_pDat;
 
     // unknown segment score
     const float m_UnkScore;
+    // see SetWordBounded
+    bool m_fWordBounded;
 
-    // to keep track of arc data
-    struct _TArc {
-
-        int _Begin;    // the begging position of the ssegment
-        int _Id;       // ID of a segment from the vocab
-        double _Score; // cumulative score
+    // the best arcs for each ending position, kept as the separate arrays
+    struct _TArcs {
 
-    public:
-        _TArc ():
-            _Begin(-1),
-            _Id(-1),
-            _Score(-FLT_MAX)
-        {}
+        double * _pScores; // cumulative score
+        int * _pBegins;    // the begging position of the segment
+        int * _pIds;       // ID of a segment from the vocab, -1 if unknown
     };
 
-    // a helper method to add an arc into the pArcs
-    inline void AddArc (_TArc * pArcs, int start, int end, int OwSum) const;
+    // sets up the arcs for InSize positions in the buffers
+    inline static void InitArcs (std::vector < double > & Scores,
+        std::vector < int > & Buff, const int InSize, _TArcs * pArcs);
+
+    // relaxes the arcs [start, pEnds [i]] with the keys pKeys [i], BaseScore
+    // is the score before the first position
+    inline void AddArcs (const _TArcs * pArcs, const int start,
+        const int * pEnds, const int * pKeys, const int Count,
+        const double BaseScore) const;
 
     // a helper method to add an arc if a token is not known
-    inline void AddUnknownArc (_TArc * pArcs, int start) const;
+    inline void AddUnknownArc (const _TArcs * pArcs, int start,
+        const double BaseScore) const;
+
+    // adds the best arcs for each ending position of the input
+    inline void AddArcs (const Ty * pIn, const int InSize, const _TArcs * pArcs,
+        const double BaseScore) const;
+
+    // AddArcs with the segments from the double-array trie
+    inline void AddArcsDat (const Ty * pIn, const int InSize, const _TArcs * pArcs,
+        const double BaseScore) const;
+
+    // Process in the word bounded mode
+    const int ProcessWords (
+            const Ty * pIn,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            const int UnkId
+        ) const;
+
+    // writes the best path into pOut, returns the needed output size
+    inline static const int GetBestPath (
+            const _TArcs * pArcs,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            const int UnkId
+        );
+
+    enum {
+        MaxMatchCount = 64, // the number of matches relaxed at once
+    };
 };
 
 
@@ -90,7 +163,9 @@ FATokenSegmentationTools_1best_t < Ty >::
         m_pMealy (NULL),
         m_pK2I (NULL),
         m_pI2Info (NULL),
-        m_UnkScore (-100000.0) // this is guaranteed lower than any of the segment scores
+        m_pDat (NULL),
+        m_UnkScore (-100000.0), // this is guaranteed lower than any of the segment scores
+        m_fWordBounded (false)
 {}
 
 
@@ -105,63 +180,137 @@ void FATokenSegmentationTools_1best_t < Ty >::
     m_pMealy = pConf->GetMphMealy ();
     m_pK2I = pConf->GetK2I ();
     m_pI2Info = pConf->GetI2Info ();
+    m_pDat = pConf->GetDat ();
+
+    const int KeyCount = m_pK2I->GetCount ();
+    LogAssert(0 < KeyCount);
+
+    // keep the IDs and scores in plain arrays, so the lookup is not a 
+    // virtual call and a multi-map decoding
+    m_Ids.resize (KeyCount);
+    m_Scores.resize (KeyCount);
+
+    if (m_pDat) {
+        LogAssert (KeyCount == m_pDat->GetKeyCount ());
+        for (int Key = 0; Key < KeyCount; ++Key) {
+            m_Ids [Key] = m_pDat->GetId (Key);
+            m_Scores [Key] = m_pDat->GetScore (Key);
+        }
+        return;
+    }
+
+    for (int Key = 0; Key < KeyCount; ++Key) {
+
+        const int * pValues = NULL;
+        const int Count = m_pI2Info->Get (Key, &pValues);
+        LogAssert (2 == Count && NULL != pValues);
+
+        m_Ids [Key] = pValues [0];
+        m_Scores [Key] = *((const float*) &(pValues [1]));
+    }
+}
+
+
+template < class Ty >
+void FATokenSegmentationTools_1best_t < Ty >::
+    SetWordBounded (const bool fWordBounded)
+{
+    m_fWordBounded = fWordBounded;
+}
+
+
+template < class Ty >
+const size_t FATokenSegmentationTools_1best_t < Ty >::
+    GetMemorySize () const
+{
+    return (m_Ids.capacity () * sizeof (int)) + \
+        (m_Scores.capacity () * sizeof (float));
+}
 
-    LogAssert(0 < m_pK2I->GetCount ());
+
+template < class Ty >
+inline void FATokenSegmentationTools_1best_t < Ty >::
+    InitArcs (
+        std::vector < double > & Scores,
+        std::vector < int > & Buff,
+        const int InSize,
+        _TArcs * pArcs
+    )
+{
+    // the scores are the smallest negative float number so the first
+    // relaxation always sets the arc
+    Scores.assign (InSize, -FLT_MAX);
+    Buff.assign (2 * InSize, -1);
+
+    pArcs->_pScores = Scores.data ();
+    pArcs->_pBegins = Buff.data ();
+    pArcs->_pIds = Buff.data () + InSize;
 }
 
 
 template < class Ty >
 inline void FATokenSegmentationTools_1best_t < Ty >::
-    AddArc (_TArc * pArcs, int start, int end, int Key) const
+    AddArcs (
+        const _TArcs * pArcs,
+        const int start,
+        const int * pEnds,
+        const int * pKeys,
+        const int Count,
+        const double BaseScore
+    ) const
 {
-    // look up the score and the id of the segment
-    const int * pValues = NULL;
-    const int Count = m_pI2Info->Get (Key, &pValues);
-    LogAssert (2 == Count && NULL != pValues);
+    double * pScores = pArcs->_pScores;
+    int * pBegins = pArcs->_pBegins;
+    int * pIds = pArcs->_pIds;
 
-    const float Score = *((const float*) &(pValues [1]));
+    const float * pKeyScores = m_Scores.data ();
+    const int * pKeyIds = m_Ids.data ();
 
     // compute previous score given the start
-    const double prevScore = 0 < start ? pArcs [start - 1]._Score : 0;
+    const double prevScore = 0 < start ? pScores [start - 1] : BaseScore;
 
-    // get a pointer to the arc object
-    _TArc * pA =  pArcs + end;
+    // the ends are different, so the updates do not depend on each other
+    for (int i = 0; i < Count; ++i) {
 
-    // set the arc, if it was never set then it has smallest negative float number
-    // so the condition is always true
-    if (pA->_Score < Score + prevScore) {
+        const int end = pEnds [i];
+        const int Key = pKeys [i];
+        DebugLogAssert (0 <= Key && (unsigned int) Key < m_Scores.size ());
 
-        pA->_Begin = start;
-        pA->_Id = pValues [0];
-        pA->_Score = Score + prevScore;
+        const double Score = pKeyScores [Key] + prevScore;
+        const double OldScore = pScores [end];
+        const bool fBetter = OldScore < Score;
+
+        pScores [end] = fBetter ? Score : OldScore;
+        pBegins [end] = fBetter ? start : pBegins [end];
+        pIds [end] = fBetter ? pKeyIds [Key] : pIds [end];
     }
 }
 
 
 template < class Ty >
 inline void FATokenSegmentationTools_1best_t < Ty >::
-    AddUnknownArc (_TArc * pArcs, int start) const
+    AddUnknownArc (const _TArcs * pArcs, int start, const double BaseScore) const
 {
     const int end = start;
 
-    // get a pointer to the arc object and previous arc object
-    _TArc * pA =  pArcs + end;
-    _TArc * pPrevA =  pA - 1;
+    double * pScores = pArcs->_pScores;
+    int * pBegins = pArcs->_pBegins;
+    int * pIds = pArcs->_pIds;
 
     // compute previous score given the start
-    const double prevScore = 0 < start ? pPrevA->_Score : 0;
+    const double prevScore = 0 < start ? pScores [start - 1] : BaseScore;
 
     // set the arc, if it was never set then it has smallest negative float number
     // so the condition is always true
-    if (pA->_Score < m_UnkScore + prevScore) {
+    if (pScores [end] < m_UnkScore + prevScore) {
 
-        pA->_Begin = start;
-        pA->_Id = -1;
-        pA->_Score = m_UnkScore + prevScore;
+        pBegins [end] = start;
+        pIds [end] = -1;
+        pScores [end] = m_UnkScore + prevScore;
 
         // check if the previous arc is also Unknown then merge them
-        if (0 < start && -1 ==  pPrevA->_Id) {
-            pA->_Begin =  pPrevA->_Begin;
+        if (0 < start && -1 == pIds [start - 1]) {
+            pBegins [end] = pBegins [start - 1];
         }
     }
 }
@@ -185,14 +334,43 @@ const int FATokenSegmentationTools_1best_t < Ty >::
 
     LogAssert (pIn && InSize <= FALimits::MaxArrSize);
 
+    if (m_fWordBounded) {
+        return ProcessWords (pIn, InSize, pOut, MaxOutSize, UnkId);
+    }
+
     // allocate storage for best arcs for each ending position
-    std::vector <_TArc> End2BestArc (InSize);
-    DebugLogAssert(InSize == End2BestArc.size ());
-    _TArc * pArcs = End2BestArc.data ();
+    std::vector < double > Scores;
+    std::vector < int > Buff;
+    _TArcs Arcs;
+    InitArcs (Scores, Buff, InSize, &Arcs);
+
+    AddArcs (pIn, InSize, &Arcs, 0);
+
+    return GetBestPath (&Arcs, InSize, pOut, MaxOutSize, UnkId);
+}
+
+
+template < class Ty >
+inline void FATokenSegmentationTools_1best_t < Ty >::
+    AddArcs (
+        const Ty * pIn,
+        const int InSize,
+        const _TArcs * pArcs,
+        const double BaseScore
+    ) const
+{
+    if (m_pDat) {
+        AddArcsDat (pIn, InSize, pArcs, BaseScore);
+        return;
+    }
 
     // get the initial state
     const int InitialState = m_pDfa->GetInitial ();
 
+    // the matches from the start position
+    int Ends [MaxMatchCount];
+    int Keys [MaxMatchCount];
+
     // populate the arcs
     for (int start = 0; start < InSize; ++start) {
 
@@ -200,6 +378,7 @@ const int FATokenSegmentationTools_1best_t < Ty >::
         int SumOw = 0;
         int Ow = 0;
         bool TokenUnknown = true;
+        int Count = 0;
 
         // go as deep as we can from the start position
         for (int i = start; i < InSize; ++i) {
@@ -218,27 +397,224 @@ const int FATokenSegmentationTools_1best_t < Ty >::
             // see if the destination state is a final state
             if (m_pDfa->IsFinal (State)) {
 
-                AddArc (pArcs, start, i, SumOw);
+                if (MaxMatchCount == Count) {
+                    AddArcs (pArcs, start, Ends, Keys, Count, BaseScore);
+                    Count = 0;
+                }
+                Ends [Count] = i;
+                Keys [Count] = SumOw;
+                Count++;
                 TokenUnknown = false;
             }
 
         } // of for(int i = start; i < InSize; ++start) ...
 
+        AddArcs (pArcs, start, Ends, Keys, Count, BaseScore);
+
         if (TokenUnknown) {
-            AddUnknownArc (pArcs, start);
+            AddUnknownArc (pArcs, start, BaseScore);
         }
 
     } // for(int start = 0; start < InSize; ++start) ...
+}
+
+
+template < class Ty >
+void FATokenSegmentationTools_1best_t < Ty >::
+    BuildLattice (
+        const Ty * pIn,
+        const int InSize,
+        FATokenLattice * pLattice
+    ) const
+{
+    DebugLogAssert (m_pDfa && m_pMealy && m_pK2I && m_pI2Info);
+    LogAssert (pLattice);
+    LogAssert ((pIn || 0 == InSize) && 0 <= InSize && InSize <= FALimits::MaxArrSize);
+
+    pLattice->Reset (InSize);
+
+    // the root if the double-array trie is used
+    const int InitialState = m_pDat ? m_pDat->GetRoot () : m_pDfa->GetInitial ();
 
+    for (int start = 0; start < InSize; ++start) {
+
+        int State = InitialState;
+        int SumOw = 0;
+        int Ow = 0;
+        bool TokenUnknown = true;
+
+        // go as deep as we can from the start position
+        for (int i = start; i < InSize; ++i) {
+
+            const Ty Iw = pIn [i];
+            int Key = -1;
+
+            if (m_pDat) {
+
+                State = m_pDat->GetDest (State, Iw);
+                if (-1 == State) {
+                    break;
+                }
+                if (m_pDat->IsFinal (State)) {
+                    Key = m_pDat->GetKey (State);
+                }
+
+            } else {
+
+                State = m_pMealy->GetDestOw (State, Iw, &Ow);
+                if (-1 == State) {
+                    break;
+                }
+                SumOw += Ow;
+                if (m_pDfa->IsFinal (State)) {
+                    Key = SumOw;
+                }
+            }
+
+            if (-1 != Key) {
+                DebugLogAssert (0 <= Key && (unsigned int) Key < m_Ids.size ());
+                pLattice->AddArc (start, i, m_Ids [Key], m_Scores [Key]);
+                TokenUnknown = false;
+            }
+        }
+
+        if (TokenUnknown) {
+            pLattice->AddArc (start, start, -1, m_UnkScore);
+        }
+    }
+
+    pLattice->Finish ();
+}
+
+
+template < class Ty >
+inline void FATokenSegmentationTools_1best_t < Ty >::
+    AddArcsDat (
+        const Ty * pIn,
+        const int InSize,
+        const _TArcs * pArcs,
+        const double BaseScore
+    ) const
+{
+    DebugLogAssert (m_pDat);
+
+    const int Root = m_pDat->GetRoot ();
+
+    // the matches from the start position
+    int Ends [MaxMatchCount];
+    int Keys [MaxMatchCount];
+
+    // populate the arcs
+    for (int start = 0; start < InSize; ++start) {
+
+        int Node = Root;
+        bool TokenUnknown = true;
+        int Count = 0;
+
+        // go as deep as we can from the start position
+        for (int i = start; i < InSize; ++i) {
+
+            Node = m_pDat->GetDest (Node, pIn [i]);
+
+            if (-1 == Node) {
+                break;
+            }
+            if (m_pDat->IsFinal (Node)) {
+
+                if (MaxMatchCount == Count) {
+                    AddArcs (pArcs, start, Ends, Keys, Count, BaseScore);
+                    Count = 0;
+                }
+                Ends [Count] = i;
+                Keys [Count] = m_pDat->GetKey (Node);
+                Count++;
+                TokenUnknown = false;
+            }
+        }
+
+        AddArcs (pArcs, start, Ends, Keys, Count, BaseScore);
+
+        if (TokenUnknown) {
+            AddUnknownArc (pArcs, start, BaseScore);
+        }
+    }
+}
+
+
+template < class Ty >
+const int FATokenSegmentationTools_1best_t < Ty >::
+    ProcessWords (
+        const Ty * pIn, 
+        const int InSize, 
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+    ) const
+{
+    // best arcs for each ending position of the current word
+    std::vector < double > Scores;
+    std::vector < int > Buff;
+    _TArcs Arcs;
+
+    // the score of the best path up to the current word, the arcs start
+    // from it, so the scores are the same as in the whole input lattice
+    double BaseScore = 0;
+    int OutSize = 0;
+    int From = 0;
+
+    while (From < InSize) {
+
+        // find the end of the word
+        int To = From + 1;
+        while (To < InSize && __FASpDelimiter__ != pIn [To]) {
+            To++;
+        }
+        const int WordSize = To - From;
+
+        InitArcs (Scores, Buff, WordSize, &Arcs);
+
+        AddArcs (pIn + From, WordSize, &Arcs, BaseScore);
+        BaseScore = Arcs._pScores [WordSize - 1];
+
+        // write the word's results, if they fit
+        const int OutFrom = OutSize < MaxOutSize ? OutSize : MaxOutSize;
+        const int WordOutSize = GetBestPath (&Arcs, WordSize, pOut + OutFrom, \
+            MaxOutSize - OutFrom, UnkId);
+
+        if (OutSize + WordOutSize <= MaxOutSize) {
+            // make the offsets relative to the input
+            for (int i = OutSize; i < OutSize + WordOutSize; i += 3) {
+                pOut [i + 1] += From;
+                pOut [i + 2] += From;
+            }
+        }
+
+        OutSize += WordOutSize;
+        From = To;
+    }
+
+    return OutSize;
+}
+
+
+template < class Ty >
+inline const int FATokenSegmentationTools_1best_t < Ty >::
+    GetBestPath (
+        const _TArcs * pArcs,
+        const int InSize,
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+    )
+{
     int ActualOutSize = 0;
     int end = InSize - 1;
 
     // now let's go in the reverse order and follow the best path
     while (0 <= end) {
 
-        const _TArc * pA = pArcs + end;
-        const int start = pA->_Begin;
-        const int ID = pA->_Id;
+        const int start = pArcs->_pBegins [end];
+        const int ID = pArcs->_pIds [end];
 
         // validate the invariant of the algorithm
         DebugLogAssert (0 <= start && start < InSize);
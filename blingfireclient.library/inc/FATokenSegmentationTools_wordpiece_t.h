@@ -0,0 +1,395 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+#ifndef _FA_TOKENSEGMENTATIONTOOLS_WORDPIECE_T_H_
+#define _FA_TOKENSEGMENTATIONTOOLS_WORDPIECE_T_H_
+
+#include "FAConfig.h"
+#include "FARSDfaCA.h"
+#include "FAMealyDfaCA.h"
+#include "FAGetIWsCA.h"
+#include "FAArrayCA.h"
+#include "FAMultiMapCA.h"
+#include "FADictConfKeeper.h"
+#include "FALimits.h"
+#include "FASecurity.h"
+#include <vector>
+
+///
+/// Splits a word into the word-pieces, greedy longest-match-first, as it is
+///   done in BERT's WordpieceTokenizer.
+///
+/// Input:  sequence of characters of one word
+/// Output: array of tuples <TokenId, From, To>
+///
+/// If the word cannot be covered by the pieces then the output is one
+///   <UnkId, 0, InSize - 1> tuple.
+///
+/// Notes:
+///
+/// 1. The dictionary keeps the word-initial pieces as-is and the other
+///    pieces with the "##" prefix, e.g. "play" and "##ing".
+///
+/// 2. SetConf unfolds the dictionary automaton into a trie with two roots,
+///    one for the word-initial pieces and one for the "##" pieces, and
+///    computes the failure links and the failure pops for every node, see
+///    LinMaxMatch in "Fast WordPiece Tokenization", Song et al. 2021. Then
+///    Process reads every character once and does not back-track.
+///
+
+template < class Ty >
+class FATokenSegmentationTools_wordpiece_t {
+
+public:
+    FATokenSegmentationTools_wordpiece_t ();
+
+public:
+    /// initializes from the valid configuration object
+    void SetConf (const FADictConfKeeper * pConf);
+    /// returns the number of bytes used by the trie
+    const size_t GetMemorySize () const;
+
+    /// writes an array of tuples <TokenId, From, To> into pOut
+    /// returns the actual / needed size of the array to fit all the tuples or
+    ///  -1 in case of an error
+    const int Process (
+            const Ty * pIn,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize,
+            const int UnkId
+        ) const;
+
+private:
+    // returns the child of the Node by the Iw or -1
+    inline const int GetChild (const int Node, const int Iw) const;
+
+    // builds the trie from the dictionary automaton
+    void BuildTrie (const FADictConfKeeper * pConf);
+
+    // computes the failure links and pops
+    void BuildLinks ();
+
+private:
+    enum {
+        Root = 0,           // the root of the word-initial pieces
+        SuffixRoot = 1,     // the root of the "##" pieces
+        SuffixIw = 0x23,    // '#'
+    };
+
+    // the children of the node i are [m_ChildFrom [i], m_ChildFrom [i + 1])
+    // nodes, they are sorted by m_Iws
+    std::vector < int > m_ChildFrom;
+    // the incoming Iw of the node
+    std::vector < int > m_Iws;
+    // the token id of the node or -1
+    std::vector < int > m_Ids;
+    // the number of characters of the node's token
+    std::vector < int > m_Lens;
+    // the failure link or -1
+    std::vector < int > m_Fails;
+    // the failure pops of the node i are m_Pops [m_PopFrom [i], m_PopFrom [i + 1]),
+    // the pops are the token nodes
+    std::vector < int > m_PopFrom;
+    std::vector < int > m_Pops;
+};
+
+
+template < class Ty >
+FATokenSegmentationTools_wordpiece_t < Ty >::
+    FATokenSegmentationTools_wordpiece_t ()
+{}
+
+
+template < class Ty >
+void FATokenSegmentationTools_wordpiece_t < Ty >::
+    SetConf (const FADictConfKeeper * pConf)
+{
+    LogAssert (pConf);
+    LogAssert (FAFsmConst::TYPE_MEALY_DFA == pConf->GetFsmType());
+    LogAssert (pConf->GetRsDfa () && pConf->GetMphMealy () && pConf->GetI2Info ());
+    // the trie is built from the Iws of the automaton, GetIws is NULL if
+    // they are remapped
+    LogAssert (pConf->GetIws ());
+
+    BuildTrie (pConf);
+    BuildLinks ();
+}
+
+
+template < class Ty >
+const size_t FATokenSegmentationTools_wordpiece_t < Ty >::
+    GetMemorySize () const
+{
+    return (m_ChildFrom.capacity () + m_Iws.capacity () + m_Ids.capacity () + \
+        m_Lens.capacity () + m_Fails.capacity () + m_PopFrom.capacity () + \
+        m_Pops.capacity ()) * sizeof (int);
+}
+
+
+template < class Ty >
+void FATokenSegmentationTools_wordpiece_t < Ty >::
+    BuildTrie (const FADictConfKeeper * pConf)
+{
+    const FARSDfaCA * pDfa = pConf->GetRsDfa ();
+    const FAMealyDfaCA * pMealy = pConf->GetMphMealy ();
+    const FAGetIWsCA * pGetIws = pConf->GetIws ();
+    const FAMultiMapCA * pI2Info = pConf->GetI2Info ();
+
+    m_ChildFrom.clear ();
+    m_Iws.clear ();
+    m_Lens.clear ();
+
+    // the automaton state, the sum of Ows and the parent of every node
+    std::vector < int > States;
+    std::vector < int > SumOws;
+    std::vector < int > Parents;
+
+    const int Initial = pDfa->GetInitial ();
+
+    // the suffix root is the state after "##", -1 if there are no such pieces
+    int Ow = 0;
+    int SuffixSumOw = 0;
+    int SuffixState = pMealy->GetDestOw (Initial, SuffixIw, &Ow);
+
+    if (-1 != SuffixState) {
+        SuffixSumOw = Ow;
+        SuffixState = pMealy->GetDestOw (SuffixState, SuffixIw, &Ow);
+        SuffixSumOw += Ow;
+    }
+
+    States.push_back (Initial);
+    SumOws.push_back (0);
+    Parents.push_back (-1);
+    m_Iws.push_back (0);
+    m_Lens.push_back (0);
+
+    States.push_back (SuffixState);
+    SumOws.push_back (SuffixSumOw);
+    Parents.push_back (-1);
+    m_Iws.push_back (0);
+    m_Lens.push_back (0);
+
+    std::vector < int > Iws (1024);
+
+    // breadth-first, so the children of every node get consecutive numbers
+    // and the nodes are sorted by the depth
+    for (int Node = 0; Node < (int) States.size (); ++Node) {
+
+        m_ChildFrom.push_back ((int) States.size ());
+
+        const int NodeState = States [Node];
+        if (-1 == NodeState) {
+            continue;
+        }
+
+        int IwCount = pGetIws->GetIWs (NodeState, Iws.data (), (int) Iws.size ());
+        if ((int) Iws.size () < IwCount) {
+            Iws.resize (IwCount);
+            IwCount = pGetIws->GetIWs (NodeState, Iws.data (), IwCount);
+        }
+
+        // the "##" pieces are kept under the suffix root only
+        const bool fSkipSuffix = Root == Parents [Node] && SuffixIw == m_Iws [Node];
+
+        for (int i = 0; i < IwCount; ++i) {
+
+            const int Iw = Iws [i];
+            DebugLogAssert (0 == i || Iws [i - 1] < Iw);
+
+            if (fSkipSuffix && SuffixIw == Iw) {
+                continue;
+            }
+
+            const int Dst = pMealy->GetDestOw (NodeState, Iw, &Ow);
+            if (-1 == Dst) {
+                continue;
+            }
+
+            States.push_back (Dst);
+            SumOws.push_back (SumOws [Node] + Ow);
+            Parents.push_back (Node);
+            m_Iws.push_back (Iw);
+            m_Lens.push_back (m_Lens [Node] + 1);
+        }
+
+        LogAssert (FALimits::MaxArrSize >= (int) States.size ());
+    }
+    m_ChildFrom.push_back ((int) States.size ());
+
+    // get the token ids
+    const int NodeCount = (int) States.size ();
+    m_Ids.assign (NodeCount, -1);
+
+    for (int Node = SuffixRoot + 1; Node < NodeCount; ++Node) {
+
+        if (pDfa->IsFinal (States [Node])) {
+
+            const int * pValues = NULL;
+            const int Count = pI2Info->Get (SumOws [Node], &pValues);
+            LogAssert (1 <= Count && NULL != pValues);
+
+            m_Ids [Node] = pValues [0];
+        }
+    }
+}
+
+
+template < class Ty >
+void FATokenSegmentationTools_wordpiece_t < Ty >::
+    BuildLinks ()
+{
+    const int NodeCount = (int) m_Iws.size ();
+
+    m_Fails.assign (NodeCount, -1);
+    m_PopFrom.assign (NodeCount + 1, 0);
+    m_Pops.clear ();
+
+    // the nodes are sorted by the depth and the failure links go to the
+    // smaller depth, so the links and pops of the node's parent and of the
+    // nodes the links go to are already computed
+    for (int Parent = 0; Parent < NodeCount; ++Parent) {
+
+        const int ChildFrom = m_ChildFrom [Parent];
+        const int ChildTo = m_ChildFrom [Parent + 1];
+
+        for (int Node = ChildFrom; Node < ChildTo; ++Node) {
+
+            m_PopFrom [Node] = (int) m_Pops.size ();
+
+            // a token, pop it and continue with the "##" pieces
+            if (-1 != m_Ids [Node]) {
+                m_Fails [Node] = SuffixRoot;
+                m_Pops.push_back (Node);
+                continue;
+            }
+
+            // otherwise pop what the parent pops and follow its failure links
+            // until there is a transition by the node's Iw
+            const int Iw = m_Iws [Node];
+            int Fail = Parent;
+            int Child = -1;
+
+            do {
+                for (int i = m_PopFrom [Fail]; i < m_PopFrom [Fail + 1]; ++i) {
+                    const int Pop = m_Pops [i];
+                    m_Pops.push_back (Pop);
+                }
+                Fail = m_Fails [Fail];
+                if (-1 == Fail) {
+                    break;
+                }
+                Child = GetChild (Fail, Iw);
+            } while (-1 == Child);
+
+            m_Fails [Node] = Child;
+        }
+    }
+
+    m_PopFrom [NodeCount] = (int) m_Pops.size ();
+}
+
+
+template < class Ty >
+inline const int FATokenSegmentationTools_wordpiece_t < Ty >::
+    GetChild (const int Node, const int Iw) const
+{
+    DebugLogAssert (0 <= Node && Node + 1 < (int) m_ChildFrom.size ());
+
+    int From = m_ChildFrom [Node];
+    int To = m_ChildFrom [Node + 1];
+    const int * pIws = m_Iws.data ();
+
+    // binary search for the big nodes
+    while (8 < To - From) {
+        const int Mid = (From + To) >> 1;
+        if (pIws [Mid] <= Iw) {
+            From = Mid;
+        } else {
+            To = Mid;
+        }
+    }
+    for (; From < To; ++From) {
+        if (pIws [From] == Iw) {
+            return From;
+        }
+    }
+    return -1;
+}
+
+
+template < class Ty >
+const int FATokenSegmentationTools_wordpiece_t < Ty >::
+    Process (
+        const Ty * pIn, 
+        const int InSize, 
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+    ) const
+{
+    DebugLogAssert (!m_Iws.empty ());
+
+    if (0 >= InSize) {
+        return 0;
+    }
+
+    LogAssert (pIn && InSize <= FALimits::MaxArrSize);
+
+    int OutSize = 0;
+    int Pos = 0;
+    int Node = Root;
+
+    for (int i = 0; i <= InSize; ++i) {
+
+        // go by the next character, or to a root after the last one
+        while (true) {
+
+            if (i < InSize) {
+                const int Child = GetChild (Node, pIn [i]);
+                if (-1 != Child) {
+                    Node = Child;
+                    break;
+                }
+            } else if (Root == Node || SuffixRoot == Node) {
+                break;
+            }
+
+            const int Fail = m_Fails [Node];
+
+            // the word cannot be covered by the pieces
+            if (-1 == Fail) {
+                if (3 <= MaxOutSize) {
+                    pOut [0] = UnkId;
+                    pOut [1] = 0;
+                    pOut [2] = InSize - 1;
+                }
+                return 3;
+            }
+
+            // output the pieces that are known to be in the longest-match
+            for (int j = m_PopFrom [Node]; j < m_PopFrom [Node + 1]; ++j) {
+
+                const int Pop = m_Pops [j];
+                const int Len = m_Lens [Pop];
+
+                if (OutSize + 3 <= MaxOutSize) {
+                    pOut [OutSize] = m_Ids [Pop];
+                    pOut [OutSize + 1] = Pos;
+                    pOut [OutSize + 2] = Pos + Len - 1;
+                }
+                OutSize += 3;
+                Pos += Len;
+            }
+
+            Node = Fail;
+        }
+    }
+
+    DebugLogAssert (Pos == InSize);
+    return OutSize;
+}
+
+#endif
@@ -94,6 +94,29 @@ const int FAStrUtf8ToUtf16LE (
         const int MaxSize
     );
 
+/// Converts UTF-16LE string of specified length to the array of ints and
+/// for each UTF-32 character returns its offset in the pStr in 16-bit units,
+/// if pOffsets is not NULL. The leading Byte-Order-Mark is skipped and
+/// unpaired surrogates are replaced with U+FFFD.
+/// Returns the number of used elements in the array.
+const int FAStrUtf16LEToArray (
+        const uint16_t * pStr,
+        const int Len,
+        __out_ecount(MaxSize) int * pArray,
+        __out_ecount_opt(MaxSize) int * pOffsets,
+        const int MaxSize
+    );
+
+/// Converts array of ints (UTF-32LE) into UTF-16LE string of upto MaxStrSize
+/// 16-bit units, does not place terminating 0. Returns output string length.
+/// Returns -1 for invalid input sequence.
+const int FAArrayToStrUtf16LE (
+        const int * pArray,
+        const int Size,
+        __out_ecount(MaxStrSize) uint16_t * pStr,
+        const int MaxStrSize
+    );
+
 /// Converts array of ints (UTF-32LE) into UTF-8 string of  upto MaxStrSize
 /// length, does not place terminating 0-byte. Returns output string length.
 /// Returns -1 for invalid input sequence.
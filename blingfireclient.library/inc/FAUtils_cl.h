@@ -16,6 +16,7 @@
 
 class FARSNfaCA;
 class FARSDfaCA;
+class FAGetIWsCA;
 
 
 ///
@@ -246,6 +247,14 @@ const bool FAIsValidNfa (const FARSNfaCA * pNfa);
 /// returns true if FARSDfaCA is invalid or empty
 const bool FAIsValidDfa (const FARSDfaCA * pDfa);
 
+/// returns true if Delim is a word of the Dfa and no word has Delim after
+/// the first position, so no word can cross the beginning of a Delim
+const bool FAIsDelimBounded (
+        const FARSDfaCA * pDfa,
+        const FAGetIWsCA * pIws,
+        const int Delim
+    );
+
 
 /// returns sequence case type, e.g. one of the FAFsmConst::CASE_* constants
 template < class Ty >
@@ -11,6 +11,7 @@
 
 class FALDB;
 class FARSDfa_pack_triv;
+class FAIwMap_pack;
 class FAState2Ow_pack_triv;
 class FAState2Ows_pack_triv;
 class FAMultiMap_pack;
@@ -62,6 +63,10 @@ public:
     const FAMultiMapCA * GetActData () const;
     /// returns maximum allowed token length, FALimits::MaxWordLen is used by default
     const int GetMaxTokenLength () const;
+    /// returns true if the automaton reads UTF-8 bytes rather than code points
+    const bool GetUtf8Input () const;
+    /// returns the Iw map of the automaton from the LDB, NULL if not loaded
+    const FAIwMap_pack * GetIwMap () const;
 
 public:
     // overrides RS Dfa from the LDB
@@ -76,6 +81,10 @@ public:
     void SetMaxDepth (const int MaxRecDepth);
     // overrides action data map
     void SetActData (const FAMultiMapCA * pActData);
+    // overrides maximum allowed token length
+    void SetMaxTokenLength (const int MaxTokenLength);
+    // overrides whether the automaton reads UTF-8 bytes
+    void SetUtf8Input (const bool Utf8Input);
 
 private:
     /// sets up rules' actions map
@@ -110,6 +119,8 @@ private:
 
     /// maximum token length
     int m_MaxTokenLength;
+    /// the automaton reads UTF-8 bytes
+    bool m_Utf8Input;
 
     enum {
         DefMaxDepth = 5,
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_WORDCACHE_H_
+#define _FA_WORDCACHE_H_
+
+#include "FAConfig.h"
+#include "FASecurity.h"
+
+#include <atomic>
+#include <mutex>
+
+///
+/// A bounded cache of the word segmentation results, keeps for a word the
+/// <id, from, to> triples as returned by FATokenSegmentationTools_1best_t
+/// and FATokenSegmentationTools_1best_bpe_t, so the repeated words do not
+/// need to be segmented again.
+///
+/// Notes:
+///
+/// 1. The cache is split into ShardCount shards by the word hash, each shard
+///    is a direct-mapped table of fixed size entries, a new word replaces
+///    whatever was in its entry.
+///
+/// 2. Get does not take locks, every entry has a sequence counter which is
+///    odd while the entry is being written, if the counter is odd or changes
+///    while the entry is read then the lookup is a miss. Add takes the lock
+///    of the shard, if the lock is busy the word is not added.
+///
+/// 3. Get and Add can be called from many threads, SetMaxCount and Clear
+///    should not be called while the cache is used, to resize the cache in
+///    use set up a new one and swap the pointers (see SetWordCacheSize).
+///
+/// 4. Words longer than MaxWordLen and results with more than MaxSegCount
+///    segments are not kept, the offsets are relative to the word start.
+///
+
+class FAWordCache {
+
+public:
+    FAWordCache ();
+    ~FAWordCache ();
+
+public:
+    /// sets up the cache for up to MaxCount words, 0 disables it
+    void SetMaxCount (const int MaxCount);
+    /// returns the number of the entries, 0 if the cache is disabled
+    const int GetMaxCount () const;
+    /// returns the number of bytes used by the entries
+    const size_t GetMemorySize () const;
+    /// returns the results size for the word, or -1 if not found,
+    /// Param is a part of the key (e.g. an unknown token id)
+    const int Get (
+            const int * pWord,
+            const int WordLen,
+            const int Param,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize
+        ) const;
+    /// adds the results for the word
+    void Add (
+            const int * pWord,
+            const int WordLen,
+            const int Param,
+            const int * pRes,
+            const int ResSize
+        ) const;
+    /// returns the number of hits and misses of Get
+    void GetCounts (long long * pHitCount, long long * pMissCount) const;
+    /// returns object into the initial state
+    void Clear ();
+
+public:
+    enum {
+        MaxWordLen = 24,
+        MaxSegCount = 12,
+        ShardCount = 16,
+    };
+
+private:
+    inline static const unsigned int GetHash (
+            const int * pWord,
+            const int WordLen,
+            const int Param
+        );
+
+private:
+    enum {
+        // the data layout of an entry
+        OfsHash = 0,
+        OfsParam,
+        OfsSizes,
+        OfsWord,
+        OfsIds = OfsWord + MaxWordLen,
+        OfsSpans = OfsIds + MaxSegCount,
+        DataSize = OfsSpans + MaxSegCount,
+        // padding to keep the shard counters in different cache lines
+        CacheLine = 64,
+    };
+
+    struct _TEntry {
+        // odd while the entry is being written
+        std::atomic < unsigned int > _Seq;
+        // hash, param, <word length, segment count>, word, ids, <from, to>
+        std::atomic < int > _Data [DataSize];
+    };
+
+    struct _TShard {
+        _TEntry * _pEntries;
+        std::mutex _Lock;
+        std::atomic < long long > _HitCount;
+        std::atomic < long long > _MissCount;
+        char _Padding [CacheLine];
+    };
+
+    // shards
+    mutable _TShard m_Shards [ShardCount];
+    // the number of entries in one shard - 1, the number is a power of 2
+    unsigned int m_Mask;
+    // total number of entries
+    int m_MaxCount;
+};
+
+#endif
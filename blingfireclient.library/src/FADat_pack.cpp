@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FALimits.h"
+#include "FADat_pack.h"
+
+
+FADat_pack::FADat_pack () :
+    m_pDirect (NULL),
+    m_DirectCount (0),
+    m_pTop (NULL),
+    m_TopBase (0),
+    m_pBlocks (NULL),
+    m_MaxIw (0),
+    m_pUnits (NULL),
+    m_UnitCount (0),
+    m_pTerms (NULL),
+    m_KeyCount (0)
+{}
+
+
+void FADat_pack::SetImage (const unsigned char * pImage)
+{
+    LogAssert (pImage);
+
+    const int * pHeader = (const int *) pImage;
+
+    const int MaxIw = pHeader [0];
+    const int DirectCount = pHeader [1];
+    const int BlockCount = pHeader [2];
+    const int UnitCount = pHeader [3];
+    const int KeyCount = pHeader [4];
+
+    LogAssert (0 <= MaxIw);
+    LogAssert (0 < DirectCount && DirectCount <= MaxIw + 1);
+    LogAssert (0 == (DirectCount & 0xff) || DirectCount == MaxIw + 1);
+    LogAssert (0 <= BlockCount);
+    LogAssert (0 < UnitCount && FALimits::MaxArrSize >= UnitCount);
+    LogAssert (0 < KeyCount && FALimits::MaxArrSize >= KeyCount);
+
+    const int TopCount = MaxIw < DirectCount ? 0 : \
+        (MaxIw >> 8) + 1 - (DirectCount >> 8);
+
+    int Offset = 5 * sizeof (int);
+
+    m_pDirect = (const unsigned short *) (pImage + Offset);
+    Offset += ((DirectCount * sizeof (unsigned short)) + 3) & ~3;
+
+    m_pTop = (const int *) (pImage + Offset);
+    Offset += TopCount * sizeof (int);
+
+    m_pBlocks = (const unsigned short *) (pImage + Offset);
+    Offset += ((BlockCount * 256 * sizeof (unsigned short)) + 3) & ~3;
+
+    m_pUnits = (const int *) (pImage + Offset);
+    Offset += UnitCount * 2 * sizeof (int);
+
+    m_pTerms = (const int *) (pImage + Offset);
+
+    m_DirectCount = DirectCount;
+    m_TopBase = DirectCount >> 8;
+    m_MaxIw = MaxIw;
+    m_UnitCount = UnitCount;
+    m_KeyCount = KeyCount;
+}
+
+
+const int FADat_pack::GetKeyCount () const
+{
+    return m_KeyCount;
+}
+
+
+const int FADat_pack::GetId (const int Key) const
+{
+    DebugLogAssert (0 <= Key && Key < m_KeyCount);
+    return m_pTerms [Key << 1];
+}
+
+
+const float FADat_pack::GetScore (const int Key) const
+{
+    DebugLogAssert (0 <= Key && Key < m_KeyCount);
+    return *((const float *) (m_pTerms + (Key << 1) + 1));
+}
@@ -0,0 +1,484 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FADfa_dense.h"
+#include <algorithm>
+#include <vector>
+#include <unordered_set>
+
+
+FADfa_dense::FADfa_dense () :
+    m_pDfa (NULL),
+    m_pMealy (NULL),
+    m_MaxMemory (0),
+    m_DenseIwCount (DefDenseIwCount),
+    m_pIw2Class (NULL),
+    m_ClassCount (0),
+    m_RowCount (0),
+    m_pDsts (NULL),
+    m_pOws (NULL),
+    m_pState2Row (NULL),
+    m_HashMask (0),
+    m_fOwnTables (false)
+{}
+
+
+FADfa_dense::~FADfa_dense ()
+{
+    FADfa_dense::Clear ();
+}
+
+
+void FADfa_dense::SetRsDfa (const FARSDfaCA * pDfa)
+{
+    m_pDfa = pDfa;
+}
+
+
+void FADfa_dense::SetMealyDfa (const FAMealyDfaCA * pMealy)
+{
+    m_pMealy = pMealy;
+}
+
+
+void FADfa_dense::SetMaxMemory (const int MaxMemory)
+{
+    m_MaxMemory = MaxMemory;
+}
+
+
+void FADfa_dense::SetDenseIwCount (const int DenseIwCount)
+{
+    LogAssert (0 < DenseIwCount && DenseIwCount <= MaxDenseIwCount);
+    m_DenseIwCount = DenseIwCount;
+}
+
+
+void FADfa_dense::FreeTables ()
+{
+    if (m_fOwnTables) {
+        delete [] m_pIw2Class;
+        delete [] m_pDsts;
+        delete [] m_pOws;
+        delete [] m_pState2Row;
+        m_fOwnTables = false;
+    }
+    m_pIw2Class = NULL;
+    m_pDsts = NULL;
+    m_pOws = NULL;
+    m_pState2Row = NULL;
+    m_ClassCount = 0;
+    m_RowCount = 0;
+    m_HashMask = 0;
+}
+
+
+void FADfa_dense::Clear ()
+{
+    FreeTables ();
+
+    m_pDfa = NULL;
+    m_pMealy = NULL;
+    m_MaxMemory = 0;
+    m_DenseIwCount = DefDenseIwCount;
+}
+
+
+inline const int FADfa_dense::
+    GetOrigDestOw (const int State, const int Iw, int * pOw) const
+{
+    if (m_pMealy) {
+        return m_pMealy->GetDestOw (State, Iw, pOw);
+    } else {
+        return m_pDfa->GetDest (State, Iw);
+    }
+}
+
+
+void FADfa_dense::Process ()
+{
+    FreeTables ();
+
+    if (!m_pDfa || 0 >= m_MaxMemory) {
+        return;
+    }
+
+    const int IwCount = m_DenseIwCount;
+    const size_t EntrySize = m_pMealy ? 2 * sizeof (int) : sizeof (int);
+
+    // the hot state candidates in the breadth-first order
+    std::vector < int > States;
+    std::unordered_set < int > Seen;
+    // transitions of the accepted states, IwCount per state
+    std::vector < int > RowDsts;
+    std::vector < int > RowOws;
+    // Iw --> column of the accepted states
+    std::vector < int > Iw2Class (IwCount, 0);
+    std::vector < int > NewIw2Class (IwCount, 0);
+    int ClassCount = 1;
+    // transitions of the current state
+    std::vector < int > Dsts (IwCount);
+    std::vector < int > Ows (IwCount);
+    std::vector < int > Order (IwCount);
+
+    const int Initial = m_pDfa->GetInitial ();
+    if (0 > Initial) {
+        return;
+    }
+    States.push_back (Initial);
+    Seen.insert (Initial);
+
+    size_t HashSize = 0;
+    int RowCount = 0;
+
+    for (; (size_t) RowCount < States.size (); ++RowCount) {
+
+        const int State = States [RowCount];
+
+        for (int Iw = 0; Iw < IwCount; ++Iw) {
+            Ows [Iw] = -1;
+            Dsts [Iw] = GetOrigDestOw (State, Iw, &(Ows [Iw]));
+            if (-1 == Dsts [Iw]) {
+                Ows [Iw] = -1;
+            }
+        }
+
+        // split the columns by the transitions of this state
+        for (int Iw = 0; Iw < IwCount; ++Iw) {
+            Order [Iw] = Iw;
+        }
+        std::sort (Order.begin (), Order.end (),
+            [&] (const int Iw1, const int Iw2) {
+                if (Iw2Class [Iw1] != Iw2Class [Iw2])
+                    return Iw2Class [Iw1] < Iw2Class [Iw2];
+                if (Dsts [Iw1] != Dsts [Iw2])
+                    return Dsts [Iw1] < Dsts [Iw2];
+                if (Ows [Iw1] != Ows [Iw2])
+                    return Ows [Iw1] < Ows [Iw2];
+                return Iw1 < Iw2;
+            });
+
+        int NewClassCount = 0;
+        int PrevIw = -1;
+
+        for (int i = 0; i < IwCount; ++i) {
+            const int Iw = Order [i];
+            if (-1 == PrevIw || Iw2Class [Iw] != Iw2Class [PrevIw] || \
+                Dsts [Iw] != Dsts [PrevIw] || Ows [Iw] != Ows [PrevIw]) {
+                NewClassCount++;
+            }
+            NewIw2Class [Iw] = NewClassCount - 1;
+            PrevIw = Iw;
+        }
+
+        // see if this state fits into the budget
+        const size_t NewRowCount = RowCount + 1;
+        size_t NewHashSize = 1;
+        while (NewHashSize < 2 * NewRowCount) {
+            NewHashSize <<= 1;
+        }
+        const size_t Memory = (NewRowCount * NewClassCount * EntrySize) + \
+            (NewHashSize * 2 * sizeof (int)) + (IwCount * sizeof (int));
+
+        if ((size_t) m_MaxMemory < Memory) {
+            break;
+        }
+
+        // accept the state
+        Iw2Class.swap (NewIw2Class);
+        ClassCount = NewClassCount;
+        HashSize = NewHashSize;
+
+        RowDsts.insert (RowDsts.end (), Dsts.begin (), Dsts.end ());
+        if (m_pMealy) {
+            RowOws.insert (RowOws.end (), Ows.begin (), Ows.end ());
+        }
+
+        for (int Iw = 0; Iw < IwCount; ++Iw) {
+            const int Dst = Dsts [Iw];
+            if (0 <= Dst && Seen.insert (Dst).second) {
+                States.push_back (Dst);
+            }
+        }
+    } // of for (; RowCount < States.size (); ...
+
+    if (0 == RowCount) {
+        return;
+    }
+
+    // build the tables
+    m_RowCount = RowCount;
+    m_ClassCount = ClassCount;
+
+    m_fOwnTables = true;
+
+    int * pIw2Class = new int [IwCount];
+    LogAssert (pIw2Class);
+    memcpy (pIw2Class, Iw2Class.data (), sizeof (int) * IwCount);
+    m_pIw2Class = pIw2Class;
+
+    // Iw representing each column
+    std::vector < int > Class2Iw (ClassCount, -1);
+    for (int Iw = 0; Iw < IwCount; ++Iw) {
+        const int C = Iw2Class [Iw];
+        if (-1 == Class2Iw [C]) {
+            Class2Iw [C] = Iw;
+        }
+    }
+
+    int * pDsts = new int [RowCount * ClassCount];
+    LogAssert (pDsts);
+    m_pDsts = pDsts;
+
+    int * pOws = NULL;
+    if (m_pMealy) {
+        pOws = new int [RowCount * ClassCount];
+        LogAssert (pOws);
+        m_pOws = pOws;
+    }
+
+    for (int Row = 0; Row < RowCount; ++Row) {
+        for (int C = 0; C < ClassCount; ++C) {
+            const size_t From = ((size_t) Row * IwCount) + Class2Iw [C];
+            pDsts [(Row * ClassCount) + C] = RowDsts [From];
+            if (pOws) {
+                pOws [(Row * ClassCount) + C] = RowOws [From];
+            }
+        }
+    }
+
+    m_HashMask = (unsigned int) HashSize - 1;
+    int * pState2Row = new int [2 * HashSize];
+    LogAssert (pState2Row);
+    m_pState2Row = pState2Row;
+    for (size_t i = 0; i < 2 * HashSize; ++i) {
+        pState2Row [i] = -1;
+    }
+
+    for (int Row = 0; Row < RowCount; ++Row) {
+        const int State = States [Row];
+        unsigned int i = ((unsigned int) State * 2654435761U) & m_HashMask;
+        while (-1 != pState2Row [i << 1]) {
+            i = (i + 1) & m_HashMask;
+        }
+        pState2Row [i << 1] = State;
+        pState2Row [(i << 1) + 1] = Row;
+    }
+}
+
+
+const size_t FADfa_dense::GetDumpSize () const
+{
+    size_t Count = DumpHeaderSize;
+
+    if (0 < m_RowCount) {
+        const size_t TableSize = (size_t) m_RowCount * m_ClassCount;
+        Count += m_DenseIwCount + TableSize + (m_pOws ? TableSize : 0) + \
+            (2 * ((size_t) m_HashMask + 1));
+    }
+
+    return Count * sizeof (int);
+}
+
+
+void FADfa_dense::Save (unsigned char * pDump) const
+{
+    LogAssert (pDump);
+
+    int * pOut = (int *) pDump;
+
+    pOut [0] = m_MaxMemory;
+    pOut [1] = m_DenseIwCount;
+    pOut [2] = NULL != m_pMealy;
+    pOut [3] = m_RowCount;
+    pOut [4] = m_ClassCount;
+    pOut [5] = 0 < m_RowCount ? (int) m_HashMask + 1 : 0;
+    pOut += DumpHeaderSize;
+
+    if (0 == m_RowCount) {
+        return;
+    }
+
+    const size_t TableSize = (size_t) m_RowCount * m_ClassCount;
+
+    memcpy (pOut, m_pIw2Class, sizeof (int) * m_DenseIwCount);
+    pOut += m_DenseIwCount;
+    memcpy (pOut, m_pDsts, sizeof (int) * TableSize);
+    pOut += TableSize;
+    if (m_pOws) {
+        memcpy (pOut, m_pOws, sizeof (int) * TableSize);
+        pOut += TableSize;
+    }
+    memcpy (pOut, m_pState2Row, sizeof (int) * 2 * ((size_t) m_HashMask + 1));
+}
+
+
+const bool FADfa_dense::SetDump (const unsigned char * pDump, const size_t Size)
+{
+    FreeTables ();
+
+    if (!pDump || !m_pDfa || DumpHeaderSize * sizeof (int) > Size) {
+        return false;
+    }
+
+    const int * pIn = (const int *) pDump;
+
+    const int RowCount = pIn [3];
+    const int ClassCount = pIn [4];
+    const int HashSize = pIn [5];
+
+    if (m_MaxMemory != pIn [0] || m_DenseIwCount != pIn [1] || \
+        (NULL != m_pMealy) != (0 != pIn [2])) {
+        return false;
+    }
+    if (0 == RowCount) {
+        return DumpHeaderSize * sizeof (int) == Size;
+    }
+    if (0 > RowCount || 0 >= ClassCount || ClassCount > m_DenseIwCount || \
+        HashSize < 2 * RowCount || 0 != (HashSize & (HashSize - 1))) {
+        return false;
+    }
+
+    const size_t TableSize = (size_t) RowCount * ClassCount;
+    const size_t Count = DumpHeaderSize + m_DenseIwCount + TableSize + \
+        (m_pMealy ? TableSize : 0) + (2 * (size_t) HashSize);
+
+    if (Count * sizeof (int) != Size) {
+        return false;
+    }
+    pIn += DumpHeaderSize;
+
+    // the columns and the rows should be in range, the states are not
+    // checked, the dump is as good as the automaton it was made for
+    const int * pIw2Class = pIn;
+    pIn += m_DenseIwCount;
+    for (int Iw = 0; Iw < m_DenseIwCount; ++Iw) {
+        if (0 > pIw2Class [Iw] || ClassCount <= pIw2Class [Iw]) {
+            return false;
+        }
+    }
+    const int * pDsts = pIn;
+    pIn += TableSize;
+    const int * pOws = NULL;
+    if (m_pMealy) {
+        pOws = pIn;
+        pIn += TableSize;
+    }
+    const int * pState2Row = pIn;
+    int EmptyCount = 0;
+    for (int i = 0; i < HashSize; ++i) {
+        const int Row = pState2Row [(i << 1) + 1];
+        if (-1 == pState2Row [i << 1]) {
+            EmptyCount++;
+        } else if (0 > Row || RowCount <= Row) {
+            return false;
+        }
+    }
+    if (HashSize - RowCount != EmptyCount) {
+        return false;
+    }
+
+    m_RowCount = RowCount;
+    m_ClassCount = ClassCount;
+    m_pIw2Class = pIw2Class;
+    m_pDsts = pDsts;
+    m_pOws = pOws;
+    m_pState2Row = pState2Row;
+    m_HashMask = (unsigned int) HashSize - 1;
+
+    return true;
+}
+
+
+const int FADfa_dense::GetMemorySize () const
+{
+    if (0 == m_RowCount) {
+        return 0;
+    }
+    const int EntrySize = m_pOws ? 2 * sizeof (int) : sizeof (int);
+    return (m_RowCount * m_ClassCount * EntrySize) + \
+        ((m_HashMask + 1) * 2 * sizeof (int)) + (m_DenseIwCount * sizeof (int));
+}
+
+
+const int FADfa_dense::GetStateCount () const
+{
+    return m_RowCount;
+}
+
+
+const bool FADfa_dense::IsFromDump () const
+{
+    return 0 < m_RowCount && !m_fOwnTables;
+}
+
+
+const int FADfa_dense::GetInitial () const
+{
+    DebugLogAssert (m_pDfa);
+    return m_pDfa->GetInitial ();
+}
+
+
+const bool FADfa_dense::IsFinal (const int State) const
+{
+    DebugLogAssert (m_pDfa);
+    return m_pDfa->IsFinal (State);
+}
+
+
+const int FADfa_dense::GetIWs (
+        __out_ecount_opt (MaxIwCount) int * pIws,
+        const int MaxIwCount
+    ) const
+{
+    DebugLogAssert (m_pDfa);
+    return m_pDfa->GetIWs (pIws, MaxIwCount);
+}
+
+
+const int FADfa_dense::GetDest (const int State, const int Iw) const
+{
+    DebugLogAssert (m_pDfa);
+
+    if (m_pDsts && !m_pMealy && 0 <= State && \
+        (unsigned int) Iw < (unsigned int) m_DenseIwCount) {
+
+        const int Row = GetRow (State);
+
+        if (-1 != Row) {
+            return m_pDsts [(Row * m_ClassCount) + m_pIw2Class [Iw]];
+        }
+    }
+
+    return m_pDfa->GetDest (State, Iw);
+}
+
+
+const int FADfa_dense::
+    GetDestOw (const int State, const int Iw, int * pOw) const
+{
+    DebugLogAssert (m_pMealy && pOw);
+
+    if (m_pOws && 0 <= State && \
+        (unsigned int) Iw < (unsigned int) m_DenseIwCount) {
+
+        const int Row = GetRow (State);
+
+        if (-1 != Row) {
+            const int Idx = (Row * m_ClassCount) + m_pIw2Class [Iw];
+            const int Dst = m_pDsts [Idx];
+            if (-1 != Dst) {
+                *pOw = m_pOws [Idx];
+            }
+            return Dst;
+        }
+    }
+
+    return m_pMealy->GetDestOw (State, Iw, pOw);
+}
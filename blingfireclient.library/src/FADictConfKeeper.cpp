@@ -16,6 +16,8 @@
 #include "FAMultiMap_pack.h"
 #include "FAMultiMap_pack_mph.h"
 #include "FAMultiMap_pack_fixed.h"
+#include "FAGetIWs_pack_triv.h"
+#include "FADat_pack.h"
 
 
 FADictConfKeeper::FADictConfKeeper () :
@@ -23,12 +25,15 @@ FADictConfKeeper::FADictConfKeeper () :
     m_FsmType (FAFsmConst::TYPE_MEALY_DFA),
     m_pRsDfa (NULL),
     m_pMealy (NULL),
+    m_pMealyA (NULL),
     m_pState2Ow (NULL),
+    m_pIws (NULL),
     m_pK2I (NULL),
     m_pI2Info_triv (NULL),
     m_pI2Info_mph (NULL),
     m_pI2Info_fixed (NULL),
     m_pI2Info (NULL),
+    m_pDat (NULL),
     m_IgnoreCase (false),
     m_NoTrUse (true),
     m_Direction (FAFsmConst::DIR_L2R),
@@ -123,6 +128,15 @@ void FADictConfKeeper::Init (const int * pValues, const int Size)
             }
             m_pRsDfa->SetImage (pDump);
 
+            // FAGetIWs_pack_triv does not support the remapped Iws
+            const unsigned int IwsCount = *(const unsigned int *)(pDump + (2 * sizeof (int)));
+            if (0 == (0x80000000 & IwsCount)) {
+                if (!m_pIws) {
+                    m_pIws = NEW FAGetIWs_pack_triv;
+                }
+                m_pIws->SetImage (pDump);
+            }
+
             if (FAFsmConst::TYPE_MEALY_DFA == m_FsmType) {
 
                 if (!m_pMealy) {
@@ -200,6 +214,19 @@ void FADictConfKeeper::Init (const int * pValues, const int Size)
             }
             break;
         }
+        case FAFsmConst::PARAM_DAT:
+        {
+            const int DumpNum = pValues [++i];
+            const unsigned char * pDump = m_pLDB->GetDump (DumpNum);
+            LogAssert (pDump);
+
+            if (!m_pDat) {
+                m_pDat = NEW FADat_pack;
+            }
+            m_pDat->SetImage (pDump);
+
+            break;
+        }
 
         default:
             LogAssert (0);
@@ -218,10 +245,15 @@ void FADictConfKeeper::Clear ()
         delete m_pMealy;
         m_pMealy = NULL;
     }
+    m_pMealyA = NULL;
     if (m_pState2Ow) {
         delete m_pState2Ow;
         m_pState2Ow = NULL;
     }
+    if (m_pIws) {
+        delete m_pIws;
+        m_pIws = NULL;
+    }
     if (m_pK2I) {
         delete m_pK2I;
         m_pK2I = NULL;
@@ -242,6 +274,10 @@ void FADictConfKeeper::Clear ()
         delete m_pCharMap;
         m_pCharMap = NULL;
     }
+    if (m_pDat) {
+        delete m_pDat;
+        m_pDat = NULL;
+    }
 
     m_IgnoreCase = false;
     m_NoTrUse = true;
@@ -265,6 +301,9 @@ const FARSDfaCA * FADictConfKeeper::GetRsDfa () const
 
 const FAMealyDfaCA * FADictConfKeeper::GetMphMealy () const
 {
+    if (m_pMealyA) {
+        return m_pMealyA;
+    }
     return m_pMealy;
 }
 
@@ -314,3 +353,23 @@ const int FADictConfKeeper::GetTokAlgo () const
 {
     return m_TokAlgo;
 }
+
+const FAGetIWsCA * FADictConfKeeper::GetIws () const
+{
+    return m_pIws;
+}
+
+const FADat_pack * FADictConfKeeper::GetDat () const
+{
+    return m_pDat;
+}
+
+const FAIwMap_pack * FADictConfKeeper::GetIwMap () const
+{
+    return m_pRsDfa ? m_pRsDfa->GetIwMap () : NULL;
+}
+
+void FADictConfKeeper::SetMphMealy (const FAMealyDfaCA * pMealy)
+{
+    m_pMealyA = pMealy;
+}
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FADumpRegistry.h"
+#include "FAFsmConst.h"
+
+#include <string.h>
+
+
+FADumpRegistry::FADumpRegistry () :
+    m_Size (0)
+{}
+
+
+FADumpRegistry::~FADumpRegistry ()
+{
+    std::unordered_map < const unsigned char *, _TEntry >::iterator I = \
+        m_Entries.begin ();
+
+    for (; I != m_Entries.end (); ++I) {
+        delete [] I->second._pHeap;
+    }
+}
+
+
+const unsigned char * FADumpRegistry::Add (
+        const unsigned char * pDump,
+        const size_t Size,
+        const unsigned int Crc
+    )
+{
+    LogAssert (pDump && 0 < Size);
+
+    std::lock_guard < std::mutex > Guard (m_Lock);
+
+    // see if the identical dump is already stored
+    typedef std::unordered_multimap < unsigned int, const unsigned char * >::iterator TIter;
+    std::pair < TIter, TIter > Range = m_ByCrc.equal_range (Crc);
+
+    for (TIter I = Range.first; I != Range.second; ++I) {
+
+        _TEntry & Entry = m_Entries [I->second];
+
+        if (Size == Entry._Size && 0 == memcmp (I->second, pDump, Size)) {
+            Entry._RefCount++;
+            return I->second;
+        }
+    }
+
+    // store a copy, aligned as the LDB sections, see FALDB
+    const size_t Align = FAFsmConst::LDB_V2_ALIGNMENT;
+
+    _TEntry Entry;
+    Entry._pHeap = NEW unsigned char [Size + Align - 1];
+    LogAssert (Entry._pHeap);
+    Entry._Size = Size;
+    Entry._Crc = Crc;
+    Entry._RefCount = 1;
+
+    unsigned char * pCopy = Entry._pHeap + \
+        ((Align - (((size_t) Entry._pHeap) & (Align - 1))) & (Align - 1));
+    memcpy (pCopy, pDump, Size);
+
+    m_Entries [pCopy] = Entry;
+    m_ByCrc.insert (std::make_pair (Crc, (const unsigned char *) pCopy));
+    m_Size += Size;
+
+    return pCopy;
+}
+
+
+void FADumpRegistry::Release (const unsigned char * pDump)
+{
+    std::lock_guard < std::mutex > Guard (m_Lock);
+
+    std::unordered_map < const unsigned char *, _TEntry >::iterator I = \
+        m_Entries.find (pDump);
+    LogAssert (I != m_Entries.end ());
+
+    _TEntry & Entry = I->second;
+
+    if (0 < --Entry._RefCount) {
+        return;
+    }
+
+    typedef std::unordered_multimap < unsigned int, const unsigned char * >::iterator TIter;
+    std::pair < TIter, TIter > Range = m_ByCrc.equal_range (Entry._Crc);
+
+    for (TIter J = Range.first; J != Range.second; ++J) {
+        if (pDump == J->second) {
+            m_ByCrc.erase (J);
+            break;
+        }
+    }
+
+    m_Size -= Entry._Size;
+    delete [] Entry._pHeap;
+    m_Entries.erase (I);
+}
+
+
+const int FADumpRegistry::GetRefCount (const unsigned char * pDump) const
+{
+    std::lock_guard < std::mutex > Guard (m_Lock);
+
+    std::unordered_map < const unsigned char *, _TEntry >::const_iterator I = \
+        m_Entries.find (pDump);
+    if (I == m_Entries.end ()) {
+        return 0;
+    }
+    return I->second._RefCount;
+}
+
+
+const size_t FADumpRegistry::GetCount () const
+{
+    std::lock_guard < std::mutex > Guard (m_Lock);
+    return m_Entries.size ();
+}
+
+
+const size_t FADumpRegistry::GetSize () const
+{
+    std::lock_guard < std::mutex > Guard (m_Lock);
+    return m_Size;
+}
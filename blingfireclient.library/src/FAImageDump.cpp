@@ -7,10 +7,21 @@
 #include "blingfire-client_src_pch.h"
 #include "FAConfig.h"
 #include "FAImageDump.h"
+#include "FAFsmConst.h"
+#include "FALzDecompress.h"
+
+#ifdef BLING_FIRE_NOWINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 
 FAImageDump::FAImageDump () :
     m_pImageDump (NULL),
+    m_pHeap (NULL),
+    m_Size (0),
     m_MustDelete (false),
     m_hFileMapping (0),
     m_MustUnmap (false)
@@ -27,8 +38,9 @@ FAImageDump::~FAImageDump ()
 void FAImageDump::FAFreeHeap ()
 {
     if (m_MustDelete) {
-        LogAssert (m_pImageDump);
-        delete [] m_pImageDump;
+        LogAssert (m_pHeap);
+        delete [] m_pHeap;
+        m_pHeap = NULL;
         m_pImageDump = NULL;
         m_MustDelete = false;
     }
@@ -53,6 +65,13 @@ void FAImageDump::FAFreeMm ()
 
 #else
 
+    if (m_MustUnmap) {
+        const int Res = ::munmap ((void *) m_pImageDump, m_Size);
+        LogAssert (0 == Res, "Cannot unmap the view of a file");
+        m_pImageDump = NULL;
+        m_MustUnmap = false;
+    }
+
 #endif
 }
 
@@ -64,6 +83,7 @@ void FAImageDump::Load (const char * pFileName, const bool fUseMemMapping)
     // free the memory and resources if there was anything loaded
     FAImageDump::FAFreeHeap ();
     FAImageDump::FAFreeMm ();
+    m_Size = 0;
 
 #ifndef BLING_FIRE_NOWINDOWS
 
@@ -80,10 +100,66 @@ void FAImageDump::Load (const char * pFileName, const bool fUseMemMapping)
 
 #else
 
-    // load the file using fopen_s into the heap
-    FALoadHeap (pFileName);
+    if (false == fUseMemMapping) {
+
+        // load the file using fopen_s into the heap
+        FALoadHeap (pFileName);
+
+    } else {
+
+        // load the file using mmap
+        FALoadMm (pFileName);
+    }
 
 #endif
+
+    // expand the compressed LDB sections, if any
+    if (FALzDecompress::IsCompressed (m_pImageDump, m_Size)) {
+        FAExpand ();
+    }
+}
+
+
+unsigned char * FAImageDump::FAAllocHeap (const size_t Size)
+{
+    // align the image as the LDB sections are aligned, see FALDB
+    const size_t Align = FAFsmConst::LDB_V2_ALIGNMENT;
+
+    m_pHeap = NEW unsigned char [Size + Align - 1];
+    LogAssert (m_pHeap);
+
+    m_MustDelete = true;
+
+    return m_pHeap + \
+        ((Align - (((size_t) m_pHeap) & (Align - 1))) & (Align - 1));
+}
+
+
+void FAImageDump::FAExpand ()
+{
+    FALzDecompress Lz;
+    Lz.SetImage (m_pImageDump, m_Size);
+
+    const size_t Size = Lz.GetSize ();
+
+    // keep the compressed image until the expansion is done
+    FAImageDump Compressed;
+    Compressed.m_pImageDump = m_pImageDump;
+    Compressed.m_pHeap = m_pHeap;
+    Compressed.m_Size = m_Size;
+    Compressed.m_MustDelete = m_MustDelete;
+    Compressed.m_hFileMapping = m_hFileMapping;
+    Compressed.m_MustUnmap = m_MustUnmap;
+
+    m_pHeap = NULL;
+    m_MustDelete = false;
+    m_hFileMapping = 0;
+    m_MustUnmap = false;
+
+    m_pImageDump = FAAllocHeap (Size);
+    m_Size = Size;
+
+    Lz.Process (m_pImageDump);
 }
 
 
@@ -98,21 +174,20 @@ void FAImageDump::FALoadHeap (const char * pFileName)
     res = fseek (file, 0, SEEK_END);
     LogAssert (0 == res);
 
-    const unsigned int Size = ftell (file);
-    LogAssert (0 < Size);
+    const long FileSize = ftell (file);
+    LogAssert (0 < FileSize);
+    const size_t Size = (size_t) FileSize;
 
     res = fseek (file, 0, SEEK_SET);
     LogAssert (0 == res);
 
-    m_pImageDump = NEW unsigned char [Size];
-    LogAssert (m_pImageDump);
+    m_pImageDump = FAAllocHeap (Size);
+    m_Size = Size;
 
     const size_t ActSize = fread (m_pImageDump, sizeof (char), Size, file);
     LogAssert (ActSize == Size);
 
     fclose (file);
-
-    m_MustDelete = true;
 }
 
 
@@ -136,13 +211,36 @@ void FAImageDump::FALoadMm (const char * pFileName)
     LogAssert (NULL != m_pImageDump, "Failed to get a pointer from the memory mapped file %s, GetLastError()=%lu", 
         pFileName, GetLastError());
 
-    BOOL fRes = ::CloseHandle (hFile);
+    LARGE_INTEGER FileSize;
+    BOOL fRes = ::GetFileSizeEx (hFile, &FileSize);
+    LogAssert (0 != fRes, "Cannot get the size of a file %s, GetLastError()=%lu", 
+        pFileName, GetLastError());
+    m_Size = (size_t) FileSize.QuadPart;
+
+    fRes = ::CloseHandle (hFile);
     LogAssert (0 != fRes, "Cannot close handle, GetLastError()=%lu", GetLastError());
 
     m_MustUnmap = true;
 
 #else
 
+    LogAssert (pFileName);
+
+    const int File = ::open (pFileName, O_RDONLY);
+    LogAssert (-1 != File, "Failed to open a file %s for memory mapping", pFileName);
+
+    struct stat FileStat;
+    int Res = ::fstat (File, &FileStat);
+    LogAssert (0 == Res && 0 < FileStat.st_size, "Cannot get the size of a file %s", pFileName);
+    m_Size = (size_t) FileStat.st_size;
+
+    void * pView = ::mmap (NULL, m_Size, PROT_READ, MAP_PRIVATE, File, 0);
+    ::close (File);
+    LogAssert (MAP_FAILED != pView, "Failed to memory map the file %s", pFileName);
+
+    m_pImageDump = (unsigned char *) pView;
+    m_MustUnmap = true;
+
 #endif
 }
 
@@ -153,6 +251,7 @@ void FAImageDump::SetImageDump (const unsigned char * pImageDump)
     FAImageDump::FAFreeMm ();
 
     m_pImageDump = (unsigned char *) pImageDump;
+    m_Size = 0;
 }
 
 
@@ -160,3 +259,15 @@ const unsigned char * FAImageDump::GetImageDump () const
 {
     return m_pImageDump;
 }
+
+
+const size_t FAImageDump::GetSize () const
+{
+    return m_Size;
+}
+
+
+const bool FAImageDump::IsMapped () const
+{
+    return m_MustUnmap;
+}
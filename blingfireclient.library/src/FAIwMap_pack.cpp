@@ -9,6 +9,76 @@
 #include "FAIwMap_pack.h"
 #include <algorithm>
 #include <limits>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <string.h>
+
+
+///
+/// Multi-stage Iw --> NewIw table, the identical tables are shared
+///
+struct FAIwMap_pack::_TTable {
+    // the number of the objects using this table
+    int m_RefCount;
+    // the CRC32 of the intervals and the copy of the map dump the table is
+    // built from
+    unsigned int m_Crc;
+    std::vector < unsigned char > m_Dump;
+    // the table covers OldIws [0, m_Size)
+    int m_Size;
+    std::vector < int > m_Stage1;
+    std::vector < int > m_Stage2;
+    std::vector < int > m_Stage3;
+};
+
+
+namespace {
+
+// the tables in use by the CRC32 of their intervals, created with the first
+// table and deleted with the last one
+typedef std::unordered_multimap < unsigned int, void * > FAIwTables;
+FAIwTables * g_pIwTables = NULL;
+
+// guards g_pIwTables, the mutex is never destroyed so the tables can be
+// released from the destructors of the static objects in any order
+std::mutex * FAGetIwTablesLock ()
+{
+    static std::mutex * pLock = new std::mutex;
+    return pLock;
+}
+
+// returns the offset of the block in the stage, adds the block if the stage
+// does not have it yet, pBlocks maps the hash of a block to its offsets
+const int FAAddBlock (
+        std::vector < int > * pStage,
+        std::unordered_multimap < unsigned int, int > * pBlocks,
+        const int * pBlock,
+        const int Size
+    )
+{
+    unsigned int Hash = 0;
+    for (int i = 0; i < Size; ++i) {
+        Hash = (Hash * 0x01000193) ^ ((unsigned int) pBlock [i]);
+    }
+
+    typedef std::unordered_multimap < unsigned int, int >::const_iterator TIter;
+    std::pair < TIter, TIter > Range = pBlocks->equal_range (Hash);
+
+    for (TIter I = Range.first; I != Range.second; ++I) {
+        if (0 == memcmp (pStage->data () + I->second, pBlock, Size * sizeof (int))) {
+            return I->second;
+        }
+    }
+
+    const int Offset = (int) pStage->size ();
+    pStage->insert (pStage->end (), pBlock, pBlock + Size);
+    pBlocks->insert (std::make_pair (Hash, Offset));
+
+    return Offset;
+}
+
+}
 
 
 FAIwMap_pack::FAIwMap_pack () :
@@ -17,27 +87,23 @@ FAIwMap_pack::FAIwMap_pack () :
     m_pArrToIwOffset (NULL),
     m_SizeOfNewIw (0),
     m_pNewIws (NULL),
-    m_CacheSize (0),
-    m_pIw2IwCache (NULL)
+    m_TableSize (0),
+    m_pStage1 (NULL),
+    m_pStage2 (NULL),
+    m_pStage3 (NULL),
+    m_pTable (NULL)
 {
 }
 
 FAIwMap_pack::~FAIwMap_pack ()
 {
-    if (m_pIw2IwCache) {
-        delete [] m_pIw2IwCache;
-        m_pIw2IwCache = NULL;
-    }
+    ReleaseTable ();
 }
 
 void FAIwMap_pack::SetImage (const unsigned char * pImage)
 {
-    // reset the cache
-    m_CacheSize = 0;
-    if (m_pIw2IwCache) {
-        delete [] m_pIw2IwCache;
-        m_pIw2IwCache = NULL;
-    }
+    // reset the table
+    ReleaseTable ();
 
     if (pImage) {
 
@@ -58,29 +124,268 @@ void FAIwMap_pack::SetImage (const unsigned char * pImage)
         // NewIws storage
         m_pNewIws = pImage + Offset;
 
-        // setup the cache, if the map is not empty
+        // setup the table, if the map is not empty
         if (0 < m_IntervalCount) {
-            // get pair temporary pointer
-            const int * pPair = m_pArrToIwOffset + ((m_IntervalCount - 1) << 1);
-            // get ending of the interval
-            const int EndIw = *pPair;
-            LogAssert (0 <= EndIw);
-
-            // allocate memory for the cache
-            const int CacheSize = (std::min) (EndIw + 1, (int)MaxCacheSize);
-            m_pIw2IwCache = new int [CacheSize];
-            LogAssert (m_pIw2IwCache);
-
-            // initialize the cache
-            for (int OldIw = 0; OldIw < CacheSize; ++OldIw)
-            {
-                // Note: this call will not use cache if m_CacheSize == 0
-                const int NewIw = FAIwMap_pack::GetNewIw (OldIw);
-                m_pIw2IwCache [OldIw] = NewIw;
+            SetTable (pImage);
+        }
+    }
+}
+
+
+FAIwMap_pack::_TTable * FAIwMap_pack::
+    FindTable (const unsigned char * pDump, const size_t Size, const unsigned int Crc)
+{
+    if (!g_pIwTables) {
+        return NULL;
+    }
+
+    typedef FAIwTables::const_iterator TIter;
+    std::pair < TIter, TIter > Range = g_pIwTables->equal_range (Crc);
+
+    for (TIter I = Range.first; I != Range.second; ++I) {
+
+        _TTable * pTable = (_TTable *) I->second;
+
+        if (Size == pTable->m_Dump.size () && \
+            0 == memcmp (pTable->m_Dump.data (), pDump, Size)) {
+            pTable->m_RefCount++;
+            return pTable;
+        }
+    }
+
+    return NULL;
+}
+
+
+void FAIwMap_pack::SetTable (const unsigned char * pImage)
+{
+    DebugLogAssert (0 < m_IntervalCount && !m_pTable);
+
+    // the size of the map dump, the NewIws of each interval are stored
+    // at the interval's offset
+    size_t NewIwsSize = 0;
+
+    for (int i = 0; i < m_IntervalCount; ++i) {
+
+        const int FromIw = m_pArrFromIw [i];
+        const int ToIw = m_pArrToIwOffset [i << 1];
+        const int IntervalOffset = m_pArrToIwOffset [(i << 1) + 1];
+        LogAssert (FromIw <= ToIw && 0 <= IntervalOffset);
+
+        const size_t End = IntervalOffset + \
+            (((size_t) ToIw - FromIw + 1) * m_SizeOfNewIw);
+        NewIwsSize = (std::max) (NewIwsSize, End);
+    }
+
+    const size_t DumpSize = (m_pNewIws - pImage) + NewIwsSize;
+    // the key is the CRC32 of the intervals, the NewIws are compared only
+    // if the intervals match, so a big map is not read twice
+    const unsigned int Crc = ::FAGetCrc32 (pImage, m_pNewIws - pImage);
+
+    // use the table built from an identical map, if there is one
+    _TTable * pTable = NULL;
+    {
+        std::lock_guard < std::mutex > Guard (*FAGetIwTablesLock ());
+        pTable = FindTable (pImage, DumpSize, Crc);
+    }
+
+    if (!pTable) {
+
+        // build the table without the lock
+        _TTable * pNewTable = BuildTable ();
+        pNewTable->m_Crc = Crc;
+        pNewTable->m_Dump.assign (pImage, pImage + DumpSize);
+
+        std::lock_guard < std::mutex > Guard (*FAGetIwTablesLock ());
+
+        // the same table could have been added meanwhile
+        pTable = FindTable (pImage, DumpSize, Crc);
+
+        if (pTable) {
+            delete pNewTable;
+        } else {
+            if (!g_pIwTables) {
+                g_pIwTables = new FAIwTables;
+                LogAssert (g_pIwTables);
+            }
+            g_pIwTables->insert (std::make_pair (Crc, (void *) pNewTable));
+            pTable = pNewTable;
+        }
+    }
+
+    m_pTable = pTable;
+    m_pStage1 = pTable->m_Stage1.data ();
+    m_pStage2 = pTable->m_Stage2.data ();
+    m_pStage3 = pTable->m_Stage3.data ();
+    m_TableSize = pTable->m_Size;
+}
+
+
+FAIwMap_pack::_TTable * FAIwMap_pack::BuildTable () const
+{
+    DebugLogAssert (0 < m_IntervalCount);
+
+    // get pair temporary pointer
+    const int * pPair = m_pArrToIwOffset + ((m_IntervalCount - 1) << 1);
+    // get ending of the interval
+    const int EndIw = *pPair;
+    LogAssert (0 <= EndIw);
+
+    _TTable * pTable = new _TTable;
+    LogAssert (pTable);
+
+    const int Size = (std::min) (EndIw, (int) MaxTableIw) + 1;
+    const int BlockSize = Stage3Mask + 1;
+    const int Block2Size = Stage2Mask + 1;
+    const int BlockCount = (Size + BlockSize - 1) / BlockSize;
+    const int Block2Count = (BlockCount + Block2Size - 1) / Block2Size;
+
+    pTable->m_RefCount = 1;
+    pTable->m_Crc = 0;
+    pTable->m_Size = Size;
+
+    // the hash of a block --> its offsets
+    std::unordered_multimap < unsigned int, int > Stage3Blocks;
+    std::unordered_multimap < unsigned int, int > Stage2Blocks;
+
+    std::vector < int > Block (BlockSize);
+    std::vector < int > Block2 (Block2Size);
+    // the offset of the block with no mapped OldIws, -1 if not added yet
+    int EmptyOffset3 = -1;
+    // the encoded NewIws of the previous block if it is within one interval,
+    // the same bytes make the same block, e.g. in a large script
+    const unsigned char * pPrevNewIws = NULL;
+    int PrevOffset3 = -1;
+    const int BlockNewIwsSize = BlockSize * m_SizeOfNewIw;
+
+    int IntervalIdx = 0;
+
+    for (int i = 0; i < Block2Count; ++i) {
+        for (int j = 0; j < Block2Size; ++j) {
+
+            const int BlockFrom = ((i * Block2Size) + j) * BlockSize;
+            const int BlockTo = (std::min) (BlockFrom + BlockSize, Size) - 1;
+
+            // skip the intervals which end before the block
+            while (IntervalIdx < m_IntervalCount && \
+                   m_pArrToIwOffset [IntervalIdx << 1] < BlockFrom) {
+                IntervalIdx++;
+            }
+
+            // most of the blocks have no mapped OldIws
+            if (IntervalIdx == m_IntervalCount || \
+                m_pArrFromIw [IntervalIdx] > BlockTo) {
+                if (-1 == EmptyOffset3) {
+                    std::fill (Block.begin (), Block.end (), -1);
+                    EmptyOffset3 = FAAddBlock (&(pTable->m_Stage3), \
+                        &Stage3Blocks, Block.data (), BlockSize);
+                }
+                Block2 [j] = EmptyOffset3;
+                continue;
+            }
+
+            // see if the block is within one interval and is the same as the
+            // previous one
+            const unsigned char * pNewIws = NULL;
+
+            if (m_pArrFromIw [IntervalIdx] <= BlockFrom && \
+                BlockFrom + BlockSize - 1 <= BlockTo && \
+                BlockTo <= m_pArrToIwOffset [IntervalIdx << 1]) {
+
+                pNewIws = m_pNewIws + m_pArrToIwOffset [(IntervalIdx << 1) + 1] + \
+                    ((BlockFrom - m_pArrFromIw [IntervalIdx]) * m_SizeOfNewIw);
+
+                if (pPrevNewIws && \
+                    0 == memcmp (pPrevNewIws, pNewIws, BlockNewIwsSize)) {
+                    Block2 [j] = PrevOffset3;
+                    continue;
+                }
+            }
+
+            // compute the block from the intervals it overlaps
+            std::fill (Block.begin (), Block.end (), -1);
+
+            for (int Idx = IntervalIdx; Idx < m_IntervalCount && \
+                 m_pArrFromIw [Idx] <= BlockTo; ++Idx) {
+
+                const int FromIw = (std::max) (m_pArrFromIw [Idx], BlockFrom);
+                const int ToIw = (std::min) (m_pArrToIwOffset [Idx << 1], BlockTo);
+
+                for (int OldIw = FromIw; OldIw <= ToIw; ++OldIw) {
+                    Block [OldIw - BlockFrom] = DecodeNewIw (Idx, OldIw);
+                }
+            }
+
+            Block2 [j] = FAAddBlock (&(pTable->m_Stage3), &Stage3Blocks, \
+                Block.data (), BlockSize);
+
+            pPrevNewIws = pNewIws;
+            PrevOffset3 = Block2 [j];
+        }
+
+        pTable->m_Stage1.push_back (FAAddBlock (&(pTable->m_Stage2), \
+            &Stage2Blocks, Block2.data (), Block2Size));
+    }
+
+    return pTable;
+}
+
+
+const size_t FAIwMap_pack::GetTableSize () const
+{
+    if (!m_pTable) {
+        return 0;
+    }
+    return (m_pTable->m_Stage1.size () + m_pTable->m_Stage2.size () + \
+        m_pTable->m_Stage3.size ()) * sizeof (int);
+}
+
+
+const int FAIwMap_pack::GetTableShareCount () const
+{
+    if (!m_pTable) {
+        return 0;
+    }
+
+    std::lock_guard < std::mutex > Guard (*FAGetIwTablesLock ());
+
+    return m_pTable->m_RefCount;
+}
+
+
+void FAIwMap_pack::ReleaseTable ()
+{
+    if (m_pTable) {
+
+        std::lock_guard < std::mutex > Guard (*FAGetIwTablesLock ());
+
+        if (0 == --(m_pTable->m_RefCount)) {
+
+            DebugLogAssert (g_pIwTables);
+
+            typedef FAIwTables::iterator TIter;
+            std::pair < TIter, TIter > Range = \
+                g_pIwTables->equal_range (m_pTable->m_Crc);
+
+            for (TIter I = Range.first; I != Range.second; ++I) {
+                if (m_pTable == I->second) {
+                    g_pIwTables->erase (I);
+                    break;
+                }
             }
-            // update cache size
-            m_CacheSize = CacheSize;
+            delete m_pTable;
 
-        } // of if (0 < m_IntervalCount) ...
+            // the last table is released
+            if (g_pIwTables->empty ()) {
+                delete g_pIwTables;
+                g_pIwTables = NULL;
+            }
+        }
+        m_pTable = NULL;
     }
+
+    m_TableSize = 0;
+    m_pStage1 = NULL;
+    m_pStage2 = NULL;
+    m_pStage3 = NULL;
 }
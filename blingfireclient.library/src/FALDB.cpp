@@ -9,24 +9,85 @@
 #include "FALDB.h"
 #include "FAFsmConst.h"
 #include "FAUtils_cl.h"
+#include "FADumpRegistry.h"
+
+#include <algorithm>
+#include <vector>
 
 
 FALDB::FALDB () :
-    m_DumpCount (0)
+    m_DumpCount (0),
+    m_Version (0),
+    m_pImage (NULL),
+    m_pRegistry (NULL),
+    m_VerifyMode (FAFsmConst::LDB_VERIFY_EAGER),
+    m_fVerifyOnAccess (false)
 {
+    for (int i = 0; i < FALimits::MaxLdbDumpCount; ++i) {
+        m_States [i] = DUMP_UNKNOWN;
+    }
 }
 
 FALDB::~FALDB ()
-{}
+{
+    FALDB::JoinVerifier ();
+    FALDB::ReleaseDumps ();
+}
+
+
+void FALDB::SetVerifyMode (const int VerifyMode)
+{
+    LogAssert (0 <= VerifyMode && VerifyMode < FAFsmConst::LDB_VERIFY_COUNT);
+    m_VerifyMode = VerifyMode;
+}
 
 void FALDB::SetImage (const unsigned char * pImgDump)
 {
+    FALDB::SetImage (pImgDump, 0);
+}
+
+
+void FALDB::SetImage (const unsigned char * pImgDump, const size_t ImageSize)
+{
+    // the previous image may still be verified
+    JoinVerifier ();
+    ReleaseDumps ();
+
     m_DumpCount = 0;
+    m_Version = 0;
+    m_pImage = pImgDump;
+    m_fVerifyOnAccess = false;
+
+    for (int i = 0; i < FALimits::MaxLdbDumpCount; ++i) {
+        m_States [i] = DUMP_UNKNOWN;
+    }
 
     if (!pImgDump) {
         return;
     }
 
+    LogAssert (0 == ImageSize || sizeof (int) <= ImageSize, \
+        "Invalid LDB binary file detected.");
+
+    if (FAFsmConst::LDB_V2_MAGIC == *((const unsigned int *)pImgDump)) {
+        SetImageV2 (pImgDump, ImageSize);
+    } else {
+        SetImageV1 (pImgDump, ImageSize);
+    }
+
+    // setup configuration image-dump, it is 0-th
+    LogAssert (0 < m_DumpCount);
+    m_Conf.SetImage (m_Dumps [0]);
+
+    const bool fIsValid = IsValidBinary ();
+    LogAssert (fIsValid, "Invalid LDB binary file detected.");
+}
+
+
+void FALDB::SetImageV1 (const unsigned char * pImgDump, const size_t ImageSize)
+{
+    DebugLogAssert (pImgDump);
+
     const unsigned char * pArr = pImgDump;
 
     // get the number of dumps
@@ -37,28 +98,91 @@ void FALDB::SetImage (const unsigned char * pImgDump)
     // LDB configuration has more dumps than 
     // FALimits::MaxLdbDumpCount or the Count is negative
     LogAssert (0 <= Count && Count <= FALimits::MaxLdbDumpCount);
+    LogAssert (0 == ImageSize || (size_t) (Count + 1) * sizeof (int) <= ImageSize);
 
-    // setup configuration image-dump, it is 0-th
-    int Offset = *((const int *)pArr);
-    DebugLogAssert (0 <= Offset);
-    m_Conf.SetImage (pImgDump + Offset);
+    // setup dumps array
+    for (int i = 0; i < Count; ++i) {
+
+        const int Offset = *((const int *)pArr);
+        LogAssert (0 <= Offset && (0 == ImageSize || (size_t) Offset <= ImageSize));
+        pArr += sizeof (int);
+
+        m_Dumps [i] = (pImgDump + Offset);
+        m_Crcs [i] = 0;
+
+        // the size of the last dump is not known
+        if (i + 1 < Count) {
+            const int NextOffset = *((const int *)pArr);
+            m_Sizes [i] = NextOffset < Offset ? 0 : NextOffset - Offset;
+        } else {
+            m_Sizes [i] = 0;
+        }
+    }
 
     // store the count
     m_DumpCount = Count;
+    m_Version = 1;
+}
+
+
+void FALDB::SetImageV2 (const unsigned char * pImgDump, const size_t RealSize)
+{
+    DebugLogAssert (pImgDump);
+
+    // the header should fit the buffer before it is read
+    LogAssert (0 == RealSize || FAFsmConst::LDB_V2_HEADER_SIZE <= RealSize, \
+        "Invalid LDB binary file detected.");
+
+    const unsigned int * pHeader = (const unsigned int *) pImgDump;
+
+    const unsigned int Version = pHeader [1];
+    const int Count = (int) pHeader [2];
+    const unsigned long long ImageSize = GetUInt64 (pHeader + 4);
+
+    LogAssert (FAFsmConst::LDB_V2_VERSION == Version, \
+        "Unsupported LDB binary file version %u.", Version);
+    LogAssert (0 < Count && Count <= FALimits::MaxLdbDumpCount);
+
+    // the header should not claim more bytes than there are, then the
+    // directory and the sections checked against ImageSize fit the buffer
+    LogAssert (0 == RealSize || ImageSize <= RealSize, \
+        "Invalid LDB binary file detected.");
+    LogAssert (FAFsmConst::LDB_V2_HEADER_SIZE + \
+        (unsigned long long) Count * FAFsmConst::LDB_V2_ENTRY_SIZE <= ImageSize);
+
+    const unsigned int * pEntry = (const unsigned int *) \
+        (pImgDump + FAFsmConst::LDB_V2_HEADER_SIZE);
 
-    // setup dumps array
     for (int i = 0; i < Count; ++i) {
 
-        Offset = *((const int *)pArr);
-        DebugLogAssert (0 <= Offset);
-        pArr += sizeof (int);
+        const unsigned int Type = pEntry [0];
+        const unsigned int Alignment = pEntry [1];
+        const unsigned long long Offset = GetUInt64 (pEntry + 2);
+        const unsigned long long Size = GetUInt64 (pEntry + 4);
 
-        m_Dumps [i] = (pImgDump + Offset);
-        m_Offsets [i] = Offset;
+        LogAssert ((0 == i) == (FAFsmConst::LDB_SECTION_CONF == Type));
+        LogAssert (0 < Alignment && 0 == (Offset % Alignment));
+        LogAssert (Offset <= ImageSize && Size <= ImageSize - Offset);
+        LogAssert (Offset + Size == (size_t) (Offset + Size));
+        LogAssert (FAFsmConst::LDB_CODEC_NONE == pEntry [7], \
+            "Compressed LDB image should be expanded by FALzDecompress.");
+
+        m_Dumps [i] = pImgDump + (size_t) Offset;
+        m_Sizes [i] = (size_t) Size;
+        m_Crcs [i] = pEntry [6];
+
+        pEntry += FAFsmConst::LDB_V2_ENTRY_SIZE / sizeof (unsigned int);
     }
 
-    const bool fIsValid = IsValidBinary ();
-    LogAssert (fIsValid, "Invalid LDB binary file detected.");
+    m_DumpCount = Count;
+    m_Version = 2;
+}
+
+
+inline const unsigned long long FALDB::GetUInt64 (const unsigned int * pArr)
+{
+    DebugLogAssert (pArr);
+    return pArr [0] | (((unsigned long long) pArr [1]) << 32);
 }
 
 
@@ -70,50 +194,253 @@ const bool FALDB::IsValidBinary ()
 
     if (fVerifyLdb)
     {
-        // LDB should have at least two dumps if the verification is requested
-        LogAssert (1 < m_DumpCount);
-        // get the validation dump (the last one)
-        const unsigned int * pVerify = (const unsigned int *) GetDump (m_DumpCount - 1);
+        if (2 == m_Version)
+        {
+            return IsValidV2 ();
+        }
 
-        // get the expected values
-        const unsigned int VaildationDataVersion = pVerify [FAFsmConst::VALIDATION_VERSION];
+        return IsValidV1 ();
+    }
 
-        if (0 == VaildationDataVersion)
-        {
-            const unsigned int ExpectedDataSize = pVerify [FAFsmConst::VALIDATION_SIZE];
-            const unsigned int ExpectedDataHash = pVerify [FAFsmConst::VALIDATION_HASH];
+    // return true if the validation is not requested
+    return true;
+}
 
-            unsigned int DataSize = 0;
-            unsigned int DataHash = 0;
 
-            // iterate over all data dumps
-            for (int i = 0; i < m_DumpCount - 1; ++i)
-            {
-                const int Size = m_Offsets [i + 1] - m_Offsets [i];
+const bool FALDB::IsValidV1 () const
+{
+    // LDB should have at least two dumps if the verification is requested
+    LogAssert (1 < m_DumpCount);
+    // get the validation dump (the last one)
+    const unsigned int * pVerify = (const unsigned int *) m_Dumps [m_DumpCount - 1];
 
-                if (0 > Size)
-                {
-                    return false;
-                }
+    // get the expected values
+    const unsigned int VaildationDataVersion = pVerify [FAFsmConst::VALIDATION_VERSION];
 
-                DataSize += Size;
-                DataHash = ::FAGetCrc32 (m_Dumps [i], (size_t) Size, DataHash);
-            }
+    if (0 == VaildationDataVersion)
+    {
+        const unsigned int ExpectedDataSize = pVerify [FAFsmConst::VALIDATION_SIZE];
+        const unsigned int ExpectedDataHash = pVerify [FAFsmConst::VALIDATION_HASH];
 
-            // see if actual numbers match the expected onces
-            if (DataSize != ExpectedDataSize || 
-                DataHash != ExpectedDataHash)
+        unsigned int DataSize = 0;
+        unsigned int DataHash = 0;
+
+        // iterate over all data dumps, the empty ones are valid
+        for (int i = 0; i < m_DumpCount - 1; ++i)
+        {
+            if (m_Dumps [i + 1] < m_Dumps [i])
             {
                 return false;
             }
+
+            const size_t Size = m_Dumps [i + 1] - m_Dumps [i];
+
+            DataSize += (unsigned int) Size;
+            DataHash = ::FAGetCrc32 (m_Dumps [i], Size, DataHash);
+        }
+
+        // see if actual numbers match the expected onces
+        if (DataSize != ExpectedDataSize || 
+            DataHash != ExpectedDataHash)
+        {
+            return false;
+        }
+    }
+
+    // return true if we don't know how to use the validation data
+    return true;
+}
+
+
+const bool FALDB::IsValidV2 ()
+{
+    // the configuration is already in use, verify it first
+    m_States [0] = IsValidDump (0) ? DUMP_VALID : DUMP_INVALID;
+
+    if (DUMP_VALID != m_States [0]) {
+        return false;
+    }
+
+    if (FAFsmConst::LDB_VERIFY_LAZY == m_VerifyMode) {
+
+        m_fVerifyOnAccess = true;
+
+    } else if (FAFsmConst::LDB_VERIFY_BACKGROUND == m_VerifyMode) {
+
+        m_fVerifyOnAccess = true;
+        m_Verifier = std::thread (&FALDB::VerifyDumps, this, 1, 1);
+
+    } else if (FAFsmConst::LDB_VERIFY_PARALLEL == m_VerifyMode) {
+
+        const int MaxThreadCount = (int) std::thread::hardware_concurrency ();
+        const int ThreadCount = \
+            std::max (1, std::min (MaxThreadCount, m_DumpCount - 1));
+
+        std::vector < std::thread > Threads;
+
+        for (int i = 1; i < ThreadCount; ++i) {
+            Threads.push_back (std::thread (&FALDB::VerifyDumps, this, \
+                i + 1, ThreadCount));
+        }
+
+        VerifyDumps (1, ThreadCount);
+
+        for (size_t i = 0; i < Threads.size (); ++i) {
+            Threads [i].join ();
+        }
+
+    } else {
+
+        VerifyDumps (1, 1);
+    }
+
+    if (!m_fVerifyOnAccess) {
+        for (int i = 0; i < m_DumpCount; ++i) {
+            if (DUMP_VALID != m_States [i]) {
+                return false;
+            }
         }
     }
 
-    // return true if we don't know how to use the validation data or if the validation is not requested
     return true;
 }
 
 
+const bool FALDB::IsValidDump (const int Num) const
+{
+    DebugLogAssert (2 == m_Version && 0 <= Num && Num < m_DumpCount);
+    return m_Crcs [Num] == ::FAGetCrc32 (m_Dumps [Num], m_Sizes [Num]);
+}
+
+
+void FALDB::VerifyDumps (const int Num, const int Step)
+{
+    for (int i = Num; i < m_DumpCount; i += Step) {
+
+        const int State = IsValidDump (i) ? DUMP_VALID : DUMP_INVALID;
+
+        std::lock_guard < std::mutex > Guard (m_Lock);
+        m_States [i] = State;
+        m_Verified.notify_all ();
+    }
+}
+
+
+void FALDB::EnsureValid (const int Num) const
+{
+    int State = m_States [Num];
+
+    if (DUMP_UNKNOWN == State) {
+
+        if (FAFsmConst::LDB_VERIFY_LAZY == m_VerifyMode) {
+
+            // concurrent calls may verify the dump more than once
+            State = IsValidDump (Num) ? DUMP_VALID : DUMP_INVALID;
+            m_States [Num] = State;
+
+        } else {
+
+            std::unique_lock < std::mutex > Lock (m_Lock);
+            while (DUMP_UNKNOWN == (State = m_States [Num])) {
+                m_Verified.wait (Lock);
+            }
+        }
+    }
+
+    LogAssert (DUMP_VALID == State, "Invalid LDB binary file detected.");
+}
+
+
+void FALDB::JoinVerifier ()
+{
+    if (m_Verifier.joinable ()) {
+        m_Verifier.join ();
+    }
+}
+
+
+void FALDB::ShareDumps (FADumpRegistry * pRegistry, const size_t ImageSize)
+{
+    LogAssert (pRegistry && !m_pRegistry && m_pImage);
+
+    for (int i = 0; i < m_DumpCount; ++i) {
+
+        // verifies the dump, if needed
+        const unsigned char * pDump = GetDump (i);
+
+        size_t Size = m_Sizes [i];
+
+        // the last version 1 dump ends with the image
+        if (1 == m_Version && m_DumpCount - 1 == i) {
+            LogAssert (pDump < m_pImage + ImageSize);
+            Size = (m_pImage + ImageSize) - pDump;
+        }
+
+        const unsigned int Crc = 2 == m_Version ? \
+            m_Crcs [i] : ::FAGetCrc32 (pDump, Size);
+
+        m_Dumps [i] = pRegistry->Add (pDump, Size, Crc);
+        m_Sizes [i] = Size;
+        m_Crcs [i] = Crc;
+    }
+
+    // the verification thread does not use the image after the dumps
+    // have been verified, but it may still be running
+    JoinVerifier ();
+
+    m_pRegistry = pRegistry;
+    m_pImage = NULL;
+
+    m_Conf.SetImage (m_Dumps [0]);
+}
+
+
+const unsigned int FALDB::GetChecksum (const size_t ImageSize) const
+{
+    unsigned int Crc = 0;
+
+    for (int i = 0; i < m_DumpCount; ++i) {
+
+        unsigned int DumpCrc = m_Crcs [i];
+        size_t Size = m_Sizes [i];
+
+        // the version 1 dumps have no CRC32 values, unless they are shared
+        if (1 == m_Version && !m_pRegistry) {
+
+            // the last version 1 dump ends with the image
+            if (m_DumpCount - 1 == i) {
+                LogAssert (m_pImage && m_Dumps [i] < m_pImage + ImageSize);
+                Size = (m_pImage + ImageSize) - m_Dumps [i];
+            }
+
+            DumpCrc = ::FAGetCrc32 (m_Dumps [i], Size);
+        }
+
+        const unsigned int Entry [3] = {
+            DumpCrc,
+            (unsigned int) Size,
+            (unsigned int) (((unsigned long long) Size) >> 32)
+        };
+        Crc = ::FAGetCrc32 ((const unsigned char *) Entry, sizeof (Entry), Crc);
+    }
+
+    return Crc;
+}
+
+
+void FALDB::ReleaseDumps ()
+{
+    if (m_pRegistry) {
+
+        for (int i = 0; i < m_DumpCount; ++i) {
+            m_pRegistry->Release (m_Dumps [i]);
+        }
+
+        m_pRegistry = NULL;
+    }
+}
+
+
 const FAMultiMapCA * FALDB::GetHeader () const
 {
     return & m_Conf;
@@ -127,10 +454,39 @@ const int FALDB::GetDumpCount () const
 const unsigned char * FALDB::GetDump (const int Num) const
 {
     LogAssert (0 <= Num && Num < m_DumpCount);
+
+    if (m_fVerifyOnAccess) {
+        EnsureValid (Num);
+    }
+
     const unsigned char * pDump = m_Dumps [Num];
     return pDump;
 }
 
+const size_t FALDB::GetDumpSize (const int Num, const size_t ImageSize) const
+{
+    LogAssert (0 <= Num && Num < m_DumpCount);
+
+    // the last version 1 dump ends with the image, unless it is shared
+    if (1 == m_Version && m_DumpCount - 1 == Num && !m_pRegistry) {
+        LogAssert (m_pImage && m_Dumps [Num] < m_pImage + ImageSize);
+        return (m_pImage + ImageSize) - m_Dumps [Num];
+    }
+
+    return m_Sizes [Num];
+}
+
+const FADumpRegistry * FALDB::GetRegistry () const
+{
+    return m_pRegistry;
+}
+
+
+const int FALDB::GetVersion () const
+{
+    return m_Version;
+}
+
 inline const bool FALDB::IsBooleanParam (const int Parameter)
 {
     return Parameter == FAFsmConst::PARAM_REVERSE ||
@@ -141,7 +497,8 @@ inline const bool FALDB::IsBooleanParam (const int Parameter)
            Parameter == FAFsmConst::PARAM_LOG_SCALE ||
            Parameter == FAFsmConst::PARAM_USE_NFST ||
            Parameter == FAFsmConst::PARAM_DO_W2B ||
-           Parameter == FAFsmConst::PARAM_VERIFY_LDB_BIN ;
+           Parameter == FAFsmConst::PARAM_VERIFY_LDB_BIN ||
+           Parameter == FAFsmConst::PARAM_UTF8_INPUT ;
 }
 
 const bool FALDB::
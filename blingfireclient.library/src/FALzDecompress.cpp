@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FALzDecompress.h"
+#include "FAFsmConst.h"
+#include "FALimits.h"
+
+#include <algorithm>
+#include <string.h>
+#include <thread>
+
+
+FALzDecompress::FALzDecompress () :
+    m_pImage (NULL),
+    m_Size (0)
+{}
+
+
+const bool FALzDecompress::IsCompressed (
+        const unsigned char * pImage,
+        const size_t ImageSize
+    )
+{
+    // too small for the LDB v2 header
+    if (!pImage || FAFsmConst::LDB_V2_HEADER_SIZE > ImageSize) {
+        return false;
+    }
+
+    const unsigned int * pHeader = (const unsigned int *) pImage;
+
+    if (FAFsmConst::LDB_V2_MAGIC != pHeader [0] || \
+        FAFsmConst::LDB_V2_VERSION != pHeader [1]) {
+        return false;
+    }
+
+    const int Count = (int) pHeader [2];
+    LogAssert (0 < Count && Count <= FALimits::MaxLdbDumpCount);
+    LogAssert (FAFsmConst::LDB_V2_HEADER_SIZE + \
+        ((size_t) Count * FAFsmConst::LDB_V2_ENTRY_SIZE) <= ImageSize);
+
+    const unsigned int * pEntry = (const unsigned int *) \
+        (pImage + FAFsmConst::LDB_V2_HEADER_SIZE);
+
+    for (int i = 0; i < Count; ++i) {
+        if (FAFsmConst::LDB_CODEC_NONE != pEntry [7]) {
+            return true;
+        }
+        pEntry += FAFsmConst::LDB_V2_ENTRY_SIZE / sizeof (unsigned int);
+    }
+
+    return false;
+}
+
+
+// reads a little endian 64-bit value stored as two ints
+static inline const unsigned long long FAGetUInt64 (const unsigned int * pArr)
+{
+    return pArr [0] | (((unsigned long long) pArr [1]) << 32);
+}
+
+
+void FALzDecompress::SetImage (
+        const unsigned char * pImage,
+        const size_t ImageSize
+    )
+{
+    LogAssert (IsCompressed (pImage, ImageSize));
+
+    m_pImage = pImage;
+    m_Blocks.clear ();
+
+    const unsigned int * pHeader = (const unsigned int *) pImage;
+    const int Count = (int) pHeader [2];
+    const int EntryCount = FAFsmConst::LDB_V2_ENTRY_SIZE / sizeof (unsigned int);
+    const size_t DirSize = FAFsmConst::LDB_V2_HEADER_SIZE + \
+        (Count * FAFsmConst::LDB_V2_ENTRY_SIZE);
+
+    LogAssert (DirSize <= ImageSize && FAGetUInt64 (pHeader + 4) <= ImageSize);
+
+    // copy the header and the directory, the sections will be updated
+    m_Header.assign (pHeader, pHeader + (DirSize / sizeof (unsigned int)));
+
+    const size_t Align = FAFsmConst::LDB_V2_ALIGNMENT;
+    size_t OutOffset = DirSize;
+
+    for (int i = 0; i < Count; ++i) {
+
+        unsigned int * pEntry = m_Header.data () + \
+            (FAFsmConst::LDB_V2_HEADER_SIZE / sizeof (unsigned int)) + \
+            (i * EntryCount);
+
+        const unsigned long long Offset = FAGetUInt64 (pEntry + 2);
+        const unsigned long long Size = FAGetUInt64 (pEntry + 4);
+        const unsigned int Codec = pEntry [7];
+
+        LogAssert (Offset <= ImageSize && Size <= ImageSize - Offset);
+        LogAssert (FAFsmConst::LDB_CODEC_NONE == Codec || \
+            FAFsmConst::LDB_CODEC_LZ == Codec);
+
+        OutOffset = (OutOffset + Align - 1) & ~(Align - 1);
+
+        _TBlock Block;
+        unsigned long long RawSize = Size;
+
+        if (FAFsmConst::LDB_CODEC_NONE == Codec) {
+
+            Block._InOffset = (size_t) Offset;
+            Block._InSize = (size_t) Size;
+            Block._OutOffset = OutOffset;
+            Block._OutSize = (size_t) Size;
+            Block._fRaw = true;
+            m_Blocks.push_back (Block);
+
+        } else {
+
+            LogAssert (FAFsmConst::LDB_LZ_HEADER_SIZE <= Size);
+
+            const unsigned int * pSection = \
+                (const unsigned int *) (pImage + Offset);
+
+            RawSize = FAGetUInt64 (pSection);
+            const unsigned int RawCrc = pSection [2];
+            const unsigned int BlockCount = pSection [3];
+            const unsigned long long BlockSize = FAFsmConst::LDB_LZ_BLOCK_SIZE;
+
+            LogAssert (RawSize == (size_t) RawSize);
+            LogAssert (BlockCount == (RawSize + BlockSize - 1) / BlockSize);
+            LogAssert (BlockCount <= (Size - FAFsmConst::LDB_LZ_HEADER_SIZE) \
+                / sizeof (unsigned int));
+
+            const unsigned int * pBlockSizes = pSection + \
+                (FAFsmConst::LDB_LZ_HEADER_SIZE / sizeof (unsigned int));
+
+            size_t InOffset = (size_t) Offset + FAFsmConst::LDB_LZ_HEADER_SIZE + \
+                (BlockCount * sizeof (unsigned int));
+            const size_t InEnd = (size_t) (Offset + Size);
+
+            for (unsigned int j = 0; j < BlockCount; ++j) {
+
+                const size_t InSize = pBlockSizes [j];
+                LogAssert (InSize <= InEnd - InOffset);
+
+                Block._InOffset = InOffset;
+                Block._InSize = InSize;
+                Block._OutOffset = OutOffset + (size_t) (j * BlockSize);
+                Block._OutSize = (size_t) \
+                    std::min (BlockSize, RawSize - (j * BlockSize));
+                Block._fRaw = false;
+                m_Blocks.push_back (Block);
+
+                InOffset += InSize;
+            }
+
+            // the expanded section is stored as is
+            pEntry [6] = RawCrc;
+            pEntry [7] = FAFsmConst::LDB_CODEC_NONE;
+        }
+
+        pEntry [2] = (unsigned int) (OutOffset & 0xffffffff);
+        pEntry [3] = (unsigned int) (((unsigned long long) OutOffset) >> 32);
+        pEntry [4] = (unsigned int) (RawSize & 0xffffffff);
+        pEntry [5] = (unsigned int) (RawSize >> 32);
+
+        OutOffset += (size_t) RawSize;
+    }
+
+    m_Size = OutOffset;
+
+    m_Header [4] = (unsigned int) (((unsigned long long) m_Size) & 0xffffffff);
+    m_Header [5] = (unsigned int) (((unsigned long long) m_Size) >> 32);
+}
+
+
+const size_t FALzDecompress::GetSize () const
+{
+    return m_Size;
+}
+
+
+void FALzDecompress::Process (unsigned char * pOut) const
+{
+    LogAssert (pOut && m_pImage);
+
+    // the header and the directory, the gaps are filled with 0s
+    memset (pOut, 0, m_Size);
+    memcpy (pOut, m_Header.data (), m_Header.size () * sizeof (unsigned int));
+
+    const int BlockCount = (int) m_Blocks.size ();
+    const int MaxThreadCount = (int) std::thread::hardware_concurrency ();
+    const int ThreadCount = std::max (1, std::min (MaxThreadCount, BlockCount));
+
+    std::vector < std::thread > Threads;
+    std::vector < int > ErrorCounts (ThreadCount, 0);
+
+    for (int i = 1; i < ThreadCount; ++i) {
+        Threads.push_back (std::thread (&FALzDecompress::DecodeBlocks, this, \
+            pOut, i, ThreadCount, ErrorCounts.data () + i));
+    }
+
+    DecodeBlocks (pOut, 0, ThreadCount, ErrorCounts.data ());
+
+    for (size_t i = 0; i < Threads.size (); ++i) {
+        Threads [i].join ();
+    }
+    for (int i = 0; i < ThreadCount; ++i) {
+        LogAssert (0 == ErrorCounts [i], "Corrupted compressed LDB section.");
+    }
+}
+
+
+void FALzDecompress::DecodeBlocks (
+        unsigned char * pOut,
+        const int Num,
+        const int Step,
+        int * pErrorCount
+    ) const
+{
+    DebugLogAssert (pOut && pErrorCount);
+
+    const int BlockCount = (int) m_Blocks.size ();
+
+    for (int i = Num; i < BlockCount; i += Step) {
+
+        const _TBlock & Block = m_Blocks [i];
+
+        if (Block._fRaw) {
+            memcpy (pOut + Block._OutOffset, m_pImage + Block._InOffset, \
+                Block._OutSize);
+        } else if (!DecodeBlock (m_pImage + Block._InOffset, Block._InSize, \
+                pOut + Block._OutOffset, Block._OutSize)) {
+            (*pErrorCount)++;
+        }
+    }
+}
+
+
+const bool FALzDecompress::DecodeBlock (
+        const unsigned char * pIn,
+        const size_t InSize,
+        unsigned char * pOut,
+        const size_t OutSize
+    )
+{
+    const unsigned char * pInEnd = pIn + InSize;
+    size_t OutPos = 0;
+
+    while (pIn < pInEnd) {
+
+        const unsigned int Token = *pIn++;
+
+        // the literals
+        size_t LitCount = Token >> 4;
+
+        if (15 == LitCount) {
+            unsigned int Byte;
+            do {
+                if (pIn == pInEnd) {
+                    return false;
+                }
+                Byte = *pIn++;
+                LitCount += Byte;
+            } while (255 == Byte);
+        }
+        if (LitCount > (size_t) (pInEnd - pIn) || LitCount > OutSize - OutPos) {
+            return false;
+        }
+
+        memcpy (pOut + OutPos, pIn, LitCount);
+        pIn += LitCount;
+        OutPos += LitCount;
+
+        // the last sequence has literals only
+        if (pIn == pInEnd) {
+            break;
+        }
+
+        // the match
+        if (2 > pInEnd - pIn) {
+            return false;
+        }
+
+        const size_t Offset = pIn [0] | (pIn [1] << 8);
+        pIn += 2;
+
+        size_t MatchLen = (Token & 15) + 4;
+
+        if (19 == MatchLen) {
+            unsigned int Byte;
+            do {
+                if (pIn == pInEnd) {
+                    return false;
+                }
+                Byte = *pIn++;
+                MatchLen += Byte;
+            } while (255 == Byte);
+        }
+        if (0 == Offset || Offset > OutPos || MatchLen > OutSize - OutPos) {
+            return false;
+        }
+
+        // the match may overlap with its own output
+        const unsigned char * pFrom = pOut + OutPos - Offset;
+        unsigned char * pTo = pOut + OutPos;
+
+        if (Offset >= MatchLen) {
+            memcpy (pTo, pFrom, MatchLen);
+        } else {
+            for (size_t i = 0; i < MatchLen; ++i) {
+                pTo [i] = pFrom [i];
+            }
+        }
+
+        OutPos += MatchLen;
+    }
+
+    return OutPos == OutSize;
+}
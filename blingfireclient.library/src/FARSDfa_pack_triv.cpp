@@ -136,6 +136,12 @@ const bool FARSDfa_pack_triv::IsFinal (const int State) const
 }
 
 
+const FAIwMap_pack * FARSDfa_pack_triv::GetIwMap () const
+{
+    return & m_iw2iw;
+}
+
+
 const int FARSDfa_pack_triv::GetDest (const int State, const int Iw) const
 {
     if (0 > State) {
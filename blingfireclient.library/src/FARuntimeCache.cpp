@@ -0,0 +1,317 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FARuntimeCache.h"
+#include "FAFsmConst.h"
+#include "FAUtils_cl.h"
+#include "FALimits.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifdef BLING_FIRE_NOWINDOWS
+#include <sys/stat.h>
+#endif
+
+
+FARuntimeCache::FARuntimeCache () :
+    m_pEntries (NULL),
+    m_Count (0)
+{}
+
+
+void FARuntimeCache::Clear ()
+{
+    m_Img.SetImageDump (NULL);
+    m_pEntries = NULL;
+    m_Count = 0;
+
+    m_Keys.clear ();
+    m_Sections.clear ();
+}
+
+
+inline const unsigned long long FARuntimeCache::
+    GetUInt64 (const unsigned int * pArr)
+{
+    DebugLogAssert (pArr);
+    return pArr [0] | (((unsigned long long) pArr [1]) << 32);
+}
+
+
+const bool FARuntimeCache::GetFileStamp (
+        const char * pFileName,
+        unsigned long long * pSize,
+        unsigned long long * pTime
+    )
+{
+    DebugLogAssert (pFileName && pSize && pTime);
+
+#ifndef BLING_FIRE_NOWINDOWS
+
+    WIN32_FILE_ATTRIBUTE_DATA Data;
+    if (!::GetFileAttributesExA (pFileName, GetFileExInfoStandard, &Data)) {
+        return false;
+    }
+    *pSize = (((unsigned long long) Data.nFileSizeHigh) << 32) | Data.nFileSizeLow;
+    *pTime = (((unsigned long long) Data.ftLastWriteTime.dwHighDateTime) << 32) | \
+        Data.ftLastWriteTime.dwLowDateTime;
+
+#else
+
+    struct stat FileStat;
+    if (0 != ::stat (pFileName, &FileStat)) {
+        return false;
+    }
+    *pSize = (unsigned long long) FileStat.st_size;
+    *pTime = (unsigned long long) FileStat.st_mtime;
+
+#endif
+
+    return true;
+}
+
+
+const unsigned int FARuntimeCache::
+    GetModelCrc (const FALDB * pLdb, const size_t ModelSize)
+{
+    DebugLogAssert (pLdb);
+
+    // the version 2 checksum is made of the CRC32s from the header
+    if (2 == pLdb->GetVersion ()) {
+        return pLdb->GetChecksum (ModelSize);
+    }
+    return 0;
+}
+
+
+const bool FARuntimeCache::Load (
+        const char * pFileName,
+        const char * pModelFileName,
+        const FALDB * pLdb,
+        const size_t ModelSize
+    )
+{
+    LogAssert (pFileName && pModelFileName && pLdb);
+
+    m_Img.SetImageDump (NULL);
+    m_pEntries = NULL;
+    m_Count = 0;
+
+    // see if the file is there, a missing cache is not an error
+    FILE * file = NULL;
+    int res = fopen_s (&file, pFileName, "rb");
+    if (0 != res || NULL == file) {
+        return false;
+    }
+    res = fseek (file, 0, SEEK_END);
+    const long FileSize = ftell (file);
+    fclose (file);
+
+    if (0 != res || FAFsmConst::RTC_HEADER_SIZE > FileSize) {
+        return false;
+    }
+
+    unsigned long long ModelFileSize = 0;
+    unsigned long long ModelTime = 0;
+    if (!GetFileStamp (pModelFileName, &ModelFileSize, &ModelTime)) {
+        return false;
+    }
+
+    m_Img.Load (pFileName, true);
+
+    const unsigned char * pImage = m_Img.GetImageDump ();
+    const size_t Size = m_Img.GetSize ();
+    const unsigned int * pHeader = (const unsigned int *) pImage;
+
+    const int Count = (int) pHeader [2];
+    const size_t DirSize = FAFsmConst::RTC_HEADER_SIZE + \
+        ((size_t) Count * FAFsmConst::RTC_ENTRY_SIZE);
+
+    // check the header, the model stamp and the directory
+    bool fValid = FAFsmConst::RTC_MAGIC == pHeader [0] && \
+        FAFsmConst::RTC_VERSION == pHeader [1] && \
+        0 < Count && Count <= FALimits::MaxLdbDumpCount && \
+        DirSize <= Size && \
+        ModelFileSize == GetUInt64 (pHeader + 6) && \
+        ModelTime == GetUInt64 (pHeader + 8) && \
+        Size == GetUInt64 (pHeader + 10) && \
+        pHeader [4] == GetModelCrc (pLdb, ModelSize);
+
+    const unsigned int * pEntries = (const unsigned int *) \
+        (pImage + FAFsmConst::RTC_HEADER_SIZE);
+    const unsigned int * pEntry = pEntries;
+
+    for (int i = 0; fValid && i < Count; ++i) {
+
+        const unsigned long long Offset = GetUInt64 (pEntry + 2);
+        const unsigned long long SectionSize = GetUInt64 (pEntry + 4);
+
+        fValid = 0 == (Offset % FAFsmConst::RTC_ALIGNMENT) && \
+            DirSize <= Offset && Offset <= Size && SectionSize <= Size - Offset;
+
+        pEntry += FAFsmConst::RTC_ENTRY_SIZE / sizeof (unsigned int);
+    }
+
+    if (!fValid) {
+        m_Img.SetImageDump (NULL);
+        return false;
+    }
+
+    m_pEntries = pEntries;
+    m_Count = Count;
+
+    return true;
+}
+
+
+const unsigned char * FARuntimeCache::Get (const int Key, size_t * pSize) const
+{
+    DebugLogAssert (pSize);
+
+    const unsigned int * pEntry = m_pEntries;
+
+    for (int i = 0; i < m_Count; ++i) {
+
+        if ((unsigned int) Key == pEntry [0]) {
+            *pSize = (size_t) GetUInt64 (pEntry + 4);
+            return m_Img.GetImageDump () + (size_t) GetUInt64 (pEntry + 2);
+        }
+
+        pEntry += FAFsmConst::RTC_ENTRY_SIZE / sizeof (unsigned int);
+    }
+
+    *pSize = 0;
+    return NULL;
+}
+
+
+const size_t FARuntimeCache::GetSize () const
+{
+    return m_pEntries ? m_Img.GetSize () : 0;
+}
+
+
+const bool FARuntimeCache::IsMapped () const
+{
+    return m_Img.IsMapped ();
+}
+
+
+unsigned char * FARuntimeCache::Add (const int Key, const size_t Size)
+{
+    LogAssert (0 < Size);
+    LogAssert ((int) m_Keys.size () < FALimits::MaxLdbDumpCount);
+
+    m_Keys.push_back (Key);
+    m_Sections.push_back (std::vector < unsigned char > (Size));
+
+    return m_Sections.back ().data ();
+}
+
+
+const bool FARuntimeCache::Save (
+        const char * pFileName,
+        const char * pModelFileName,
+        const FALDB * pLdb,
+        const size_t ModelSize
+    ) const
+{
+    LogAssert (pFileName && pModelFileName && pLdb);
+
+    const int Count = (int) m_Keys.size ();
+    if (0 == Count) {
+        return false;
+    }
+
+    unsigned long long ModelFileSize = 0;
+    unsigned long long ModelTime = 0;
+    if (!GetFileStamp (pModelFileName, &ModelFileSize, &ModelTime)) {
+        return false;
+    }
+
+    const size_t Align = FAFsmConst::RTC_ALIGNMENT;
+
+    // compute the layout
+    std::vector < size_t > Offsets (Count);
+    size_t Size = FAFsmConst::RTC_HEADER_SIZE + \
+        ((size_t) Count * FAFsmConst::RTC_ENTRY_SIZE);
+
+    for (int i = 0; i < Count; ++i) {
+        Size = (Size + Align - 1) & ~(Align - 1);
+        Offsets [i] = Size;
+        Size += m_Sections [i].size ();
+    }
+
+    std::vector < unsigned int > Image ((Size + 3) / sizeof (unsigned int), 0);
+    unsigned char * pImage = (unsigned char *) Image.data ();
+    unsigned int * pHeader = Image.data ();
+
+    pHeader [0] = FAFsmConst::RTC_MAGIC;
+    pHeader [1] = FAFsmConst::RTC_VERSION;
+    pHeader [2] = Count;
+    pHeader [4] = GetModelCrc (pLdb, ModelSize);
+    pHeader [6] = (unsigned int) ModelFileSize;
+    pHeader [7] = (unsigned int) (ModelFileSize >> 32);
+    pHeader [8] = (unsigned int) ModelTime;
+    pHeader [9] = (unsigned int) (ModelTime >> 32);
+    pHeader [10] = (unsigned int) Size;
+    pHeader [11] = (unsigned int) (((unsigned long long) Size) >> 32);
+
+    unsigned int * pEntry = (unsigned int *) \
+        (pImage + FAFsmConst::RTC_HEADER_SIZE);
+
+    for (int i = 0; i < Count; ++i) {
+
+        const size_t SectionSize = m_Sections [i].size ();
+
+        pEntry [0] = m_Keys [i];
+        pEntry [2] = (unsigned int) Offsets [i];
+        pEntry [3] = (unsigned int) (((unsigned long long) Offsets [i]) >> 32);
+        pEntry [4] = (unsigned int) SectionSize;
+        pEntry [5] = (unsigned int) (((unsigned long long) SectionSize) >> 32);
+
+        memcpy (pImage + Offsets [i], m_Sections [i].data (), SectionSize);
+
+        pEntry += FAFsmConst::RTC_ENTRY_SIZE / sizeof (unsigned int);
+    }
+
+    pHeader [3] = ::FAGetCrc32 (pImage + FAFsmConst::RTC_HEADER_SIZE, \
+        Size - FAFsmConst::RTC_HEADER_SIZE);
+
+    // write a temporary file and replace the cache with it
+    const std::string TmpFileName = std::string (pFileName) + ".tmp";
+
+    FILE * file = NULL;
+    int res = fopen_s (&file, TmpFileName.c_str (), "wb");
+    if (0 != res || NULL == file) {
+        return false;
+    }
+
+    const size_t ActSize = fwrite (pImage, sizeof (char), Size, file);
+    res = fclose (file);
+
+    bool fReplaced = ActSize == Size && 0 == res;
+
+    // rename does not replace an existing file on Windows
+    if (fReplaced) {
+#ifndef BLING_FIRE_NOWINDOWS
+        fReplaced = 0 != ::MoveFileExA (TmpFileName.c_str (), pFileName, \
+            MOVEFILE_REPLACE_EXISTING);
+#else
+        fReplaced = 0 == rename (TmpFileName.c_str (), pFileName);
+#endif
+    }
+    if (!fReplaced) {
+        remove (TmpFileName.c_str ());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FATokenLattice.h"
+#include "FALimits.h"
+
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+
+
+FATokenLattice::FATokenLattice () :
+    m_InSize (0)
+{}
+
+
+void FATokenLattice::Reset (const int InSize)
+{
+    LogAssert (0 <= InSize && InSize <= FALimits::MaxArrSize);
+
+    m_InSize = InSize;
+
+    m_Froms.clear ();
+    m_Tos.clear ();
+    m_Ids.clear ();
+    m_Scores.clear ();
+    m_EndFrom.clear ();
+    m_ByEnd.clear ();
+}
+
+
+void FATokenLattice::AddArc (
+        const int From,
+        const int To,
+        const int Id,
+        const float Score
+    )
+{
+    DebugLogAssert (0 <= From && From <= To && To < m_InSize);
+    DebugLogAssert (m_Froms.empty () || m_Froms.back () <= From);
+
+    m_Froms.push_back (From);
+    m_Tos.push_back (To);
+    m_Ids.push_back (Id);
+    m_Scores.push_back (Score);
+}
+
+
+void FATokenLattice::Finish ()
+{
+    const int ArcCount = (int) m_Froms.size ();
+    LogAssert (ArcCount <= FALimits::MaxArrSize);
+
+    // the counting sort by the end position, keeps the order of From
+    m_EndFrom.assign (m_InSize + 2, 0);
+
+    for (int i = 0; i < ArcCount; ++i) {
+        m_EndFrom [m_Tos [i] + 2]++;
+    }
+    for (int i = 1; i < m_InSize + 2; ++i) {
+        m_EndFrom [i] += m_EndFrom [i - 1];
+    }
+
+    std::vector < int > Pos (m_EndFrom);
+    m_ByEnd.resize (ArcCount);
+
+    for (int i = 0; i < ArcCount; ++i) {
+        m_ByEnd [Pos [m_Tos [i] + 1]++] = i;
+    }
+}
+
+
+const int FATokenLattice::GetSize () const
+{
+    return m_InSize;
+}
+
+
+const int FATokenLattice::GetArcCount () const
+{
+    return (int) m_Froms.size ();
+}
+
+
+const int FATokenLattice::PutPath (
+        const int * pRevArcs,
+        const int ArcCount,
+        const int * pFroms,
+        const int * pTos,
+        const int * pIds,
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+    )
+{
+    int OutSize = 0;
+
+    for (int i = ArcCount - 1; 0 <= i; --i) {
+
+        const int Arc = pRevArcs [i];
+        const int Id = pIds [Arc];
+
+        // merge the consecutive unknown segments
+        if (-1 == Id && 0 < OutSize && i < ArcCount - 1 && \
+            -1 == pIds [pRevArcs [i + 1]]) {
+            pOut [OutSize - 1] = pTos [Arc];
+            continue;
+        }
+        if (OutSize + 3 > MaxOutSize) {
+            return -1;
+        }
+
+        pOut [OutSize] = -1 == Id ? UnkId : Id;
+        pOut [OutSize + 1] = pFroms [Arc];
+        pOut [OutSize + 2] = pTos [Arc];
+        OutSize += 3;
+    }
+
+    return OutSize;
+}
+
+
+const int FATokenLattice::GetNBest (
+        const int N,
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        __out_ecount(N) int * pPathSizes,
+        const int UnkId
+    ) const
+{
+    DebugLogAssert ((int) m_EndFrom.size () == m_InSize + 2);
+
+    if (0 >= N || 0 == m_InSize) {
+        return 0;
+    }
+
+    LogAssert (pOut && pPathSizes && N <= FALimits::MaxArrSize / (m_InSize + 1));
+
+    // up to N partial paths for every position, the path k of the position i
+    // is at i * N + k, it keeps the score, the last arc and the index of the
+    // previous path, paths are sorted by the score
+    const int Size = (m_InSize + 1) * N;
+    std::vector < double > Scores (Size);
+    std::vector < int > Arcs (Size);
+    std::vector < int > Prevs (Size);
+    std::vector < int > Counts (m_InSize + 1, 0);
+
+    Scores [0] = 0;
+    Arcs [0] = -1;
+    Prevs [0] = -1;
+    Counts [0] = 1;
+
+    // the candidates: <-score, sequence number> and the path index
+    std::vector < std::pair < std::pair < double, int >, int > > Cands;
+    std::vector < std::pair < int, int > > CandPaths;
+
+    for (int i = 1; i <= m_InSize; ++i) {
+
+        Cands.clear ();
+        CandPaths.clear ();
+
+        for (int j = m_EndFrom [i]; j < m_EndFrom [i + 1]; ++j) {
+
+            const int Arc = m_ByEnd [j];
+            const int From = m_Froms [Arc];
+            const double Score = m_Scores [Arc];
+
+            for (int k = 0; k < Counts [From]; ++k) {
+
+                const int Prev = (From * N) + k;
+                const int Seq = (int) Cands.size ();
+
+                Cands.push_back (std::make_pair (std::make_pair ( \
+                    -(Scores [Prev] + Score), Seq), Seq));
+                CandPaths.push_back (std::make_pair (Arc, Prev));
+            }
+        }
+
+        // keep the N best, the earlier ones first for the equal scores,
+        // as in FATokenSegmentationTools_1best_t
+        const int Count = std::min (N, (int) Cands.size ());
+        std::partial_sort (Cands.begin (), Cands.begin () + Count, Cands.end ());
+
+        for (int k = 0; k < Count; ++k) {
+
+            const int Path = (i * N) + k;
+            const int Cand = Cands [k].second;
+
+            Scores [Path] = -Cands [k].first.first;
+            Arcs [Path] = CandPaths [Cand].first;
+            Prevs [Path] = CandPaths [Cand].second;
+        }
+
+        Counts [i] = Count;
+    }
+
+    // output the paths
+    std::vector < int > RevArcs;
+    int OutSize = 0;
+    const int PathCount = Counts [m_InSize];
+
+    for (int k = 0; k < PathCount; ++k) {
+
+        RevArcs.clear ();
+
+        for (int Path = (m_InSize * N) + k; 0 != Path; Path = Prevs [Path]) {
+            RevArcs.push_back (Arcs [Path]);
+        }
+
+        const int PathSize = PutPath (RevArcs.data (), (int) RevArcs.size (), \
+            m_Froms.data (), m_Tos.data (), m_Ids.data (), pOut + OutSize, \
+            MaxOutSize - OutSize, UnkId);
+        if (-1 == PathSize) {
+            return -1;
+        }
+
+        pPathSizes [k] = PathSize;
+        OutSize += PathSize;
+    }
+
+    return PathCount;
+}
+
+
+inline const double FATokenLattice::GetRandom (unsigned int * pSeed)
+{
+    // xorshift32, the state should not be 0
+    unsigned int x = *pSeed;
+    if (0 == x) {
+        x = 0x9e3779b9;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *pSeed = x;
+
+    return (x >> 8) * (1.0 / 16777216.0);
+}
+
+
+const int FATokenLattice::Sample (
+        const int Count,
+        const float Alpha,
+        unsigned int * pSeed,
+        __out_ecount(MaxOutSize) int * pOut,
+        const int MaxOutSize,
+        __out_ecount(Count) int * pPathSizes,
+        const int UnkId
+    ) const
+{
+    DebugLogAssert ((int) m_EndFrom.size () == m_InSize + 2);
+
+    if (0 >= Count || 0 == m_InSize) {
+        return 0;
+    }
+
+    LogAssert (pOut && pPathSizes && pSeed);
+
+    // the forward log-probabilities, -DBL_MAX if the position cannot be reached
+    std::vector < double > Fwd (m_InSize + 1, -DBL_MAX);
+    Fwd [0] = 0;
+
+    for (int i = 1; i <= m_InSize; ++i) {
+
+        double Max = -DBL_MAX;
+
+        for (int j = m_EndFrom [i]; j < m_EndFrom [i + 1]; ++j) {
+            const int Arc = m_ByEnd [j];
+            const double PrevFwd = Fwd [m_Froms [Arc]];
+            if (-DBL_MAX != PrevFwd) {
+                Max = std::max (Max, PrevFwd + (Alpha * m_Scores [Arc]));
+            }
+        }
+        if (-DBL_MAX == Max) {
+            continue;
+        }
+
+        double Sum = 0;
+
+        for (int j = m_EndFrom [i]; j < m_EndFrom [i + 1]; ++j) {
+            const int Arc = m_ByEnd [j];
+            const double PrevFwd = Fwd [m_Froms [Arc]];
+            if (-DBL_MAX != PrevFwd) {
+                Sum += exp (PrevFwd + (Alpha * m_Scores [Arc]) - Max);
+            }
+        }
+
+        Fwd [i] = Max + log (Sum);
+    }
+
+    if (-DBL_MAX == Fwd [m_InSize]) {
+        return 0;
+    }
+
+    // sample the paths backwards
+    std::vector < int > RevArcs;
+    int OutSize = 0;
+
+    for (int k = 0; k < Count; ++k) {
+
+        RevArcs.clear ();
+
+        for (int i = m_InSize; 0 < i;) {
+
+            // pick the arc with the probability of the paths through it
+            const double Random = GetRandom (pSeed);
+            double Sum = 0;
+            int Picked = -1;
+
+            for (int j = m_EndFrom [i]; j < m_EndFrom [i + 1]; ++j) {
+
+                const int Arc = m_ByEnd [j];
+                const double PrevFwd = Fwd [m_Froms [Arc]];
+
+                if (-DBL_MAX != PrevFwd) {
+
+                    Sum += exp (PrevFwd + (Alpha * m_Scores [Arc]) - Fwd [i]);
+                    Picked = Arc;
+
+                    if (Random < Sum) {
+                        break;
+                    }
+                }
+            }
+            DebugLogAssert (-1 != Picked);
+
+            RevArcs.push_back (Picked);
+            i = m_Froms [Picked];
+        }
+
+        const int PathSize = PutPath (RevArcs.data (), (int) RevArcs.size (), \
+            m_Froms.data (), m_Tos.data (), m_Ids.data (), pOut + OutSize, \
+            MaxOutSize - OutSize, UnkId);
+        if (-1 == PathSize) {
+            return -1;
+        }
+
+        pPathSizes [k] = PathSize;
+        OutSize += PathSize;
+    }
+
+    return Count;
+}
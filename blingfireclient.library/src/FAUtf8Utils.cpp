@@ -481,6 +481,87 @@ const int FAArrayToStrUtf8 (
 }
 
 
+const int FAStrUtf16LEToArray (
+        const uint16_t * pStr,
+        const int Len,
+        __out_ecount(MaxSize) int * pArray,
+        __out_ecount_opt(MaxSize) int * pOffsets,
+        const int MaxSize
+    )
+{
+    DebugLogAssert (0 == Len || pStr);
+    DebugLogAssert (pArray);
+
+    int j = 0;
+
+    // check for Byte-Order-Mark (U+FEFF symbol)
+    if (1 <= Len && 0xFEFF == pStr [0]) {
+        j = 1;
+    }
+
+    // process symbol sequence
+    int i = 0;
+    while (j < Len && i < MaxSize) {
+
+        const int Offset = j;
+        int Symbol = pStr [j++];
+
+        if (FAIsSurrogate (Symbol)) {
+            // high surrogate must be followed by the low one
+            if (0xDC00 <= Symbol || j >= Len || 0xDC00 != (0xFC00 & pStr [j])) {
+                Symbol = 0xFFFD;
+            } else {
+                Symbol = 0x10000 + ((Symbol & 0x3FF) << 10) + (pStr [j++] & 0x3FF);
+            }
+        }
+
+        pArray [i] = Symbol;
+        if (pOffsets) {
+            pOffsets [i] = Offset;
+        }
+        i++;
+    }
+
+    return i;
+}
+
+
+const int FAArrayToStrUtf16LE (
+        const int * pArray,
+        const int Size,
+        __out_ecount(MaxStrSize) uint16_t * pStr,
+        const int MaxStrSize
+    )
+{
+    DebugLogAssert (pStr);
+    DebugLogAssert (pArray && 0 < Size);
+
+    int j = 0;
+
+    for (int i = 0; i < Size; ++i) {
+
+        int Symbol = pArray [i];
+
+        if (0xFFFF >= (unsigned int) Symbol && !FAIsSurrogate (Symbol) && j < MaxStrSize) {
+
+            pStr [j++] = (uint16_t) Symbol;
+
+        } else if (0x10FFFF >= (unsigned int) Symbol && 0xFFFF < Symbol && j + 1 < MaxStrSize) {
+
+            Symbol -= 0x10000;
+            pStr [j++] = (uint16_t) (0xD800 | (Symbol >> 10));
+            pStr [j++] = (uint16_t) (0xDC00 | (Symbol & 0x3FF));
+
+        } else {
+            // invalid input sequence
+            return -1;
+        }
+    }
+
+    return j;
+}
+
+
 const bool FAIsUtf8Enc (const char * pEncName)
 {
     bool IsUtf8 = false;
@@ -9,8 +9,10 @@
 #include "FAUtils_cl.h"
 #include "FARSDfaCA.h"
 #include "FARSNfaCA.h"
+#include "FAGetIWsCA.h"
 
 #include <algorithm>
+#include <vector>
 
 
 /// returns new size of the array
@@ -143,11 +145,123 @@ static unsigned int __fa_crc32_table__ [256] = {
 };
 
 
+const bool FAIsDelimBounded (
+        const FARSDfaCA * pDfa,
+        const FAGetIWsCA * pIws,
+        const int Delim
+    )
+{
+    if (!pDfa || !pIws) {
+        return false;
+    }
+
+    const int Initial = pDfa->GetInitial ();
+    const int DelimDst = pDfa->GetDest (Initial, Delim);
+
+    if (-1 == DelimDst || !pDfa->IsFinal (DelimDst)) {
+        return false;
+    }
+
+    // traverse all the states reachable from the initial, states are small
+    // non-negative numbers (offsets in the automaton image) so a bit per state
+    // is cheaper than a hash set
+    std::vector < int > Stack;
+    std::vector < bool > Visited (Initial + 1);
+    std::vector < int > Iws (1024);
+
+    Stack.push_back (Initial);
+    Visited [Initial] = true;
+
+    while (!Stack.empty ()) {
+
+        const int State = Stack.back ();
+        Stack.pop_back ();
+
+        int IwCount = pIws->GetIWs (State, Iws.data (), (int) Iws.size ());
+        if ((int) Iws.size () < IwCount) {
+            Iws.resize (IwCount);
+            IwCount = pIws->GetIWs (State, Iws.data (), IwCount);
+        }
+
+        for (int i = 0; i < IwCount; ++i) {
+
+            const int Iw = Iws [i];
+
+            if (Delim == Iw && Initial != State) {
+                return false;
+            }
+
+            const int Dst = pDfa->GetDest (State, Iw);
+
+            if (0 > Dst) {
+                continue;
+            }
+            if ((int) Visited.size () <= Dst) {
+                Visited.resize (2 * (size_t) Dst + 1);
+            }
+            if (!Visited [Dst]) {
+                Visited [Dst] = true;
+                Stack.push_back (Dst);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+// the slicing-by-8 tables, the table k gives the CRC of a byte followed
+// by k zero bytes, the table 0 is __fa_crc32_table__
+struct FACrc32Tables {
+
+    unsigned int m_Table [8][256];
+
+    FACrc32Tables ()
+    {
+        for (int i = 0; i < 256; ++i) {
+
+            unsigned int crc = __fa_crc32_table__ [i];
+            m_Table [0][i] = crc;
+
+            for (int k = 1; k < 8; ++k) {
+                crc = __fa_crc32_table__ [crc & 0xFF] ^ (crc >> 8);
+                m_Table [k][i] = crc;
+            }
+        }
+    }
+};
+
+
 const unsigned int FAGetCrc32 (const unsigned char *buf, size_t size, unsigned int crc)
 {
+    static const FACrc32Tables Tables;
+    const unsigned int (*t) [256] = Tables.m_Table;
+
     const unsigned char *p = buf;
     crc = crc ^ ~0U;
 
+    // align the input for the 4-byte reads
+    while (size && 0 != (((size_t) p) & 3))
+    {
+        crc = __fa_crc32_table__ [(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+
+    // process 8 bytes at a time, the input is little endian
+    while (size >= 8)
+    {
+        const unsigned int lo = crc ^ *((const unsigned int *) p);
+        const unsigned int hi = *((const unsigned int *) (p + 4));
+
+        crc = t [7][lo & 0xFF] ^ t [6][(lo >> 8) & 0xFF] ^
+              t [5][(lo >> 16) & 0xFF] ^ t [4][lo >> 24] ^
+              t [3][hi & 0xFF] ^ t [2][(hi >> 8) & 0xFF] ^
+              t [1][(hi >> 16) & 0xFF] ^ t [0][hi >> 24];
+
+        p += 8;
+        size -= 8;
+    }
+
     while (size--)
     {
         crc = __fa_crc32_table__ [(crc ^ *p++) & 0xFF] ^ (crc >> 8);
@@ -41,7 +41,8 @@ FAWbdConfKeeper::FAWbdConfKeeper () :
     m_pActDataCA (NULL),
     m_pFn2Ini (NULL),
     m_Fn2IniSize (0),
-    m_MaxTokenLength (FALimits::MaxWordLen)
+    m_MaxTokenLength (FALimits::MaxWordLen),
+    m_Utf8Input (false)
 {}
 
 
@@ -90,6 +91,11 @@ void FAWbdConfKeeper::Initialize (const FALDB * pLDB, const int * pValues, const
             m_IgnoreCase = true;
             break;
         }
+        case FAFsmConst::PARAM_UTF8_INPUT:
+        {
+            m_Utf8Input = true;
+            break;
+        }
         case FAFsmConst::PARAM_FSM_TYPE:
         {
             FsmType = pValues [++i];
@@ -363,6 +369,8 @@ void FAWbdConfKeeper::Clear ()
     m_MaxDepth = DefMaxDepth;
 
     m_MaxTokenLength = FALimits::MaxWordLen;
+
+    m_Utf8Input = false;
 }
 
 
@@ -476,6 +484,17 @@ void FAWbdConfKeeper::SetMaxDepth (const int MaxRecDepth)
     LogAssert (0 <= m_MaxDepth);
 }
 
+void FAWbdConfKeeper::SetMaxTokenLength (const int MaxTokenLength)
+{
+    m_MaxTokenLength = MaxTokenLength;
+    LogAssert (0 <= m_MaxTokenLength);
+}
+
+void FAWbdConfKeeper::SetUtf8Input (const bool Utf8Input)
+{
+    m_Utf8Input = Utf8Input;
+}
+
 const FAMultiMapCA * FAWbdConfKeeper::GetCharMap () const
 {
     return m_pCharMap;
@@ -490,3 +509,13 @@ const int FAWbdConfKeeper::GetMaxTokenLength () const
 {
     return m_MaxTokenLength;
 }
+
+const bool FAWbdConfKeeper::GetUtf8Input () const
+{
+    return m_Utf8Input;
+}
+
+const FAIwMap_pack * FAWbdConfKeeper::GetIwMap () const
+{
+    return m_pRsDfa ? m_pRsDfa->GetIwMap () : NULL;
+}
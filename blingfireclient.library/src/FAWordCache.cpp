@@ -0,0 +1,256 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-client_src_pch.h"
+#include "FAConfig.h"
+#include "FAWordCache.h"
+#include "FALimits.h"
+
+
+FAWordCache::FAWordCache () :
+    m_Mask (0),
+    m_MaxCount (0)
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        m_Shards [i]._pEntries = NULL;
+        m_Shards [i]._HitCount.store (0);
+        m_Shards [i]._MissCount.store (0);
+    }
+}
+
+
+FAWordCache::~FAWordCache ()
+{
+    FAWordCache::Clear ();
+}
+
+
+void FAWordCache::SetMaxCount (const int MaxCount)
+{
+    FAWordCache::Clear ();
+
+    LogAssert (0 <= MaxCount && MaxCount <= FALimits::MaxArrSize);
+
+    if (0 == MaxCount) {
+        return;
+    }
+
+    // the smallest power of 2, which makes the shards keep at least MaxCount entries
+    unsigned int ShardSize = 1;
+    while (ShardSize * ShardCount < (unsigned int) MaxCount) {
+        ShardSize <<= 1;
+    }
+
+    for (int i = 0; i < ShardCount; ++i) {
+
+        _TEntry * pEntries = NEW _TEntry [ShardSize];
+        LogAssert (pEntries);
+
+        for (unsigned int j = 0; j < ShardSize; ++j) {
+            pEntries [j]._Seq.store (0, std::memory_order_relaxed);
+            for (int k = 0; k < DataSize; ++k) {
+                pEntries [j]._Data [k].store (0, std::memory_order_relaxed);
+            }
+        }
+
+        m_Shards [i]._pEntries = pEntries;
+    }
+
+    m_Mask = ShardSize - 1;
+    m_MaxCount = ShardSize * ShardCount;
+}
+
+
+const int FAWordCache::GetMaxCount () const
+{
+    return m_MaxCount;
+}
+
+
+const size_t FAWordCache::GetMemorySize () const
+{
+    return (size_t) m_MaxCount * sizeof (_TEntry);
+}
+
+
+inline const unsigned int FAWordCache::
+    GetHash (const int * pWord, const int WordLen, const int Param)
+{
+    unsigned int Hash = 2166136261u ^ (unsigned int) Param;
+
+    for (int i = 0; i < WordLen; ++i) {
+        Hash = (Hash ^ (unsigned int) pWord [i]) * 16777619u;
+    }
+
+    // mix the bits, the upper ones select the shard
+    Hash ^= Hash >> 15;
+    Hash *= 0x2c1b3c6du;
+    Hash ^= Hash >> 12;
+    Hash *= 0x297a2d39u;
+    Hash ^= Hash >> 15;
+
+    return Hash;
+}
+
+
+const int FAWordCache::
+    Get (
+            const int * pWord,
+            const int WordLen,
+            const int Param,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize
+        ) const
+{
+    DebugLogAssert (pWord && 0 < WordLen);
+
+    if (0 == m_MaxCount) {
+        return -1;
+    }
+
+    const unsigned int Hash = GetHash (pWord, WordLen, Param);
+    _TShard * pShard = m_Shards + (Hash >> 28);
+
+    if (MaxWordLen < WordLen) {
+        pShard->_MissCount.fetch_add (1, std::memory_order_relaxed);
+        return -1;
+    }
+
+    const _TEntry * pEntry = pShard->_pEntries + (Hash & m_Mask);
+    const std::atomic < int > * pData = pEntry->_Data;
+
+    const unsigned int Seq = pEntry->_Seq.load (std::memory_order_acquire);
+    int OutSize = -1;
+
+    if (0 == (Seq & 1) && \
+        (int) Hash == pData [OfsHash].load (std::memory_order_relaxed) && \
+        Param == pData [OfsParam].load (std::memory_order_relaxed)) {
+
+        const int Sizes = pData [OfsSizes].load (std::memory_order_relaxed);
+        const int SegCount = Sizes & 0xffff;
+
+        if (WordLen == (Sizes >> 16) && SegCount * 3 <= MaxOutSize) {
+
+            int i = 0;
+            for (; i < WordLen; ++i) {
+                if (pWord [i] != pData [OfsWord + i].load (std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            if (WordLen == i) {
+                for (int j = 0; j < SegCount; ++j) {
+                    const int Span = pData [OfsSpans + j].load (std::memory_order_relaxed);
+                    pOut [3 * j] = pData [OfsIds + j].load (std::memory_order_relaxed);
+                    pOut [3 * j + 1] = Span >> 16;
+                    pOut [3 * j + 2] = Span & 0xffff;
+                }
+                // see whether the entry was not changed while it was read
+                std::atomic_thread_fence (std::memory_order_acquire);
+                if (Seq == pEntry->_Seq.load (std::memory_order_relaxed)) {
+                    OutSize = SegCount * 3;
+                }
+            }
+        }
+    }
+
+    if (-1 != OutSize) {
+        pShard->_HitCount.fetch_add (1, std::memory_order_relaxed);
+    } else {
+        pShard->_MissCount.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    return OutSize;
+}
+
+
+void FAWordCache::
+    Add (
+            const int * pWord,
+            const int WordLen,
+            const int Param,
+            const int * pRes,
+            const int ResSize
+        ) const
+{
+    DebugLogAssert (pWord && 0 < WordLen);
+    DebugLogAssert (pRes && 0 < ResSize && 0 == ResSize % 3);
+
+    if (0 == m_MaxCount || MaxWordLen < WordLen || 3 * MaxSegCount < ResSize) {
+        return;
+    }
+
+    const unsigned int Hash = GetHash (pWord, WordLen, Param);
+    _TShard * pShard = m_Shards + (Hash >> 28);
+
+    // don't wait for other writers
+    std::unique_lock < std::mutex > Lock (pShard->_Lock, std::try_to_lock);
+    if (!Lock.owns_lock ()) {
+        return;
+    }
+
+    _TEntry * pEntry = pShard->_pEntries + (Hash & m_Mask);
+    std::atomic < int > * pData = pEntry->_Data;
+
+    // make the entry invalid for the readers
+    const unsigned int Seq = pEntry->_Seq.load (std::memory_order_relaxed);
+    pEntry->_Seq.store (Seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    const int SegCount = ResSize / 3;
+
+    pData [OfsHash].store ((int) Hash, std::memory_order_relaxed);
+    pData [OfsParam].store (Param, std::memory_order_relaxed);
+    pData [OfsSizes].store ((WordLen << 16) | SegCount, std::memory_order_relaxed);
+
+    for (int i = 0; i < WordLen; ++i) {
+        pData [OfsWord + i].store (pWord [i], std::memory_order_relaxed);
+    }
+    for (int j = 0; j < SegCount; ++j) {
+        const int From = pRes [3 * j + 1];
+        const int To = pRes [3 * j + 2];
+        DebugLogAssert (0 <= From && From <= To && To < WordLen);
+        pData [OfsIds + j].store (pRes [3 * j], std::memory_order_relaxed);
+        pData [OfsSpans + j].store ((From << 16) | To, std::memory_order_relaxed);
+    }
+
+    // make the entry valid
+    pEntry->_Seq.store (Seq + 2, std::memory_order_release);
+}
+
+
+void FAWordCache::GetCounts (long long * pHitCount, long long * pMissCount) const
+{
+    long long HitCount = 0;
+    long long MissCount = 0;
+
+    for (int i = 0; i < ShardCount; ++i) {
+        HitCount += m_Shards [i]._HitCount.load (std::memory_order_relaxed);
+        MissCount += m_Shards [i]._MissCount.load (std::memory_order_relaxed);
+    }
+
+    if (pHitCount) {
+        *pHitCount = HitCount;
+    }
+    if (pMissCount) {
+        *pMissCount = MissCount;
+    }
+}
+
+
+void FAWordCache::Clear ()
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        if (m_Shards [i]._pEntries) {
+            delete [] m_Shards [i]._pEntries;
+            m_Shards [i]._pEntries = NULL;
+        }
+        m_Shards [i]._HitCount.store (0);
+        m_Shards [i]._MissCount.store (0);
+    }
+
+    m_Mask = 0;
+    m_MaxCount = 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_DATPACK_H_
+#define _FA_DATPACK_H_
+
+#include "FAConfig.h"
+#include "FAArray_cont_t.h"
+
+class FAAllocatorA;
+class FARSDfaA;
+class FAMealyDfaA;
+class FAMultiMapA;
+
+///
+/// Builds a double-array trie image of a dictionary, from its Mealy DFA
+/// based MPH (word --> Key) and its Key --> [ Id, Score ] map, e.g. the
+/// pos-dict of the segmentation models. See FADat_pack for the runtime.
+///
+/// Notes:
+///
+/// 1. The acyclic automaton is unfolded into a trie, the trie node of a word
+///    is final if the word is in the dictionary, the word's Key is the sum of
+///    the Ows along its path, as in the automaton.
+///
+/// 2. The Iws are mapped into codes, the more frequent Iws get the smaller
+///    codes, code 0 is reserved for the Iws not in the alphabet and code 1
+///    for the terminal unit of a final node.
+///
+/// 3. The children of the node at position s are at Base[s] + Code and have
+///    Check == s, a final node also has a terminal unit at Base[s] + 1 which
+///    keeps the Key. The Ids and the Scores are stored by the Key.
+///
+/// 4. The trie does not share the suffixes as the minimal automaton does, so
+///    it is several times bigger, e.g. 444 KB vs 76 KB for the 8k pieces of
+///    ldbsrc/bpe_example, and the automaton is kept in the LDB as well, see
+///    ldbsrc/bpe_example_dat/README.TXT.
+///
+/// Dump format:
+///   <MaxIw>                       - int, the biggest Iw of the alphabet
+///   <DirectCount>                 - int, Iws [0, DirectCount) are mapped
+///                                   by the Direct array
+///   <BlockCount>                  - int, the number of 256-code blocks for
+///                                   the other Iws
+///   <UnitCount>                   - int, the number of units
+///   <KeyCount>                    - int, the number of Keys
+///   <Direct> [DirectCount]        - ushort, Iw --> Code
+///   <Top> [(MaxIw >> 8) + 1 - (DirectCount >> 8)]
+///                                 - int, Iw >> 8 --> Block offset
+///   <Blocks> [BlockCount * 256]   - ushort, Block offset + (Iw & 0xff) --> Code
+///   <Units> [UnitCount]           - <Base << 1 | IsFinal, Check> int pairs,
+///                                   a terminal unit keeps <Key, Check>
+///   <Terms> [KeyCount]            - <Id, Score> pairs, int and float
+///   (ushort arrays are padded to the 4 bytes boundary)
+///
+
+class FADatPack {
+
+public:
+    FADatPack (FAAllocatorA * pAlloc);
+
+public:
+    /// sets up the dictionary automaton
+    void SetDfa (const FARSDfaA * pDfa);
+    /// sets up the automaton Ows
+    void SetSigma (const FAMealyDfaA * pSigma);
+    /// sets up Key --> [ Id, Score ] map, the Score is optional
+    void SetI2Info (const FAMultiMapA * pI2Info);
+    /// builds the dump
+    void Process ();
+    /// returns the dump
+    const int GetDump (const unsigned char ** ppDump) const;
+
+private:
+    // unfolds the automaton into the trie
+    void BuildTrie ();
+    // assigns the codes to the Iws
+    void BuildCodes ();
+    // places the trie nodes into the units
+    void BuildUnits ();
+    // returns true if all the Base + Code units are free
+    inline const bool IsFree (const int Base, const int * pCodes, const int Count) const;
+    // makes sure the unit Pos exists, the new units are free
+    inline void Ensure (const int Pos);
+    // removes the unit Pos from the list of the free units
+    inline void Take (const int Pos);
+    // builds the dump
+    void BuildDump ();
+
+private:
+    enum {
+        CodeUnknown = 0,
+        CodeTerm = 1,
+        CodeFirst = 2,
+        MaxCode = 0xffff,
+        BlockSize = 256,
+        MaxDirectCount = 0x10000,
+    };
+
+    const FARSDfaA * m_pDfa;
+    const FAMealyDfaA * m_pSigma;
+    const FAMultiMapA * m_pI2Info;
+    FAAllocatorA * m_pAlloc;
+
+    // the automaton transitions, the arcs of State are
+    // [m_StateFrom [State], m_StateFrom [State + 1]) <Iw, Dst, Ow> triplets
+    FAArray_cont_t < int > m_StateFrom;
+    FAArray_cont_t < int > m_Arcs;
+
+    // the trie nodes, the children of Node are consecutive from
+    // [m_ChildFrom [Node], m_ChildFrom [Node + 1])
+    FAArray_cont_t < int > m_ChildFrom;
+    FAArray_cont_t < int > m_NodeIws;
+    FAArray_cont_t < int > m_NodeKeys;
+
+    // Iw --> Code
+    FAArray_cont_t < int > m_Iw2Code;
+    int m_MaxIw;
+
+    // the units, <Base << 1 | IsFinal, Check> pairs
+    FAArray_cont_t < int > m_Units;
+    // the unit of every trie node
+    FAArray_cont_t < int > m_NodePos;
+    // the doubly-linked list of the free units, -1 terminated, so the
+    // search for a Base does not go through the used ones
+    FAArray_cont_t < int > m_NextFree;
+    FAArray_cont_t < int > m_PrevFree;
+    int m_FirstFree;
+    int m_LastFree;
+
+    // the resulting dump
+    FAArray_cont_t < unsigned char > m_dump;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_LZCOMPRESS_H_
+#define _FA_LZCOMPRESS_H_
+
+#include "FAConfig.h"
+#include "FAArray_cont_t.h"
+
+class FAAllocatorA;
+
+///
+/// Compresses the LDB sections, see FALzDecompress for the format and the
+/// runtime.
+///
+/// The matches are looked up with the hash chains of 4-byte prefixes within
+/// the 64K window, the longest one of the first MaxChainLength candidates
+/// is taken.
+///
+
+class FALzCompress {
+
+public:
+    FALzCompress (FAAllocatorA * pAlloc);
+
+public:
+    /// compresses the section of InSize bytes, appends the compressed
+    /// section (the header, the block sizes and the blocks) to the pOut
+    void Process (
+            const unsigned char * pIn,
+            const size_t InSize,
+            FAArray_cont_t < unsigned char > * pOut
+        );
+
+private:
+    // compresses one block, appends it to the pOut, returns its size
+    const unsigned int CompressBlock (
+            const unsigned char * pIn,
+            const int InSize,
+            FAArray_cont_t < unsigned char > * pOut
+        );
+
+    // appends a sequence, MatchLen == 0 for the last one
+    inline static void PutSequence (
+            const unsigned char * pLits,
+            const int LitCount,
+            const int Offset,
+            const int MatchLen,
+            FAArray_cont_t < unsigned char > * pOut
+        );
+
+    // appends the rest of a length, as 255-bytes and the rest
+    inline static void PutLength (
+            int Length,
+            FAArray_cont_t < unsigned char > * pOut
+        );
+
+    // appends the value as little endian bytes
+    inline static void PutUInt32 (
+            const unsigned int Value,
+            FAArray_cont_t < unsigned char > * pOut
+        );
+
+private:
+    enum {
+        MinMatchLength = 4,
+        MaxOffset = 0xffff,
+        HashBits = 16,
+        MaxChainLength = 64,
+    };
+
+    // the last position of each hash value, -1 if none
+    FAArray_cont_t < int > m_Head;
+    // the previous position with the same hash value, -1 if none
+    FAArray_cont_t < int > m_Prev;
+};
+
+#endif
@@ -18,6 +18,11 @@ class FAAllocatorA;
 /// This class merges together memory dumps into a single file and adds
 /// array of entry points.
 ///
+/// By default the LDB bin version 2 is written: the header, the section
+/// directory with 64-bit offsets, sizes and CRC32s and the 64-byte aligned
+/// sections, see FALDB for the details. The version 1 is written if asked.
+/// The version 2 sections can be compressed, see FALzCompress.
+///
 
 class FAMergeDumps {
 
@@ -26,6 +31,10 @@ public:
     ~FAMergeDumps ();
 
 public:
+    // sets up the output format version, 1 or 2 (the default)
+    void SetVersion (const int Version);
+    // sets up whether the version 2 sections are compressed, false by default
+    void SetCompress (const bool fCompress);
     // loads in one more dump file
     void AddDumpFile (const char * pFileName);
     // adds validation data and stores merged dump into an output stream
@@ -36,9 +45,17 @@ public:
 private:
     // adds a dump with BIN file validation data
     void AddValidationDump ();
+    // stores the dumps in the version 1 format
+    void SaveV1 (std::ostream * pOs);
+    // stores the dumps in the version 2 format
+    void SaveV2 (std::ostream * pOs);
+    // writes a 64-bit value as two little endian ints
+    static inline void PutUInt64 (unsigned int * pArr, const unsigned long long Val);
 
 private:
     FAAllocatorA * m_pAlloc;
+    int m_Version;
+    bool m_fCompress;
     FAArray_cont_t < unsigned char * > m_dumps;
     FAArray_cont_t < int > m_sizes;
 };
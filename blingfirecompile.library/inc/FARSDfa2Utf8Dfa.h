@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#ifndef _FA_RSDFA2UTF8DFA_H_
+#define _FA_RSDFA2UTF8DFA_H_
+
+#include "FAConfig.h"
+#include "FAArray_cont_t.h"
+#include "FAChain2Num_hash.h"
+
+class FAAllocatorA;
+class FARSDfaA;
+class FAState2OwA;
+class FAMapA;
+
+///
+/// Converts (min) Rabin-Scott or Moore Dfa reading Unicode code points into
+/// an equivalent Dfa reading UTF-8 bytes.
+///
+/// Notes:
+///
+/// 1. Every code point transition is replaced with a sequence of byte
+///    transitions thru the new intermediate states, the intermediate states
+///    are shared if they have identical transitions. The original states
+///    keep their numbers, their finality and their Ows.
+///
+/// 2. Special Iws (IW_ANY, IW_L_ANCHOR, IW_R_ANCHOR) are kept as-is, the
+///    state reachable from the initial by IW_R_ANCHOR keeps function ids
+///    as-is, see FAWbdConfKeeper::CalcFnIniStates.
+///
+/// 3. The IW_ANY transition is also expanded for all code points which do not
+///    have explicit transitions, so the result does not need the IW_ANY
+///    fall-back for a valid UTF-8 input. Code points below IW_EPSILON are not
+///    expanded, since they are never passed to the automaton.
+///
+/// 4. If the New2Old Iw map is specified (see fa_fsm2fsm_pack --iw-map) then
+///    the input automaton reads Old Iws and code points are mapped into them.
+///
+
+class FARSDfa2Utf8Dfa {
+
+public:
+    FARSDfa2Utf8Dfa (FAAllocatorA * pAlloc);
+
+public:
+    // input automaton
+    void SetInDfa (const FARSDfaA * pInDfa);
+    // optional input State -> Ow map
+    void SetInState2Ow (const FAState2OwA * pInState2Ow);
+    // optional New -> Old Iw map, code point -> input automaton Iw
+    void SetIwMap (const FAMapA * pNew2Old);
+    // output automaton
+    void SetOutDfa (FARSDfaA * pOutDfa);
+    // output State -> Ow map, should be set if the input map is set
+    void SetOutState2Ow (FAState2OwA * pOutState2Ow);
+    // makes convertion
+    void Process ();
+    // returns object into the initial state
+    void Clear ();
+
+private:
+    enum {
+        MaxCodePoint = 0x10FFFF,
+        MinSurrogate = 0xD800,
+        MaxSurrogate = 0xDFFF,
+        MaxFunctionId = 65536,
+        MaxUtf8Len = 4,
+    };
+    // code point range of the input Iw
+    struct _TIwRange {
+        int m_Iw;
+        int m_Lo;
+        int m_Hi;
+    };
+    // code point range with a destination state
+    struct _TDstRange {
+        int m_Lo;
+        int m_Hi;
+        int m_Dst;
+    };
+    // UTF-8 byte ranges for a sequence of m_Len bytes
+    struct _TBox {
+        int m_Len;
+        int m_Lo [MaxUtf8Len];
+        int m_Hi [MaxUtf8Len];
+        int m_Dst;
+    };
+
+private:
+    // builds code point ranges for each Iw of the input automaton
+    void BuildIwRanges ();
+    // returns the destination state for a code point or a special Iw
+    inline const int GetInDest (const int State, const int Iw) const;
+    // converts one state of the input automaton
+    void ProcessState (const int State);
+    // fills in m_dst_ranges for the given state
+    void CalcDstRanges (const int State);
+    // converts code point range into a set of UTF-8 boxes
+    void AddBoxes (const int Lo, const int Hi, const int Dst);
+    // calculates arcs of the given level for the boxes [Begin, End)
+    void BuildLevel (const int Begin, const int End, const int Level);
+    // returns state for the given intermediate arcs
+    const int GetNodeState (const int * pArcs, const int Count);
+    // adds the intermediate states into the output automaton
+    void AddNodes ();
+
+    inline static const bool IwRangeLess (
+            const _TIwRange & r1,
+            const _TIwRange & r2
+        );
+    inline static const bool DstRangeLess (
+            const _TDstRange & r1,
+            const _TDstRange & r2
+        );
+
+private:
+    const FARSDfaA * m_pInDfa;
+    const FAState2OwA * m_pInState2Ow;
+    const FAMapA * m_pNew2Old;
+    FARSDfaA * m_pOutDfa;
+    FAState2OwA * m_pOutState2Ow;
+    // the maximum state of the input automaton
+    int m_MaxState;
+    // the state with function id transitions
+    int m_StateR;
+    // input Iw -> code point ranges, sorted by Iw
+    FAArray_cont_t < _TIwRange > m_iw_ranges;
+    // code point ranges of the current state
+    FAArray_cont_t < _TDstRange > m_tmp_ranges;
+    FAArray_cont_t < _TDstRange > m_dst_ranges;
+    // UTF-8 boxes of the current state
+    FAArray_cont_t < _TBox > m_boxes;
+    // arcs of the current state for each level, < Iw, Dst > pairs
+    FAArray_cont_t < int > m_arcs [MaxUtf8Len];
+    // intermediate states, their arcs are stored as < Iw, Dst > pairs
+    FAChain2Num_hash m_nodes;
+};
+
+#endif
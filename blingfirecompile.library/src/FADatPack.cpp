@@ -0,0 +1,516 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-compile_src_pch.h"
+#include "FAConfig.h"
+#include "FADatPack.h"
+#include "FAAllocatorA.h"
+#include "FARSDfaA.h"
+#include "FAMealyDfaA.h"
+#include "FAMultiMapA.h"
+#include "FAException.h"
+
+#include <algorithm>
+#include <vector>
+
+
+FADatPack::FADatPack (FAAllocatorA * pAlloc) :
+    m_pDfa (NULL),
+    m_pSigma (NULL),
+    m_pI2Info (NULL),
+    m_pAlloc (pAlloc),
+    m_MaxIw (-1),
+    m_FirstFree (-1),
+    m_LastFree (-1)
+{
+    m_StateFrom.SetAllocator (pAlloc);
+    m_StateFrom.Create ();
+
+    m_Arcs.SetAllocator (pAlloc);
+    m_Arcs.Create ();
+
+    m_ChildFrom.SetAllocator (pAlloc);
+    m_ChildFrom.Create ();
+
+    m_NodeIws.SetAllocator (pAlloc);
+    m_NodeIws.Create ();
+
+    m_NodeKeys.SetAllocator (pAlloc);
+    m_NodeKeys.Create ();
+
+    m_Iw2Code.SetAllocator (pAlloc);
+    m_Iw2Code.Create ();
+
+    m_Units.SetAllocator (pAlloc);
+    m_Units.Create ();
+
+    m_NodePos.SetAllocator (pAlloc);
+    m_NodePos.Create ();
+
+    m_NextFree.SetAllocator (pAlloc);
+    m_NextFree.Create ();
+
+    m_PrevFree.SetAllocator (pAlloc);
+    m_PrevFree.Create ();
+
+    m_dump.SetAllocator (pAlloc);
+    m_dump.Create ();
+}
+
+
+void FADatPack::SetDfa (const FARSDfaA * pDfa)
+{
+    m_pDfa = pDfa;
+}
+
+
+void FADatPack::SetSigma (const FAMealyDfaA * pSigma)
+{
+    m_pSigma = pSigma;
+}
+
+
+void FADatPack::SetI2Info (const FAMultiMapA * pI2Info)
+{
+    m_pI2Info = pI2Info;
+}
+
+
+void FADatPack::BuildTrie ()
+{
+    DebugLogAssert (m_pDfa && m_pSigma);
+
+    const int * pIws = NULL;
+    const int IwCount = m_pDfa->GetIWs (&pIws);
+    const int MaxState = m_pDfa->GetMaxState ();
+
+    FAAssert (0 < IwCount && pIws && 0 <= MaxState, FAMsg::InvalidParameters);
+
+    // get the transitions of every state, once
+    m_StateFrom.resize (MaxState + 2);
+    m_Arcs.resize (0);
+
+    for (int State = 0; State <= MaxState; ++State) {
+
+        m_StateFrom [State] = m_Arcs.size ();
+
+        for (int i = 0; i < IwCount; ++i) {
+
+            const int Iw = pIws [i];
+            const int Dst = m_pDfa->GetDest (State, Iw);
+
+            if (0 <= Dst) {
+                const int Ow = m_pSigma->GetOw (State, Iw);
+                m_Arcs.push_back (Iw);
+                m_Arcs.push_back (Dst);
+                m_Arcs.push_back (0 < Ow ? Ow : 0);
+            }
+        }
+    }
+    m_StateFrom [MaxState + 1] = m_Arcs.size ();
+
+    // unfold the automaton breadth-first, so the children of every node
+    // have consecutive numbers
+    FAArray_cont_t < int > States;
+    States.SetAllocator (m_pAlloc);
+    States.Create ();
+
+    FAArray_cont_t < int > SumOws;
+    SumOws.SetAllocator (m_pAlloc);
+    SumOws.Create ();
+
+    m_ChildFrom.resize (0);
+    m_NodeIws.resize (0);
+    m_NodeKeys.resize (0);
+
+    States.push_back (m_pDfa->GetInitial ());
+    SumOws.push_back (0);
+    m_NodeIws.push_back (-1);
+
+    for (unsigned int Node = 0; Node < States.size (); ++Node) {
+
+        const int State = States [Node];
+        const int SumOw = SumOws [Node];
+
+        m_ChildFrom.push_back (States.size ());
+        m_NodeKeys.push_back (m_pDfa->IsFinal (State) ? SumOw : -1);
+
+        for (int i = m_StateFrom [State]; i < m_StateFrom [State + 1]; i += 3) {
+
+            States.push_back (m_Arcs [i + 1]);
+            SumOws.push_back (SumOw + m_Arcs [i + 2]);
+            m_NodeIws.push_back (m_Arcs [i]);
+        }
+
+        // the automaton should be acyclic
+        FAAssert (States.size () < 0x10000000, FAMsg::InternalError);
+    }
+    m_ChildFrom.push_back (States.size ());
+}
+
+
+void FADatPack::BuildCodes ()
+{
+    const int NodeCount = m_NodeIws.size ();
+
+    m_MaxIw = -1;
+    for (int Node = 1; Node < NodeCount; ++Node) {
+        if (m_MaxIw < m_NodeIws [Node]) {
+            m_MaxIw = m_NodeIws [Node];
+        }
+    }
+    FAAssert (0 <= m_MaxIw, FAMsg::InvalidParameters);
+
+    // count the Iws of the trie
+    FAArray_cont_t < int > Freqs;
+    Freqs.SetAllocator (m_pAlloc);
+    Freqs.Create ();
+    Freqs.resize (m_MaxIw + 1);
+    memset (Freqs.begin (), 0, sizeof (int) * (m_MaxIw + 1));
+
+    for (int Node = 1; Node < NodeCount; ++Node) {
+        Freqs [m_NodeIws [Node]]++;
+    }
+
+    // sort the alphabet by the frequency
+    std::vector < std::pair < int, int > > FreqIws;
+    for (int Iw = 0; Iw <= m_MaxIw; ++Iw) {
+        if (0 < Freqs [Iw]) {
+            FreqIws.push_back (std::make_pair (-Freqs [Iw], Iw));
+        }
+    }
+    std::sort (FreqIws.begin (), FreqIws.end ());
+
+    FAAssert (MaxCode >= CodeFirst + (int) FreqIws.size () - 1, FAMsg::InternalError);
+
+    m_Iw2Code.resize (m_MaxIw + 1);
+    memset (m_Iw2Code.begin (), 0, sizeof (int) * (m_MaxIw + 1));
+
+    for (int i = 0; i < (int) FreqIws.size (); ++i) {
+        m_Iw2Code [FreqIws [i].second] = CodeFirst + i;
+    }
+}
+
+
+inline void FADatPack::Ensure (const int Pos)
+{
+    const int OldCount = m_Units.size () / 2;
+
+    if (Pos < OldCount) {
+        return;
+    }
+
+    const int NewCount = (Pos + 1) + (OldCount / 2);
+    m_Units.resize (2 * NewCount);
+    m_NextFree.resize (NewCount);
+    m_PrevFree.resize (NewCount);
+
+    for (int i = OldCount; i < NewCount; ++i) {
+
+        m_Units [2 * i] = 0;
+        m_Units [(2 * i) + 1] = -1;
+
+        // append to the free list, the unit 0 is the root
+        m_NextFree [i] = -1;
+        m_PrevFree [i] = m_LastFree;
+
+        if (0 == i) {
+            continue;
+        } else if (-1 == m_LastFree) {
+            m_FirstFree = i;
+        } else {
+            m_NextFree [m_LastFree] = i;
+        }
+        m_LastFree = i;
+    }
+}
+
+
+inline void FADatPack::Take (const int Pos)
+{
+    DebugLogAssert (0 < Pos && Pos < (int) m_NextFree.size ());
+
+    const int Next = m_NextFree [Pos];
+    const int Prev = m_PrevFree [Pos];
+
+    if (-1 == Prev) {
+        m_FirstFree = Next;
+    } else {
+        m_NextFree [Prev] = Next;
+    }
+    if (-1 == Next) {
+        m_LastFree = Prev;
+    } else {
+        m_PrevFree [Next] = Prev;
+    }
+}
+
+
+inline const bool FADatPack::
+    IsFree (const int Base, const int * pCodes, const int Count) const
+{
+    const int UnitCount = m_Units.size () / 2;
+
+    for (int i = 0; i < Count; ++i) {
+        const int Pos = Base + pCodes [i];
+        if (Pos < UnitCount && -1 != m_Units [(2 * Pos) + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void FADatPack::BuildUnits ()
+{
+    const int NodeCount = m_NodeIws.size ();
+
+    m_Units.resize (0);
+    m_NextFree.resize (0);
+    m_PrevFree.resize (0);
+    m_FirstFree = -1;
+    m_LastFree = -1;
+    Ensure (NodeCount + CodeFirst);
+
+    m_NodePos.resize (NodeCount);
+    m_NodePos [0] = 0;
+
+    int MaxBase = 0;
+
+    FAArray_cont_t < int > Codes;
+    Codes.SetAllocator (m_pAlloc);
+    Codes.Create ();
+
+    for (int Node = 0; Node < NodeCount; ++Node) {
+
+        const int Pos = m_NodePos [Node];
+        const int Key = m_NodeKeys [Node];
+        const int ChildFrom = m_ChildFrom [Node];
+        const int ChildTo = m_ChildFrom [Node + 1];
+
+        // get the codes of the node, sorted
+        Codes.resize (0);
+        if (-1 != Key) {
+            Codes.push_back (CodeTerm);
+        }
+        for (int Child = ChildFrom; Child < ChildTo; ++Child) {
+            Codes.push_back (m_Iw2Code [m_NodeIws [Child]]);
+        }
+
+        const int Count = Codes.size ();
+        if (0 == Count) {
+            continue;
+        }
+        std::sort (Codes.begin (), Codes.end ());
+
+        // find the smallest Base, such that all the units are free, the
+        // units after the last one are free
+        const int MinCode = Codes [0];
+        int Base = 0;
+        int p = m_FirstFree;
+
+        for (; -1 != p; p = m_NextFree [p]) {
+            if (MinCode < p && IsFree (p - MinCode, Codes.begin (), Count)) {
+                Base = p - MinCode;
+                break;
+            }
+        }
+        if (-1 == p) {
+            const int UnitCount = m_Units.size () / 2;
+            Base = (MinCode < UnitCount ? UnitCount : MinCode + 1) - MinCode;
+        }
+        DebugLogAssert (0 < Base);
+
+        if (MaxBase < Base) {
+            MaxBase = Base;
+        }
+        FAAssert (Base < 0x20000000, FAMsg::InternalError);
+
+        m_Units [2 * Pos] = (Base << 1) | (-1 != Key ? 1 : 0);
+
+        // take the units
+        if (-1 != Key) {
+            const int TermPos = Base + CodeTerm;
+            Ensure (TermPos);
+            Take (TermPos);
+            m_Units [2 * TermPos] = Key;
+            m_Units [(2 * TermPos) + 1] = Pos;
+        }
+        for (int Child = ChildFrom; Child < ChildTo; ++Child) {
+            const int ChildPos = Base + m_Iw2Code [m_NodeIws [Child]];
+            Ensure (ChildPos);
+            Take (ChildPos);
+            m_Units [(2 * ChildPos) + 1] = Pos;
+            m_NodePos [Child] = ChildPos;
+        }
+    }
+
+    // any Base + Code should be a valid unit
+    int MaxUsedCode = CodeFirst;
+    for (int Iw = 0; Iw <= m_MaxIw; ++Iw) {
+        if (MaxUsedCode < m_Iw2Code [Iw]) {
+            MaxUsedCode = m_Iw2Code [Iw];
+        }
+    }
+    Ensure (MaxBase + MaxUsedCode);
+    m_Units.resize (2 * (MaxBase + MaxUsedCode + 1));
+}
+
+
+void FADatPack::BuildDump ()
+{
+    DebugLogAssert (m_pI2Info);
+
+    // get the Keys count, the Keys are the MPH values of the words
+    int KeyCount = 0;
+    const int NodeCount = m_NodeKeys.size ();
+
+    for (int Node = 0; Node < NodeCount; ++Node) {
+        if (KeyCount <= m_NodeKeys [Node]) {
+            KeyCount = m_NodeKeys [Node] + 1;
+        }
+    }
+
+    // compute the sizes
+    const int DirectCount = m_MaxIw < MaxDirectCount ? m_MaxIw + 1 : MaxDirectCount;
+    const int TopCount = m_MaxIw < DirectCount ? 0 : \
+        (m_MaxIw / BlockSize) + 1 - (DirectCount / BlockSize);
+
+    // the code blocks for Iws >= DirectCount, the first one is empty
+    FAArray_cont_t < int > Tops;
+    Tops.SetAllocator (m_pAlloc);
+    Tops.Create ();
+    Tops.resize (TopCount);
+
+    int BlockCount = 0 < TopCount ? 1 : 0;
+
+    for (int i = 0; i < TopCount; ++i) {
+
+        const int IwFrom = DirectCount + (i * BlockSize);
+        bool fEmpty = true;
+
+        for (int Iw = IwFrom; Iw < IwFrom + BlockSize && Iw <= m_MaxIw; ++Iw) {
+            if (CodeUnknown != m_Iw2Code [Iw]) {
+                fEmpty = false;
+                break;
+            }
+        }
+        if (fEmpty) {
+            Tops [i] = 0;
+        } else {
+            Tops [i] = BlockCount * BlockSize;
+            BlockCount++;
+        }
+    }
+
+    const int UnitCount = m_Units.size () / 2;
+
+    const int HeaderSize = 5 * sizeof (int);
+    const int DirectSize = ((DirectCount * sizeof (unsigned short)) + 3) & ~3;
+    const int TopSize = TopCount * sizeof (int);
+    const int BlocksSize = ((BlockCount * BlockSize * sizeof (unsigned short)) + 3) & ~3;
+    const int UnitsSize = UnitCount * 2 * sizeof (int);
+    const int TermsSize = KeyCount * 2 * sizeof (int);
+
+    const int DumpSize = HeaderSize + DirectSize + TopSize + BlocksSize + \
+        UnitsSize + TermsSize;
+
+    m_dump.resize (DumpSize);
+    unsigned char * pDump = m_dump.begin ();
+    memset (pDump, 0, DumpSize);
+
+    // header
+    int * pHeader = (int *) pDump;
+    pHeader [0] = m_MaxIw;
+    pHeader [1] = DirectCount;
+    pHeader [2] = BlockCount;
+    pHeader [3] = UnitCount;
+    pHeader [4] = KeyCount;
+    pDump += HeaderSize;
+
+    // Iw --> Code maps
+    unsigned short * pDirect = (unsigned short *) pDump;
+    for (int Iw = 0; Iw < DirectCount; ++Iw) {
+        pDirect [Iw] = (unsigned short) m_Iw2Code [Iw];
+    }
+    pDump += DirectSize;
+
+    int * pTop = (int *) pDump;
+    for (int i = 0; i < TopCount; ++i) {
+        pTop [i] = Tops [i];
+    }
+    pDump += TopSize;
+
+    unsigned short * pBlocks = (unsigned short *) pDump;
+    for (int i = 0; i < TopCount; ++i) {
+        if (0 != Tops [i]) {
+            const int IwFrom = DirectCount + (i * BlockSize);
+            for (int j = 0; j < BlockSize && IwFrom + j <= m_MaxIw; ++j) {
+                pBlocks [Tops [i] + j] = (unsigned short) m_Iw2Code [IwFrom + j];
+            }
+        }
+    }
+    pDump += BlocksSize;
+
+    // units
+    memcpy (pDump, m_Units.begin (), UnitsSize);
+    pDump += UnitsSize;
+
+    // Key --> <Id, Score>
+    int * pTerms = (int *) pDump;
+    for (int Key = 0; Key < KeyCount; ++Key) {
+
+        const int * pValues = NULL;
+        const int Count = m_pI2Info->Get (Key, &pValues);
+        FAAssert (0 < Count && pValues, FAMsg::InvalidParameters);
+
+        pTerms [2 * Key] = pValues [0];
+        if (1 < Count) {
+            pTerms [(2 * Key) + 1] = pValues [1];
+        }
+    }
+}
+
+
+void FADatPack::Process ()
+{
+    FAAssert (m_pDfa && m_pSigma && m_pI2Info, FAMsg::InvalidParameters);
+
+    BuildTrie ();
+    BuildCodes ();
+    BuildUnits ();
+    BuildDump ();
+
+    // free the memory
+    m_StateFrom.Clear ();
+    m_StateFrom.Create ();
+    m_Arcs.Clear ();
+    m_Arcs.Create ();
+    m_ChildFrom.Clear ();
+    m_ChildFrom.Create ();
+    m_NodeIws.Clear ();
+    m_NodeIws.Create ();
+    m_NodeKeys.Clear ();
+    m_NodeKeys.Create ();
+    m_Iw2Code.Clear ();
+    m_Iw2Code.Create ();
+    m_Units.Clear ();
+    m_Units.Create ();
+    m_NodePos.Clear ();
+    m_NodePos.Create ();
+    m_NextFree.Clear ();
+    m_NextFree.Create ();
+    m_PrevFree.Clear ();
+    m_PrevFree.Create ();
+}
+
+
+const int FADatPack::GetDump (const unsigned char ** ppDump) const
+{
+    DebugLogAssert (ppDump);
+    *ppDump = m_dump.begin ();
+    return m_dump.size ();
+}
@@ -0,0 +1,209 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-compile_src_pch.h"
+#include "FAConfig.h"
+#include "FALzCompress.h"
+#include "FAFsmConst.h"
+#include "FAUtils_cl.h"
+#include "FAException.h"
+
+
+FALzCompress::FALzCompress (FAAllocatorA * pAlloc)
+{
+    m_Head.SetAllocator (pAlloc);
+    m_Head.Create ();
+    m_Head.resize (1 << HashBits);
+
+    m_Prev.SetAllocator (pAlloc);
+    m_Prev.Create ();
+    m_Prev.resize (FAFsmConst::LDB_LZ_BLOCK_SIZE);
+}
+
+
+inline void FALzCompress::PutUInt32 (
+        const unsigned int Value,
+        FAArray_cont_t < unsigned char > * pOut
+    )
+{
+    pOut->push_back ((unsigned char) (Value & 0xff));
+    pOut->push_back ((unsigned char) ((Value >> 8) & 0xff));
+    pOut->push_back ((unsigned char) ((Value >> 16) & 0xff));
+    pOut->push_back ((unsigned char) (Value >> 24));
+}
+
+
+void FALzCompress::Process (
+        const unsigned char * pIn,
+        const size_t InSize,
+        FAArray_cont_t < unsigned char > * pOut
+    )
+{
+    DebugLogAssert (pIn && pOut);
+
+    const size_t BlockSize = FAFsmConst::LDB_LZ_BLOCK_SIZE;
+    const size_t BlockCount = (InSize + BlockSize - 1) / BlockSize;
+    FAAssert (BlockCount < (1U << 30), FAMsg::LimitIsExceeded);
+
+    // the header
+    const unsigned long long RawSize = InSize;
+
+    PutUInt32 ((unsigned int) (RawSize & 0xffffffff), pOut);
+    PutUInt32 ((unsigned int) (RawSize >> 32), pOut);
+    PutUInt32 (::FAGetCrc32 (pIn, InSize), pOut);
+    PutUInt32 ((unsigned int) BlockCount, pOut);
+
+    // the block sizes are filled in as the blocks are compressed
+    const unsigned int SizesPos = pOut->size ();
+
+    for (size_t i = 0; i < BlockCount; ++i) {
+        PutUInt32 (0, pOut);
+    }
+
+    for (size_t i = 0; i < BlockCount; ++i) {
+
+        const size_t From = i * BlockSize;
+        const int Size = (int) (InSize - From < BlockSize ? InSize - From : BlockSize);
+
+        const unsigned int OutSize = CompressBlock (pIn + From, Size, pOut);
+
+        unsigned char * pSize = pOut->begin () + SizesPos + (4 * i);
+        pSize [0] = (unsigned char) (OutSize & 0xff);
+        pSize [1] = (unsigned char) ((OutSize >> 8) & 0xff);
+        pSize [2] = (unsigned char) ((OutSize >> 16) & 0xff);
+        pSize [3] = (unsigned char) (OutSize >> 24);
+    }
+}
+
+
+inline void FALzCompress::PutLength (
+        int Length,
+        FAArray_cont_t < unsigned char > * pOut
+    )
+{
+    while (255 <= Length) {
+        pOut->push_back (255);
+        Length -= 255;
+    }
+    pOut->push_back ((unsigned char) Length);
+}
+
+
+inline void FALzCompress::PutSequence (
+        const unsigned char * pLits,
+        const int LitCount,
+        const int Offset,
+        const int MatchLen,
+        FAArray_cont_t < unsigned char > * pOut
+    )
+{
+    const int LitCode = 15 > LitCount ? LitCount : 15;
+    const int MatchCode = 0 == MatchLen ? 0 : \
+        (15 > MatchLen - MinMatchLength ? MatchLen - MinMatchLength : 15);
+
+    pOut->push_back ((unsigned char) ((LitCode << 4) | MatchCode));
+
+    if (15 == LitCode) {
+        PutLength (LitCount - 15, pOut);
+    }
+    for (int i = 0; i < LitCount; ++i) {
+        pOut->push_back (pLits [i]);
+    }
+
+    if (0 != MatchLen) {
+
+        pOut->push_back ((unsigned char) (Offset & 0xff));
+        pOut->push_back ((unsigned char) (Offset >> 8));
+
+        if (15 == MatchCode) {
+            PutLength (MatchLen - MinMatchLength - 15, pOut);
+        }
+    }
+}
+
+
+const unsigned int FALzCompress::CompressBlock (
+        const unsigned char * pIn,
+        const int InSize,
+        FAArray_cont_t < unsigned char > * pOut
+    )
+{
+    DebugLogAssert (0 < InSize && InSize <= FAFsmConst::LDB_LZ_BLOCK_SIZE);
+
+    const unsigned int OldSize = pOut->size ();
+
+    int * pHead = m_Head.begin ();
+    int * pPrev = m_Prev.begin ();
+
+    for (int i = 0; i < (1 << HashBits); ++i) {
+        pHead [i] = -1;
+    }
+
+    int LitStart = 0;
+    int Pos = 0;
+
+    while (Pos + MinMatchLength <= InSize) {
+
+        const unsigned int Prefix = pIn [Pos] | (pIn [Pos + 1] << 8) | \
+            (pIn [Pos + 2] << 16) | (((unsigned int) pIn [Pos + 3]) << 24);
+        const unsigned int Hash = (Prefix * 2654435761U) >> (32 - HashBits);
+
+        // find the longest match among the candidates
+        int BestLen = 0;
+        int BestOffset = 0;
+        int Cand = pHead [Hash];
+
+        for (int k = 0; -1 != Cand && Pos - Cand <= MaxOffset && \
+                k < MaxChainLength; ++k, Cand = pPrev [Cand]) {
+
+            const int MaxLen = InSize - Pos;
+            int Len = 0;
+
+            while (Len < MaxLen && pIn [Cand + Len] == pIn [Pos + Len]) {
+                Len++;
+            }
+            if (Len > BestLen) {
+                BestLen = Len;
+                BestOffset = Pos - Cand;
+                if (Len == MaxLen) {
+                    break;
+                }
+            }
+        }
+
+        pPrev [Pos] = pHead [Hash];
+        pHead [Hash] = Pos;
+
+        if (MinMatchLength > BestLen) {
+            Pos++;
+            continue;
+        }
+
+        PutSequence (pIn + LitStart, Pos - LitStart, BestOffset, BestLen, pOut);
+
+        // add the matched positions into the hash chains
+        const int End = Pos + BestLen;
+
+        for (Pos++; Pos < End && Pos + MinMatchLength <= InSize; ++Pos) {
+
+            const unsigned int NextPrefix = pIn [Pos] | (pIn [Pos + 1] << 8) | \
+                (pIn [Pos + 2] << 16) | (((unsigned int) pIn [Pos + 3]) << 24);
+            const unsigned int NextHash = \
+                (NextPrefix * 2654435761U) >> (32 - HashBits);
+
+            pPrev [Pos] = pHead [NextHash];
+            pHead [NextHash] = Pos;
+        }
+
+        Pos = End;
+        LitStart = End;
+    }
+
+    // the last sequence, the literals only
+    PutSequence (pIn + LitStart, InSize - LitStart, 0, 0, pOut);
+
+    return pOut->size () - OldSize;
+}
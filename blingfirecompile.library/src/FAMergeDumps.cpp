@@ -11,10 +11,14 @@
 #include "FAException.h"
 #include "FAFsmConst.h"
 #include "FAUtils_cl.h"
+#include "FALimits.h"
+#include "FALzCompress.h"
 
 
 FAMergeDumps::FAMergeDumps (FAAllocatorA * pAlloc) :
-    m_pAlloc (pAlloc)
+    m_pAlloc (pAlloc),
+    m_Version (FAFsmConst::LDB_V2_VERSION),
+    m_fCompress (false)
 {
     m_dumps.SetAllocator (pAlloc);
     m_dumps.Create ();
@@ -30,6 +34,20 @@ FAMergeDumps::~FAMergeDumps ()
 }
 
 
+void FAMergeDumps::SetVersion (const int Version)
+{
+    FAAssert (1 == Version || FAFsmConst::LDB_V2_VERSION == Version, \
+        FAMsg::InvalidParameters);
+    m_Version = Version;
+}
+
+
+void FAMergeDumps::SetCompress (const bool fCompress)
+{
+    m_fCompress = fCompress;
+}
+
+
 void FAMergeDumps::AddDumpFile (const char * pFileName)
 {
     DebugLogAssert (m_pAlloc);
@@ -116,6 +134,16 @@ void FAMergeDumps::Save (std::ostream * pOs)
     DebugLogAssert (pOs);
     DebugLogAssert (0 < m_dumps.size () && m_dumps.size () == m_sizes.size ());
 
+    if (1 == m_Version) {
+        SaveV1 (pOs);
+    } else {
+        SaveV2 (pOs);
+    }
+}
+
+
+void FAMergeDumps::SaveV1 (std::ostream * pOs)
+{
     int i;
 
     // always add the last validation dump
@@ -145,3 +173,132 @@ void FAMergeDumps::Save (std::ostream * pOs)
         pOs->write ((const char *) pImageDump, CurrSize);
     }
 }
+
+
+inline void FAMergeDumps::PutUInt64 (
+        unsigned int * pArr,
+        const unsigned long long Val
+    )
+{
+    pArr [0] = (unsigned int) (Val & 0xffffffff);
+    pArr [1] = (unsigned int) (Val >> 32);
+}
+
+
+void FAMergeDumps::SaveV2 (std::ostream * pOs)
+{
+    int i;
+
+    const int DumpCount = m_dumps.size ();
+    FAAssert (DumpCount <= FALimits::MaxLdbDumpCount, FAMsg::LimitIsExceeded);
+
+    const unsigned long long Align = FAFsmConst::LDB_V2_ALIGNMENT;
+    const int EntryCount = FAFsmConst::LDB_V2_ENTRY_SIZE / sizeof (unsigned int);
+
+    // the compressed sections, a section is stored as is if it does not
+    // get smaller, its packed offset is -1 then
+    FAArray_cont_t < unsigned char > packed;
+    packed.SetAllocator (m_pAlloc);
+    packed.Create ();
+
+    FAArray_cont_t < int > packed_offsets;
+    packed_offsets.SetAllocator (m_pAlloc);
+    packed_offsets.Create ();
+    packed_offsets.resize (DumpCount);
+
+    FAArray_cont_t < int > stored_sizes;
+    stored_sizes.SetAllocator (m_pAlloc);
+    stored_sizes.Create ();
+    stored_sizes.resize (DumpCount);
+
+    FALzCompress lz (m_pAlloc);
+
+    for (i = 0; i < DumpCount; ++i) {
+
+        const int CurrSize = m_sizes [i];
+        DebugLogAssert (0 < CurrSize);
+
+        packed_offsets [i] = -1;
+        stored_sizes [i] = CurrSize;
+
+        if (m_fCompress) {
+
+            const int PackedOffset = packed.size ();
+            lz.Process (m_dumps [i], (size_t) CurrSize, &packed);
+            const int PackedSize = packed.size () - PackedOffset;
+
+            if (PackedSize < CurrSize) {
+                packed_offsets [i] = PackedOffset;
+                stored_sizes [i] = PackedSize;
+            } else {
+                packed.resize (PackedOffset);
+            }
+        }
+    }
+
+    // build the section directory, the sections are aligned
+    FAArray_cont_t < unsigned int > dir;
+    dir.SetAllocator (m_pAlloc);
+    dir.Create ();
+    dir.resize (DumpCount * EntryCount);
+
+    unsigned long long Offset = FAFsmConst::LDB_V2_HEADER_SIZE + \
+        (DumpCount * FAFsmConst::LDB_V2_ENTRY_SIZE);
+
+    for (i = 0; i < DumpCount; ++i) {
+
+        const int CurrSize = stored_sizes [i];
+        const unsigned char * pData = -1 == packed_offsets [i] ? \
+            m_dumps [i] : packed.begin () + packed_offsets [i];
+
+        Offset = (Offset + Align - 1) & ~(Align - 1);
+
+        unsigned int * pEntry = dir.begin () + (i * EntryCount);
+
+        pEntry [0] = 0 == i ? FAFsmConst::LDB_SECTION_CONF : \
+            FAFsmConst::LDB_SECTION_DATA;
+        pEntry [1] = FAFsmConst::LDB_V2_ALIGNMENT;
+        PutUInt64 (pEntry + 2, Offset);
+        PutUInt64 (pEntry + 4, CurrSize);
+        pEntry [6] = ::FAGetCrc32 (pData, (size_t) CurrSize);
+        pEntry [7] = -1 == packed_offsets [i] ? FAFsmConst::LDB_CODEC_NONE : \
+            FAFsmConst::LDB_CODEC_LZ;
+
+        Offset += CurrSize;
+    }
+
+    // write the header
+    unsigned int Header [FAFsmConst::LDB_V2_HEADER_SIZE / sizeof (unsigned int)];
+
+    Header [0] = FAFsmConst::LDB_V2_MAGIC;
+    Header [1] = FAFsmConst::LDB_V2_VERSION;
+    Header [2] = DumpCount;
+    Header [3] = FAFsmConst::LDB_V2_ALIGNMENT;
+    PutUInt64 (Header + 4, Offset);
+
+    pOs->write ((const char *) Header, sizeof (Header));
+    pOs->write ((const char *) dir.begin (), dir.size () * sizeof (unsigned int));
+
+    unsigned long long Pos = sizeof (Header) + (dir.size () * sizeof (unsigned int));
+
+    // write the sections, fill the gaps with 0s
+    const char Zeros [FAFsmConst::LDB_V2_ALIGNMENT] = { 0 };
+
+    for (i = 0; i < DumpCount; ++i) {
+
+        const unsigned long long CurrOffset = \
+            (Pos + Align - 1) & ~(Align - 1);
+
+        pOs->write (Zeros, (std::streamsize) (CurrOffset - Pos));
+
+        const int CurrSize = stored_sizes [i];
+        const unsigned char * pData = -1 == packed_offsets [i] ? \
+            m_dumps [i] : packed.begin () + packed_offsets [i];
+        DebugLogAssert (pData);
+
+        pOs->write ((const char *) pData, CurrSize);
+        Pos = CurrOffset + CurrSize;
+    }
+
+    FAAssert (!pOs->fail (), FAMsg::WriteError);
+}
@@ -0,0 +1,542 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "blingfire-compile_src_pch.h"
+#include "FAConfig.h"
+#include "FARSDfa2Utf8Dfa.h"
+#include "FAAllocatorA.h"
+#include "FARSDfaA.h"
+#include "FAState2OwA.h"
+#include "FAMapA.h"
+#include "FAFsmConst.h"
+#include "FAUtf8Utils.h"
+#include "FAUtils.h"
+
+#include <algorithm>
+
+
+FARSDfa2Utf8Dfa::FARSDfa2Utf8Dfa (FAAllocatorA * pAlloc) :
+    m_pInDfa (NULL),
+    m_pInState2Ow (NULL),
+    m_pNew2Old (NULL),
+    m_pOutDfa (NULL),
+    m_pOutState2Ow (NULL),
+    m_MaxState (-1),
+    m_StateR (-1)
+{
+    m_iw_ranges.SetAllocator (pAlloc);
+    m_iw_ranges.Create ();
+
+    m_tmp_ranges.SetAllocator (pAlloc);
+    m_tmp_ranges.Create ();
+
+    m_dst_ranges.SetAllocator (pAlloc);
+    m_dst_ranges.Create ();
+
+    m_boxes.SetAllocator (pAlloc);
+    m_boxes.Create ();
+
+    for (int i = 0; i < MaxUtf8Len; ++i) {
+        m_arcs [i].SetAllocator (pAlloc);
+        m_arcs [i].Create ();
+    }
+
+    m_nodes.SetAllocator (pAlloc);
+}
+
+
+void FARSDfa2Utf8Dfa::Clear ()
+{
+    m_iw_ranges.Clear ();
+    m_iw_ranges.Create ();
+
+    m_tmp_ranges.Clear ();
+    m_tmp_ranges.Create ();
+
+    m_dst_ranges.Clear ();
+    m_dst_ranges.Create ();
+
+    m_boxes.Clear ();
+    m_boxes.Create ();
+
+    for (int i = 0; i < MaxUtf8Len; ++i) {
+        m_arcs [i].Clear ();
+        m_arcs [i].Create ();
+    }
+
+    m_nodes.Clear ();
+
+    m_MaxState = -1;
+    m_StateR = -1;
+}
+
+
+void FARSDfa2Utf8Dfa::SetInDfa (const FARSDfaA * pInDfa)
+{
+    m_pInDfa = pInDfa;
+}
+
+
+void FARSDfa2Utf8Dfa::SetInState2Ow (const FAState2OwA * pInState2Ow)
+{
+    m_pInState2Ow = pInState2Ow;
+}
+
+
+void FARSDfa2Utf8Dfa::SetIwMap (const FAMapA * pNew2Old)
+{
+    m_pNew2Old = pNew2Old;
+}
+
+
+void FARSDfa2Utf8Dfa::SetOutDfa (FARSDfaA * pOutDfa)
+{
+    m_pOutDfa = pOutDfa;
+}
+
+
+void FARSDfa2Utf8Dfa::SetOutState2Ow (FAState2OwA * pOutState2Ow)
+{
+    m_pOutState2Ow = pOutState2Ow;
+}
+
+
+inline const bool FARSDfa2Utf8Dfa::
+    IwRangeLess (const _TIwRange & r1, const _TIwRange & r2)
+{
+    if (r1.m_Iw != r2.m_Iw) {
+        return r1.m_Iw < r2.m_Iw;
+    }
+    return r1.m_Lo < r2.m_Lo;
+}
+
+
+inline const bool FARSDfa2Utf8Dfa::
+    DstRangeLess (const _TDstRange & r1, const _TDstRange & r2)
+{
+    return r1.m_Lo < r2.m_Lo;
+}
+
+
+void FARSDfa2Utf8Dfa::BuildIwRanges ()
+{
+    DebugLogAssert (m_pInDfa);
+
+    m_iw_ranges.resize (0);
+
+    _TIwRange r;
+
+    if (m_pNew2Old) {
+
+        // make a range for each code point, they are merged below
+        int Cp = -1;
+        const int * pOldIw = m_pNew2Old->Prev (&Cp);
+
+        while (NULL != pOldIw) {
+
+            if (FAFsmConst::IW_EPSILON <= Cp && MaxCodePoint >= Cp) {
+                r.m_Iw = *pOldIw;
+                r.m_Lo = Cp;
+                r.m_Hi = Cp;
+                m_iw_ranges.push_back (r);
+            }
+            pOldIw = m_pNew2Old->Prev (&Cp);
+        }
+
+    } else {
+
+        const int * pIws;
+        const int IwCount = m_pInDfa->GetIWs (&pIws);
+
+        for (int i = 0; i < IwCount; ++i) {
+
+            const int Cp = pIws [i];
+
+            if (FAFsmConst::IW_EPSILON <= Cp && MaxCodePoint >= Cp) {
+                r.m_Iw = Cp;
+                r.m_Lo = Cp;
+                r.m_Hi = Cp;
+                m_iw_ranges.push_back (r);
+            }
+        }
+    }
+
+    const int Count = m_iw_ranges.size ();
+
+    if (0 == Count) {
+        return;
+    }
+
+    _TIwRange * pRanges = m_iw_ranges.begin ();
+    std::sort (pRanges, pRanges + Count, IwRangeLess);
+
+    // merge adjacent code points of the same Iw
+    int j = 0;
+
+    for (int i = 1; i < Count; ++i) {
+
+        if (pRanges [j].m_Iw == pRanges [i].m_Iw && \
+            pRanges [j].m_Hi + 1 == pRanges [i].m_Lo) {
+            pRanges [j].m_Hi = pRanges [i].m_Hi;
+        } else {
+            pRanges [++j] = pRanges [i];
+        }
+    }
+
+    m_iw_ranges.resize (j + 1);
+}
+
+
+inline const int FARSDfa2Utf8Dfa::
+    GetInDest (const int State, const int Iw) const
+{
+    if (m_pNew2Old) {
+
+        const int * pOldIw = m_pNew2Old->Get (Iw);
+
+        if (NULL == pOldIw) {
+            return -1;
+        }
+        return m_pInDfa->GetDest (State, *pOldIw);
+    }
+
+    return m_pInDfa->GetDest (State, Iw);
+}
+
+
+void FARSDfa2Utf8Dfa::CalcDstRanges (const int State)
+{
+    m_tmp_ranges.resize (0);
+    m_dst_ranges.resize (0);
+
+    const _TIwRange * pIwRanges = m_iw_ranges.begin ();
+    const int IwRangeCount = m_iw_ranges.size ();
+
+    int PrevIw = -1;
+    int Dst = -1;
+    _TDstRange r;
+
+    // get explicitly specified ranges
+    for (int i = 0; i < IwRangeCount; ++i) {
+
+        const int Iw = pIwRanges [i].m_Iw;
+
+        if (PrevIw != Iw) {
+            Dst = m_pInDfa->GetDest (State, Iw);
+            PrevIw = Iw;
+        }
+        if (-1 != Dst) {
+            r.m_Lo = pIwRanges [i].m_Lo;
+            r.m_Hi = pIwRanges [i].m_Hi;
+            r.m_Dst = Dst;
+            m_tmp_ranges.push_back (r);
+        }
+    }
+
+    const int Count = m_tmp_ranges.size ();
+    _TDstRange * pRanges = m_tmp_ranges.begin ();
+    std::sort (pRanges, pRanges + Count, DstRangeLess);
+
+    // fill in the gaps with IW_ANY destination, merge adjacent ranges
+    const int AnyDst = GetInDest (State, FAFsmConst::IW_ANY);
+    int Next = FAFsmConst::IW_EPSILON;
+
+    for (int i = 0; i <= Count; ++i) {
+
+        if (i < Count) {
+            r = pRanges [i];
+            DebugLogAssert (Next <= r.m_Lo);
+        } else {
+            r.m_Lo = MaxCodePoint + 1;
+        }
+        if (Next < r.m_Lo && -1 != AnyDst) {
+
+            const int Size = m_dst_ranges.size ();
+
+            if (0 < Size && AnyDst == m_dst_ranges [Size - 1].m_Dst) {
+                m_dst_ranges [Size - 1].m_Hi = r.m_Lo - 1;
+            } else {
+                _TDstRange r2;
+                r2.m_Lo = Next;
+                r2.m_Hi = r.m_Lo - 1;
+                r2.m_Dst = AnyDst;
+                m_dst_ranges.push_back (r2);
+            }
+        }
+        if (i < Count) {
+
+            const int Size = m_dst_ranges.size ();
+
+            if (0 < Size && r.m_Dst == m_dst_ranges [Size - 1].m_Dst && \
+                r.m_Lo == m_dst_ranges [Size - 1].m_Hi + 1) {
+                m_dst_ranges [Size - 1].m_Hi = r.m_Hi;
+            } else {
+                m_dst_ranges.push_back (r);
+            }
+            Next = r.m_Hi + 1;
+        }
+    }
+}
+
+
+///
+/// Splits the range until the first and the last code points have the
+/// same UTF-8 length and the range covers all continuation bytes of the
+/// varying positions, then each range corresponds to a box of bytes.
+///
+
+void FARSDfa2Utf8Dfa::AddBoxes (const int Lo, const int Hi, const int Dst)
+{
+    if (Lo > Hi) {
+        return;
+    }
+
+    // surrogates cannot appear in UTF-8
+    if (Lo <= MaxSurrogate && Hi >= MinSurrogate) {
+        AddBoxes (Lo, MinSurrogate - 1, Dst);
+        AddBoxes (MaxSurrogate + 1, Hi, Dst);
+        return;
+    }
+
+    // split by the encoding length
+    const int MaxCps [] = { 0x7F, 0x7FF, 0xFFFF };
+
+    for (int i = 0; i < 3; ++i) {
+        if (Lo <= MaxCps [i] && Hi > MaxCps [i]) {
+            AddBoxes (Lo, MaxCps [i], Dst);
+            AddBoxes (MaxCps [i] + 1, Hi, Dst);
+            return;
+        }
+    }
+
+    const int Len = ::FAUtf8Size (Lo);
+    DebugLogAssert (Len == ::FAUtf8Size (Hi));
+    DebugLogAssert (0 < Len && MaxUtf8Len >= Len);
+
+    // split by the continuation bytes
+    for (int i = 1; i < Len; ++i) {
+
+        const int Mask = (1 << (6 * i)) - 1;
+
+        if ((Lo & ~Mask) != (Hi & ~Mask)) {
+            if (0 != (Lo & Mask)) {
+                AddBoxes (Lo, Lo | Mask, Dst);
+                AddBoxes ((Lo | Mask) + 1, Hi, Dst);
+                return;
+            }
+            if (Mask != (Hi & Mask)) {
+                AddBoxes (Lo, (Hi & ~Mask) - 1, Dst);
+                AddBoxes (Hi & ~Mask, Hi, Dst);
+                return;
+            }
+        }
+    }
+
+    char LoUtf8 [MaxUtf8Len];
+    char HiUtf8 [MaxUtf8Len];
+
+    ::FAIntToUtf8 (Lo, LoUtf8, MaxUtf8Len);
+    ::FAIntToUtf8 (Hi, HiUtf8, MaxUtf8Len);
+
+    _TBox Box;
+
+    Box.m_Len = Len;
+    Box.m_Dst = Dst;
+
+    for (int i = 0; i < Len; ++i) {
+        Box.m_Lo [i] = (unsigned char) LoUtf8 [i];
+        Box.m_Hi [i] = (unsigned char) HiUtf8 [i];
+    }
+
+    m_boxes.push_back (Box);
+}
+
+
+const int FARSDfa2Utf8Dfa::GetNodeState (const int * pArcs, const int Count)
+{
+    DebugLogAssert (pArcs && 0 < Count && 0 == Count % 2);
+
+    const int Idx = m_nodes.Add (pArcs, Count, 0);
+    return m_MaxState + 1 + Idx;
+}
+
+
+///
+/// Boxes are sorted lexicographically and boxes sharing a prefix have
+/// identical byte ranges at the same level, so the boxes which go thru the
+/// same intermediate state are adjacent.
+///
+
+void FARSDfa2Utf8Dfa::BuildLevel (const int Begin, const int End, const int Level)
+{
+    DebugLogAssert (0 <= Level && MaxUtf8Len > Level);
+
+    FAArray_cont_t < int > * pArcs = & (m_arcs [Level]);
+
+    int i = Begin;
+
+    while (i < End) {
+
+        const _TBox * pBox = m_boxes.begin () + i;
+
+        const int Lo = pBox->m_Lo [Level];
+        const int Hi = pBox->m_Hi [Level];
+        int Dst;
+
+        if (Level + 1 == pBox->m_Len) {
+
+            Dst = pBox->m_Dst;
+            i++;
+
+        } else {
+
+            int j = i + 1;
+
+            for (; j < End; ++j) {
+                const _TBox * pBox2 = m_boxes.begin () + j;
+                if (Lo != pBox2->m_Lo [Level] || Hi != pBox2->m_Hi [Level]) {
+                    break;
+                }
+            }
+
+            m_arcs [Level + 1].resize (0);
+            BuildLevel (i, j, Level + 1);
+
+            const int * pNodeArcs = m_arcs [Level + 1].begin ();
+            const int NodeArcCount = m_arcs [Level + 1].size ();
+
+            Dst = GetNodeState (pNodeArcs, NodeArcCount);
+            i = j;
+        }
+
+        for (int b = Lo; b <= Hi; ++b) {
+            pArcs->push_back (b);
+            pArcs->push_back (Dst);
+        }
+    }
+}
+
+
+void FARSDfa2Utf8Dfa::ProcessState (const int State)
+{
+    FAArray_cont_t < int > * pArcs = & (m_arcs [0]);
+    pArcs->resize (0);
+
+    // copy the special Iws as-is
+    for (int Iw = FAFsmConst::IW_ANY; Iw < FAFsmConst::IW_EPSILON; ++Iw) {
+
+        const int Dst = GetInDest (State, Iw);
+
+        if (-1 != Dst) {
+            pArcs->push_back (Iw);
+            pArcs->push_back (Dst);
+        }
+    }
+
+    if (m_StateR == State) {
+
+        // copy function ids as-is
+        for (int FnId = FAFsmConst::IW_EPSILON; FnId <= MaxFunctionId; ++FnId) {
+
+            const int Dst = GetInDest (State, FnId);
+
+            if (-1 != Dst) {
+                pArcs->push_back (FnId);
+                pArcs->push_back (Dst);
+            }
+        }
+
+    } else {
+
+        CalcDstRanges (State);
+
+        m_boxes.resize (0);
+
+        const _TDstRange * pRanges = m_dst_ranges.begin ();
+        const int Count = m_dst_ranges.size ();
+
+        for (int i = 0; i < Count; ++i) {
+            AddBoxes (pRanges [i].m_Lo, pRanges [i].m_Hi, pRanges [i].m_Dst);
+        }
+
+        BuildLevel (0, m_boxes.size (), 0);
+    }
+
+    const int ArcCount = pArcs->size () / 2;
+
+    if (0 == ArcCount) {
+        return;
+    }
+
+    const int * pArc = pArcs->begin ();
+
+    for (int i = 0; i < ArcCount; ++i) {
+        m_pOutDfa->SetTransition (State, pArc [0], pArc [1]);
+        pArc += 2;
+    }
+}
+
+
+void FARSDfa2Utf8Dfa::AddNodes ()
+{
+    const int NodeCount = m_nodes.GetChainCount ();
+
+    for (int Idx = 0; Idx < NodeCount; ++Idx) {
+
+        const int * pArc;
+        const int Count = m_nodes.GetChain (Idx, &pArc);
+        DebugLogAssert (0 < Count && 0 == Count % 2);
+
+        const int State = m_MaxState + 1 + Idx;
+
+        for (int i = 0; i < Count; i += 2) {
+            m_pOutDfa->SetTransition (State, pArc [i], pArc [i + 1]);
+        }
+    }
+}
+
+
+void FARSDfa2Utf8Dfa::Process ()
+{
+    LogAssert (m_pInDfa && m_pOutDfa);
+    LogAssert (!m_pInState2Ow || m_pOutState2Ow);
+
+    m_MaxState = m_pInDfa->GetMaxState ();
+
+    const int Initial = m_pInDfa->GetInitial ();
+    m_StateR = GetInDest (Initial, FAFsmConst::IW_R_ANCHOR);
+
+    BuildIwRanges ();
+
+    m_pOutDfa->SetMaxState (m_MaxState);
+    m_pOutDfa->SetMaxIw (UCHAR_MAX);
+    m_pOutDfa->Create ();
+
+    for (int State = 0; State <= m_MaxState; ++State) {
+        ProcessState (State);
+    }
+
+    AddNodes ();
+
+    m_pOutDfa->SetInitial (Initial);
+
+    const int * pFinals;
+    const int FinalCount = m_pInDfa->GetFinals (&pFinals);
+    m_pOutDfa->SetFinals (pFinals, FinalCount);
+
+    m_pOutDfa->Prepare ();
+
+    if (m_pInState2Ow) {
+        for (int State = 0; State <= m_MaxState; ++State) {
+            const int Ow = m_pInState2Ow->GetOw (State);
+            if (-1 != Ow) {
+                m_pOutState2Ow->SetOw (State, Ow);
+            }
+        }
+    }
+
+    m_nodes.Clear ();
+}
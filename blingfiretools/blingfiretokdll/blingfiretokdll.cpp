@@ -8,14 +8,34 @@
 #include "FADictConfKeeper.h"
 #include "FATokenSegmentationTools_1best_t.h"
 #include "FATokenSegmentationTools_1best_bpe_t.h"
+#include "FATokenSegmentationTools_wordpiece_t.h"
+#include "FADfa_dense.h"
+#include "FAWordCache.h"
+#include "FATokenLattice.h"
+#include "FAUtils_cl.h"
+#include "FADumpRegistry.h"
+#include "FARuntimeCache.h"
+#include "FAIwMap_pack.h"
 
 #include <algorithm>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <mutex>
+#include <memory>
+#include <list>
+#include <unordered_map>
 #include <assert.h>
 
+// SSE2 is always available on x64
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define FA_USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 /*
 This library provides easy interface to sentence and word-breaking functionality
 which can be used in C#, Python, Perl, etc.
@@ -42,6 +62,10 @@ const int WBD_IGNORE_TAG = 4;
 volatile bool g_fInitialized = false;
 std::mutex g_InitializationMutex; // this mutex is used once for default models only
 
+// the dumps of the models loaded by LoadModelWithSharedDumps, the identical
+// dumps are kept once
+FADumpRegistry g_DumpRegistry;
+
 // keep model data together
 struct FAModelData
 {
@@ -54,6 +78,10 @@ struct FAModelData
     FALexTools_t < int > m_Engine;
     bool m_hasWbd;
 
+    // const processor for the models with UTF-8 byte automaton, see utf8-input
+    FALexTools_t < unsigned char > m_EngineUtf8;
+    bool m_isUtf8;
+
     // data and const processor for tokenization
     FADictConfKeeper m_DictConf;
     FATokenSegmentationTools_1best_t < int > m_SegEngine;
@@ -63,10 +91,31 @@ struct FAModelData
     FATokenSegmentationTools_1best_bpe_t < int > m_SegEngineBpe;
     bool m_isBpe;
 
+    // word-piece runtime for the words from the WBD, it uses the m_DictConf for data
+    FATokenSegmentationTools_wordpiece_t < int > m_SegEngineWp;
+    bool m_isWordPiece;
+
+    // optional dense tables for the hot states, see LoadModelWithDenseStates
+    FADfa_dense m_DenseDfa;
+    FADfa_dense m_DenseMealy;
+
+    // the mapped runtime cache file, if it was valid, see LoadModelWithCache
+    FARuntimeCache m_Cache;
+
+    // the size of the loaded image
+    size_t m_ImgSize;
+
+    // optional cache of the word segmentations, see SetWordCacheSize, NULL if
+    // not set up, read and replaced with std::atomic_load / std::atomic_store
+    std::shared_ptr < const FAWordCache > m_pWordCache;
+
     FAModelData ():
         m_hasWbd (false),
+        m_isUtf8 (false),
         m_hasSeg (false),
-        m_isBpe (false)
+        m_isBpe (false),
+        m_isWordPiece (false),
+        m_ImgSize (0)
     {}
 };
 
@@ -74,6 +123,35 @@ struct FAModelData
 FAModelData g_DefaultWbd;
 FAModelData g_DefaultSbd;
 
+// the models loaded by name, see AcquireModel
+struct FAModelRegistry
+{
+    struct _TEntry {
+        void * _pModel;                       // the model handle
+        int _RefCount;                        // the number of AcquireModel calls not released
+        std::list < std::string >::iterator _Lru; // the position in m_Lru
+    };
+
+    // guards all the data
+    std::mutex m_Lock;
+    // name --> entry
+    std::unordered_map < std::string, _TEntry > m_Models;
+    // model handle --> name
+    std::unordered_map < void *, std::string > m_Names;
+    // the names, the most recently acquired first
+    std::list < std::string > m_Lru;
+    // the memory budget in bytes, 0 if there is no limit
+    int64_t m_MaxMemory;
+
+    FAModelRegistry ():
+        m_MaxMemory (0)
+    {}
+
+    ~FAModelRegistry ();
+};
+
+FAModelRegistry g_ModelRegistry;
+
 //
 // returns the current version of the algo
 //
@@ -132,81 +210,159 @@ inline int FAGetFirstNonWhiteSpace(int * pStr, const int StrLen)
 
 
 //
-// The same as TextToSentences, but it allows to use a custom model and returns offsets
-// 
-// pStartOffsets is an array of integers (first character of each sentence) with upto MaxOutUtf8StrByteCount elements
-// pEndOffsets is an array of integers (last character of each sentence) with upto MaxOutUtf8StrByteCount elements
-//
-// The hModel parameter allows to use a custom model loaded with LoadModel API, if NULL then
-//  the built in is used.
+// UTF-8 input and output, the offsets are in bytes
 //
-
-extern "C"
-const int TextToSentencesWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8StrByteCount,
-    char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount,
-    void * hModel)
+struct FAUtf8Traits
 {
-    // check if the initilization is needed
-    if (false == g_fInitialized) {
-        // make sure only one thread can get the mutex
-        std::lock_guard<std::mutex> guard(g_InitializationMutex);
-        // see if the g_fInitialized is still false
-        if (false == g_fInitialized) {
-            InitializeWbdSbd();
-            g_fInitialized = true;
-        }
-    }
+    typedef char Ch;
 
-    // use the default model if it was not provided
-    if (NULL == hModel) {
-        hModel = &g_DefaultSbd;
+    // converts input string into UTF-32 array, pOffsets can be NULL
+    static inline const int Decode(const Ch * pStr, const int Len, int * pArray, int * pOffsets, const int MaxSize)
+    {
+        return NULL != pOffsets ?
+            ::FAStrUtf8ToArray(pStr, Len, pArray, pOffsets, MaxSize) :
+            ::FAStrUtf8ToArray(pStr, Len, pArray, MaxSize);
     }
 
-    // get the types right, hModel is always defined 
-    const FAModelData * pModel = (const FAModelData *) hModel;
+    // converts UTF-32 array into the output string
+    static inline const int Encode(const int * pArray, const int Size, Ch * pStr, const int MaxStrSize)
+    {
+        return ::FAArrayToStrUtf8(pArray, Size, pStr, MaxStrSize);
+    }
 
-    // validate the parameters
-    if (0 == InUtf8StrByteCount) {
-        return 0;
+    // returns the offset of the last byte of the character starting at Offset
+    static inline const int GetCharEnd(const Ch * pStr, const int /*Len*/, const int Offset)
+    {
+        const int CharSize = ::FAUtf8Size(pStr + Offset);
+        return Offset + (0 < CharSize ? CharSize - 1 : 0);
     }
-    if (0 > InUtf8StrByteCount || InUtf8StrByteCount > FALimits::MaxArrSize) {
-        return -1;
+};
+
+
+//
+// UTF-16LE input and output, the offsets are in 16-bit code units
+//
+struct FAUtf16Traits
+{
+    typedef uint16_t Ch;
+
+    // converts input string into UTF-32 array, pOffsets can be NULL
+    static inline const int Decode(const Ch * pStr, const int Len, int * pArray, int * pOffsets, const int MaxSize)
+    {
+        return ::FAStrUtf16LEToArray(pStr, Len, pArray, pOffsets, MaxSize);
     }
-    if (NULL == pInUtf8Str) {
-        return -1;
+
+    // converts UTF-32 array into the output string
+    static inline const int Encode(const int * pArray, const int Size, Ch * pStr, const int MaxStrSize)
+    {
+        return ::FAArrayToStrUtf16LE(pArray, Size, pStr, MaxStrSize);
     }
 
-    // allocate buffer for UTF-32, sentence breaking results, word-breaking results
-    std::vector< int > utf32input(InUtf8StrByteCount);
-    int * pBuff = utf32input.data();
-    if (NULL == pBuff) {
-        return -1;
+    // returns the offset of the last unit of the character starting at Offset,
+    // an unpaired surrogate is a character of its own
+    static inline const int GetCharEnd(const Ch * pStr, const int Len, const int Offset)
+    {
+        return Offset + (0xD800 == (0xFC00 & pStr[Offset]) && Offset + 1 < Len && 0xDC00 == (0xFC00 & pStr[Offset + 1]) ? 1 : 0);
     }
-    std::vector< int > utf32offsets(InUtf8StrByteCount);
-    int * pOffsets = utf32offsets.data();
-    if (NULL == pOffsets) {
-        return -1;
+};
+
+
+//
+// Copies valid UTF-8 input into the byte buffer for the UTF-8 byte automaton,
+// skips the BOM, replaces 0 bytes with spaces. Returns the number of bytes in
+// the buffer and the number of skipped leading bytes in BomSize, or -1 if the
+// input is not a valid UTF-8.
+//
+inline int FAStrUtf8ToBytes(const char * pStr, const int Len, unsigned char * pBuff, int * pBomSize)
+{
+    int BomSize = 0;
+    if (3 <= Len && 0xEF == (unsigned char) pStr[0] &&
+        0xBB == (unsigned char) pStr[1] && 0xBF == (unsigned char) pStr[2]) {
+        BomSize = 3;
+    }
+    *pBomSize = BomSize;
+
+    const char * pBegin = pStr + BomSize;
+    const char * pEnd = pStr + Len;
+    const char * pCurr = pBegin;
+
+    while (pCurr < pEnd) {
+        // ASCII characters are copied as-is
+        const unsigned char C = (unsigned char) *pCurr;
+        if (0x80 > C) {
+            *pBuff++ = 0 == C ? 0x20 : C;
+            pCurr++;
+            continue;
+        }
+        // validate the multi-byte sequence
+        int Symbol;
+        const char * pNext = ::FAUtf8ToInt(pCurr, pEnd, &Symbol);
+        if (NULL == pNext) {
+            return -1;
+        }
+        for (; pCurr < pNext; ++pCurr) {
+            *pBuff++ = (unsigned char) *pCurr;
+        }
     }
-    // make sure there are no uninitialized offsets
-    if (pStartOffsets) {
-        memset(pStartOffsets, 0, MaxOutUtf8StrByteCount * sizeof(int));
+
+    return (int)(pEnd - pBegin);
+}
+
+
+//
+// The same as FAGetFirstNonWhiteSpace but for the UTF-8 bytes, returns the
+// offset in bytes
+//
+inline int FAGetFirstNonWhiteSpaceUtf8(const unsigned char * pStr, const int StrLen)
+{
+    const char * pBegin = (const char *) pStr;
+    const char * pEnd = pBegin + StrLen;
+    const char * pCurr = pBegin;
+
+    while (pCurr < pEnd) {
+        int C;
+        const char * pNext = ::FAUtf8ToInt(pCurr, pEnd, &C);
+        if (NULL == pNext || !(__FAIsWhiteSpace__(C))) {
+            break;
+        }
+        pCurr = pNext;
     }
-    if (pEndOffsets) {
-        memset(pEndOffsets, 0, MaxOutUtf8StrByteCount * sizeof(int));
+
+    return (int)(pCurr - pBegin);
+}
+
+
+//
+// Appends bytes [From, To] to the output stream, the Delim characters are
+// replaced with the Sub characters
+//
+inline void FAAddBytes(std::ostringstream & Os, const unsigned char * pBuff,
+    const int From, const int To, const char Delim, const char Sub)
+{
+    for (int i = From; i <= To; ++i) {
+        const char C = (char) pBuff[i];
+        Os << (Delim == C ? Sub : C);
     }
+}
 
-    // convert input to UTF-32
-    const int MaxBuffSize = ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff, pOffsets, InUtf8StrByteCount);
-    if (MaxBuffSize <= 0 || MaxBuffSize > InUtf8StrByteCount) {
+
+//
+// TextToSentencesWithOffsetsWithModel for the models with UTF-8 byte automaton,
+// the parameters are already validated
+//
+static const int TextToSentencesWithOffsetsUtf8(const FAModelData * pModel,
+    const char * pInUtf8Str, int InUtf8StrByteCount,
+    char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount)
+{
+    // copy the input bytes, no decoding is needed
+    std::vector< unsigned char > utf8input(InUtf8StrByteCount);
+    unsigned char * pBuff = utf8input.data();
+    if (NULL == pBuff) {
         return -1;
     }
-    // make sure the utf32input does not contain 'U+0000' elements
-    std::replace(pBuff, pBuff + MaxBuffSize, 0, 0x20);
-
-    // allocated a buffer for UTF-8 output
-    std::vector< char > utf8output(InUtf8StrByteCount + 1);
-    char * pTmpUtf8 = utf8output.data();
-    if (NULL == pTmpUtf8) {
+    int BomSize = 0;
+    const int MaxBuffSize = FAStrUtf8ToBytes(pInUtf8Str, InUtf8StrByteCount, pBuff, &BomSize);
+    if (MaxBuffSize <= 0 || MaxBuffSize > InUtf8StrByteCount) {
         return -1;
     }
 
@@ -217,8 +373,8 @@ const int TextToSentencesWithOffsetsWithModel(const char * pInUtf8Str, int InUtf
         return -1;
     }
 
-    // get the sentence breaking results
-    const int SbdOutSize = pModel->m_Engine.Process(pBuff, MaxBuffSize, pSbdRes, MaxBuffSize * 3);
+    // get the sentence breaking results, From and To are byte offsets
+    const int SbdOutSize = pModel->m_EngineUtf8.Process(pBuff, MaxBuffSize, pSbdRes, MaxBuffSize * 3);
     if (SbdOutSize > MaxBuffSize * 3 || 0 != SbdOutSize % 3) {
         return -1;
     }
@@ -227,90 +383,37 @@ const int TextToSentencesWithOffsetsWithModel(const char * pInUtf8Str, int InUtf
     int SentCount = 0;
     // accumulate the output here
     std::ostringstream Os;
-    // keep track if a sentence was already added
-    bool fAdded = false;
     // set previous sentence end to -1
     int PrevEnd = -1;
 
-    for (int i = 0; i < SbdOutSize; i += 3) {
+    // the last iteration adds the end of paragraph as the end of sentence
+    for (int i = 0; i <= SbdOutSize; i += 3) {
 
-        // we don't care about Tag or From for p2s task
         const int From = PrevEnd + 1;
-        const int To = pSbdRes[i + 2];
+        const int To = i < SbdOutSize ? pSbdRes[i + 2] : MaxBuffSize - 1;
         const int Len = To - From + 1;
         PrevEnd = To;
 
-        // adjust sentence start if needed
-        const int Delta = FAGetFirstNonWhiteSpace(pBuff + From, Len);
-        if (Delta < Len) {
-            // convert buffer to a UTF-8 string, we temporary use pOutUtf8Str, MaxOutUtf8StrByteCount
-            const int StrOutSize = ::FAArrayToStrUtf8(pBuff + From + Delta, Len - Delta, pTmpUtf8, InUtf8StrByteCount);
-            if (pStartOffsets && SentCount < MaxOutUtf8StrByteCount) {
-                pStartOffsets[SentCount] = pOffsets[From + Delta];
-            }
-            if (pEndOffsets && SentCount < MaxOutUtf8StrByteCount) {
-                const int ToCharSize = ::FAUtf8Size(pInUtf8Str + pOffsets[To]);
-                pEndOffsets[SentCount] = pOffsets[To] + (0 < ToCharSize ? ToCharSize - 1 : 0);
-            }
-            SentCount++;
-
-            // check the output size
-            if (0 > StrOutSize || StrOutSize > InUtf8StrByteCount) {
-                // should never happen, but happened :-(
-                return -1;
-            }
-            else {
-                // add a new line separator
-                if (fAdded) {
-                    Os << '\n';
-                }
-                // make sure this buffer does not contain '\n' since it is a delimiter
-                std::replace(pTmpUtf8, pTmpUtf8 + StrOutSize, '\n', ' ');
-                // actually copy the data into the string builder
-                pTmpUtf8[StrOutSize] = 0;
-                Os << pTmpUtf8;
-                fAdded = true;
-            }
+        if (0 >= Len) {
+            continue;
         }
-    }
-
-    // always use the end of paragraph as the end of sentence
-    if (PrevEnd + 1 < MaxBuffSize) {
-
-        const int From = PrevEnd + 1;
-        const int To = MaxBuffSize - 1;
-        const int Len = To - From + 1;
 
         // adjust sentence start if needed
-        const int Delta = FAGetFirstNonWhiteSpace(pBuff + From, Len);
+        const int Delta = FAGetFirstNonWhiteSpaceUtf8(pBuff + From, Len);
         if (Delta < Len) {
-            // convert buffer to a UTF-8 string, we temporary use pOutUtf8Str, MaxOutUtf8StrByteCount
-            const int StrOutSize = ::FAArrayToStrUtf8(pBuff + From + Delta, Len - Delta, pTmpUtf8, InUtf8StrByteCount);
             if (pStartOffsets && SentCount < MaxOutUtf8StrByteCount) {
-                pStartOffsets[SentCount] = pOffsets[From + Delta];
+                pStartOffsets[SentCount] = From + Delta + BomSize;
             }
             if (pEndOffsets && SentCount < MaxOutUtf8StrByteCount) {
-                const int ToCharSize = ::FAUtf8Size(pInUtf8Str + pOffsets[To]);
-                pEndOffsets[SentCount] = pOffsets[To] + (0 < ToCharSize ? ToCharSize - 1 : 0);
-            }
-            SentCount++;
-
-            // check the output size
-            if (0 > StrOutSize || StrOutSize > InUtf8StrByteCount) {
-                // should never happen, but happened :-(
-                return -1;
+                pEndOffsets[SentCount] = To + BomSize;
             }
-            else {
-                // add a new line separator
-                if (fAdded) {
-                    Os << '\n';
-                }
-                // make sure this buffer does not contain '\n' since it is a delimiter
-                std::replace(pTmpUtf8, pTmpUtf8 + StrOutSize, '\n', ' ');
-                // actually copy the data into the string builder
-                pTmpUtf8[StrOutSize] = 0;
-                Os << pTmpUtf8;
+            // add a new line separator
+            if (0 < SentCount) {
+                Os << '\n';
             }
+            SentCount++;
+            // make sure the sentence does not contain '\n' since it is a delimiter
+            FAAddBytes(Os, pBuff, From + Delta, To, '\n', ' ');
         }
     }
 
@@ -330,66 +433,505 @@ const int TextToSentencesWithOffsetsWithModel(const char * pInUtf8Str, int InUtf
 
 
 //
-// The same as TextToSentences, but this one also returns original offsets from the input buffer for each sentence.
-//
-// pStartOffsets is an array of integers (first character of each sentence) with upto MaxOutUtf8StrByteCount elements
-// pEndOffsets is an array of integers (last character of each sentence) with upto MaxOutUtf8StrByteCount elements
+// TextToWordsWithOffsetsWithModel for the models with UTF-8 byte automaton,
+// the parameters are already validated
 //
-extern "C"
-const int TextToSentencesWithOffsets(const char * pInUtf8Str, int InUtf8StrByteCount,
+static const int TextToWordsWithOffsetsUtf8(const FAModelData * pModel,
+    const char * pInUtf8Str, int InUtf8StrByteCount,
     char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount)
 {
-    return TextToSentencesWithOffsetsWithModel(pInUtf8Str, InUtf8StrByteCount, pOutUtf8Str,  pStartOffsets, pEndOffsets, MaxOutUtf8StrByteCount, NULL);
+    // copy the input bytes, no decoding is needed
+    std::vector< unsigned char > utf8input(InUtf8StrByteCount);
+    unsigned char * pBuff = utf8input.data();
+    if (NULL == pBuff) {
+        return -1;
+    }
+    int BomSize = 0;
+    const int MaxBuffSize = FAStrUtf8ToBytes(pInUtf8Str, InUtf8StrByteCount, pBuff, &BomSize);
+    if (MaxBuffSize <= 0 || MaxBuffSize > InUtf8StrByteCount) {
+        return -1;
+    }
+
+    // keep word boundary information here
+    std::vector< int > WbdRes(MaxBuffSize * 3);
+    int * pWbdRes = WbdRes.data();
+    if (NULL == pWbdRes) {
+        return -1;
+    }
+
+    // get the word breaking results, From and To are byte offsets
+    const int WbdOutSize = pModel->m_EngineUtf8.Process(pBuff, MaxBuffSize, pWbdRes, MaxBuffSize * 3);
+    if (WbdOutSize > MaxBuffSize * 3 || 0 != WbdOutSize % 3) {
+        return -1;
+    }
+
+    // keep track of the word count
+    int WordCount = 0;
+    // accumulate the output here
+    std::ostringstream Os;
+
+    for (int i = 0; i < WbdOutSize; i += 3) {
+
+        // ignore tokens with IGNORE tag
+        const int Tag = pWbdRes[i];
+        if (WBD_IGNORE_TAG == Tag) {
+            continue;
+        }
+
+        const int From = pWbdRes[i + 1];
+        const int To = pWbdRes[i + 2];
+
+        if (pStartOffsets && WordCount < MaxOutUtf8StrByteCount) {
+            pStartOffsets[WordCount] = From + BomSize;
+        }
+        if (pEndOffsets && WordCount < MaxOutUtf8StrByteCount) {
+            pEndOffsets[WordCount] = To + BomSize;
+        }
+        // add a space separator
+        if (0 < WordCount) {
+            Os << ' ';
+        }
+        WordCount++;
+        // make sure the word does not contain ' ' since it is a delimiter
+        FAAddBytes(Os, pBuff, From, To, ' ', '_');
+    }
+
+    // we will include the 0 just in case some scriping languages expect 0-terminated buffers and cannot use the size
+    Os << char(0);
+
+    // get the actual output buffer as one string
+    const std::string & OsStr = Os.str();
+    const char * pStr = OsStr.c_str();
+    const int StrLen = (int)OsStr.length();
+
+    if (StrLen <= MaxOutUtf8StrByteCount) {
+        memcpy(pOutUtf8Str, pStr, StrLen);
+    }
+    return StrLen;
 }
 
 
 //
-// The same as TextToSentences, but allows to load a custom model
-// 
-// The hModel parameter allows to use a custom model loaded with LoadModel API, if NULL then
-//  the built in is used.
+// Converts UTF-16LE input into UTF-8, skips the BOM and replaces unpaired
+// surrogates with U+FFFD. For each output byte pOffsets gets the offset of its
+// character in 16-bit units: the first byte gets the first unit and the other
+// bytes get the last unit. pUtf8 and pOffsets should have 3 * Len elements.
+// Returns the number of bytes.
 //
-extern "C"
-const int TextToSentencesWithModel(const char * pInUtf8Str, int InUtf8StrByteCount, char * pOutUtf8Str, const int MaxOutUtf8StrByteCount, void * hModel)
+inline int FAStrUtf16LEToUtf8(const uint16_t * pStr, const int Len, char * pUtf8, int * pOffsets)
 {
-    return TextToSentencesWithOffsetsWithModel(pInUtf8Str, InUtf8StrByteCount, pOutUtf8Str,  NULL, NULL, MaxOutUtf8StrByteCount, hModel);
+    int j = 0;
+    if (1 <= Len && 0xFEFF == pStr[0]) {
+        j = 1;
+    }
+
+    int Size = 0;
+
+    while (j < Len) {
+
+        const int Offset = j;
+        int Symbol = pStr[j++];
+
+        if (0xD800 == (0xFC00 & Symbol) && j < Len && 0xDC00 == (0xFC00 & pStr[j])) {
+            Symbol = 0x10000 + ((Symbol & 0x3FF) << 10) + (pStr[j++] & 0x3FF);
+        } else if (0xD800 == (0xF800 & Symbol)) {
+            Symbol = 0xFFFD;
+        }
+
+        const char * pEnd = ::FAIntToUtf8(Symbol, pUtf8 + Size, 4);
+        const int CharSize = (int)(pEnd - (pUtf8 + Size));
+
+        pOffsets[Size] = Offset;
+        for (int k = 1; k < CharSize; ++k) {
+            pOffsets[Size + k] = j - 1;
+        }
+        Size += CharSize;
+    }
+
+    return Size;
 }
 
 
+typedef const int (*FAUtf8WithOffsetsFn)(const FAModelData * pModel,
+    const char * pInUtf8Str, int InUtf8StrByteCount,
+    char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount);
+
 //
-// Splits plain-text in UTF-8 encoding into sentences.
-//
-// Input:  UTF-8 string of one paragraph or document
-// Output: Size in bytes of the output string and UTF-8 string of '\n' delimited sentences, if the return size <= MaxOutUtf8StrByteCount
-//
-//  Notes:  
-//
-//  1. The return value is -1 in case of an error (make sure your input is a valid UTF-8, BOM is not required)
-//  2. We do not use "\r\n" to delimit sentences, it is always '\n'
-//  3. It is not necessary to remove '\n' from the input paragraph, sentence breaking algorithm will take care of them
-//  4. The output sentences will not contain '\n' in them
+// Runs the UTF-8 byte automaton function on UTF-16LE input, converts the
+// output back to UTF-16LE and the offsets to 16-bit units
 //
-extern "C"
-const int TextToSentences(const char * pInUtf8Str, int InUtf8StrByteCount, char * pOutUtf8Str, const int MaxOutUtf8StrByteCount)
+static const int TextToTokensWithOffsetsUtf16(FAUtf8WithOffsetsFn pUtf8Fn, const FAModelData * pModel,
+    const uint16_t * pInStr, int InStrSize,
+    uint16_t * pOutStr, int * pStartOffsets, int * pEndOffsets, const int MaxOutStrSize)
 {
-    return TextToSentencesWithOffsetsWithModel(pInUtf8Str, InUtf8StrByteCount, pOutUtf8Str,  NULL, NULL, MaxOutUtf8StrByteCount, NULL);
+    // convert the input into UTF-8
+    std::vector< char > utf8input(3 * InStrSize);
+    std::vector< int > utf8offsets(3 * InStrSize);
+    const int Utf8Size = FAStrUtf16LEToUtf8(pInStr, InStrSize, utf8input.data(), utf8offsets.data());
+    if (0 >= Utf8Size) {
+        return -1;
+    }
+
+    // each input byte is copied at most once, plus delimiters and the 0
+    const int MaxUtf8OutSize = (2 * Utf8Size) + 1;
+    std::vector< char > utf8output(MaxUtf8OutSize);
+    // -1 marks the unused offsets
+    std::vector< int > Starts(MaxUtf8OutSize, -1);
+    std::vector< int > Ends(MaxUtf8OutSize, -1);
+
+    const int Utf8OutSize = (*pUtf8Fn)(pModel, utf8input.data(), Utf8Size,
+        utf8output.data(), Starts.data(), Ends.data(), MaxUtf8OutSize);
+    if (0 >= Utf8OutSize || Utf8OutSize > MaxUtf8OutSize) {
+        return -1;
+    }
+
+    // map the byte offsets to the offsets in 16-bit units
+    const int * pOffsets = utf8offsets.data();
+    for (int i = 0; i < MaxOutStrSize && i < MaxUtf8OutSize && -1 != Starts[i]; ++i) {
+        if (pStartOffsets) {
+            pStartOffsets[i] = pOffsets[Starts[i]];
+        }
+        if (pEndOffsets) {
+            pEndOffsets[i] = pOffsets[Ends[i]];
+        }
+    }
+
+    // convert the output into UTF-16LE, the terminating 0 included
+    std::vector< int > utf32output(Utf8OutSize);
+    const int Utf32OutSize = ::FAStrUtf8ToArray(utf8output.data(), Utf8OutSize, utf32output.data(), Utf8OutSize);
+    if (0 >= Utf32OutSize) {
+        return -1;
+    }
+    std::vector< uint16_t > utf16output(Utf8OutSize);
+    const int StrLen = ::FAArrayToStrUtf16LE(utf32output.data(), Utf32OutSize, utf16output.data(), Utf8OutSize);
+    if (0 >= StrLen) {
+        return -1;
+    }
+
+    if (StrLen <= MaxOutStrSize) {
+        memcpy(pOutStr, utf16output.data(), StrLen * sizeof(uint16_t));
+    }
+    return StrLen;
 }
 
 
 //
-// Same as TextToWords, but also returns original offsets from the input buffer for each word and allows to use a 
-//  custom model
+// UTF-8 byte automata read UTF-16 input converted into UTF-8
 //
-// pStartOffsets is an array of integers (first character of each word) with upto MaxOutUtf8StrByteCount elements
-// pEndOffsets is an array of integers (last character of each word) with upto MaxOutUtf8StrByteCount elements
+static const int TextToSentencesWithOffsetsUtf8(const FAModelData * pModel,
+    const uint16_t * pInStr, int InStrSize,
+    uint16_t * pOutStr, int * pStartOffsets, int * pEndOffsets, const int MaxOutStrSize)
+{
+    return TextToTokensWithOffsetsUtf16(&TextToSentencesWithOffsetsUtf8, pModel,
+        pInStr, InStrSize, pOutStr, pStartOffsets, pEndOffsets, MaxOutStrSize);
+}
+
+static const int TextToWordsWithOffsetsUtf8(const FAModelData * pModel,
+    const uint16_t * pInStr, int InStrSize,
+    uint16_t * pOutStr, int * pStartOffsets, int * pEndOffsets, const int MaxOutStrSize)
+{
+    return TextToTokensWithOffsetsUtf16(&TextToWordsWithOffsetsUtf8, pModel,
+        pInStr, InStrSize, pOutStr, pStartOffsets, pEndOffsets, MaxOutStrSize);
+}
+
+
+//
+// Implements TextToSentencesWithOffsetsWithModel for the input and output encoding
+// defined by Tr, the offsets are in the units of the encoding
+//
+template < class Tr >
+static const int TextToSentencesWithOffsets_t(const typename Tr::Ch * pInStr, int InStrSize,
+    typename Tr::Ch * pOutStr, int * pStartOffsets, int * pEndOffsets, const int MaxOutStrSize,
+    void * hModel)
+{
+    // check if the initilization is needed
+    if (false == g_fInitialized) {
+        // make sure only one thread can get the mutex
+        std::lock_guard<std::mutex> guard(g_InitializationMutex);
+        // see if the g_fInitialized is still false
+        if (false == g_fInitialized) {
+            InitializeWbdSbd();
+            g_fInitialized = true;
+        }
+    }
+
+    // use the default model if it was not provided
+    if (NULL == hModel) {
+        hModel = &g_DefaultSbd;
+    }
+
+    // get the types right, hModel is always defined 
+    const FAModelData * pModel = (const FAModelData *) hModel;
+
+    // validate the parameters
+    if (0 == InStrSize) {
+        return 0;
+    }
+    if (0 > InStrSize || InStrSize > FALimits::MaxArrSize) {
+        return -1;
+    }
+    if (NULL == pInStr) {
+        return -1;
+    }
+
+    // make sure there are no uninitialized offsets
+    if (pStartOffsets) {
+        memset(pStartOffsets, 0, MaxOutStrSize * sizeof(int));
+    }
+    if (pEndOffsets) {
+        memset(pEndOffsets, 0, MaxOutStrSize * sizeof(int));
+    }
+
+    // UTF-8 byte automaton reads the input as-is
+    if (pModel->m_isUtf8) {
+        return TextToSentencesWithOffsetsUtf8(pModel, pInStr, InStrSize,
+            pOutStr, pStartOffsets, pEndOffsets, MaxOutStrSize);
+    }
+
+    // allocate buffer for UTF-32, sentence breaking results, word-breaking results
+    std::vector< int > utf32input(InStrSize);
+    int * pBuff = utf32input.data();
+    if (NULL == pBuff) {
+        return -1;
+    }
+    std::vector< int > utf32offsets(InStrSize);
+    int * pOffsets = utf32offsets.data();
+    if (NULL == pOffsets) {
+        return -1;
+    }
+
+    // convert input to UTF-32
+    const int MaxBuffSize = Tr::Decode(pInStr, InStrSize, pBuff, pOffsets, InStrSize);
+    if (MaxBuffSize <= 0 || MaxBuffSize > InStrSize) {
+        return -1;
+    }
+    // make sure the utf32input does not contain 'U+0000' elements
+    std::replace(pBuff, pBuff + MaxBuffSize, 0, 0x20);
+
+    // allocated a buffer for the output
+    std::vector< typename Tr::Ch > tmpoutput(InStrSize + 1);
+    typename Tr::Ch * pTmpStr = tmpoutput.data();
+    if (NULL == pTmpStr) {
+        return -1;
+    }
+
+    // keep sentence boundary information here
+    std::vector< int > SbdRes(MaxBuffSize * 3);
+    int * pSbdRes = SbdRes.data();
+    if (NULL == pSbdRes) {
+        return -1;
+    }
+
+    // get the sentence breaking results
+    const int SbdOutSize = pModel->m_Engine.Process(pBuff, MaxBuffSize, pSbdRes, MaxBuffSize * 3);
+    if (SbdOutSize > MaxBuffSize * 3 || 0 != SbdOutSize % 3) {
+        return -1;
+    }
+
+    // number of sentences
+    int SentCount = 0;
+    // accumulate the output here
+    std::vector< typename Tr::Ch > Os;
+    // keep track if a sentence was already added
+    bool fAdded = false;
+    // set previous sentence end to -1
+    int PrevEnd = -1;
+
+    for (int i = 0; i < SbdOutSize; i += 3) {
+
+        // we don't care about Tag or From for p2s task
+        const int From = PrevEnd + 1;
+        const int To = pSbdRes[i + 2];
+        const int Len = To - From + 1;
+        PrevEnd = To;
+
+        // adjust sentence start if needed
+        const int Delta = FAGetFirstNonWhiteSpace(pBuff + From, Len);
+        if (Delta < Len) {
+            // convert buffer to the output encoding, we temporary use pTmpStr
+            const int StrOutSize = Tr::Encode(pBuff + From + Delta, Len - Delta, pTmpStr, InStrSize);
+            if (pStartOffsets && SentCount < MaxOutStrSize) {
+                pStartOffsets[SentCount] = pOffsets[From + Delta];
+            }
+            if (pEndOffsets && SentCount < MaxOutStrSize) {
+                pEndOffsets[SentCount] = Tr::GetCharEnd(pInStr, InStrSize, pOffsets[To]);
+            }
+            SentCount++;
+
+            // check the output size
+            if (0 > StrOutSize || StrOutSize > InStrSize) {
+                // should never happen, but happened :-(
+                return -1;
+            }
+            else {
+                // add a new line separator
+                if (fAdded) {
+                    Os.push_back('\n');
+                }
+                // make sure this buffer does not contain '\n' since it is a delimiter
+                std::replace(pTmpStr, pTmpStr + StrOutSize, '\n', ' ');
+                // actually copy the data into the string builder
+                Os.insert(Os.end(), pTmpStr, pTmpStr + StrOutSize);
+                fAdded = true;
+            }
+        }
+    }
+
+    // always use the end of paragraph as the end of sentence
+    if (PrevEnd + 1 < MaxBuffSize) {
+
+        const int From = PrevEnd + 1;
+        const int To = MaxBuffSize - 1;
+        const int Len = To - From + 1;
+
+        // adjust sentence start if needed
+        const int Delta = FAGetFirstNonWhiteSpace(pBuff + From, Len);
+        if (Delta < Len) {
+            // convert buffer to the output encoding, we temporary use pTmpStr
+            const int StrOutSize = Tr::Encode(pBuff + From + Delta, Len - Delta, pTmpStr, InStrSize);
+            if (pStartOffsets && SentCount < MaxOutStrSize) {
+                pStartOffsets[SentCount] = pOffsets[From + Delta];
+            }
+            if (pEndOffsets && SentCount < MaxOutStrSize) {
+                pEndOffsets[SentCount] = Tr::GetCharEnd(pInStr, InStrSize, pOffsets[To]);
+            }
+            SentCount++;
+
+            // check the output size
+            if (0 > StrOutSize || StrOutSize > InStrSize) {
+                // should never happen, but happened :-(
+                return -1;
+            }
+            else {
+                // add a new line separator
+                if (fAdded) {
+                    Os.push_back('\n');
+                }
+                // make sure this buffer does not contain '\n' since it is a delimiter
+                std::replace(pTmpStr, pTmpStr + StrOutSize, '\n', ' ');
+                // actually copy the data into the string builder
+                Os.insert(Os.end(), pTmpStr, pTmpStr + StrOutSize);
+            }
+        }
+    }
+
+    // we will include the 0 just in case some scriping languages expect 0-terminated buffers and cannot use the size
+    Os.push_back(0);
+
+    // get the actual output buffer size
+    const int StrLen = (int)Os.size();
+
+    if (StrLen <= MaxOutStrSize) {
+        memcpy(pOutStr, Os.data(), StrLen * sizeof(typename Tr::Ch));
+    }
+    return StrLen;
+}
+
+
+//
+// The same as TextToSentences, but it allows to use a custom model and returns offsets
+// 
+// pStartOffsets is an array of integers (first character of each sentence) with upto MaxOutUtf8StrByteCount elements
+// pEndOffsets is an array of integers (last character of each sentence) with upto MaxOutUtf8StrByteCount elements
 //
 // The hModel parameter allows to use a custom model loaded with LoadModel API, if NULL then
 //  the built in is used.
 //
+
 extern "C"
-const int TextToWordsWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8StrByteCount,
+const int TextToSentencesWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8StrByteCount,
     char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount,
     void * hModel)
+{
+    return TextToSentencesWithOffsets_t < FAUtf8Traits > (pInUtf8Str, InUtf8StrByteCount,
+        pOutUtf8Str, pStartOffsets, pEndOffsets, MaxOutUtf8StrByteCount, hModel);
+}
+
+
+//
+// The same as TextToSentences, but this one also returns original offsets from the input buffer for each sentence.
+//
+// pStartOffsets is an array of integers (first character of each sentence) with upto MaxOutUtf8StrByteCount elements
+// pEndOffsets is an array of integers (last character of each sentence) with upto MaxOutUtf8StrByteCount elements
+//
+extern "C"
+const int TextToSentencesWithOffsets(const char * pInUtf8Str, int InUtf8StrByteCount,
+    char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount)
+{
+    return TextToSentencesWithOffsetsWithModel(pInUtf8Str, InUtf8StrByteCount, pOutUtf8Str,  pStartOffsets, pEndOffsets, MaxOutUtf8StrByteCount, NULL);
+}
+
+
+//
+// The same as TextToSentences, but allows to load a custom model
+// 
+// The hModel parameter allows to use a custom model loaded with LoadModel API, if NULL then
+//  the built in is used.
+//
+extern "C"
+const int TextToSentencesWithModel(const char * pInUtf8Str, int InUtf8StrByteCount, char * pOutUtf8Str, const int MaxOutUtf8StrByteCount, void * hModel)
+{
+    return TextToSentencesWithOffsetsWithModel(pInUtf8Str, InUtf8StrByteCount, pOutUtf8Str,  NULL, NULL, MaxOutUtf8StrByteCount, hModel);
+}
+
+
+//
+// Splits plain-text in UTF-8 encoding into sentences.
+//
+// Input:  UTF-8 string of one paragraph or document
+// Output: Size in bytes of the output string and UTF-8 string of '\n' delimited sentences, if the return size <= MaxOutUtf8StrByteCount
+//
+//  Notes:  
+//
+//  1. The return value is -1 in case of an error (make sure your input is a valid UTF-8, BOM is not required)
+//  2. We do not use "\r\n" to delimit sentences, it is always '\n'
+//  3. It is not necessary to remove '\n' from the input paragraph, sentence breaking algorithm will take care of them
+//  4. The output sentences will not contain '\n' in them
+//
+extern "C"
+const int TextToSentences(const char * pInUtf8Str, int InUtf8StrByteCount, char * pOutUtf8Str, const int MaxOutUtf8StrByteCount)
+{
+    return TextToSentencesWithOffsetsWithModel(pInUtf8Str, InUtf8StrByteCount, pOutUtf8Str,  NULL, NULL, MaxOutUtf8StrByteCount, NULL);
+}
+
+
+//
+// The same as TextToSentencesWithOffsetsWithModel, but the input and the output are UTF-16LE strings,
+// InUtf16StrSize, MaxOutUtf16StrSize, the return value and the offsets are in 16-bit code units.
+// Surrogate pairs are decoded directly, so callers holding UTF-16 strings (.NET, Java) do not need
+// to transcode to UTF-8 and map byte offsets back.
+//
+// Unpaired surrogates are read as U+FFFD. Models compiled with utf8-input get the input converted
+// to UTF-8 and their offsets are mapped back to 16-bit units.
+//
+extern "C"
+const int TextToSentencesWithOffsetsWithModel_Utf16(const uint16_t * pInUtf16Str, int InUtf16StrSize,
+    uint16_t * pOutUtf16Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf16StrSize,
+    void * hModel)
+{
+    return TextToSentencesWithOffsets_t < FAUtf16Traits > (pInUtf16Str, InUtf16StrSize,
+        pOutUtf16Str, pStartOffsets, pEndOffsets, MaxOutUtf16StrSize, hModel);
+}
+
+
+//
+// The same as TextToSentences, but the input and the output are UTF-16LE strings
+//
+extern "C"
+const int TextToSentences_Utf16(const uint16_t * pInUtf16Str, int InUtf16StrSize, uint16_t * pOutUtf16Str, const int MaxOutUtf16StrSize)
+{
+    return TextToSentencesWithOffsetsWithModel_Utf16(pInUtf16Str, InUtf16StrSize, pOutUtf16Str, NULL, NULL, MaxOutUtf16StrSize, NULL);
+}
+
+
+//
+// Implements TextToWordsWithOffsetsWithModel for the input and output encoding
+// defined by Tr, the offsets are in the units of the encoding
+//
+template < class Tr >
+static const int TextToWordsWithOffsets_t(const typename Tr::Ch * pInStr, int InStrSize,
+    typename Tr::Ch * pOutStr, int * pStartOffsets, int * pEndOffsets, const int MaxOutStrSize,
+    void * hModel)
 {
     // check if the initilization is needed
     if (false == g_fInitialized) {
@@ -411,48 +953,54 @@ const int TextToWordsWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8Str
     const FAModelData * pModel = (const FAModelData *) hModel; 
 
     // validate the parameters
-    if (0 == InUtf8StrByteCount) {
+    if (0 == InStrSize) {
         return 0;
     }
-    if (0 > InUtf8StrByteCount || InUtf8StrByteCount > FALimits::MaxArrSize) {
+    if (0 > InStrSize || InStrSize > FALimits::MaxArrSize) {
         return -1;
     }
-    if (NULL == pInUtf8Str) {
+    if (NULL == pInStr) {
         return -1;
     }
 
+    // make sure there are no uninitialized offsets
+    if (pStartOffsets) {
+        memset(pStartOffsets, 0, MaxOutStrSize * sizeof(int));
+    }
+    if (pEndOffsets) {
+        memset(pEndOffsets, 0, MaxOutStrSize * sizeof(int));
+    }
+
+    // UTF-8 byte automaton reads the input as-is
+    if (pModel->m_isUtf8) {
+        return TextToWordsWithOffsetsUtf8(pModel, pInStr, InStrSize,
+            pOutStr, pStartOffsets, pEndOffsets, MaxOutStrSize);
+    }
+
     // allocate buffer for UTF-32, sentence breaking results, word-breaking results
-    std::vector< int > utf32input(InUtf8StrByteCount);
+    std::vector< int > utf32input(InStrSize);
     int * pBuff = utf32input.data();
     if (NULL == pBuff) {
         return -1;
     }
-
-    std::vector< int > utf32offsets(InUtf8StrByteCount);
+    std::vector< int > utf32offsets(InStrSize);
     int * pOffsets = utf32offsets.data();
     if (NULL == pOffsets) {
         return -1;
     }
-    // make sure there are no uninitialized offsets
-    if (pStartOffsets) {
-        memset(pStartOffsets, 0, MaxOutUtf8StrByteCount * sizeof(int));
-    }
-    if (pEndOffsets) {
-        memset(pEndOffsets, 0, MaxOutUtf8StrByteCount * sizeof(int));
-    }
 
     // convert input to UTF-32
-    const int MaxBuffSize = ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff, pOffsets, InUtf8StrByteCount);
-    if (MaxBuffSize <= 0 || MaxBuffSize > InUtf8StrByteCount) {
+    const int MaxBuffSize = Tr::Decode(pInStr, InStrSize, pBuff, pOffsets, InStrSize);
+    if (MaxBuffSize <= 0 || MaxBuffSize > InStrSize) {
         return -1;
     }
     // make sure the utf32input does not contain 'U+0000' elements
     std::replace(pBuff, pBuff + MaxBuffSize, 0, 0x20);
 
-    // allocated a buffer for UTF-8 output
-    std::vector< char > utf8output(InUtf8StrByteCount + 1);
-    char * pTmpUtf8 = utf8output.data();
-    if (NULL == pTmpUtf8) {
+    // allocated a buffer for the output
+    std::vector< typename Tr::Ch > tmpoutput(InStrSize + 1);
+    typename Tr::Ch * pTmpStr = tmpoutput.data();
+    if (NULL == pTmpStr) {
         return -1;
     }
 
@@ -472,7 +1020,7 @@ const int TextToWordsWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8Str
     // keep track of the word count
     int WordCount = 0;
     // accumulate the output here
-    std::ostringstream Os;
+    std::vector< typename Tr::Ch > Os;
     // keep track if a word was already added
     bool fAdded = false;
 
@@ -488,52 +1036,68 @@ const int TextToWordsWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8Str
         const int To = pWbdRes[i + 2];
         const int Len = To - From + 1;
 
-        // convert buffer to a UTF-8 string, we temporary use pOutUtf8Str, MaxOutUtf8StrByteCount
-        const int StrOutSize = ::FAArrayToStrUtf8(pBuff + From, Len, pTmpUtf8, InUtf8StrByteCount);
-        if (pStartOffsets && WordCount < MaxOutUtf8StrByteCount) {
+        // convert buffer to the output encoding, we temporary use pTmpStr
+        const int StrOutSize = Tr::Encode(pBuff + From, Len, pTmpStr, InStrSize);
+        if (pStartOffsets && WordCount < MaxOutStrSize) {
             pStartOffsets[WordCount] = pOffsets[From];
         }
-        if (pEndOffsets && WordCount < MaxOutUtf8StrByteCount) {
-            // offset of last UTF-32 character plus its length in bytes in the original string - 1
-            const int ToCharSize = ::FAUtf8Size(pInUtf8Str + pOffsets[To]);
-            pEndOffsets[WordCount] = pOffsets[To] + (0 < ToCharSize ? ToCharSize - 1 : 0);
+        if (pEndOffsets && WordCount < MaxOutStrSize) {
+            // offset of the last unit of the last UTF-32 character in the original string
+            pEndOffsets[WordCount] = Tr::GetCharEnd(pInStr, InStrSize, pOffsets[To]);
         }
         WordCount++;
 
         // check the output size
-        if (0 > StrOutSize || StrOutSize > InUtf8StrByteCount) {
+        if (0 > StrOutSize || StrOutSize > InStrSize) {
             // should never happen, but happened :-(
             return -1;
         }
         else {
             // add a new line separator
             if (fAdded) {
-                Os << ' ';
+                Os.push_back(' ');
             }
             // make sure this buffer does not contain ' ' since it is a delimiter
-            std::replace(pTmpUtf8, pTmpUtf8 + StrOutSize, ' ', '_');
+            std::replace(pTmpStr, pTmpStr + StrOutSize, ' ', '_');
             // actually copy the data into the string builder
-            pTmpUtf8[StrOutSize] = 0;
-            Os << pTmpUtf8;
+            Os.insert(Os.end(), pTmpStr, pTmpStr + StrOutSize);
             fAdded = true;
         }
     }
 
     // we will include the 0 just in case some scriping languages expect 0-terminated buffers and cannot use the size
-    Os << char(0);
+    Os.push_back(0);
 
-    // get the actual output buffer as one string
-    const std::string & OsStr = Os.str();
-    const char * pStr = OsStr.c_str();
-    const int StrLen = (int)OsStr.length();
+    // get the actual output buffer size
+    const int StrLen = (int)Os.size();
 
-    if (StrLen <= MaxOutUtf8StrByteCount) {
-        memcpy(pOutUtf8Str, pStr, StrLen);
+    if (StrLen <= MaxOutStrSize) {
+        memcpy(pOutStr, Os.data(), StrLen * sizeof(typename Tr::Ch));
     }
     return StrLen;
 }
 
 
+//
+// Same as TextToWords, but also returns original offsets from the input buffer for each word and allows to use a 
+//  custom model
+//
+// pStartOffsets is an array of integers (first character of each word) with upto MaxOutUtf8StrByteCount elements
+// pEndOffsets is an array of integers (last character of each word) with upto MaxOutUtf8StrByteCount elements
+//
+// The hModel parameter allows to use a custom model loaded with LoadModel API, if NULL then
+//  the built in is used.
+//
+extern "C"
+const int TextToWordsWithOffsetsWithModel(const char * pInUtf8Str, int InUtf8StrByteCount,
+    char * pOutUtf8Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf8StrByteCount,
+    void * hModel)
+{
+    return TextToWordsWithOffsets_t < FAUtf8Traits > (pInUtf8Str, InUtf8StrByteCount,
+        pOutUtf8Str, pStartOffsets, pEndOffsets, MaxOutUtf8StrByteCount, hModel);
+}
+
+
 //
 // Same as TextToWords, but also returns original offsets from the input buffer for each word.
 //
@@ -582,6 +1146,33 @@ const int TextToWords(const char * pInUtf8Str, int InUtf8StrByteCount, char * pO
 }
 
 
+//
+// The same as TextToWordsWithOffsetsWithModel, but the input and the output are UTF-16LE strings,
+// InUtf16StrSize, MaxOutUtf16StrSize, the return value and the offsets are in 16-bit code units.
+//
+// Unpaired surrogates are read as U+FFFD. Models compiled with utf8-input get the input converted
+// to UTF-8 and their offsets are mapped back to 16-bit units.
+//
+extern "C"
+const int TextToWordsWithOffsetsWithModel_Utf16(const uint16_t * pInUtf16Str, int InUtf16StrSize,
+    uint16_t * pOutUtf16Str, int * pStartOffsets, int * pEndOffsets, const int MaxOutUtf16StrSize,
+    void * hModel)
+{
+    return TextToWordsWithOffsets_t < FAUtf16Traits > (pInUtf16Str, InUtf16StrSize,
+        pOutUtf16Str, pStartOffsets, pEndOffsets, MaxOutUtf16StrSize, hModel);
+}
+
+
+//
+// The same as TextToWords, but the input and the output are UTF-16LE strings
+//
+extern "C"
+const int TextToWords_Utf16(const uint16_t * pInUtf16Str, int InUtf16StrSize, uint16_t * pOutUtf16Str, const int MaxOutUtf16StrSize)
+{
+    return TextToWordsWithOffsetsWithModel_Utf16(pInUtf16Str, InUtf16StrSize, pOutUtf16Str, NULL, NULL, MaxOutUtf16StrSize, NULL);
+}
+
+
 //
 // This function is like TextToWords, but it only normalizes consequtive spaces, it is not as flexble
 //  as TextToWords as it cannot take a tokenization and normalization rules, but it does space normalization
@@ -600,54 +1191,157 @@ const int NormalizeSpaces(const char * pInUtf8Str, int InUtf8StrByteCount, char
     // we can get weird results if this is not true
     DebugLogAssert(__FAIsWhiteSpace__(uSpace));
 
-    if (0 == InUtf8StrByteCount) {
+    if (0 >= InUtf8StrByteCount || NULL == pInUtf8Str) {
         return -1;
     }
 
-    // allocate buffer for UTF-32, sentence breaking results, word-breaking results
-    std::vector< int > utf32input(InUtf8StrByteCount);
-    int * pBuff = utf32input.data();
-    if (NULL == pBuff) {
+    // UTF-8 encoding of the space
+    char Space [FAUtf8Const::MAX_CHAR_SIZE];
+    const char * pSpaceEnd = ::FAIntToUtf8(uSpace, Space, FAUtf8Const::MAX_CHAR_SIZE);
+    if (NULL == pSpaceEnd) {
         return -1;
     }
+    const int SpaceSize = (int) (pSpaceEnd - Space);
 
-    // convert input to UTF-32
-    int MaxBuffSize = ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff, InUtf8StrByteCount);
-    if (MaxBuffSize <= 0 || MaxBuffSize > InUtf8StrByteCount) {
+    const char * pIn = pInUtf8Str;
+    const char * pEnd = pInUtf8Str + InUtf8StrByteCount;
+
+    // skip the Byte-Order-Mark
+    if (3 <= InUtf8StrByteCount && 0xEF == (unsigned char) pIn[0] &&
+        0xBB == (unsigned char) pIn[1] && 0xBF == (unsigned char) pIn[2]) {
+        pIn += 3;
+    }
+    if (pIn == pEnd) {
         return -1;
     }
 
-    int i = 0; // index for reading
-    int j = 0; // index for writing
-    while (i < MaxBuffSize) {
+    // the output size, can be bigger than MaxOutUtf8StrByteCount, then nothing is written
+    int OutSize = 0;
+    // output offset of the last written character
+    int LastCharPos = 0;
+    // number of written characters
+    int CharCount = 0;
+    // true if the last written character is uSpace
+    bool fLastIsSpace = false;
+    // true if uSpace should be written before the next non-space character
+    bool fPending = false;
+
+    while (pIn < pEnd) {
+
+        // find a run of ASCII non-space characters
+        const char * pRun = pIn;
+
+#ifdef FA_USE_SSE2
+        const __m128i Max20 = _mm_set1_epi8(0x20);
+        while (pIn + 16 <= pEnd) {
+            const __m128i X = _mm_loadu_si128((const __m128i *) pIn);
+            // bytes <= 0x20 are ASCII spaces, bytes >= 0x80 have the highest bit set
+            const __m128i IsSpace = _mm_cmpeq_epi8(_mm_min_epu8(X, Max20), X);
+            const unsigned int Mask = (unsigned int) _mm_movemask_epi8(_mm_or_si128(IsSpace, X));
+            if (0 != Mask) {
+#ifdef _MSC_VER
+                unsigned long Idx;
+                _BitScanForward(&Idx, Mask);
+                pIn += Idx;
+#else
+                pIn += __builtin_ctz(Mask);
+#endif
+                break;
+            }
+            pIn += 16;
+        }
+#endif
+        while (pIn < pEnd && 0x20 < (unsigned char) *pIn && 0x80 > (unsigned char) *pIn) {
+            pIn++;
+        }
 
-        const int Ci = pBuff[i++];
+        // copy the run as-is
+        if (pRun < pIn) {
 
-        // check if the Ci is not a space
-        if (!__FAIsWhiteSpace__(Ci)) {
-            // copy it
-            pBuff[j++] = Ci;
-        // if Ci is a space, check if the previous character was not a sapce
-        } else if (0 < j && uSpace != pBuff[j - 1]) {
-            // copy normalized space
-            pBuff[j++] = uSpace;
+            if (fPending) {
+                if (OutSize + SpaceSize <= MaxOutUtf8StrByteCount) {
+                    memcpy(pOutUtf8Str + OutSize, Space, SpaceSize);
+                }
+                OutSize += SpaceSize;
+                fPending = false;
+            }
+
+            // copy as much as fits, the last character can be trimmed later
+            const int RunSize = (int) (pIn - pRun);
+            const int CopySize = std::min(RunSize, MaxOutUtf8StrByteCount - OutSize);
+            if (0 < CopySize) {
+                memcpy(pOutUtf8Str + OutSize, pRun, CopySize);
+            }
+            OutSize += RunSize;
+
+            LastCharPos = OutSize - 1;
+            CharCount += RunSize;
+            fLastIsSpace = uSpace == (unsigned char) pIn[-1];
+        }
+
+        if (pIn == pEnd) {
+            break;
+        }
+
+        // get the next character, it is either an ASCII space or a non-ASCII character
+        int C = (unsigned char) *pIn;
+        const char * pNext = pIn + 1;
+        bool fIsSpace = true;
+
+        if (0x80 <= C) {
+            pNext = ::FAUtf8ToInt(pIn, pEnd, &C);
+            if (NULL == pNext) {
+                // invalid input sequence
+                return -1;
+            }
+            // only characters starting with C2, E2, E3, EF bytes can be spaces
+            const unsigned char B = (unsigned char) *pIn;
+            fIsSpace = (0xC2 == B || 0xE2 == B || 0xE3 == B || 0xEF == B) && __FAIsWhiteSpace__(C);
+        }
+
+        if (fIsSpace) {
+            // a space is written only after a non-space character
+            if (0 < CharCount && !fLastIsSpace) {
+                fPending = true;
+            }
+        } else {
+
+            if (fPending) {
+                if (OutSize + SpaceSize <= MaxOutUtf8StrByteCount) {
+                    memcpy(pOutUtf8Str + OutSize, Space, SpaceSize);
+                }
+                OutSize += SpaceSize;
+                fPending = false;
+            }
+
+            const int CharSize = (int) (pNext - pIn);
+            if (OutSize + CharSize <= MaxOutUtf8StrByteCount) {
+                memcpy(pOutUtf8Str + OutSize, pIn, CharSize);
+            }
+            LastCharPos = OutSize;
+            OutSize += CharSize;
+
+            CharCount++;
+            fLastIsSpace = uSpace == C;
         }
+
+        pIn = pNext;
+
     } // of while ...
 
-    // trim the final space if there was no content characters after
-    if (1 < j && pBuff[j - 1] == uSpace) {
-        j--;
+    // trim the final space if there was no content characters after, the pending one is never written
+    if (!fPending && fLastIsSpace && 1 < CharCount) {
+        OutSize = LastCharPos;
     }
 
-    MaxBuffSize = j;
-
-    // convert UTF-32 back to UTF-8
-    const int StrOutSize = ::FAArrayToStrUtf8(pBuff, MaxBuffSize, pOutUtf8Str, MaxOutUtf8StrByteCount);
-    if (0 <= StrOutSize && StrOutSize < MaxOutUtf8StrByteCount) {
-        pOutUtf8Str [StrOutSize] = 0;
+    if (OutSize > MaxOutUtf8StrByteCount) {
+        return -1;
+    }
+    if (OutSize < MaxOutUtf8StrByteCount) {
+        pOutUtf8Str [OutSize] = 0;
     }
 
-    return StrOutSize;
+    return OutSize;
 }
 
 
@@ -782,11 +1476,23 @@ const int TextToHashes(const char * pInUtf8Str, int InUtf8StrByteCount, int32_t
 
 
 //
-// Loads a model and return a handle.
-// Returns 0 in case of an error.
+// Returns the runtime cache section, NULL if there is no valid cache
 //
-extern "C"
-void* LoadModel(const char * pszLdbFileName)
+static const unsigned char * GetCacheSection(const FAModelData * pModelData, const bool fCache,
+    const int Key, size_t * pSize)
+{
+    *pSize = 0;
+    return fCache ? pModelData->m_Cache.Get (Key, pSize) : NULL;
+}
+
+
+//
+// Loads a model, MaxDenseMemory bytes can be used for the dense transition
+// tables of the hot states, VerifyMode is FAFsmConst::LDB_VERIFY_EAGER or
+// FAFsmConst::LDB_VERIFY_PARALLEL, if fShareDumps is true the dumps are kept in the g_DumpRegistry.
+//
+static void* LoadModel_int(const char * pszLdbFileName, const int MaxDenseMemory, const int VerifyMode,
+    const char * pszCacheFileName, const bool fSaveCache, const bool fShareDumps)
 {
     FAModelData * pNewModelData = new FAModelData();
     if (NULL == pNewModelData) {
@@ -799,9 +1505,31 @@ void* LoadModel(const char * pszLdbFileName)
     if (NULL == pImgBytes) {
         return 0;
     }
+    const size_t ImgSize = pNewModelData->m_Img.GetSize ();
+    pNewModelData->m_ImgSize = ImgSize;
 
     // create a generic LDB object from bytes
-    pNewModelData->m_Ldb.SetImage (pImgBytes);
+    pNewModelData->m_Ldb.SetVerifyMode (VerifyMode);
+    pNewModelData->m_Ldb.SetImage (pImgBytes, ImgSize);
+
+    // if asked, share the dumps identical to the ones of the other models, the image
+    // is freed at the end
+    const bool fShare = fShareDumps;
+    if (fShare) {
+        pNewModelData->m_Ldb.ShareDumps (&g_DumpRegistry, ImgSize);
+    }
+
+    // map the runtime cache, if it was made for this model
+    const std::string CacheFileName = NULL != pszCacheFileName ? \
+        std::string (pszCacheFileName) : std::string (pszLdbFileName) + ".cache";
+    const bool fCache = pNewModelData->m_Cache.Load (CacheFileName.c_str (), pszLdbFileName, \
+        &(pNewModelData->m_Ldb), ImgSize);
+    // the sections of the new cache file, if anything was computed
+    FARuntimeCache NewCache;
+    bool fComputed = false;
+
+    size_t SectionSize = 0;
+    const unsigned char * pSection = NULL;
 
     // get the configuration paramenters for [wbd]
     const int * pValues = NULL;
@@ -812,8 +1540,28 @@ void* LoadModel(const char * pszLdbFileName)
         pNewModelData->m_hasWbd = true;
         // initialize WBD configuration
         pNewModelData->m_Conf.Initialize (&(pNewModelData->m_Ldb), pValues, iSize);
-        // now initialize the engine
-        pNewModelData->m_Engine.SetConf(&(pNewModelData->m_Conf));
+        // build the dense tables before the engine gets the automaton
+        if (0 < MaxDenseMemory) {
+            pNewModelData->m_DenseDfa.SetRsDfa (pNewModelData->m_Conf.GetRsDfa ());
+            pNewModelData->m_DenseDfa.SetMaxMemory (MaxDenseMemory);
+            pSection = GetCacheSection (pNewModelData, fCache, FAFsmConst::RTC_WBD_DENSE, &SectionSize);
+            if (!pNewModelData->m_DenseDfa.SetDump (pSection, SectionSize)) {
+                pNewModelData->m_DenseDfa.Process ();
+                fComputed = true;
+            }
+            if (fSaveCache) {
+                pNewModelData->m_DenseDfa.Save (NewCache.Add (FAFsmConst::RTC_WBD_DENSE, \
+                    pNewModelData->m_DenseDfa.GetDumpSize ()));
+            }
+            pNewModelData->m_Conf.SetRsDfa (&(pNewModelData->m_DenseDfa));
+        }
+        // now initialize the engine, code point or UTF-8 byte one
+        pNewModelData->m_isUtf8 = pNewModelData->m_Conf.GetUtf8Input ();
+        if (pNewModelData->m_isUtf8) {
+            pNewModelData->m_EngineUtf8.SetConf(&(pNewModelData->m_Conf));
+        } else {
+            pNewModelData->m_Engine.SetConf(&(pNewModelData->m_Conf));
+        }
     }
 
     // get the configuration paramenters for [pos-dict]
@@ -827,53 +1575,200 @@ void* LoadModel(const char * pszLdbFileName)
         pNewModelData->m_DictConf.SetLDB (&(pNewModelData->m_Ldb));
         pNewModelData->m_DictConf.Init (pValues, iSize);
 
+        // the dense tables of the segmentation use what is left of the budget
+        const int DenseMemoryLeft = MaxDenseMemory - pNewModelData->m_DenseDfa.GetMemorySize ();
+        if (0 < DenseMemoryLeft && pNewModelData->m_DictConf.GetRsDfa () && pNewModelData->m_DictConf.GetMphMealy ()) {
+            pNewModelData->m_DenseMealy.SetRsDfa (pNewModelData->m_DictConf.GetRsDfa ());
+            pNewModelData->m_DenseMealy.SetMealyDfa (pNewModelData->m_DictConf.GetMphMealy ());
+            pNewModelData->m_DenseMealy.SetMaxMemory (DenseMemoryLeft);
+            pSection = GetCacheSection (pNewModelData, fCache, FAFsmConst::RTC_DICT_DENSE, &SectionSize);
+            if (!pNewModelData->m_DenseMealy.SetDump (pSection, SectionSize)) {
+                pNewModelData->m_DenseMealy.Process ();
+                fComputed = true;
+            }
+            if (fSaveCache) {
+                pNewModelData->m_DenseMealy.Save (NewCache.Add (FAFsmConst::RTC_DICT_DENSE, \
+                    pNewModelData->m_DenseMealy.GetDumpSize ()));
+            }
+            pNewModelData->m_DictConf.SetMphMealy (&(pNewModelData->m_DenseMealy));
+        }
+
         // check if this is a Unigram LM or BPE model
         pNewModelData->m_isBpe = FAFsmConst::TOKENIZE_BPE == pNewModelData->m_DictConf.GetTokAlgo()
-            || FAFsmConst::TOKENIZE_BPE_OPT == pNewModelData->m_DictConf.GetTokAlgo();
+            || FAFsmConst::TOKENIZE_BPE_OPT == pNewModelData->m_DictConf.GetTokAlgo()
+            || FAFsmConst::TOKENIZE_BPE_MERGE == pNewModelData->m_DictConf.GetTokAlgo();
+
+        pNewModelData->m_isWordPiece = FAFsmConst::TOKENIZE_WORDPIECE == pNewModelData->m_DictConf.GetTokAlgo();
 
         // initialize the segmentation engine
-        if (pNewModelData->m_isBpe)
+        if (pNewModelData->m_isWordPiece)
+        {
+            pNewModelData->m_SegEngineWp.SetConf(&pNewModelData->m_DictConf);
+        } else if (pNewModelData->m_isBpe)
         {
             pNewModelData->m_SegEngineBpe.SetConf(&pNewModelData->m_DictConf);
         } else {
             pNewModelData->m_SegEngine.SetConf(&pNewModelData->m_DictConf);
+            // run Viterbi word by word, if no segment crosses U+2581
+            int WordBounded = 0;
+            pSection = GetCacheSection (pNewModelData, fCache, FAFsmConst::RTC_WORD_BOUNDED, &SectionSize);
+            if (sizeof (int) == SectionSize) {
+                WordBounded = *((const int *) pSection);
+            } else {
+                const FADictConfKeeper * pConf = &(pNewModelData->m_DictConf);
+                WordBounded = ::FAIsDelimBounded (pConf->GetRsDfa (), pConf->GetIws (), __FASpDelimiter__);
+                fComputed = true;
+            }
+            if (fSaveCache) {
+                *((int *) NewCache.Add (FAFsmConst::RTC_WORD_BOUNDED, sizeof (int))) = WordBounded;
+            }
+            pNewModelData->m_SegEngine.SetWordBounded (0 != WordBounded);
         }
     }
 
+    // write the runtime cache, a failure is not an error
+    if (fSaveCache && fComputed) {
+        NewCache.Save (CacheFileName.c_str (), pszLdbFileName, &(pNewModelData->m_Ldb), ImgSize);
+    }
+
+    if (fShare) {
+        pNewModelData->m_Img.SetImageDump (NULL);
+    }
+
     return (void*) pNewModelData;
 }
 
 
 //
-// Implements a word-piece algorithm. Returns ids of words or sub-words, returns upto MaxIdsArrLength ids,
-// the rest of the array is unchanged, so the array can be set to initial length and fill with 0's for padding.
-// If pStartOffsets and pEndOffsets are not NULL then fills in the start and end offset for each token.
-// Return value is the number of ids copied into the array.
-//
-// Example:
-//  input: Эpple pie.
-//  fa_lex output: эpple/WORD э/WORD_ID_1208 pp/WORD_ID_9397 le/WORD_ID_2571 pie/WORD pie/WORD_ID_11345 ./WORD ./WORD_ID_1012
-//  TextToIds output: [1208, 9397, 2571, 11345, 1012, ... <unchanged>]
+// Loads a model and return a handle, if there is a valid runtime cache file
+// for the model (see LoadModelWithCache) the data it keeps are not computed.
+// Returns 0 in case of an error.
+//
+extern "C"
+void* LoadModel(const char * pszLdbFileName)
+{
+    return LoadModel_int(pszLdbFileName, 0, FAFsmConst::LDB_VERIFY_EAGER, NULL, false, false);
+}
+
+
+//
+// Loads a model as LoadModel does, but the sections of the model file are
+// kept in a process-wide storage, so the sections identical to the ones of
+// the other models loaded by this function (e.g. the same pre-tokenizer or
+// charmap) are kept in memory once. This costs a checksum and a copy of the
+// sections at load time, so it is useful when many similar models are
+// loaded. Returns 0 in case of an error.
+//
+extern "C"
+void* LoadModelWithSharedDumps(const char * pszLdbFileName)
+{
+    return LoadModel_int(pszLdbFileName, 0, FAFsmConst::LDB_VERIFY_EAGER, NULL, false, true);
+}
+
+
+//
+// Loads a model as LoadModel does, but the unigram lm segmentation runs Viterbi
+// over the whole text rather than word by word, even if no segment crosses U+2581
+// (see FAIsDelimBounded). The ids are the same, so this is for checking the
+// word by word mode. Returns 0 in case of an error.
+//
+extern "C"
+void* LoadModelWithWholeTextViterbi(const char * pszLdbFileName)
+{
+    FAModelData * pModelData = (FAModelData *) LoadModel_int(pszLdbFileName, 0,
+        FAFsmConst::LDB_VERIFY_EAGER, NULL, false, false);
+    if (NULL != pModelData) {
+        pModelData->m_SegEngine.SetWordBounded (false);
+    }
+    return pModelData;
+}
+
+
+//
+// Loads a model and return a handle, up to MaxDenseMemory bytes are used to
+// keep the states closest to the initial one as dense transition tables, so
+// tokenization does not decode the packed automaton for the frequent input.
+// Returns 0 in case of an error.
+//
+extern "C"
+void* LoadModelWithDenseStates(const char * pszLdbFileName, const int MaxDenseMemory)
+{
+    if (0 > MaxDenseMemory) {
+        return 0;
+    }
+    return LoadModel_int(pszLdbFileName, MaxDenseMemory, FAFsmConst::LDB_VERIFY_EAGER, NULL, false, false);
+}
+
+
+//
+// Loads a model and return a handle, VerifyMode selects how the model file
+// is checked if the model asks for the verification: 0 - all sections at
+// load time, 1 - all sections at load time in parallel. Mode 1 needs an LDB
+// v2 file, the older files are verified sequentially. The lazy and the
+// background verification of FALDB are not offered since loading a model
+// reads all of its sections anyway. Returns 0 in case of an error.
+//
+extern "C"
+void* LoadModelWithVerifyMode(const char * pszLdbFileName, const int VerifyMode)
+{
+    if (FAFsmConst::LDB_VERIFY_EAGER != VerifyMode && FAFsmConst::LDB_VERIFY_PARALLEL != VerifyMode) {
+        return 0;
+    }
+    return LoadModel_int(pszLdbFileName, 0, VerifyMode, NULL, false, false);
+}
+
+
+//
+// Loads a model as LoadModelWithDenseStates does and keeps the data computed
+// at load time (the dense tables, etc.) in the runtime cache file, so the
+// next load maps the file instead of computing them. The file is used only
+// if it was made for the same model file, otherwise it is written again.
+// pszCacheFileName NULL means the model file name with ".cache" appended,
+// LoadModel and the other load functions use such file if it is valid.
+// A failure to write the file is not an error. Returns 0 in case of an error.
+//
+extern "C"
+void* LoadModelWithCache(const char * pszLdbFileName, const int MaxDenseMemory, const char * pszCacheFileName)
+{
+    if (0 > MaxDenseMemory) {
+        return 0;
+    }
+    return LoadModel_int(pszLdbFileName, MaxDenseMemory, FAFsmConst::LDB_VERIFY_EAGER, pszCacheFileName, true, false);
+}
+
+
+//
+// Implements TextToIdsWithOffsets_wp for the input encoding defined by Tr,
+// the offsets are in the units of the encoding
 //
-extern "C"
-const int TextToIdsWithOffsets_wp(
+template < class Tr >
+static const int TextToIdsWithOffsets_wp_t(
         void* ModelPtr,
-        const char * pInUtf8Str,
-        int InUtf8StrByteCount,
+        const typename Tr::Ch * pInStr,
+        int InStrSize,
         int32_t * pIdsArr, 
         int * pStartOffsets, 
         int * pEndOffsets,
         const int MaxIdsArrLength,
-        const int UnkId = 0
+        const int UnkId
 )
 {
     // validate the parameters
-    if (0 >= InUtf8StrByteCount || InUtf8StrByteCount > FALimits::MaxArrSize || NULL == pInUtf8Str || 0 == ModelPtr) {
+    if (0 >= InStrSize || InStrSize > FALimits::MaxArrSize || NULL == pInStr || 0 == ModelPtr) {
+        return 0;
+    }
+
+    // get the model data
+    const FAModelData * pModelData = (const FAModelData *)ModelPtr;
+    const FAWbdConfKeeper * pConf = &(pModelData->m_Conf);
+
+    // UTF-8 byte automata are not supported with the word-piece
+    if (pModelData->m_isUtf8) {
         return 0;
     }
 
-    // allocate buffer for UTF-8 --> UTF-32 conversion
-    std::vector< int > utf32input(InUtf8StrByteCount);
+    // allocate buffer for the input --> UTF-32 conversion
+    std::vector< int > utf32input(InStrSize);
     int * pBuff = utf32input.data();
     if (NULL == pBuff) {
         return 0;
@@ -887,7 +1782,7 @@ const int TextToIdsWithOffsets_wp(
     const bool fNeedOffsets = NULL != pStartOffsets && NULL != pEndOffsets;
 
     if (fNeedOffsets) {
-        utf32offsets.resize(InUtf8StrByteCount);
+        utf32offsets.resize(InStrSize);
         pOffsets = utf32offsets.data();
         if (NULL == pOffsets) {
             return 0;
@@ -895,10 +1790,8 @@ const int TextToIdsWithOffsets_wp(
     }
 
     // convert input to UTF-32, track offsets if needed
-    int BuffSize = fNeedOffsets ? 
-        ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff, pOffsets, InUtf8StrByteCount) :
-        ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff, InUtf8StrByteCount);
-    if (BuffSize <= 0 || BuffSize > InUtf8StrByteCount) {
+    int BuffSize = Tr::Decode(pInStr, InStrSize, pBuff, pOffsets, InStrSize);
+    if (BuffSize <= 0 || BuffSize > InStrSize) {
         return 0;
     }
 
@@ -908,21 +1801,18 @@ const int TextToIdsWithOffsets_wp(
     std::vector< int > utf32norm_offsets;
     int * pNormOffsets = NULL;
 
-    // get the model data
-    const FAModelData * pModelData = (const FAModelData *)ModelPtr;
-    const FAWbdConfKeeper * pConf = &(pModelData->m_Conf);
     const FAMultiMapCA * pCharMap = pConf->GetCharMap ();
 
     // do the normalization for the entire input
     if (pCharMap) {
 
-        utf32input_norm.resize(InUtf8StrByteCount);
+        utf32input_norm.resize(InStrSize);
         pNormBuff = utf32input_norm.data();
         if (NULL == pNormBuff) {
             return 0;
         }
         if (fNeedOffsets) {
-            utf32norm_offsets.resize(InUtf8StrByteCount);
+            utf32norm_offsets.resize(InStrSize);
             pNormOffsets = utf32norm_offsets.data();
             if (NULL == pNormOffsets) {
                 return 0;
@@ -930,9 +1820,9 @@ const int TextToIdsWithOffsets_wp(
         }
 
         BuffSize = fNeedOffsets ? 
-            ::FANormalize(pBuff, BuffSize, pNormBuff, pNormOffsets, InUtf8StrByteCount, pCharMap) :
-            ::FANormalize(pBuff, BuffSize, pNormBuff, InUtf8StrByteCount, pCharMap);
-        if (BuffSize <= 0 || BuffSize > InUtf8StrByteCount) {
+            ::FANormalize(pBuff, BuffSize, pNormBuff, pNormOffsets, InStrSize, pCharMap) :
+            ::FANormalize(pBuff, BuffSize, pNormBuff, InStrSize, pCharMap);
+        if (BuffSize <= 0 || BuffSize > InStrSize) {
             return 0;
         }
 
@@ -954,6 +1844,9 @@ const int TextToIdsWithOffsets_wp(
         return 0;
     }
 
+    // keeps the word-pieces of one word, if the model has the [pos-dict] with them
+    std::vector< int > WpRes;
+
     int OutCount = 0;
 
     // iterate over the results
@@ -968,7 +1861,41 @@ const int TextToIdsWithOffsets_wp(
         // For each token with WORD tag copy all subword tags into the output if
         //  this word is covered completely by the subwords without gaps,
         //  otherwise copy the UnkId tag (this is how it's done in the original BERT TokenizerFull).
-        if (WBD_WORD_TAG == Tag) {
+        if (WBD_WORD_TAG == Tag && pModelData->m_isWordPiece) {
+
+            const int TokenFrom = pWbdRes[i + 1];
+            const int TokenTo = pWbdRes[i + 2];
+            const int TokenSize = TokenTo - TokenFrom + 1;
+
+            // split the word into the word-pieces, or get one UnkId piece
+            if ((int) WpRes.size () < TokenSize * 3) {
+                WpRes.resize (TokenSize * 3);
+            }
+            const int WpResSize = pModelData->m_SegEngineWp.Process(pBuff + TokenFrom, TokenSize,
+                WpRes.data (), (int) WpRes.size (), UnkId);
+            if (WpResSize > (int) WpRes.size () || 0 != WpResSize % 3) {
+                return 0;
+            }
+
+            for (int k = 0; k < WpResSize && OutCount < MaxIdsArrLength; k += 3) {
+
+                pIdsArr[OutCount] = WpRes[k];
+
+                if (fNeedOffsets) {
+
+                    const int SubTokenFrom = TokenFrom + WpRes[k + 1];
+                    const int FromOffset = pOffsets[(pCharMap) ? pNormOffsets [SubTokenFrom] : SubTokenFrom];
+                    pStartOffsets[OutCount] = FromOffset;
+
+                    const int SubTokenTo = TokenFrom + WpRes[k + 2];
+                    const int ToOffset = pOffsets[(pCharMap) ? pNormOffsets [SubTokenTo] : SubTokenTo];
+                    pEndOffsets[OutCount] = Tr::GetCharEnd(pInStr, InStrSize, ToOffset);
+                }
+
+                OutCount++;
+            }
+
+        } else if (WBD_WORD_TAG == Tag) {
 
             const int TokenFrom = pWbdRes[i + 1];
             const int TokenTo = pWbdRes[i + 2];
@@ -1018,8 +1945,7 @@ const int TextToIdsWithOffsets_wp(
 
                                 const int SubTokenTo = pWbdRes[TagIdx + 2];
                                 const int ToOffset = pOffsets[(pCharMap) ? pNormOffsets [SubTokenTo] : SubTokenTo];
-                                const int ToCharSize = ::FAUtf8Size(pInUtf8Str + ToOffset);
-                                pEndOffsets[OutCount] = ToOffset + (0 < ToCharSize ? ToCharSize - 1 : 0);
+                                pEndOffsets[OutCount] = Tr::GetCharEnd(pInStr, InStrSize, ToOffset);
                             }
 
                             OutCount++;
@@ -1042,8 +1968,7 @@ const int TextToIdsWithOffsets_wp(
                         pStartOffsets[OutCount] = FromOffset;
 
                         const int ToOffset = pOffsets[(pCharMap) ? pNormOffsets [TokenTo] : TokenTo];
-                        const int ToCharSize = ::FAUtf8Size(pInUtf8Str + ToOffset);
-                        pEndOffsets[OutCount] = ToOffset + (0 < ToCharSize ? ToCharSize - 1 : 0);
+                        pEndOffsets[OutCount] = Tr::GetCharEnd(pInStr, InStrSize, ToOffset);
                     }
 
                     OutCount++;
@@ -1064,6 +1989,34 @@ const int TextToIdsWithOffsets_wp(
 }
 
 
+//
+// Implements a word-piece algorithm. Returns ids of words or sub-words, returns upto MaxIdsArrLength ids,
+// the rest of the array is unchanged, so the array can be set to initial length and fill with 0's for padding.
+// If pStartOffsets and pEndOffsets are not NULL then fills in the start and end offset for each token.
+// Return value is the number of ids copied into the array.
+//
+// Example:
+//  input: Эpple pie.
+//  fa_lex output: эpple/WORD э/WORD_ID_1208 pp/WORD_ID_9397 le/WORD_ID_2571 pie/WORD pie/WORD_ID_11345 ./WORD ./WORD_ID_1012
+//  TextToIds output: [1208, 9397, 2571, 11345, 1012, ... <unchanged>]
+//
+extern "C"
+const int TextToIdsWithOffsets_wp(
+        void* ModelPtr,
+        const char * pInUtf8Str,
+        int InUtf8StrByteCount,
+        int32_t * pIdsArr, 
+        int * pStartOffsets, 
+        int * pEndOffsets,
+        const int MaxIdsArrLength,
+        const int UnkId = 0
+)
+{
+    return TextToIdsWithOffsets_wp_t < FAUtf8Traits > (ModelPtr, pInUtf8Str, InUtf8StrByteCount,
+        pIdsArr, pStartOffsets, pEndOffsets, MaxIdsArrLength, UnkId);
+}
+
+
 //
 // The same as TextToIdsWithOffsets_wp, except does not return offsets
 //
@@ -1082,39 +2035,224 @@ const int TextToIds_wp(
 
 
 //
-// Implements a sentence piece algorithm, returns predictions from FATokenSegmentationTools_1best_t.
-// The input is always prepended with ' ' / '▁' since this seems the case in the sentence piece.
-// Returns upto MaxIdsArrLength ids, the rest of the array is unchanged, so the array can be set to 
-// initial length and fill with 0's for padding. Returns number of ids copied into the array.
+// Segments [From, To) of the text and adds the results of each word into the cache,
+// the words start with U+2581. Returns the output size or -1 in case of an error.
 //
-// Example:
-// printf "Sergei Alonichau I saw a girl with a \ttelescope." | spm_encode --model=xlnet/spiece.model 
-// ▁Sergei ▁Al oni chau ▁I ▁saw ▁a ▁girl ▁with ▁a ▁telescope .
+static const int SegmentAndCacheWords(
+        const FAModelData * pModelData,
+        const FAWordCache * pWordCache,
+        const int * pBuff,
+        const int From,
+        const int To,
+        int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+)
+{
+    const int * pIn = pBuff + From;
+    const int InSize = To - From;
+
+    // use either unigram lm or bpe runtime
+    const int OutSize = pModelData->m_isBpe ? 
+        pModelData->m_SegEngineBpe.Process (pIn, InSize, pOut, MaxOutSize, UnkId) :
+        pModelData->m_SegEngine.Process (pIn, InSize, pOut, MaxOutSize, UnkId);
+    if (OutSize > MaxOutSize || 0 != OutSize % 3) {
+        return -1;
+    }
+
+    // the index of the first token of the current word
+    int WordRes = 0;
+
+    for (int i = 3; i <= OutSize; i += 3) {
+
+        // see if the current word ends
+        if (i < OutSize && __FASpDelimiter__ != pIn [pOut [i + 1]]) {
+            continue;
+        }
+
+        const int WordFrom = pOut [WordRes + 1];
+        const int WordTo = (i < OutSize) ? pOut [i + 1] : InSize;
+
+        // make the offsets relative to the word
+        for (int j = WordRes; j < i; j += 3) {
+            pOut [j + 1] -= WordFrom;
+            pOut [j + 2] -= WordFrom;
+        }
+
+        pWordCache->Add (pIn + WordFrom, WordTo - WordFrom, UnkId, pOut + WordRes, i - WordRes);
+
+        // make the offsets relative to the text
+        for (int j = WordRes; j < i; j += 3) {
+            pOut [j + 1] += (From + WordFrom);
+            pOut [j + 2] += (From + WordFrom);
+        }
+
+        WordRes = i;
+    }
+
+    return OutSize;
+}
+
+
 //
-// printf "Sergei Alonichau I saw a girl with a \ttelescope." | spm_encode --model=xlnet/spiece.model --output_format=id
-// 14363 651 7201 25263 35 685 24 1615 33 24 16163 9
+// Segments the text word by word, the words start with U+2581, the results for
+// the words which are not in the cache are computed for all such consecutive
+// words at once. Returns the output size or -1 in case of an error.
 //
-// TextToIds_sp output: 12, [14363 651 7201 25263 35 685 24 1615 33 24 16163 9]
+static const int SegmentWithWordCache(
+        const FAModelData * pModelData,
+        const FAWordCache * pWordCache,
+        const int * pBuff,
+        const int BuffSize,
+        int * pOut,
+        const int MaxOutSize,
+        const int UnkId
+)
+{
+    int WordRes [3 * FAWordCache::MaxSegCount];
+
+    int OutSize = 0;
+    // the beginning of the words which are not in the cache
+    int MissFrom = 0;
+    int WordFrom = 0;
+
+    while (WordFrom < BuffSize) {
+
+        int WordTo = WordFrom + 1;
+        while (WordTo < BuffSize && __FASpDelimiter__ != pBuff [WordTo]) {
+            WordTo++;
+        }
+
+        const int WordResSize = pWordCache->Get (pBuff + WordFrom,
+            WordTo - WordFrom, UnkId, WordRes, 3 * FAWordCache::MaxSegCount);
+
+        if (-1 != WordResSize) {
+
+            // segment the words before which were not found
+            if (MissFrom < WordFrom) {
+                const int MissOutSize = SegmentAndCacheWords (pModelData, pWordCache, pBuff, MissFrom, WordFrom,
+                    pOut + OutSize, MaxOutSize - OutSize, UnkId);
+                if (-1 == MissOutSize) {
+                    return -1;
+                }
+                OutSize += MissOutSize;
+            }
+            if (OutSize + WordResSize > MaxOutSize) {
+                return -1;
+            }
+
+            // copy the results for the word
+            for (int i = 0; i < WordResSize; i += 3) {
+                pOut [OutSize + i] = WordRes [i];
+                pOut [OutSize + i + 1] = WordRes [i + 1] + WordFrom;
+                pOut [OutSize + i + 2] = WordRes [i + 2] + WordFrom;
+            }
+            OutSize += WordResSize;
+
+            MissFrom = WordTo;
+        }
+
+        WordFrom = WordTo;
+    }
+
+    // segment the words in the end which were not found
+    if (MissFrom < BuffSize) {
+        const int MissOutSize = SegmentAndCacheWords (pModelData, pWordCache, pBuff, MissFrom, BuffSize,
+            pOut + OutSize, MaxOutSize - OutSize, UnkId);
+        if (-1 == MissOutSize) {
+            return -1;
+        }
+        OutSize += MissOutSize;
+    }
+
+    return OutSize;
+}
+
+
 //
-extern "C"
-const int TextToIdsWithOffsets_sp(
+// Parameters of the several segmentations of one text, see TextToIdsSample_sp
+// and TextToIdsNBest_sp
+//
+struct FASpPathParams {
+
+    int m_Count;            // the number of segmentations
+    bool m_fSample;         // sample the segmentations, otherwise take the N-best
+    float m_Alpha;          // the smoothing parameter of the sampling
+    unsigned int m_Seed;    // the state of the random numbers generator
+    int * m_pPathSizes;     // the number of ids of each segmentation, the output
+};
+
+
+//
+// Writes several segmentations of the text from one lattice, returns the
+// output size or -1 in case of an error.
+//
+static const int SegmentPaths(
+        const FAModelData * pModelData,
+        const int * pBuff,
+        const int BuffSize,
+        FASpPathParams * pPaths,
+        std::vector< int > & Results,
+        const int UnkId
+)
+{
+    if (pPaths->m_Count > FALimits::MaxArrSize / (BuffSize * 3)) {
+        return -1;
+    }
+
+    FATokenLattice Lattice;
+    pModelData->m_SegEngine.BuildLattice (pBuff, BuffSize, &Lattice);
+
+    const int MaxResultsSize = BuffSize * 3 * pPaths->m_Count;
+    Results.resize (MaxResultsSize);
+
+    std::vector< int > PathSizes (pPaths->m_Count, 0);
+
+    const int PathCount = pPaths->m_fSample ?
+        Lattice.Sample (pPaths->m_Count, pPaths->m_Alpha, &(pPaths->m_Seed),
+            Results.data (), MaxResultsSize, PathSizes.data (), UnkId) :
+        Lattice.GetNBest (pPaths->m_Count, Results.data (), MaxResultsSize,
+            PathSizes.data (), UnkId);
+    if (0 > PathCount) {
+        return -1;
+    }
+
+    int ResultsSize = 0;
+    for (int i = 0; i < pPaths->m_Count; ++i) {
+        // the number of ids
+        pPaths->m_pPathSizes [i] = PathSizes [i] / 3;
+        ResultsSize += PathSizes [i];
+    }
+
+    return ResultsSize;
+}
+
+
+//
+// Implements TextToIdsWithOffsets_sp for the input encoding defined by Tr,
+// the offsets are in the units of the encoding. If pPaths is not NULL then
+// several segmentations are written one after another.
+//
+template < class Tr >
+static const int TextToIdsWithOffsets_sp_t(
         void* ModelPtr,
-        const char * pInUtf8Str,
-        int InUtf8StrByteCount,
+        const typename Tr::Ch * pInStr,
+        int InStrSize,
         int32_t * pIdsArr,
         int * pStartOffsets, 
         int * pEndOffsets,
         const int MaxIdsArrLength,
-        const int UnkId = 0
+        const int UnkId,
+        FASpPathParams * pPaths = NULL
 )
 {
     // validate the parameters
-    if (0 >= InUtf8StrByteCount || InUtf8StrByteCount > FALimits::MaxArrSize || NULL == pInUtf8Str || 0 == ModelPtr) {
+    if (0 >= InStrSize || InStrSize > FALimits::MaxArrSize || NULL == pInStr || 0 == ModelPtr) {
         return 0;
     }
 
-    // allocate buffer for UTF-8 --> UTF-32 conversion
-    std::vector< int > utf32input(InUtf8StrByteCount + 1);
+    // allocate buffer for the input --> UTF-32 conversion
+    std::vector< int > utf32input(InStrSize + 1);
     int * pBuff = utf32input.data();
     if (NULL == pBuff) {
         return 0;
@@ -1129,7 +2267,7 @@ const int TextToIdsWithOffsets_sp(
     const bool fNeedOffsets = NULL != pStartOffsets && NULL != pEndOffsets;
 
     if (fNeedOffsets) {
-        utf32offsets.resize(InUtf8StrByteCount + 1);
+        utf32offsets.resize(InStrSize + 1);
         pOffsets = utf32offsets.data();
         if (NULL == pOffsets) {
             return 0;
@@ -1138,10 +2276,8 @@ const int TextToIdsWithOffsets_sp(
     }
 
     // convert input to UTF-32 (write past the added first space)
-    int BuffSize = fNeedOffsets ? 
-        ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff + 1, pOffsets + 1, InUtf8StrByteCount) :
-        ::FAStrUtf8ToArray(pInUtf8Str, InUtf8StrByteCount, pBuff + 1, InUtf8StrByteCount);
-    if (BuffSize <= 0 || BuffSize > InUtf8StrByteCount) {
+    int BuffSize = Tr::Decode(pInStr, InStrSize, pBuff + 1, fNeedOffsets ? pOffsets + 1 : NULL, InStrSize);
+    if (BuffSize <= 0 || BuffSize > InStrSize) {
         return 0;
     }
     BuffSize++; // to accomodate the first space
@@ -1160,7 +2296,7 @@ const int TextToIdsWithOffsets_sp(
     // do normalization, if needed
     if (NULL != pCharMap) {
 
-        const int MaxNormBuffSize = (InUtf8StrByteCount + 1) * 2;
+        const int MaxNormBuffSize = (InStrSize + 1) * 2;
         utf32input_norm.resize(MaxNormBuffSize);
         pNormBuff = utf32input_norm.data();
         if (NULL == pNormBuff) {
@@ -1236,15 +2372,27 @@ const int TextToIdsWithOffsets_sp(
     BuffSize = j;
 
     // do the segmentation
-    const int WbdResMaxSize = BuffSize * 3;
+    int WbdResMaxSize = BuffSize * 3;
     std::vector< int > WbdResults(WbdResMaxSize);
     int * pWbdResults = WbdResults.data ();
 
-    // use either unigram lm or bpe runtime
-    const int WbdOutSize = pModelData->m_isBpe ? 
+    // the word cache stays alive till the end of the call, even if SetWordCacheSize replaces it
+    const std::shared_ptr < const FAWordCache > pWordCache = std::atomic_load (&(pModelData->m_pWordCache));
+
+    // use the word cache, if set up, or either unigram lm or bpe runtime
+    const int WbdOutSize = NULL != pPaths ?
+        SegmentPaths (pModelData, pBuff, BuffSize, pPaths, WbdResults, UnkId) :
+        NULL != pWordCache ?
+        SegmentWithWordCache (pModelData, pWordCache.get (), pBuff, BuffSize, pWbdResults, WbdResMaxSize, UnkId) :
+        pModelData->m_isBpe ? 
         pModelData->m_SegEngineBpe.Process (pBuff, BuffSize, pWbdResults, WbdResMaxSize, UnkId) :
         pModelData->m_SegEngine.Process (pBuff, BuffSize, pWbdResults, WbdResMaxSize, UnkId);
-    if (WbdOutSize > WbdResMaxSize || 0 != WbdOutSize % 3) {
+
+    if (NULL != pPaths) {
+        WbdResMaxSize = (int) WbdResults.size ();
+        pWbdResults = WbdResults.data ();
+    }
+    if (0 > WbdOutSize || WbdOutSize > WbdResMaxSize || 0 != WbdOutSize % 3) {
         return 0;
     }
 
@@ -1257,40 +2405,235 @@ const int TextToIdsWithOffsets_sp(
         const int id = pWbdResults [i];
         pIdsArr [OutSize] = id;
 
-        // copy offsets if needed
-        if (fNeedOffsets) {
+        // copy offsets if needed
+        if (fNeedOffsets) {
+
+            const int TokenFrom = pWbdResults [i + 1];
+            const int FromOffset = pOffsets[(pCharMap) ? pNormOffsets [TokenFrom] : TokenFrom];
+            pStartOffsets[OutSize] = FromOffset;
+
+            const int TokenTo = pWbdResults [i + 2];
+            const int ToOffset = pOffsets[(pCharMap) ? pNormOffsets [TokenTo] : TokenTo];
+            pEndOffsets[OutSize] = Tr::GetCharEnd(pInStr, InStrSize, ToOffset);
+        }
+
+        OutSize++;
+    }
+
+    // cut the segmentations which did not fit
+    if (NULL != pPaths) {
+        int IdCount = 0;
+        for (int i = 0; i < pPaths->m_Count; ++i) {
+            const int PathSize = std::min (pPaths->m_pPathSizes [i], OutSize - IdCount);
+            pPaths->m_pPathSizes [i] = PathSize;
+            IdCount += PathSize;
+        }
+    }
+
+    return OutSize;
+}
+
+
+//
+// Sets up a cache of up to MaxWordCount words for TextToIds_sp and TextToIdsWithOffsets_sp,
+// then the text is segmented word by word, where words start with U+2581, and the frequent
+// words are taken from the cache. The cache is used only if this gives the same results,
+// that is U+2581 is a token and no other token contains U+2581 after the first character.
+// 0 disables the cache. Can be called while the model is in use, the calls in progress keep
+// using the old cache. Returns 1 if the cache is set up and 0 otherwise.
+//
+extern "C"
+const int SetWordCacheSize(void* ModelPtr, const int MaxWordCount)
+{
+    FAModelData * pModelData = (FAModelData *)ModelPtr;
+    if (NULL == pModelData || !pModelData->m_hasSeg || 0 > MaxWordCount || FALimits::MaxArrSize < MaxWordCount) {
+        return 0;
+    }
+
+    std::shared_ptr < FAWordCache > pWordCache;
+
+    const FADictConfKeeper * pConf = &(pModelData->m_DictConf);
+    if (0 < MaxWordCount && ::FAIsDelimBounded (pConf->GetRsDfa (), pConf->GetIws (), __FASpDelimiter__)) {
+        pWordCache = std::make_shared < FAWordCache > ();
+        pWordCache->SetMaxCount (MaxWordCount);
+    }
+
+    // the old cache is freed by the last call which uses it
+    std::atomic_store (&(pModelData->m_pWordCache), std::shared_ptr < const FAWordCache > (pWordCache));
+    return NULL != pWordCache ? 1 : 0;
+}
+
+
+//
+// Returns the number of words found and not found in the word cache since it was set up.
+// Returns 1 if the cache is set up and 0 otherwise.
+//
+extern "C"
+const int GetWordCacheCounts(void* ModelPtr, int64_t * pHitCount, int64_t * pMissCount)
+{
+    const FAModelData * pModelData = (const FAModelData *)ModelPtr;
+    if (NULL == pModelData) {
+        return 0;
+    }
+    const std::shared_ptr < const FAWordCache > pWordCache = std::atomic_load (&(pModelData->m_pWordCache));
+    if (NULL == pWordCache) {
+        return 0;
+    }
+
+    long long HitCount = 0;
+    long long MissCount = 0;
+    pWordCache->GetCounts (&HitCount, &MissCount);
+
+    if (pHitCount) {
+        *pHitCount = HitCount;
+    }
+    if (pMissCount) {
+        *pMissCount = MissCount;
+    }
+    return 1;
+}
+
+
+//
+// Implements a sentence piece algorithm, returns predictions from FATokenSegmentationTools_1best_t.
+// The input is always prepended with ' ' / '▁' since this seems the case in the sentence piece.
+// Returns upto MaxIdsArrLength ids, the rest of the array is unchanged, so the array can be set to 
+// initial length and fill with 0's for padding. Returns number of ids copied into the array.
+//
+// Example:
+// printf "Sergei Alonichau I saw a girl with a \ttelescope." | spm_encode --model=xlnet/spiece.model 
+// ▁Sergei ▁Al oni chau ▁I ▁saw ▁a ▁girl ▁with ▁a ▁telescope .
+//
+// printf "Sergei Alonichau I saw a girl with a \ttelescope." | spm_encode --model=xlnet/spiece.model --output_format=id
+// 14363 651 7201 25263 35 685 24 1615 33 24 16163 9
+//
+// TextToIds_sp output: 12, [14363 651 7201 25263 35 685 24 1615 33 24 16163 9]
+//
+extern "C"
+const int TextToIdsWithOffsets_sp(
+        void* ModelPtr,
+        const char * pInUtf8Str,
+        int InUtf8StrByteCount,
+        int32_t * pIdsArr,
+        int * pStartOffsets, 
+        int * pEndOffsets,
+        const int MaxIdsArrLength,
+        const int UnkId = 0
+)
+{
+    return TextToIdsWithOffsets_sp_t < FAUtf8Traits > (ModelPtr, pInUtf8Str, InUtf8StrByteCount,
+        pIdsArr, pStartOffsets, pEndOffsets, MaxIdsArrLength, UnkId);
+}
+
+
+//
+// The same as TextToIdsWithOffsets_sp, except does not return offsets
+//
+extern "C"
+const int TextToIds_sp(
+        void* ModelPtr,
+        const char * pInUtf8Str,
+        int InUtf8StrByteCount,
+        int32_t * pIdsArr,
+        const int MaxIdsArrLength,
+        const int UnkId = 0
+)
+{
+    return TextToIdsWithOffsets_sp(ModelPtr,pInUtf8Str,InUtf8StrByteCount,pIdsArr,NULL,NULL,MaxIdsArrLength,UnkId);
+}
+
 
-            const int TokenFrom = pWbdResults [i + 1];
-            const int FromOffset = pOffsets[(pCharMap) ? pNormOffsets [TokenFrom] : TokenFrom];
-            pStartOffsets[OutSize] = FromOffset;
+//
+// Validates the parameters of TextToIdsSample_sp and TextToIdsNBest_sp,
+// the several segmentations are supported by the unigram lm models only
+//
+static const bool CanSegmentPaths(
+        void* ModelPtr,
+        int * pPathSizes,
+        const int Count
+)
+{
+    const FAModelData * pModelData = (const FAModelData *)ModelPtr;
+    if (NULL == pModelData || NULL == pPathSizes || 0 >= Count || FALimits::MaxArrSize < Count) {
+        return false;
+    }
+    for (int i = 0; i < Count; ++i) {
+        pPathSizes [i] = 0;
+    }
+    return pModelData->m_hasSeg && !pModelData->m_isBpe && !pModelData->m_isWordPiece;
+}
 
-            const int TokenTo = pWbdResults [i + 2];
-            const int ToOffset = pOffsets[(pCharMap) ? pNormOffsets [TokenTo] : TokenTo];
-            const int ToCharSize = ::FAUtf8Size(pInUtf8Str + ToOffset);
-            pEndOffsets[OutSize] = ToOffset + (0 < ToCharSize ? ToCharSize - 1 : 0);
-        }
 
-        OutSize++;
+//
+// Samples SampleCount segmentations of the text, as it is done in the sentence
+// piece subword regularization, the probability of a segmentation is proportional
+// to exp (Alpha * Score). The dictionary lookup is done once and the segmentations
+// are sampled from the lattice of all the segments. The ids of the segmentations
+// are written one after another, the number of ids of the segmentation i is written
+// into pSampleSizes [i]. The same Seed gives the same segmentations.
+// Returns the total number of ids copied into the array, 0 if the model is not a
+// unigram lm one.
+//
+extern "C"
+const int TextToIdsSample_sp(
+        void* ModelPtr,
+        const char * pInUtf8Str,
+        int InUtf8StrByteCount,
+        int32_t * pIdsArr,
+        int * pSampleSizes,
+        const int MaxIdsArrLength,
+        const int SampleCount,
+        const float Alpha,
+        const int Seed,
+        const int UnkId = 0
+)
+{
+    if (!CanSegmentPaths(ModelPtr, pSampleSizes, SampleCount)) {
+        return 0;
     }
 
-    return OutSize;
+    FASpPathParams Paths;
+    Paths.m_Count = SampleCount;
+    Paths.m_fSample = true;
+    Paths.m_Alpha = Alpha;
+    Paths.m_Seed = (unsigned int) Seed;
+    Paths.m_pPathSizes = pSampleSizes;
+
+    return TextToIdsWithOffsets_sp_t < FAUtf8Traits > (ModelPtr, pInUtf8Str, InUtf8StrByteCount,
+        pIdsArr, NULL, NULL, MaxIdsArrLength, UnkId, &Paths);
 }
 
 
 //
-// The same as TextToIdsWithOffsets_sp, except does not return offsets
+// Writes up to NBest best segmentations of the text, the first one is the same as
+// TextToIds_sp returns. The output is the same as in TextToIdsSample_sp, the sizes
+// of the missing segmentations are 0.
 //
 extern "C"
-const int TextToIds_sp(
+const int TextToIdsNBest_sp(
         void* ModelPtr,
         const char * pInUtf8Str,
         int InUtf8StrByteCount,
         int32_t * pIdsArr,
+        int * pPathSizes,
         const int MaxIdsArrLength,
+        const int NBest,
         const int UnkId = 0
 )
 {
-    return TextToIdsWithOffsets_sp(ModelPtr,pInUtf8Str,InUtf8StrByteCount,pIdsArr,NULL,NULL,MaxIdsArrLength,UnkId);
+    if (!CanSegmentPaths(ModelPtr, pPathSizes, NBest)) {
+        return 0;
+    }
+
+    FASpPathParams Paths;
+    Paths.m_Count = NBest;
+    Paths.m_fSample = false;
+    Paths.m_Alpha = 0.0f;
+    Paths.m_Seed = 0;
+    Paths.m_pPathSizes = pPathSizes;
+
+    return TextToIdsWithOffsets_sp_t < FAUtf8Traits > (ModelPtr, pInUtf8Str, InUtf8StrByteCount,
+        pIdsArr, NULL, NULL, MaxIdsArrLength, UnkId, &Paths);
 }
 
 
@@ -1320,7 +2663,7 @@ const int TextToIdsWithOffsets(
     // check if loaded model has segmentation data
     const FAModelData * pModelData = (const FAModelData *)ModelPtr;
 
-    if (!pModelData->m_hasSeg)
+    if (!pModelData->m_hasSeg || pModelData->m_isWordPiece)
     {
         // call word-piece algorithm
         return TextToIdsWithOffsets_wp(
@@ -1375,7 +2718,7 @@ const int TextToIds(
     // check if loaded model has segmentation data
     const FAModelData * pModelData = (const FAModelData *)ModelPtr;
 
-    if (!pModelData->m_hasSeg)
+    if (!pModelData->m_hasSeg || pModelData->m_isWordPiece)
     {
         // call word-piece algorithm
         return TextToIdsWithOffsets_wp(ModelPtr, pInUtf8Str, InUtf8StrByteCount, pIdsArr, NULL, NULL, MaxIdsArrLength, UnkId);
@@ -1388,6 +2731,61 @@ const int TextToIds(
 }
 
 
+//
+// The same as TextToIdsWithOffsets, but the input is UTF-16LE string, InUtf16StrSize and the offsets
+// are in 16-bit code units.
+//
+extern "C"
+const int TextToIdsWithOffsets_Utf16(
+        void* ModelPtr,
+        const uint16_t * pInUtf16Str,
+        int InUtf16StrSize,
+        int32_t * pIdsArr,
+        int * pStartOffsets, 
+        int * pEndOffsets,
+        const int MaxIdsArrLength,
+        const int UnkId = 0
+)
+{
+    if (0 == ModelPtr) {
+        return 0;
+    }
+
+    // check if loaded model has segmentation data
+    const FAModelData * pModelData = (const FAModelData *)ModelPtr;
+
+    if (!pModelData->m_hasSeg || pModelData->m_isWordPiece)
+    {
+        // call word-piece algorithm
+        return TextToIdsWithOffsets_wp_t < FAUtf16Traits > (ModelPtr, pInUtf16Str, InUtf16StrSize,
+            pIdsArr, pStartOffsets, pEndOffsets, MaxIdsArrLength, UnkId);
+    }
+    else
+    {
+        // call sentence-piece algorithm
+        return TextToIdsWithOffsets_sp_t < FAUtf16Traits > (ModelPtr, pInUtf16Str, InUtf16StrSize,
+            pIdsArr, pStartOffsets, pEndOffsets, MaxIdsArrLength, UnkId);
+    }
+}
+
+
+//
+// The same as TextToIds, but the input is UTF-16LE string, InUtf16StrSize is in 16-bit code units.
+//
+extern "C"
+const int TextToIds_Utf16(
+        void* ModelPtr,
+        const uint16_t * pInUtf16Str,
+        int InUtf16StrSize,
+        int32_t * pIdsArr,
+        const int MaxIdsArrLength,
+        const int UnkId = 0
+)
+{
+    return TextToIdsWithOffsets_Utf16(ModelPtr, pInUtf16Str, InUtf16StrSize, pIdsArr, NULL, NULL, MaxIdsArrLength, UnkId);
+}
+
+
 //
 // Frees memory from the model, after this call ModelPtr is no longer valid
 //  Double calls to this function with the same argument will case access violation
@@ -1402,3 +2800,372 @@ int FreeModel(void* ModelPtr)
     delete (FAModelData*) ModelPtr;
     return 1;
 }
+
+
+//
+// A memory item of the model, see GetModelMemoryInfo
+//
+struct FAMemoryItem
+{
+    std::string _Name;
+    size_t _Size;
+    const char * _pStorage;
+    int _UserCount;
+};
+
+
+//
+// Adds an item of the model memory, skips the empty items
+//
+static void AddMemoryItem(
+        std::vector < FAMemoryItem > & Items,
+        const std::string & Name,
+        const size_t Size,
+        const char * pStorage,
+        const int UserCount
+    )
+{
+    if (0 == Size) {
+        return;
+    }
+    const FAMemoryItem Item = { Name, Size, pStorage, UserCount };
+    Items.push_back (Item);
+}
+
+
+//
+// Returns the items of the memory used by the model, see GetModelMemoryInfo
+//
+static void GetModelMemoryItems(const FAModelData * pModelData, std::vector < FAMemoryItem > & Items)
+{
+    // the LDB dumps and the image
+    const FALDB * pLdb = &(pModelData->m_Ldb);
+    const FADumpRegistry * pDumpRegistry = pLdb->GetRegistry ();
+    const int DumpCount = pLdb->GetDumpCount ();
+
+    for (int i = 0; i < DumpCount; ++i) {
+
+        const std::string Name = "ldb-dump-" + std::to_string (i);
+        const size_t Size = pLdb->GetDumpSize (i, pModelData->m_ImgSize);
+
+        if (NULL != pDumpRegistry) {
+            const int UserCount = pDumpRegistry->GetRefCount (pLdb->GetDump (i));
+            AddMemoryItem (Items, Name, Size, "heap", UserCount);
+        } else {
+            AddMemoryItem (Items, Name, Size, "ldb-image", 1);
+        }
+    }
+    if (NULL != pModelData->m_Img.GetImageDump ()) {
+        AddMemoryItem (Items, "ldb-image", pModelData->m_Img.GetSize (),
+            pModelData->m_Img.IsMapped () ? "mapped" : "heap", 1);
+    }
+
+    // the runtime cache file
+    const FARuntimeCache * pCache = &(pModelData->m_Cache);
+    AddMemoryItem (Items, "runtime-cache", pCache->GetSize (),
+        pCache->IsMapped () ? "mapped" : "heap", 1);
+
+    // the dense tables, built or from the runtime cache
+    AddMemoryItem (Items, "dense-wbd", pModelData->m_DenseDfa.GetMemorySize (),
+        pModelData->m_DenseDfa.IsFromDump () ? "runtime-cache" : "heap", 1);
+    AddMemoryItem (Items, "dense-dict", pModelData->m_DenseMealy.GetMemorySize (),
+        pModelData->m_DenseMealy.IsFromDump () ? "runtime-cache" : "heap", 1);
+
+    // the Iw maps, identical ones are shared by all the automata
+    const FAIwMap_pack * pIwMap = pModelData->m_hasWbd ? pModelData->m_Conf.GetIwMap () : NULL;
+    if (NULL != pIwMap) {
+        AddMemoryItem (Items, "iwmap-wbd", pIwMap->GetTableSize (), "heap", pIwMap->GetTableShareCount ());
+    }
+    pIwMap = pModelData->m_hasSeg ? pModelData->m_DictConf.GetIwMap () : NULL;
+    if (NULL != pIwMap) {
+        AddMemoryItem (Items, "iwmap-dict", pIwMap->GetTableSize (), "heap", pIwMap->GetTableShareCount ());
+    }
+
+    // the segmentation engine
+    if (pModelData->m_hasSeg) {
+        if (pModelData->m_isWordPiece) {
+            AddMemoryItem (Items, "seg-wordpiece", pModelData->m_SegEngineWp.GetMemorySize (), "heap", 1);
+        } else if (pModelData->m_isBpe) {
+            AddMemoryItem (Items, "seg-bpe", pModelData->m_SegEngineBpe.GetMemorySize (), "heap", 1);
+        } else {
+            AddMemoryItem (Items, "seg-unigram", pModelData->m_SegEngine.GetMemorySize (), "heap", 1);
+        }
+    }
+
+    // the word cache
+    const std::shared_ptr < const FAWordCache > pWordCache = std::atomic_load (&(pModelData->m_pWordCache));
+    if (NULL != pWordCache) {
+        AddMemoryItem (Items, "word-cache", pWordCache->GetMemorySize (), "heap", 1);
+    }
+}
+
+
+//
+// Returns the memory used by the model, the sum of its heap and mapped items
+// as GetModelMemoryInfo lists them, the memory shared with other models is
+// counted for each
+//
+static const int64_t GetModelMemorySize(const FAModelData * pModelData)
+{
+    std::vector < FAMemoryItem > Items;
+    GetModelMemoryItems (pModelData, Items);
+
+    int64_t Memory = 0;
+    for (size_t i = 0; i < Items.size (); ++i) {
+        const char * pStorage = Items [i]._pStorage;
+        if (0 == strcmp (pStorage, "heap") || 0 == strcmp (pStorage, "mapped")) {
+            Memory += (int64_t) Items [i]._Size;
+        }
+    }
+    return Memory;
+}
+
+
+//
+// Returns the memory used by the models of the registry, should be called
+// under the registry lock
+//
+static const int64_t GetRegistryMemorySize(const FAModelRegistry * pRegistry)
+{
+    int64_t Memory = 0;
+
+    std::unordered_map < std::string, FAModelRegistry::_TEntry >::const_iterator I = \
+        pRegistry->m_Models.begin ();
+    for (; I != pRegistry->m_Models.end (); ++I) {
+        Memory += GetModelMemorySize ((const FAModelData *) I->second._pModel);
+    }
+    return Memory;
+}
+
+
+//
+// Frees the least recently used models which are not in use until the
+// registry fits into its memory budget, should be called under the lock
+//
+static void EvictModels(FAModelRegistry * pRegistry)
+{
+    if (0 == pRegistry->m_MaxMemory) {
+        return;
+    }
+
+    int64_t Memory = GetRegistryMemorySize (pRegistry);
+
+    std::list < std::string >::iterator I = pRegistry->m_Lru.end ();
+
+    while (Memory > pRegistry->m_MaxMemory && I != pRegistry->m_Lru.begin ()) {
+
+        --I;
+
+        const FAModelRegistry::_TEntry & Entry = pRegistry->m_Models [*I];
+        if (0 < Entry._RefCount) {
+            continue;
+        }
+
+        void * pModel = Entry._pModel;
+        Memory -= GetModelMemorySize ((const FAModelData *) pModel);
+
+        pRegistry->m_Names.erase (pModel);
+        pRegistry->m_Models.erase (*I);
+        I = pRegistry->m_Lru.erase (I);
+
+        FreeModel (pModel);
+    }
+}
+
+
+FAModelRegistry::~FAModelRegistry ()
+{
+    std::unordered_map < void *, std::string >::iterator I = m_Names.begin ();
+    for (; I != m_Names.end (); ++I) {
+        FreeModel (I->first);
+    }
+}
+
+
+//
+// Returns a handle of the model loaded from the pszLdbFileName, the model is
+// loaded by the first call and is shared by the following calls with the
+// same file name. The handle should be released by ReleaseModel and should
+// not be freed by FreeModel. The models which are not in use are freed, the
+// least recently acquired first, when the memory of the loaded models
+// exceeds the budget set by SetModelRegistryMaxMemory. Returns 0 in case of
+// an error.
+//
+extern "C"
+void* AcquireModel(const char * pszLdbFileName)
+{
+    if (NULL == pszLdbFileName) {
+        return 0;
+    }
+
+    FAModelRegistry * pRegistry = &g_ModelRegistry;
+    const std::string Name (pszLdbFileName);
+
+    {
+        std::lock_guard < std::mutex > Guard (pRegistry->m_Lock);
+
+        std::unordered_map < std::string, FAModelRegistry::_TEntry >::iterator I = \
+            pRegistry->m_Models.find (Name);
+
+        if (pRegistry->m_Models.end () != I) {
+            I->second._RefCount++;
+            pRegistry->m_Lru.splice (pRegistry->m_Lru.begin (), pRegistry->m_Lru, I->second._Lru);
+            return I->second._pModel;
+        }
+    }
+
+    // load the model without the lock, so other models can be acquired meanwhile
+    void * pNewModel = LoadModel (pszLdbFileName);
+    if (NULL == pNewModel) {
+        return 0;
+    }
+
+    void * pModel = NULL;
+    {
+        std::lock_guard < std::mutex > Guard (pRegistry->m_Lock);
+
+        std::unordered_map < std::string, FAModelRegistry::_TEntry >::iterator I = \
+            pRegistry->m_Models.find (Name);
+
+        if (pRegistry->m_Models.end () != I) {
+            // the model was loaded by another thread
+            I->second._RefCount++;
+            pRegistry->m_Lru.splice (pRegistry->m_Lru.begin (), pRegistry->m_Lru, I->second._Lru);
+            pModel = I->second._pModel;
+
+        } else {
+
+            pRegistry->m_Lru.push_front (Name);
+
+            FAModelRegistry::_TEntry & Entry = pRegistry->m_Models [Name];
+            Entry._pModel = pNewModel;
+            Entry._RefCount = 1;
+            Entry._Lru = pRegistry->m_Lru.begin ();
+
+            pRegistry->m_Names [pNewModel] = Name;
+
+            pModel = pNewModel;
+            pNewModel = NULL;
+
+            EvictModels (pRegistry);
+        }
+    }
+
+    FreeModel (pNewModel);
+    return pModel;
+}
+
+
+//
+// Releases the model handle returned by AcquireModel, the model may be freed
+// after this call if it is not used by other callers.
+// Returns 1 on success and 0 if the handle was not acquired.
+//
+extern "C"
+int ReleaseModel(void* ModelPtr)
+{
+    FAModelRegistry * pRegistry = &g_ModelRegistry;
+    std::lock_guard < std::mutex > Guard (pRegistry->m_Lock);
+
+    std::unordered_map < void *, std::string >::iterator I = pRegistry->m_Names.find (ModelPtr);
+    if (pRegistry->m_Names.end () == I) {
+        return 0;
+    }
+
+    FAModelRegistry::_TEntry & Entry = pRegistry->m_Models [I->second];
+    if (0 >= Entry._RefCount) {
+        return 0;
+    }
+
+    Entry._RefCount--;
+
+    EvictModels (pRegistry);
+    return 1;
+}
+
+
+//
+// Sets up the memory budget of the models loaded by AcquireModel in bytes,
+// 0 means no limit (the default). The models in use are never freed, so the
+// budget may be exceeded while they are used.
+// Returns 1 on success and 0 if MaxMemory is negative.
+//
+extern "C"
+int SetModelRegistryMaxMemory(const int64_t MaxMemory)
+{
+    if (0 > MaxMemory) {
+        return 0;
+    }
+
+    FAModelRegistry * pRegistry = &g_ModelRegistry;
+    std::lock_guard < std::mutex > Guard (pRegistry->m_Lock);
+
+    pRegistry->m_MaxMemory = MaxMemory;
+
+    EvictModels (pRegistry);
+    return 1;
+}
+
+
+//
+// Returns the memory used by the models loaded by AcquireModel in bytes.
+//
+extern "C"
+int64_t GetModelRegistryMemory()
+{
+    FAModelRegistry * pRegistry = &g_ModelRegistry;
+    std::lock_guard < std::mutex > Guard (pRegistry->m_Lock);
+
+    return GetRegistryMemorySize (pRegistry);
+}
+
+
+//
+// Writes the memory used by the model, one line per item:
+//
+//   <Name>\t<Bytes>\t<Storage>\t<shared|private>\t<UserCount>\n
+//
+// The items are the LDB dumps (ldb-dump-<N>), the LDB image if the model
+// keeps it (ldb-image), the runtime cache file (runtime-cache) and the data
+// built at load time: the dense tables (dense-wbd, dense-dict), the Iw maps
+// of the automata (iwmap-wbd, iwmap-dict), the arrays of the segmentation
+// engine (seg-unigram, seg-bpe, seg-wordpiece) and the word cache
+// (word-cache). Storage is heap or mapped, or the name of the item which
+// contains this one (e.g. the dumps are within ldb-image, if the model
+// keeps its image), so the memory of the model is the sum of the heap and
+// the mapped items. UserCount is the number of the models (or the automata
+// for the Iw maps) which use the same memory, the shared items are listed
+// in full for each of them. The items of 0 bytes are not listed.
+//
+// Returns the size in bytes of the output, the output is written only if the
+// size <= MaxOutUtf8StrByteCount, -1 in case of an error.
+//
+extern "C"
+const int GetModelMemoryInfo(void* ModelPtr, char * pOutUtf8Str, const int MaxOutUtf8StrByteCount)
+{
+    if (NULL == ModelPtr) {
+        return -1;
+    }
+
+    std::vector < FAMemoryItem > Items;
+    GetModelMemoryItems ((const FAModelData *) ModelPtr, Items);
+
+    std::ostringstream Out;
+    for (size_t i = 0; i < Items.size (); ++i) {
+        const FAMemoryItem & Item = Items [i];
+        Out << Item._Name << '\t' << Item._Size << '\t' << Item._pStorage << '\t'
+            << (1 < Item._UserCount ? "shared" : "private") << '\t' << Item._UserCount << '\n';
+    }
+
+    const std::string Info = Out.str ();
+    const int OutSize = (int) Info.size ();
+
+    if (OutSize <= MaxOutUtf8StrByteCount && NULL != pOutUtf8Str) {
+        memcpy (pOutUtf8Str, Info.c_str (), OutSize);
+        if (OutSize < MaxOutUtf8StrByteCount) {
+            pOutUtf8Str [OutSize] = 0;
+        }
+    }
+
+    return OutSize;
+}
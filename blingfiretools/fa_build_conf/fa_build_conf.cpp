@@ -137,6 +137,7 @@ void SetupConfParams ()
     g_parser.AddNumParam ("default-tag", FAFsmConst::PARAM_DEFAULT_TAG);
     g_parser.AddNumParam ("array", FAFsmConst::PARAM_ARRAY);
     g_parser.AddNumParam ("multi-map", FAFsmConst::PARAM_MULTI_MAP);
+    g_parser.AddNumParam ("dat", FAFsmConst::PARAM_DAT);
     g_parser.AddStrParam ("fsm-type", FAFsmConst::PARAM_FSM_TYPE,
                           "rs-nfa", FAFsmConst::TYPE_RS_NFA);
     g_parser.AddStrParam ("fsm-type", FAFsmConst::PARAM_FSM_TYPE,
@@ -249,6 +250,9 @@ void SetupConfParams ()
     // requires a CRC32-like check for the LDB file to pass
     g_parser.AddParam ("verify-ldb-bin", FAFsmConst::PARAM_VERIFY_LDB_BIN);
 
+    // the automaton of the section is a UTF-8 byte automaton
+    g_parser.AddParam ("utf8-input", FAFsmConst::PARAM_UTF8_INPUT);
+
     // tokenization algo runtime
     g_parser.AddStrParam ("tokalgo", FAFsmConst::PARAM_TOKENIZATION_TYPE,
                           "falex", FAFsmConst::TOKENIZE_DEFAULT);
@@ -260,6 +264,8 @@ void SetupConfParams ()
                           "bpe", FAFsmConst::TOKENIZE_BPE);
     g_parser.AddStrParam ("tokalgo", FAFsmConst::PARAM_TOKENIZATION_TYPE,
                           "bpe-opt", FAFsmConst::TOKENIZE_BPE_OPT);
+    g_parser.AddStrParam ("tokalgo", FAFsmConst::PARAM_TOKENIZATION_TYPE,
+                          "bpe-merge", FAFsmConst::TOKENIZE_BPE_MERGE);
 
 }
 
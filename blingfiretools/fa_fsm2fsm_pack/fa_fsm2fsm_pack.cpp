@@ -12,6 +12,7 @@
 #include "FAMapIOTools.h"
 #include "FARSDfa_ro.h"
 #include "FARSDfa_renum_iws.h"
+#include "FARSDfa2Utf8Dfa.h"
 #include "FARSNfa_ro.h"
 #include "FAState2Ow.h"
 #include "FAState2Ows_ar_uniq.h"
@@ -36,6 +37,8 @@
 #include "FAArrayPack.h"
 #include "FAArray_pack.h"
 #include "FAFloatArrayPack.h"
+#include "FADatPack.h"
+#include "FADat_pack.h"
 #include "FATestCmpDfa.h"
 #include "FATestCmpPosNfa.h"
 #include "FATestCmpMultiMap.h"
@@ -44,12 +47,14 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 const char * __PROG__ = "";
 
 const char * g_pInFsmFile = NULL;
 const char * g_pInIwMapFile = NULL;
 const char * g_pInTrBrFile = NULL;
+const char * g_pInI2InfoFile = NULL;
 const char * g_pOutFsmFile = NULL;
 
 int g_type = FAFsmConst::TYPE_RS_DFA;
@@ -65,6 +70,7 @@ bool g_force_flat = false;
 bool g_no_output = false;
 bool g_no_process = false;
 bool g_auto_test = false;
+bool g_utf8_dfa = false;
 
 FAAllocator g_alloc;
 FAAutIOTools g_fsm_io (&g_alloc);
@@ -81,6 +87,8 @@ FAMultiMap_judy g_in_mmap;
 FAMealyDfa g_in_sigma (&g_alloc);
 FAMap_judy g_iw_map;
 FARSDfa_renum_iws g_in_renum_fsm (&g_alloc);
+FARSDfa_ro g_utf8_fsm_rs (&g_alloc);
+FAState2Ow g_utf8_state2ow (&g_alloc);
 
 /// memory dump containers (for test)
 FARSDfa_pack_triv g_rs_dfa_triv_dump;
@@ -94,6 +102,7 @@ FAMultiMap_pack_mph g_mmap_mph_dump;
 FAMultiMap_pack_fixed g_mmap_fixed_dump;
 FAMealyDfa_pack_triv g_out_sigma_dump;
 FAArray_pack g_array_dump;
+FADat_pack g_dat_dump;
 
 /// packers
 FAPosNfaPack_triv g_pos_nfa_pack (&g_alloc);
@@ -103,6 +112,10 @@ FAMultiMapPack_mph g_mmap_pack_mph (&g_alloc);
 FAMultiMapPack_fixed g_mmap_pack_fixed (&g_alloc);
 FAArrayPack g_array_pack (&g_alloc);
 FAFloatArrayPack g_farray_pack (&g_alloc);
+FADatPack g_dat_pack (&g_alloc);
+
+/// converters
+FARSDfa2Utf8Dfa g_utf8_conv (&g_alloc);
 
 /// interface pointers
 FARSDfaA * g_pInDfa = & g_in_fsm_rs;
@@ -149,9 +162,14 @@ This program builds packed contiguous automaton image.\n\
     mealy-dfa  - Mealy DFA\n\
     arr        - Array of integers\n\
     farr       - Array of floats\n\
+    dat        - Double-array trie, reads Mealy DFA based MPH and requires\n\
+      --i2info, see FADatPack\n\
 \n\
   --trbr-maps=<input-file> - reads triangular bracket extraction maps,\n\
     can be used to pack position NFA, does not read them by default\n\
+\n\
+  --i2info=<input-file> - reads Key -> [Id, Score] multi-map of the dictionary,\n\
+    required with --type=dat\n\
 " ;
 
   std::cout << "\n\
@@ -160,6 +178,10 @@ This program builds packed contiguous automaton image.\n\
     Note: This option cannot be used for Mealy and MHP automata representation\n\
 \n\
   --iw-map=<input> - New -> Old Iw external map, not used by default\n\
+\n\
+  --utf8-dfa - converts the automaton reading code points into an equivalent\n\
+    automaton reading UTF-8 bytes, can be used with --type=rs-dfa and\n\
+    --type=moore-dfa, see utf8-input in the LDB configuration\n\
 \n\
   --imp-mmap - uses implicit representation for mmap, if possible\n\
 \n\
@@ -224,6 +246,10 @@ void process_args (int& argc, char**& argv)
         g_use_ranges = true;
         continue;
     }
+    if (0 == strcmp ("--utf8-dfa", *argv)) {
+        g_utf8_dfa = true;
+        continue;
+    }
     if (0 == strncmp ("--in=", *argv, 5)) {
         g_pInFsmFile = &((*argv) [5]);
         continue;
@@ -236,6 +262,10 @@ void process_args (int& argc, char**& argv)
         g_pInTrBrFile = &((*argv) [12]);
         continue;
     }
+    if (0 == strncmp ("--i2info=", *argv, 9)) {
+        g_pInI2InfoFile = &((*argv) [9]);
+        continue;
+    }
     if (0 == strncmp ("--iw-map=", *argv, 9)) {
         g_pInIwMapFile = &((*argv) [9]);
         continue;
@@ -284,6 +314,10 @@ void process_args (int& argc, char**& argv)
         g_type = FAFsmConst::TYPE_FLOAT_ARRAY;
         continue;
     }
+    if (0 == strcmp ("--type=dat", *argv)) {
+        g_type = FAFsmConst::TYPE_DAT;
+        continue;
+    }
     if (0 == strcmp ("--imp-mmap", *argv)) {
         g_imp_mmap = true;
         continue;
@@ -333,7 +367,8 @@ void Load ()
         g_pState2Ows = & g_state2ows;
         g_fsm_io.Read (*pIs, g_pInDfa, g_pState2Ows);
 
-    } else if (FAFsmConst::TYPE_MEALY_DFA == g_type) {
+    } else if (FAFsmConst::TYPE_MEALY_DFA == g_type || \
+               FAFsmConst::TYPE_DAT == g_type) {
 
         g_in_sigma.SetRsDfa (g_pInDfa);
         g_pSigma = & g_in_sigma;
@@ -358,6 +393,18 @@ void Load ()
         g_fsm_io.Read (*pIs, g_pInNfa);
     }
 
+    // load Key -> [Id, Score] map
+    if (FAFsmConst::TYPE_DAT == g_type) {
+
+        FAAssert (g_pInI2InfoFile, FAMsg::IOError);
+
+        std::ifstream i2info_ifs (g_pInI2InfoFile, std::ios::in);
+        FAAssertStream (&i2info_ifs, g_pInI2InfoFile);
+
+        g_pMMap = & g_in_mmap;
+        g_map_io.Read (i2info_ifs, g_pMMap);
+    }
+
     // load triangular brackets
     if (NULL != g_pInTrBrFile) {
 
@@ -386,6 +433,113 @@ void Load ()
 }
 
 
+void ConvertToUtf8 ()
+{
+    if (FAFsmConst::TYPE_RS_DFA != g_type &&
+        FAFsmConst::TYPE_MOORE_DFA != g_type) {
+        std::cerr << "ERROR: --utf8-dfa can only be used with rs-dfa or moore-dfa"
+                  << " in program " << __PROG__ << '\n';
+        exit (1);
+    }
+
+    // the converter maps code points itself, so it takes the original Dfa
+    g_utf8_conv.SetInDfa (&g_in_fsm_rs);
+    g_utf8_conv.SetIwMap (NULL != g_pInIwMapFile ? &g_iw_map : NULL);
+    g_utf8_conv.SetOutDfa (&g_utf8_fsm_rs);
+
+    if (g_pState2Ow) {
+        g_utf8_conv.SetInState2Ow (g_pState2Ow);
+        g_utf8_conv.SetOutState2Ow (&g_utf8_state2ow);
+    }
+
+    g_utf8_conv.Process ();
+
+    g_pInDfa = & g_utf8_fsm_rs;
+
+    if (g_pState2Ow) {
+        g_pState2Ow = & g_utf8_state2ow;
+    }
+}
+
+
+// checks that every word of the automaton has the same path, Key, Id and
+// Score in the double-array trie
+const bool AutoTestDat (const unsigned char * pDump)
+{
+    g_dat_dump.SetImage (pDump);
+
+    const int * pIws = NULL;
+    const int IwCount = g_pInDfa->GetIWs (&pIws);
+    const int MaxState = g_pInDfa->GetMaxState ();
+
+    // State --> <Iw, Dst, Ow> arcs
+    std::vector < int > StateFrom (MaxState + 2, 0);
+    std::vector < int > Arcs;
+
+    for (int State = 0; State <= MaxState; ++State) {
+        StateFrom [State] = (int) Arcs.size ();
+        for (int i = 0; i < IwCount; ++i) {
+            const int Dst = g_pInDfa->GetDest (State, pIws [i]);
+            if (0 <= Dst) {
+                const int Ow = g_pSigma->GetOw (State, pIws [i]);
+                Arcs.push_back (pIws [i]);
+                Arcs.push_back (Dst);
+                Arcs.push_back (0 < Ow ? Ow : 0);
+            }
+        }
+    }
+    StateFrom [MaxState + 1] = (int) Arcs.size ();
+
+    // <State, Node, SumOw> stack
+    std::vector < int > Stack;
+    Stack.push_back (g_pInDfa->GetInitial ());
+    Stack.push_back (g_dat_dump.GetRoot ());
+    Stack.push_back (0);
+
+    while (!Stack.empty ()) {
+
+        const int SumOw = Stack.back ();
+        Stack.pop_back ();
+        const int Node = Stack.back ();
+        Stack.pop_back ();
+        const int State = Stack.back ();
+        Stack.pop_back ();
+
+        if (g_pInDfa->IsFinal (State) != g_dat_dump.IsFinal (Node)) {
+            return false;
+        }
+        if (g_pInDfa->IsFinal (State)) {
+
+            if (SumOw != g_dat_dump.GetKey (Node)) {
+                return false;
+            }
+            const int * pValues = NULL;
+            const int Count = g_pMMap->Get (SumOw, &pValues);
+            if (0 >= Count || pValues [0] != g_dat_dump.GetId (SumOw)) {
+                return false;
+            }
+            const float Score = 1 < Count ? *((const float *) (pValues + 1)) : 0.0f;
+            if (Score != g_dat_dump.GetScore (SumOw)) {
+                return false;
+            }
+        }
+
+        for (int i = StateFrom [State]; i < StateFrom [State + 1]; i += 3) {
+
+            const int Dst = g_dat_dump.GetDest (Node, Arcs [i]);
+            if (-1 == Dst) {
+                return false;
+            }
+            Stack.push_back (Arcs [i + 1]);
+            Stack.push_back (Dst);
+            Stack.push_back (SumOw + Arcs [i + 2]);
+        }
+    }
+
+    return true;
+}
+
+
 const bool AutoTest (const unsigned char * pDump, const int DumpSize)
 {
     FAAssert (0 < DumpSize && pDump, FAMsg::InvalidParameters);
@@ -511,6 +665,10 @@ const bool AutoTest (const unsigned char * pDump, const int DumpSize)
             }
         }
 
+    } else if (FAFsmConst::TYPE_DAT == g_type) {
+
+        return AutoTestDat (pDump);
+
     } else if (FAFsmConst::TYPE_FLOAT_ARRAY == g_type) {
 
         DebugLogAssert (g_FloatArray && 0 < g_FloatArraySize);
@@ -552,6 +710,11 @@ int __cdecl main (int argc, char ** argv)
         // load automaton
         Load ();
 
+        // convert automaton, if needed
+        if (g_utf8_dfa) {
+            ConvertToUtf8 ();
+        }
+
         // process
         if (false == g_no_process) {
 
@@ -599,6 +762,15 @@ int __cdecl main (int argc, char ** argv)
 
                     DumpSize = g_farray_pack.GetDump (&pDump);
 
+                } else if (FAFsmConst::TYPE_DAT == g_type) {
+
+                    g_dat_pack.SetDfa (g_pInDfa);
+                    g_dat_pack.SetSigma (g_pSigma);
+                    g_dat_pack.SetI2Info (g_pMMap);
+                    g_dat_pack.Process ();
+
+                    DumpSize = g_dat_pack.GetDump (&pDump);
+
                 } else {
 
                     g_dfa_pack.SetDfa (g_pInDfa);
@@ -0,0 +1,781 @@
+/**
+ * Copyright (c) Microsoft Corporation. All rights reserved.
+ * Licensed under the MIT License.
+ */
+
+
+#include "FAConfig.h"
+#include "FAFsmConst.h"
+#include "FAUtils.h"
+#include "FAException.h"
+#include "FAImageDump.h"
+#include "FALDB.h"
+#include "FAWbdConfKeeper.h"
+#include "FARSDfaCA.h"
+#include "FAState2OwCA.h"
+#include "FAMultiMapCA.h"
+#include "FAIwMap_pack.h"
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+const char * __PROG__ = "";
+
+const char * g_pLdbFile = NULL;
+const char * g_pOutFile = NULL;
+const char * g_pName = "FALexTools_gen";
+
+std::ostream * g_pOs = &std::cout;
+std::ofstream g_ofs;
+
+// the Iws below are looked up in the array, the rest with the branches
+const int DirectIwCount = 256;
+// the maximum Iw value considered for the input code points
+const int MaxCodePoint = 0x10FFFF;
+
+
+void usage ()
+{
+  std::cout << "\n\
+Usage: fa_lex2cpp [OPTIONS]\n\
+\n\
+This tool converts the compiled tokenization rules from the [wbd] section\n\
+of the LDB into a C++ source code with the lexer class which can be used\n\
+instead of FALexTools_t < int > or FALexTools_t < unsigned char >. The\n\
+automaton is compiled into switch statements, the actions and the\n\
+configuration parameters become constants, the lexing is made by\n\
+FALexTools_t over these data.\n\
+This is meant for the small automata, such as word and sentence breaking\n\
+rules, for the big ones the code takes long to compile.\n\
+\n\
+  --ldb=<ldb> - reads compiled rules from the <ldb> file,\n\
+    have to be specified\n\
+\n\
+  --out=<output> - writes output to the <output> file,\n\
+    if omited stdout is used\n\
+\n\
+  --name=<name> - the class name, FALexTools_gen is used by default\n\
+\n\
+";
+}
+
+
+void process_args (int& argc, char**& argv)
+{
+    for (; argc--; ++argv) {
+
+        if (!strcmp ("--help", *argv)) {
+            usage ();
+            exit (0);
+        }
+        if (0 == strncmp ("--ldb=", *argv, 6)) {
+            g_pLdbFile = &((*argv) [6]);
+            continue;
+        }
+        if (0 == strncmp ("--out=", *argv, 6)) {
+            g_pOutFile = &((*argv) [6]);
+            continue;
+        }
+        if (0 == strncmp ("--name=", *argv, 7)) {
+            g_pName = &((*argv) [7]);
+            continue;
+        }
+    }
+}
+
+
+///
+/// The lexer class, the data are compiled in and the processing is made by
+/// FALexTools_t, so the results are the same as with the LDB. $NAME is
+/// substituted with the class name and $TY with the input type.
+///
+
+const char * const g_pLexCode = R"(
+class $NAME {
+
+public:
+    $NAME ()
+    {
+        m_Conf.SetRsDfa (&m_Dfa);
+        m_Conf.SetState2Ow (&m_State2Ow);
+        m_Conf.SetIgnoreCase ($NAME_IgnoreCase);
+        m_Conf.SetMaxDepth ($NAME_MaxDepth);
+        m_Conf.SetMaxTokenLength ($NAME_MaxTokenLength);
+        m_Conf.SetUtf8Input ($NAME_Utf8Input);
+        // calculates the functions' initial states, so goes last
+        m_Conf.SetMMap (&m_Acts);
+
+        m_Lex.SetConf (&m_Conf);
+    }
+
+    $NAME (const $NAME &) = delete;
+    $NAME & operator= (const $NAME &) = delete;
+
+public:
+    /// the data are compiled in, kept for the compatibility with FALexTools_t
+    void SetConf (const FAWbdConfKeeper *) {}
+
+    /// makes a processing
+    const int Process (
+            const $TY * pIn,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize
+        ) const
+    {
+        return m_Lex.Process (pIn, InSize, pOut, MaxOutSize);
+    }
+
+    /// makes a processing, starting from a particular _function
+    const int Process (
+            const int FnTag,
+            const $TY * pIn,
+            const int InSize,
+            __out_ecount(MaxOutSize) int * pOut,
+            const int MaxOutSize
+        ) const
+    {
+        return m_Lex.Process (FnTag, pIn, InSize, pOut, MaxOutSize);
+    }
+
+private:
+    // the automaton
+    class _TDfa : public FARSDfaCA {
+    public:
+        const int GetInitial () const
+        {
+            return 0;
+        }
+        const bool IsFinal (const int State) const
+        {
+            return 0 <= State && -1 != $NAME_State2Ow [State];
+        }
+        const int GetDest (const int State, const int Iw) const
+        {
+            if (0 > State) {
+                return -1;
+            }
+            return $NAME_GetDest (State, $NAME_GetClass (Iw));
+        }
+        const int GetIWs (
+                __out_ecount_opt (MaxIwCount) int * pIws,
+                const int MaxIwCount
+            ) const
+        {
+            if (NULL == pIws && 0 != MaxIwCount) {
+                return -1;
+            }
+            for (int i = 0; i < MaxIwCount && i < $NAME_IwCount; ++i) {
+                pIws [i] = $NAME_Iws [i];
+            }
+            return $NAME_IwCount;
+        }
+    };
+
+    // the rule ids of the final states
+    class _TState2Ow : public FAState2OwCA {
+    public:
+        const int GetOw (const int State) const
+        {
+            if (0 > State) {
+                return -1;
+            }
+            return $NAME_State2Ow [State];
+        }
+    };
+
+    // the actions of the rules
+    class _TActs : public FAMultiMapCA {
+    public:
+        const int Get (const int Key, const int ** ppValues) const
+        {
+            DebugLogAssert (ppValues);
+            if (0 > Key || $NAME_OwCount <= Key || -1 == $NAME_Ow2Act [Key]) {
+                return -1;
+            }
+            const int * pAct = $NAME_Acts + $NAME_Ow2Act [Key];
+            *ppValues = pAct + 1;
+            return *pAct;
+        }
+        const int Get (
+                const int Key,
+                __out_ecount_opt(MaxCount) int * pValues,
+                const int MaxCount
+            ) const
+        {
+            const int * pAct;
+            const int Size = Get (Key, &pAct);
+            for (int i = 0; pValues && i < MaxCount && i < Size; ++i) {
+                pValues [i] = pAct [i];
+            }
+            return Size;
+        }
+        const int GetMaxCount () const
+        {
+            return $NAME_MaxActSize;
+        }
+    };
+
+private:
+    _TDfa m_Dfa;
+    _TState2Ow m_State2Ow;
+    _TActs m_Acts;
+    FAWbdConfKeeper m_Conf;
+    FALexTools_t < $TY > m_Lex;
+};
+)";
+
+// replaces all occurrences of From with To
+void Replace (std::string & Str, const std::string & From, const std::string & To)
+{
+    size_t Pos = 0;
+    while (std::string::npos != (Pos = Str.find (From, Pos))) {
+        Str.replace (Pos, From.length (), To);
+        Pos += To.length ();
+    }
+}
+
+
+///
+/// Builds the classes of Iws and the renumbered transition table
+///
+
+class FALex2Cpp {
+
+public:
+    FALex2Cpp (const FAWbdConfKeeper * pConf, const FAIwMap_pack * pIwMap);
+
+public:
+    void Process ();
+    void Print (std::ostream & os) const;
+
+private:
+    // returns the class of the Iw
+    const int GetClass (const int Iw) const;
+    // makes the Iw classes and enumerates the states
+    void BuildStates ();
+    // merges the Iw classes with the identical columns
+    void MergeClasses ();
+    // builds the actions
+    void BuildActs ();
+    // prints the branches for the Iw ranges [Begin, End)
+    void PrintRanges (
+            std::ostream & os,
+            const int Begin,
+            const int End,
+            const std::string & Indent
+        ) const;
+
+private:
+    const FAWbdConfKeeper * m_pConf;
+    const FARSDfaCA * m_pDfa;
+    const FAIwMap_pack * m_pIwMap;
+    // the alphabet of the automaton, sorted
+    std::vector < int > m_iws;
+    // the maximum Iw of the automaton
+    int m_MaxIw;
+    // Iw keys, NewIw or Iw, --> initial class
+    std::map < int, int > m_key2class;
+    // initial class --> its Iw
+    std::vector < int > m_class2iw;
+    // initial class --> final class
+    std::vector < int > m_class2final;
+    int m_ClassCount;
+    // new state --> old state
+    std::vector < int > m_states;
+    // old state --> new state
+    std::map < int, int > m_old2new;
+    // [new state][initial class] --> new destination state
+    std::vector < int > m_dsts;
+    // [new state][final class] --> new destination state
+    std::vector < int > m_dsts2;
+    // Iw ranges [From, To] --> final class, starting from DirectIwCount
+    std::vector < int > m_range_to;
+    std::vector < int > m_range_class;
+    // final classes of Iws [0, DirectIwCount)
+    std::vector < int > m_direct;
+    // the class of unknown Iws
+    int m_UnkClass;
+    // new state --> Ow, -1 for non-final
+    std::vector < int > m_state2ow;
+    // Ow --> offset in m_acts, -1 if the Ow has no action
+    std::vector < int > m_ow2act;
+    // the actions, each is prefixed with its size
+    std::vector < int > m_acts;
+    // the maximum action size
+    int m_MaxActSize;
+};
+
+
+FALex2Cpp::FALex2Cpp (const FAWbdConfKeeper * pConf, const FAIwMap_pack * pIwMap) :
+    m_pConf (pConf),
+    m_pDfa (pConf->GetRsDfa ()),
+    m_pIwMap (pIwMap),
+    m_MaxIw (0),
+    m_ClassCount (0),
+    m_UnkClass (-1),
+    m_MaxActSize (0)
+{
+    LogAssert (m_pDfa && m_pConf->GetState2Ow () && m_pConf->GetMMap ());
+}
+
+
+const int FALex2Cpp::GetClass (const int Iw) const
+{
+    int Key = -1;
+
+    if (0 <= Iw && Iw <= m_MaxIw) {
+        if (m_pIwMap) {
+            Key = m_pIwMap->GetNewIw (Iw);
+        } else if (m_key2class.end () != m_key2class.find (Iw)) {
+            Key = Iw;
+        }
+    }
+
+    std::map < int, int >::const_iterator it = m_key2class.find (Key);
+    LogAssert (m_key2class.end () != it);
+    return it->second;
+}
+
+
+void FALex2Cpp::BuildStates ()
+{
+    // get the alphabet
+    const int IwCount = m_pDfa->GetIWs (NULL, 0);
+    LogAssert (0 < IwCount);
+    std::vector < int > & Iws = m_iws;
+    Iws.resize (IwCount);
+    m_pDfa->GetIWs (Iws.data (), IwCount);
+    std::sort (Iws.begin (), Iws.end ());
+    m_MaxIw = Iws [IwCount - 1];
+
+    // the class of the Iws without transitions
+    m_key2class [-1] = 0;
+    m_class2iw.push_back (m_MaxIw + 1);
+
+    // each distinct NewIw or each Iw makes an initial class
+    for (int i = 0; i < IwCount; ++i) {
+        const int Iw = Iws [i];
+        const int Key = m_pIwMap ? m_pIwMap->GetNewIw (Iw) : Iw;
+        if (m_key2class.end () == m_key2class.find (Key)) {
+            m_key2class [Key] = (int) m_class2iw.size ();
+            m_class2iw.push_back (Iw);
+        }
+    }
+
+    const int ClassCount = (int) m_class2iw.size ();
+
+    // enumerate the states in the breadth-first order
+    const int Initial = m_pDfa->GetInitial ();
+    m_old2new [Initial] = 0;
+    m_states.push_back (Initial);
+
+    for (size_t i = 0; i < m_states.size (); ++i) {
+
+        const int State = m_states [i];
+
+        for (int C = 0; C < ClassCount; ++C) {
+
+            const int Dst = m_pDfa->GetDest (State, m_class2iw [C]);
+            int NewDst = -1;
+
+            if (-1 != Dst) {
+                std::map < int, int >::const_iterator it = m_old2new.find (Dst);
+                if (m_old2new.end () == it) {
+                    NewDst = (int) m_states.size ();
+                    m_old2new [Dst] = NewDst;
+                    m_states.push_back (Dst);
+                } else {
+                    NewDst = it->second;
+                }
+            }
+            m_dsts.push_back (NewDst);
+        }
+    }
+}
+
+
+void FALex2Cpp::MergeClasses ()
+{
+    const int ClassCount = (int) m_class2iw.size ();
+    const int StateCount = (int) m_states.size ();
+
+    std::map < std::vector < int >, int > Column2Class;
+    std::vector < int > Column (StateCount);
+
+    m_class2final.resize (ClassCount);
+
+    for (int C = 0; C < ClassCount; ++C) {
+
+        for (int State = 0; State < StateCount; ++State) {
+            Column [State] = m_dsts [(State * ClassCount) + C];
+        }
+
+        std::map < std::vector < int >, int >::const_iterator it = \
+            Column2Class.find (Column);
+
+        if (Column2Class.end () == it) {
+            const int FinalClass = (int) Column2Class.size ();
+            Column2Class [Column] = FinalClass;
+            m_class2final [C] = FinalClass;
+        } else {
+            m_class2final [C] = it->second;
+        }
+    }
+
+    m_ClassCount = (int) Column2Class.size ();
+    m_UnkClass = m_class2final [0];
+
+    m_dsts2.resize (StateCount * m_ClassCount);
+
+    for (int State = 0; State < StateCount; ++State) {
+        for (int C = 0; C < ClassCount; ++C) {
+            m_dsts2 [(State * m_ClassCount) + m_class2final [C]] = \
+                m_dsts [(State * ClassCount) + C];
+        }
+    }
+
+    // direct classes
+    m_direct.resize (DirectIwCount);
+    for (int Iw = 0; Iw < DirectIwCount; ++Iw) {
+        m_direct [Iw] = m_class2final [GetClass (Iw)];
+    }
+
+    // Iw ranges, the last one is open
+    const int MaxIw = std::max (m_MaxIw, MaxCodePoint);
+    int PrevClass = -1;
+
+    for (int Iw = DirectIwCount; Iw <= MaxIw + 1; ++Iw) {
+
+        const int FinalClass = m_class2final [GetClass (Iw)];
+
+        if (PrevClass != FinalClass && -1 != PrevClass) {
+            m_range_to.push_back (Iw - 1);
+            m_range_class.push_back (PrevClass);
+        }
+        PrevClass = FinalClass;
+    }
+    m_range_to.push_back (-1);
+    m_range_class.push_back (PrevClass);
+}
+
+
+void FALex2Cpp::BuildActs ()
+{
+    const FAState2OwCA * pState2Ow = m_pConf->GetState2Ow ();
+    const FAMultiMapCA * pActs = m_pConf->GetMMap ();
+
+    const int StateCount = (int) m_states.size ();
+
+    m_state2ow.resize (StateCount, -1);
+
+    for (int State = 0; State < StateCount; ++State) {
+
+        const int OldState = m_states [State];
+
+        if (m_pDfa->IsFinal (OldState)) {
+            m_state2ow [State] = pState2Ow->GetOw (OldState);
+            LogAssert (0 <= m_state2ow [State]);
+        }
+    }
+
+    // all the actions, the runtime reads them from 0 until the first missing
+    // one (see FAWbdConfKeeper::CalcFnIniStates), and the ones of the states
+    std::vector < int > Ows (m_state2ow);
+    for (int Ow = 0; -1 != pActs->Get (Ow, (int *) NULL, 0); ++Ow) {
+        Ows.push_back (Ow);
+    }
+    std::sort (Ows.begin (), Ows.end ());
+    Ows.erase (std::unique (Ows.begin (), Ows.end ()), Ows.end ());
+
+    m_ow2act.resize (Ows.empty () ? 0 : Ows.back () + 1, -1);
+
+    for (size_t i = 0; i < Ows.size (); ++i) {
+
+        const int Ow = Ows [i];
+        if (0 > Ow) {
+            continue;
+        }
+
+        const int * pAct;
+        const int ActSize = pActs->Get (Ow, &pAct);
+        LogAssert (3 <= ActSize && pAct);
+
+        m_ow2act [Ow] = (int) m_acts.size ();
+        m_acts.push_back (ActSize);
+        m_acts.insert (m_acts.end (), pAct, pAct + ActSize);
+
+        if (m_MaxActSize < ActSize) {
+            m_MaxActSize = ActSize;
+        }
+    }
+}
+
+
+void FALex2Cpp::Process ()
+{
+    BuildStates ();
+    MergeClasses ();
+    BuildActs ();
+}
+
+
+void FALex2Cpp::PrintRanges (
+        std::ostream & os,
+        const int Begin,
+        const int End,
+        const std::string & Indent
+    ) const
+{
+    DebugLogAssert (Begin < End);
+
+    if (End - Begin <= 3) {
+        for (int i = Begin; i < End - 1; ++i) {
+            os << Indent << "if (Iw <= " << m_range_to [i] << ") return " \
+               << m_range_class [i] << ";\n";
+        }
+        os << Indent << "return " << m_range_class [End - 1] << ";\n";
+        return;
+    }
+
+    const int Mid = (Begin + End) / 2;
+
+    os << Indent << "if (Iw <= " << m_range_to [Mid - 1] << ") {\n";
+    PrintRanges (os, Begin, Mid, Indent + "    ");
+    os << Indent << "} else {\n";
+    PrintRanges (os, Mid, End, Indent + "    ");
+    os << Indent << "}\n";
+}
+
+
+void FALex2Cpp::Print (std::ostream & os) const
+{
+    const std::string Name = g_pName;
+    const bool Utf8Input = m_pConf->GetUtf8Input ();
+    const int StateCount = (int) m_states.size ();
+
+    os << "\n#include \"FAConfig.h\"\n"
+       << "#include \"FARSDfaCA.h\"\n"
+       << "#include \"FAState2OwCA.h\"\n"
+       << "#include \"FAMultiMapCA.h\"\n"
+       << "#include \"FAWbdConfKeeper.h\"\n"
+       << "#include \"FALexTools_t.h\"\n\n";
+
+    // the constants
+    os << "// " << StateCount << " states, " << m_ClassCount << " Iw classes\n"
+       << "static const int " << Name << "_MaxDepth = " << m_pConf->GetMaxDepth () << ";\n"
+       << "static const int " << Name << "_MaxTokenLength = " << m_pConf->GetMaxTokenLength () << ";\n"
+       << "static const bool " << Name << "_IgnoreCase = " << (m_pConf->GetIgnoreCase () ? "true" : "false") << ";\n"
+       << "static const bool " << Name << "_Utf8Input = " << (Utf8Input ? "true" : "false") << ";\n\n";
+
+    // the alphabet
+    os << "static const int " << Name << "_IwCount = " << m_iws.size () << ";\n"
+       << "static const int " << Name << "_Iws [" << m_iws.size () << "] = {";
+    for (size_t i = 0; i < m_iws.size (); ++i) {
+        os << (0 == i % 16 ? "\n    " : " ") << m_iws [i] << ",";
+    }
+    os << "\n};\n\n";
+
+    // the Iw classes
+    os << "static const int " << Name << "_Iw2Class [" << DirectIwCount << "] = {";
+    for (int Iw = 0; Iw < DirectIwCount; ++Iw) {
+        os << (0 == Iw % 16 ? "\n    " : " ") << m_direct [Iw] << ",";
+    }
+    os << "\n};\n\n";
+
+    os << "inline const int " << Name << "_GetClass (const int Iw)\n{\n"
+       << "    if ((unsigned int) Iw < " << DirectIwCount << ") {\n"
+       << "        return " << Name << "_Iw2Class [Iw];\n"
+       << "    } else if (0 > Iw) {\n"
+       << "        return " << m_UnkClass << ";\n"
+       << "    }\n";
+    PrintRanges (os, 0, (int) m_range_to.size (), "    ");
+    os << "}\n\n";
+
+    // the transitions
+    os << "inline const int " << Name << "_GetDest (const int State, const int C)\n{\n"
+       << "    switch (State) {\n";
+
+    for (int State = 0; State < StateCount; ++State) {
+
+        const int * pDsts = m_dsts2.data () + (State * m_ClassCount);
+
+        // the most frequent destination goes to the default branch
+        std::map < int, int > Dst2Count;
+        for (int C = 0; C < m_ClassCount; ++C) {
+            Dst2Count [pDsts [C]]++;
+        }
+        int DefDst = -1;
+        int DefCount = 0;
+        for (std::map < int, int >::const_iterator it = Dst2Count.begin (); \
+             it != Dst2Count.end (); ++it) {
+            if (it->second > DefCount) {
+                DefDst = it->first;
+                DefCount = it->second;
+            }
+        }
+
+        os << "    case " << State << ":\n";
+
+        if (DefCount == m_ClassCount) {
+            os << "        return " << DefDst << ";\n";
+            continue;
+        }
+
+        os << "        switch (C) {\n";
+
+        for (std::map < int, int >::const_iterator it = Dst2Count.begin (); \
+             it != Dst2Count.end (); ++it) {
+
+            const int Dst = it->first;
+            if (Dst == DefDst) {
+                continue;
+            }
+            os << "        ";
+            for (int C = 0; C < m_ClassCount; ++C) {
+                if (Dst == pDsts [C]) {
+                    os << "case " << C << ": ";
+                }
+            }
+            os << "return " << Dst << ";\n";
+        }
+        os << "        default: return " << DefDst << ";\n"
+           << "        }\n";
+    }
+    os << "    }\n"
+       << "    return -1;\n"
+       << "}\n\n";
+
+    // the actions
+    os << "static const int " << Name << "_MaxActSize = " << m_MaxActSize << ";\n"
+       << "static const int " << Name << "_Acts [" << m_acts.size () + 1 << "] = {";
+    for (size_t i = 0; i < m_acts.size (); ++i) {
+        os << (0 == i % 16 ? "\n    " : " ") << m_acts [i] << ",";
+    }
+    os << "\n    0\n};\n\n";
+
+    os << "static const int " << Name << "_OwCount = " << m_ow2act.size () << ";\n"
+       << "static const int " << Name << "_Ow2Act [" << m_ow2act.size () + 1 << "] = {";
+    for (size_t i = 0; i < m_ow2act.size (); ++i) {
+        os << (0 == i % 16 ? "\n    " : " ") << m_ow2act [i] << ",";
+    }
+    os << "\n    -1\n};\n\n";
+
+    os << "static const int " << Name << "_State2Ow [" << StateCount << "] = {";
+    for (int State = 0; State < StateCount; ++State) {
+        os << (0 == State % 16 ? "\n    " : " ") << m_state2ow [State] << ",";
+    }
+    os << "\n};\n";
+
+    // the class
+    std::string Code (g_pLexCode);
+    Replace (Code, "$NAME", Name);
+    Replace (Code, "$TY", Utf8Input ? "unsigned char" : "int");
+
+    os << Code;
+}
+
+
+int __cdecl main (int argc, char ** argv)
+{
+    __PROG__ = argv [0];
+
+    --argc, ++argv;
+
+    ::FAIOSetup ();
+
+    // process command line
+    process_args (argc, argv);
+
+    try {
+
+        FAAssert (g_pLdbFile, FAMsg::InvalidParameters);
+
+        if (g_pOutFile) {
+            g_ofs.open (g_pOutFile, std::ios::out);
+            g_pOs = &g_ofs;
+        }
+
+        FAImageDump Img;
+        Img.Load (g_pLdbFile);
+        const unsigned char * pImg = Img.GetImageDump ();
+        FAAssert (pImg, FAMsg::IOError);
+
+        FALDB Ldb;
+        Ldb.SetImage (pImg);
+
+        const int * pValues = NULL;
+        const int Size = Ldb.GetHeader ()->Get (FAFsmConst::FUNC_WBD, &pValues);
+        FAAssert (0 < Size && pValues, FAMsg::IOError);
+
+        FAWbdConfKeeper Conf;
+        Conf.Initialize (&Ldb, pValues, Size);
+
+        // get the Iw remapping of the automaton, if any
+        FAIwMap_pack IwMap;
+        const FAIwMap_pack * pIwMap = NULL;
+
+        for (int i = 0; i < Size; ++i) {
+
+            // see FAWbdConfKeeper::Initialize, only these have no value
+            if (FAFsmConst::PARAM_IGNORE_CASE == pValues [i] ||
+                FAFsmConst::PARAM_UTF8_INPUT == pValues [i]) {
+                continue;
+            }
+            if (FAFsmConst::PARAM_FSM != pValues [i++]) {
+                continue;
+            }
+            if (i < Size) {
+
+                const unsigned char * pDfaImg = Ldb.GetDump (pValues [i]);
+                LogAssert (pDfaImg);
+
+                // see FARSDfa_pack_triv::SetImage
+                const unsigned int IwsCount = \
+                    *(const unsigned int *)(pDfaImg + (2 * sizeof (int)));
+
+                if (0 != (0x80000000 & IwsCount)) {
+                    const int IwCount = 0x7FFFFFFF & IwsCount;
+                    IwMap.SetImage (pDfaImg + ((4 + IwCount) * sizeof (int)));
+                    pIwMap = &IwMap;
+                }
+                break;
+            }
+        }
+
+        FALex2Cpp Gen (&Conf, pIwMap);
+        Gen.Process ();
+
+        // write the header
+        (*g_pOs)
+            << std::endl << "//" << std::endl
+            << "// Autogenerated file with" << std::endl
+            << "//     fa_lex2cpp --ldb=\"" << g_pLdbFile << "\" --name=" << g_pName
+            << std::endl << "//" << std::endl;
+
+        Gen.Print (*g_pOs);
+
+    } catch (const FAException & e) {
+
+        const char * const pErrMsg = e.GetErrMsg ();
+        const char * const pFile = e.GetSourceName ();
+        const int Line = e.GetSourceLine ();
+
+        std::cerr << "ERROR: " << pErrMsg << " in " << pFile \
+            << " at line " << Line << " in program " << __PROG__ << '\n';
+
+        return 2;
+
+    } catch (...) {
+
+        std::cerr << "ERROR: Unknown error in program " << __PROG__ << '\n';
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -18,6 +18,8 @@ const char * __PROG__ = "";
 
 FAAllocator g_alloc;
 const char * g_pOutFile = NULL;
+int g_Version = 2;
+bool g_fCompress = false;
 
 
 void usage () {
@@ -26,12 +28,20 @@ void usage () {
 Usage: fa_merge_dumps [OPTIONS] FILE [FILE [...]]\n\
 \n\
 This program merges binary files together in a specified order and adds\n\
-the header array of entry points. All array values are ints. The first value\n\
-indicates the number of merged files, each subsequent value is an offset for\n\
-the given entry point.\n\
+the header with the entry points. The version 2 header has a magic number,\n\
+the version and the directory of the sections with 64-bit offsets, sizes and\n\
+CRC32s, sections are 64-byte aligned. The version 1 header is an array of\n\
+ints, the first value indicates the number of merged files, each subsequent\n\
+value is an offset for the given entry point.\n\
 \n\
   --out=<output-file> - writes output to the <output-file>,\n\
     if omited stdout is used\n\
+\n\
+  --ldb-version=N - the output format version, 1 or 2,\n\
+    2 is used by default\n\
+\n\
+  --compress - compresses the version 2 sections, the runtime expands them\n\
+    at load time, memory mapping cannot be used for such files\n\
 \n\
 ";
 }
@@ -49,6 +59,14 @@ void process_args (int& argc, char**& argv)
             g_pOutFile = &((*argv) [6]);
             continue;
         }
+        if (0 == strncmp ("--ldb-version=", *argv, 14)) {
+            g_Version = atoi (&((*argv) [14]));
+            continue;
+        }
+        if (!strcmp ("--compress", *argv)) {
+            g_fCompress = true;
+            continue;
+        }
         break;
     }
 }
@@ -76,6 +94,8 @@ int __cdecl main (int argc, char** argv)
     try {
 
         FAMergeDumps merger (&g_alloc);
+        merger.SetVersion (g_Version);
+        merger.SetCompress (g_fCompress);
 
         while (0 <= argc) {
 
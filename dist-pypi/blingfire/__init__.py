@@ -4,6 +4,7 @@ import inspect
 import os.path
 import numpy as np
 import platform
+import random
 
 filename = inspect.getframeinfo(inspect.currentframe()).filename
 path = os.path.dirname(os.path.abspath(filename))
@@ -206,9 +207,24 @@ def text_to_sentences_and_offsets(s):
     return text_to_token_with_offsets(s, blingfire.TextToSentencesWithOffsets, ord('\n'))
 
 
-def load_model(file_name):
+# verify_mode: 0 - verify at load time, 1 - verify at load time in parallel
+def load_model(file_name, verify_mode = 0):
     s_bytes = file_name.encode("utf-8")
-    load_model_fn = blingfire.LoadModel
+    if 0 == verify_mode:
+        load_model_fn = blingfire.LoadModel
+        load_model_fn.restype = c_void_p
+        h = load_model_fn(c_char_p(s_bytes))
+    else:
+        load_model_fn = blingfire.LoadModelWithVerifyMode
+        load_model_fn.restype = c_void_p
+        h = load_model_fn(c_char_p(s_bytes), c_int(verify_mode))
+    return h
+
+
+# the identical sections of the models loaded this way are kept in memory once
+def load_model_with_shared_dumps(file_name):
+    s_bytes = file_name.encode("utf-8")
+    load_model_fn = blingfire.LoadModelWithSharedDumps
     load_model_fn.restype = c_void_p
     h = load_model_fn(c_char_p(s_bytes))
     return h
@@ -246,3 +262,39 @@ def utf8text_to_ids_with_offsets(h, s_bytes, max_len, unk = 0, no_padding = Fals
     return ( np.frombuffer(o_bytes, dtype=c_uint32, count = out_count), 
              np.frombuffer(o_bytes_starts, dtype=c_uint32, count = out_count), 
              np.frombuffer(o_bytes_ends, dtype=c_uint32, count = out_count) )
+
+
+def _split_paths(o_bytes, o_sizes, count):
+    # split the ids into one numpy array per segmentation
+    paths = []
+    offset = 0
+    for i in range(count):
+        size = o_sizes[i]
+        paths.append(np.frombuffer(o_bytes, dtype=c_uint32, count = size, offset = offset * 4))
+        offset += size
+    return paths
+
+
+# the same seed gives the same segmentations, a random seed is used if seed is None
+def text_to_ids_sample(h, s, max_len, sample_count, alpha, seed = None, unk = 0):
+    if seed is None:
+        seed = random.randint(0, 0x7FFFFFFF)
+    # get the UTF-8 bytes
+    s_bytes = s.encode("utf-8")
+    # allocate the output buffers, max_len ids per segmentation
+    o_bytes = (c_int32 * (max_len * sample_count))()
+    o_sizes = (c_int32 * sample_count)()
+    # fill in the ids of sample_count sampled segmentations
+    blingfire.TextToIdsSample_sp(c_void_p(h), c_char_p(s_bytes), c_int(len(s_bytes)), byref(o_bytes), byref(o_sizes), c_int(len(o_bytes)), c_int(sample_count), c_float(alpha), c_int(seed), c_int(unk))
+    return _split_paths(o_bytes, o_sizes, sample_count)
+
+
+def text_to_ids_nbest(h, s, max_len, nbest, unk = 0):
+    # get the UTF-8 bytes
+    s_bytes = s.encode("utf-8")
+    # allocate the output buffers, max_len ids per segmentation
+    o_bytes = (c_int32 * (max_len * nbest))()
+    o_sizes = (c_int32 * nbest)()
+    # fill in the ids of up to nbest best segmentations
+    blingfire.TextToIdsNBest_sp(c_void_p(h), c_char_p(s_bytes), c_int(len(s_bytes)), byref(o_bytes), byref(o_sizes), c_int(len(o_bytes)), c_int(nbest), c_int(unk))
+    return [p for p in _split_paths(o_bytes, o_sizes, nbest) if 0 < len(p)]
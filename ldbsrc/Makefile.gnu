@@ -81,8 +81,9 @@ dirs: $(DIRECTORIES)
 clean:
 	cd $(tmpdir) && rm *
 
+# opt_merge_dumps = --compress in the options file compresses the LDB
 $(OUTPUT): $(tmpdir)/ldb.conf.$(mode).dump $(resources)
-	fa_merge_dumps --out=$(OUTPUT) $(tmpdir)/ldb.conf.$(mode).dump $(resources)
+	fa_merge_dumps $(opt_merge_dumps) --out=$(OUTPUT) $(tmpdir)/ldb.conf.$(mode).dump $(resources)
 
 all: dirs $(OUTPUT)
 
@@ -159,6 +160,9 @@ $(tmpdir)/pos.dict.k2i.$(mode).dump: $(tmpdir)/pos.dict.k2i.txt
 $(tmpdir)/pos.dict.i2t.$(mode).dump: $(tmpdir)/pos.dict.i2t.txt
 	fa_fsm2fsm_pack $(opt_pack_dict_i2t)  --in=$< --out=$@ --auto-test
 
+$(tmpdir)/pos.dict.dat.$(mode).dump: $(tmpdir)/pos.dict.fsm.txt $(tmpdir)/pos.dict.i2t.txt
+	fa_fsm2fsm_pack --type=dat --in=$(tmpdir)/pos.dict.fsm.txt --i2info=$(tmpdir)/pos.dict.i2t.txt --out=$@ --auto-test
+
 $(tmpdir)/w2h.fsm.$(mode).dump: $(tmpdir)/w2h.fsm.txt
 	fa_fsm2fsm_pack $(opt_pack_w2h_fsm) --in=$< --out=$@ --auto-test
 
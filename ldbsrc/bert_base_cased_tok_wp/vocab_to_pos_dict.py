@@ -0,0 +1,28 @@
+#
+# Converts BERT's vocab.txt into the pos.dict.utf8 and tagset.txt for the
+# word-piece runtime (tokalgo wordpiece), usage:
+#
+#   python vocab_to_pos_dict.py ../bert_base_cased_tok/vocab.txt
+#
+
+import sys
+
+vocab = sys.argv[1] if len(sys.argv) > 1 else "vocab.txt"
+
+with open(vocab, "r", encoding='utf-8') as i:
+    with open("pos.dict.utf8", "w", encoding='utf-8') as f:
+        with open("tagset.txt", "w", encoding='utf-8') as t:
+
+            for (id, line) in enumerate(i):
+
+                # [PAD] and [unusedN] are not used by the tokenizer
+                if id < 100:
+                    continue
+
+                line = line.strip()
+
+                if line == "" or line == "##":
+                    continue
+
+                print(line + "\tWORD_ID_" + str(id), file=f)
+                print("WORD_ID_" + str(id) + " " + str(id), file=t)
@@ -120,6 +120,48 @@ namespace BlingFire
             }
         }
 
+        public static IEnumerable<Tuple<string, int, int>> GetSentencesWithUtf16Offsets(string paragraph)
+        {
+            // the same as GetSentencesWithOffsets but offsets are string indices, no UTF-8 transcoding
+            int MaxLength = (2 * paragraph.Length) + 1;
+            char[] outputChars = new char[MaxLength];
+            int[] startOffsets = new int[MaxLength];
+            int[] endOffsets = new int[MaxLength];
+
+            // native call returns '\n' delimited sentences, and adds 0 character at the end
+            Int32 actualLength = TextToSentencesWithOffsetsWithModel_Utf16(paragraph, (Int32)paragraph.Length, outputChars, startOffsets, endOffsets, MaxLength, 0);
+            if (0 < actualLength - 1 && actualLength <= MaxLength)
+            {
+                string sentencesStr = new string(outputChars, 0, actualLength - 1);
+                var sentences = sentencesStr.Split(_justNewLineChar, StringSplitOptions.RemoveEmptyEntries);
+                for (int i = 0; i < sentences.Length; ++i)
+                {
+                    yield return new Tuple<string, int, int>(sentences[i], startOffsets[i], endOffsets[i]);
+                }
+            }
+        }
+
+        public static IEnumerable<Tuple<string, int, int>> GetWordsWithUtf16Offsets(string sentence)
+        {
+            // the same as GetWordsWithOffsets but offsets are string indices, no UTF-8 transcoding
+            int MaxLength = (2 * sentence.Length) + 1;
+            char[] outputChars = new char[MaxLength];
+            int[] startOffsets = new int[MaxLength];
+            int[] endOffsets = new int[MaxLength];
+
+            // native call returns ' ' delimited words, and adds 0 character at the end
+            Int32 actualLength = TextToWordsWithOffsetsWithModel_Utf16(sentence, (Int32)sentence.Length, outputChars, startOffsets, endOffsets, MaxLength, 0);
+            if (0 < actualLength - 1 && actualLength <= MaxLength)
+            {
+                string wordsStr = new string(outputChars, 0, actualLength - 1);
+                var words = wordsStr.Split(_justSpaceChar, StringSplitOptions.RemoveEmptyEntries);
+                for (int i = 0; i < words.Length; ++i)
+                {
+                    yield return new Tuple<string, int, int>(words[i], startOffsets[i], endOffsets[i]);
+                }
+            }
+        }
+
 
         //
         // expose Bling Fire interfaces
@@ -172,6 +214,44 @@ namespace BlingFire
                 int UnkId
             );
  
+        //
+        // UTF-16 variants, lengths and offsets are in UTF-16 code units (string indices)
+        //
+
+        [DllImport(BlingFireTokDllName, CharSet = CharSet.Unicode)]
+        public static extern Int32 TextToSentences_Utf16([MarshalAs(UnmanagedType.LPWStr)] string InUtf16Str, Int32 InUtf16StrLen, [Out] char[] OutBuff, Int32 MaxBuffSize);
+
+        [DllImport(BlingFireTokDllName, CharSet = CharSet.Unicode)]
+        public static extern Int32 TextToWords_Utf16([MarshalAs(UnmanagedType.LPWStr)] string InUtf16Str, Int32 InUtf16StrLen, [Out] char[] OutBuff, Int32 MaxBuffSize);
+
+        [DllImport(BlingFireTokDllName, CharSet = CharSet.Unicode)]
+        public static extern Int32 TextToSentencesWithOffsetsWithModel_Utf16([MarshalAs(UnmanagedType.LPWStr)] string InUtf16Str, Int32 InUtf16StrLen, [Out] char[] OutBuff, int[] StartOffsets, int[] EndOffsets, Int32 MaxBuffSize, UInt64 model);
+
+        [DllImport(BlingFireTokDllName, CharSet = CharSet.Unicode)]
+        public static extern Int32 TextToWordsWithOffsetsWithModel_Utf16([MarshalAs(UnmanagedType.LPWStr)] string InUtf16Str, Int32 InUtf16StrLen, [Out] char[] OutBuff, int[] StartOffsets, int[] EndOffsets, Int32 MaxBuffSize, UInt64 model);
+
+        [DllImport(BlingFireTokDllName, CharSet = CharSet.Unicode)]
+        public static extern int TextToIds_Utf16(
+                UInt64 model,
+                [MarshalAs(UnmanagedType.LPWStr)] string InUtf16Str,
+                Int32 InUtf16StrLen,
+                int[] TokenIds,
+                Int32 MaxBuffSize,
+                int UnkId
+            );
+
+        [DllImport(BlingFireTokDllName, CharSet = CharSet.Unicode)]
+        public static extern int TextToIdsWithOffsets_Utf16(
+                UInt64 model,
+                [MarshalAs(UnmanagedType.LPWStr)] string InUtf16Str,
+                Int32 InUtf16StrLen,
+                int[] TokenIds,
+                int[] StartOffsets,
+                int[] EndOffsets,
+                Int32 MaxBuffSize,
+                int UnkId
+            );
+
         [DllImport(BlingFireTokDllName)]
         public static extern Int32 NormalizeSpaces([MarshalAs(UnmanagedType.LPArray)] byte[] InUtf8Str, Int32 InUtf8StrLen, byte[] OutBuff, Int32 MaxBuffSize, Int32 utf32SpaceCode);
 
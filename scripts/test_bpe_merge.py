@@ -0,0 +1,60 @@
+import argparse
+import sys
+import unicodedata
+import sentencepiece as spm
+from blingfire import *
+
+# Checks that the BPE model with "tokalgo bpe-merge" gives the same ids as the
+# sentence piece library with the same m.model, for every line of the stdin.
+# The lines are normalized first as the sentence piece library does it: NFKC,
+# U+2581 and U+FFFD are spaces and the spaces are collapsed.
+# Also counts the lines where the bpe-opt model differs from the library.
+#
+# Usage:
+#   python test_bpe_merge.py -m ../ldbsrc/ldb/bpe_example_merge.bin -p ../ldbsrc/bpe_example/m.model < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-m", "--model", default="../ldbsrc/ldb/bpe_example_merge.bin", help="bin file with the tokalgo bpe-merge model")
+parser.add_argument("-p", "--piece", default="../ldbsrc/bpe_example/m.model", help="the sentence piece model file")
+parser.add_argument("-o", "--opt-model", default="../ldbsrc/ldb/bpe_example.bin", help="bin file with the tokalgo bpe-opt model, for the comparison only")
+parser.add_argument("-u", "--unk", type=int, default=3, help="the id of the unknown pieces, 3 by default")
+args = parser.parse_args()
+
+sp = spm.SentencePieceProcessor()
+sp.Load(args.piece)
+
+h = load_model(args.model)
+h_opt = load_model(args.opt_model)
+
+line_count = 0
+diff_count = 0
+opt_diff_count = 0
+
+for line in sys.stdin:
+
+    line = unicodedata.normalize("NFKC", line)
+    line = " ".join(line.replace("\u2581", " ").replace("\ufffd", " ").split())
+    if not line:
+        continue
+
+    line_count += 1
+
+    max_len = 2 * len(line.encode("utf-8")) + 16
+    expected = sp.EncodeAsIds(line)
+    actual = list(text_to_ids(h, line, max_len, args.unk, no_padding = True))
+
+    if expected != actual:
+        print("DIFF: " + line)
+        print(sp.EncodeAsPieces(line))
+        print(expected)
+        print(actual)
+        diff_count += 1
+
+    if expected != list(text_to_ids(h_opt, line, max_len, args.unk, no_padding = True)):
+        opt_diff_count += 1
+
+free_model(h_opt)
+free_model(h)
+
+print(str(line_count) + " lines, " + str(diff_count) + " differences, " + str(opt_diff_count) + " differences of the bpe-opt model")
+sys.exit(1 if 0 < diff_count else 0)
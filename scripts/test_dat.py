@@ -0,0 +1,55 @@
+import argparse
+import random
+import sys
+from blingfire import *
+
+# Checks that the model with the double-array trie section (dat N in the
+# [pos-dict] of ldb.conf) gives the same ids and offsets as the same model
+# without it, for every line of the stdin and for random strings of the
+# characters of the text.
+#
+# Usage:
+#   python test_dat.py -m ../ldbsrc/ldb/bpe_example.bin -d ../ldbsrc/ldb/bpe_example_dat.bin < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-m", "--model", default="../ldbsrc/ldb/bpe_example.bin", help="bin file with the model without the trie")
+parser.add_argument("-d", "--dat-model", default="../ldbsrc/ldb/bpe_example_dat.bin", help="bin file with the same model with the trie")
+parser.add_argument("-u", "--unk", type=int, default=3, help="the id of the unknown pieces, 3 by default")
+parser.add_argument("-r", "--random-count", type=int, default=1000, help="the number of the random strings, 1000 by default")
+args = parser.parse_args()
+
+
+def get_ids(h, s):
+    s_bytes = s.encode("utf-8")
+    ids, starts, ends = utf8text_to_ids_with_offsets(h, s_bytes, 2 * len(s_bytes) + 16, args.unk, no_padding = True)
+    return list(ids), list(starts), list(ends)
+
+
+lines = [line.strip() for line in sys.stdin]
+lines = [line for line in lines if line]
+
+# the random strings of the characters of the text, spaces are more frequent
+random.seed(7)
+chars = sorted(set("".join(lines))) + [" "] * 8
+for i in range(args.random_count):
+    lines.append("".join(random.choice(chars) for j in range(random.randint(1, 64))).strip() or "x")
+
+h = load_model(args.model)
+h_dat = load_model(args.dat_model)
+
+diff_count = 0
+
+for line in lines:
+    expected = get_ids(h, line)
+    actual = get_ids(h_dat, line)
+    if expected != actual:
+        print("DIFF: " + line)
+        print(expected)
+        print(actual)
+        diff_count += 1
+
+free_model(h_dat)
+free_model(h)
+
+print(str(len(lines)) + " lines, " + str(diff_count) + " differences")
+sys.exit(1 if 0 < diff_count else 0)
@@ -0,0 +1,158 @@
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+from ctypes import *
+from blingfire import *
+
+# Rebuilds a version 1 LDB file with fa_merge_dumps as version 1, version 2
+# and compressed version 2 files and checks for every line of the stdin that
+# all of them give the same words and ids:
+#   - the version 1 file is rebuilt byte by byte
+#   - the version 2 files load with the verify modes 0 and 1, the other modes
+#     are not accepted
+#   - the runtime cache file, written by LoadModelWithCache next to the model
+#     file, is used by the following LoadModel, and is not used once the
+#     model file is changed
+#   - the truncated version 2 files are not loaded
+#
+# Usage:
+#   python test_ldb.py -b ../Release -m ../ldbsrc/ldb/xlnet.bin ../ldbsrc/ldb/wbd.bin < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-b", "--build-dir", default="../Release", help="the build directory with fa_merge_dumps")
+parser.add_argument("-m", "--model", nargs="+", default=["../ldbsrc/ldb/xlnet.bin"], help="version 1 bin files with compiled models")
+parser.add_argument("-d", "--dense-memory", type=int, default=1000000, help="the memory for the dense states in bytes")
+args = parser.parse_args()
+
+blingfire.LoadModelWithCache.restype = c_void_p
+blingfire.LoadModelWithVerifyMode.restype = c_void_p
+
+lines = [line.strip() for line in sys.stdin]
+lines = [line for line in lines if line]
+
+
+# splits a version 1 LDB file into the dumps, the last validation dump is skipped
+def split_dumps(file_name, out_dir):
+    with open(file_name, "rb") as f:
+        data = f.read()
+    count = struct.unpack_from("<i", data, 0)[0]
+    offsets = list(struct.unpack_from("<%di" % count, data, 4)) + [len(data)]
+    dumps = []
+    for i in range(count - 1):
+        dump = os.path.join(out_dir, "%02d.dump" % i)
+        with open(dump, "wb") as f:
+            f.write(data[offsets[i]:offsets[i + 1]])
+        dumps.append(dump)
+    return dumps
+
+
+def merge_dumps(dumps, out_file, options):
+    subprocess.check_call([os.path.join(args.build_dir, "fa_merge_dumps"), "--out=" + out_file] + options + dumps)
+    return out_file
+
+
+def get_outputs(h):
+    outputs = []
+    for line in lines:
+        max_len = 2 * len(line.encode("utf-8")) + 16
+        outputs.append((text_to_words_with_model(h, line), list(text_to_ids(h, line, max_len, no_padding = True))))
+    return outputs
+
+
+# returns True if the file is loaded, the failed load ends the process
+def can_load(file_name):
+    code = "from blingfire import *; load_model(%r)" % file_name
+    return 0 == subprocess.call([sys.executable, "-c", code], stderr = subprocess.DEVNULL)
+
+
+def get_memory_info(h):
+    o_bytes = create_string_buffer(4096)
+    o_len = blingfire.GetModelMemoryInfo(c_void_p(h), byref(o_bytes), c_int(len(o_bytes)))
+    if -1 == o_len or o_len > len(o_bytes):
+        return []
+    return [l.split("\t") for l in o_bytes.value.decode("utf-8").split("\n") if l]
+
+
+failed = False
+
+for model in args.model:
+
+    errors = []
+
+    h = load_model(model)
+    expected = get_outputs(h)
+    free_model(h)
+
+    with tempfile.TemporaryDirectory() as tmp:
+
+        dumps = split_dumps(model, tmp)
+
+        v1 = merge_dumps(dumps, os.path.join(tmp, "v1.bin"), ["--ldb-version=1"])
+        with open(model, "rb") as f1, open(v1, "rb") as f2:
+            if f1.read() != f2.read():
+                errors.append("the version 1 file is not the same")
+
+        v2 = merge_dumps(dumps, os.path.join(tmp, "v2.bin"), [])
+        lz = merge_dumps(dumps, os.path.join(tmp, "lz.bin"), ["--compress"])
+
+        for file_name in (v2, lz):
+            name = os.path.basename(file_name)
+
+            for verify_mode in (0, 1):
+                h = load_model(file_name, verify_mode)
+                if not h:
+                    errors.append(name + " is not loaded with the verify mode " + str(verify_mode))
+                    continue
+                if get_outputs(h) != expected:
+                    errors.append(name + " gives different results with the verify mode " + str(verify_mode))
+                free_model(h)
+
+            for verify_mode in (2, 3):
+                h = blingfire.LoadModelWithVerifyMode(c_char_p(file_name.encode("utf-8")), c_int(verify_mode))
+                if h:
+                    errors.append(name + " is loaded with the verify mode " + str(verify_mode))
+                    free_model(h)
+
+        # the first load writes the cache file, the second one maps it
+        cache = v2 + ".cache"
+        for i in range(2):
+            h = blingfire.LoadModelWithCache(c_char_p(v2.encode("utf-8")), c_int(args.dense_memory), None)
+            if get_outputs(h) != expected:
+                errors.append("the model with the cache gives different results")
+            free_model(h)
+        if not os.path.exists(cache):
+            errors.append("the cache file is not written")
+
+        h = load_model(v2)
+        if get_outputs(h) != expected:
+            errors.append("the model with the cache gives different results")
+        if "runtime-cache" not in [item[0] for item in get_memory_info(h)]:
+            errors.append("the cache file is not used by LoadModel")
+        free_model(h)
+
+        # the model file is written again, the cache is made for the old one
+        st = os.stat(v2)
+        os.utime(v2, (st.st_atime, st.st_mtime + 10))
+        h = load_model(v2)
+        if "runtime-cache" in [item[0] for item in get_memory_info(h)]:
+            errors.append("the cache file of the changed model is used")
+        free_model(h)
+
+        # the header, the directory or the sections do not fit the file
+        with open(v2, "rb") as f:
+            data = f.read()
+        for size in (12, 40, len(data) // 2, len(data) - 1):
+            truncated = os.path.join(tmp, "truncated.bin")
+            with open(truncated, "wb") as f:
+                f.write(data[:size])
+            if can_load(truncated):
+                errors.append("the version 2 file truncated to " + str(size) + " bytes is loaded")
+
+    print(model + ": " + str(len(lines)) + " lines, " + ("OK" if not errors else ", ".join(errors)))
+    if errors:
+        failed = True
+
+sys.exit(1 if failed else 0)
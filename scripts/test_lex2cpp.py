@@ -0,0 +1,124 @@
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+# Checks that the lexer generated by fa_lex2cpp gives the same output as
+# FALexTools_t with the LDB, for every line of the stdin.
+#
+# Usage:
+#   python test_lex2cpp.py -b ../Release -l ../ldbsrc/ldb/wbd.bin ../ldbsrc/ldb/sbd.bin ../ldbsrc/ldb/wbd_utf8.bin < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-b", "--build-dir", default="../Release", help="the build directory with fa_lex2cpp and libfsaClient.a")
+parser.add_argument("-r", "--root", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."), help="the repository root")
+parser.add_argument("-l", "--ldb", nargs="+", default=["../ldbsrc/ldb/wbd.bin"], help="bin files with compiled tokenization rules")
+parser.add_argument("-c", "--cxx", default="c++", help="C++ compiler")
+args = parser.parse_args()
+
+DRIVER = r'''
+#include "FAConfig.h"
+#include "FAImageDump.h"
+#include "FALDB.h"
+#include "FAWbdConfKeeper.h"
+#include "FALexTools_t.h"
+#include "FAUtf8Utils.h"
+#include "FAFsmConst.h"
+#include "lexer.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main (int argc, char ** argv)
+{
+    FAImageDump Img;
+    Img.Load (argv [1]);
+    FALDB Ldb;
+    Ldb.SetImage (Img.GetImageDump ());
+    const int * pValues = NULL;
+    const int Size = Ldb.GetHeader ()->Get (FAFsmConst::FUNC_WBD, &pValues);
+    FAWbdConfKeeper Conf;
+    Conf.Initialize (&Ldb, pValues, Size);
+
+    FALexTools_t < TY > Lex;
+    Lex.SetConf (&Conf);
+    const FALexTools_gen Gen;
+
+    int LineNum = 0;
+    int DiffCount = 0;
+    std::string Line;
+    std::vector < TY > In;
+    std::vector < int > Out1, Out2;
+
+    while (std::getline (std::cin, Line)) {
+
+        LineNum++;
+        if (1 == sizeof (TY)) {
+            In.assign (Line.begin (), Line.end ());
+        } else {
+            In.resize (Line.size () + 1);
+            const int InSize = ::FAStrUtf8ToArray (Line.c_str (), (int) Line.size (), (int *) In.data (), (int) In.size ());
+            if (0 > InSize) {
+                continue;
+            }
+            In.resize (InSize);
+        }
+
+        const int InSize = (int) In.size ();
+        const int MaxOutSize = 3 * (InSize + 2);
+        Out1.assign (MaxOutSize, 0);
+        Out2.assign (MaxOutSize, 0);
+
+        const int OutSize1 = Lex.Process (In.data (), InSize, Out1.data (), MaxOutSize);
+        const int OutSize2 = Gen.Process (In.data (), InSize, Out2.data (), MaxOutSize);
+
+        if (OutSize1 != OutSize2 || !std::equal (Out1.begin (), Out1.begin () + OutSize1, Out2.begin ())) {
+            std::cout << "DIFF at line " << LineNum << ": " << Line << std::endl;
+            DiffCount++;
+        }
+    }
+
+    std::cout << LineNum << " lines, " << DiffCount << " differences" << std::endl;
+    return 0 == DiffCount ? 0 : 1;
+}
+'''
+
+text = sys.stdin.buffer.read()
+
+root = os.path.abspath(args.root)
+build_dir = os.path.abspath(args.build_dir)
+flags = ["-O1", "-std=c++11", "-DHAVE_NO_SPECSTRINGS", "-DBLING_FIRE_NOAP", "-DBLING_FIRE_NOWINDOWS",
+         "-I" + os.path.join(root, "blingfireclient.library", "inc"),
+         "-I" + os.path.join(root, "blingfireclient.library", "src")]
+
+failed = False
+
+with tempfile.TemporaryDirectory() as tmp:
+
+    driver = os.path.join(tmp, "driver.cpp")
+    with open(driver, "w") as f:
+        f.write(DRIVER)
+
+    for ldb in args.ldb:
+
+        ldb = os.path.abspath(ldb)
+        lexer = os.path.join(tmp, "lexer.h")
+        subprocess.check_call([os.path.join(build_dir, "fa_lex2cpp"), "--ldb=" + ldb, "--out=" + lexer])
+
+        # the generated class wraps FALexTools_t of the same input type
+        with open(lexer) as f:
+            ty = "unsigned char" if "FALexTools_t < unsigned char >" in f.read() else "int"
+
+        exe = os.path.join(tmp, "driver")
+        subprocess.check_call([args.cxx] + flags + ["-DTY=" + ty, "-I" + tmp, driver, "-o", exe,
+                               "-L" + build_dir, "-lfsaClient", "-lpthread"])
+
+        result = subprocess.run([exe, ldb], input=text, stdout=subprocess.PIPE)
+        print(os.path.basename(ldb) + ": " + result.stdout.decode("utf-8", "replace").strip().split("\n")[-1])
+        if 0 != result.returncode:
+            print(result.stdout.decode("utf-8", "replace"))
+            failed = True
+
+sys.exit(1 if failed else 0)
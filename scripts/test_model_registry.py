@@ -0,0 +1,131 @@
+import argparse
+import os
+import sys
+from ctypes import *
+from blingfire import *
+
+# Checks the models loaded by AcquireModel: the same file gives the same
+# handle, ReleaseModel takes back only the acquired handles, and the models
+# not in use are freed, the least recently acquired first, when the memory
+# budget is exceeded. Checks the GetModelMemoryInfo output of the models
+# with the private and with the shared dumps and with the word cache, and
+# that the registry counts the same memory as it lists.
+#
+# Usage:
+#   python test_model_registry.py -m ../ldbsrc/ldb/xlnet.bin ../ldbsrc/ldb/laser100k.bin
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-m", "--model", nargs=2, default=["../ldbsrc/ldb/xlnet.bin", "../ldbsrc/ldb/laser100k.bin"], help="two bin files with compiled unigram lm models")
+args = parser.parse_args()
+
+blingfire.AcquireModel.restype = c_void_p
+blingfire.LoadModelWithSharedDumps.restype = c_void_p
+blingfire.GetModelRegistryMemory.restype = c_int64
+
+errors = []
+
+
+def check(condition, message):
+    if not condition:
+        errors.append(message)
+
+
+def acquire(file_name):
+    return blingfire.AcquireModel(c_char_p(file_name.encode("utf-8")))
+
+
+def release(h):
+    return blingfire.ReleaseModel(c_void_p(h))
+
+
+def set_max_memory(max_memory):
+    return blingfire.SetModelRegistryMaxMemory(c_int64(max_memory))
+
+
+def get_memory():
+    return blingfire.GetModelRegistryMemory()
+
+
+# returns the items as [name, bytes, storage, shared|private, user count]
+def get_memory_info(h):
+    o_len = blingfire.GetModelMemoryInfo(c_void_p(h), None, c_int(0))
+    o_bytes = create_string_buffer(o_len + 1)
+    o_len = blingfire.GetModelMemoryInfo(c_void_p(h), byref(o_bytes), c_int(len(o_bytes)))
+    if -1 == o_len or o_len > len(o_bytes):
+        return []
+    items = [l.split("\t") for l in o_bytes.value.decode("utf-8").split("\n") if l]
+    for item in items:
+        check(5 == len(item), "bad memory info line: " + "\t".join(item))
+    return [item for item in items if 5 == len(item)]
+
+
+# returns the sum of the heap and the mapped items
+def get_memory_size(h):
+    return sum(int(item[1]) for item in get_memory_info(h) if item[2] in ["heap", "mapped"])
+
+
+def check_memory_info(h, file_name, user_count):
+    items = get_memory_info(h)
+    names = [item[0] for item in items]
+    check("ldb-dump-0" in names, "no LDB dumps in the memory info")
+    for name, size, storage, sharing, count in items:
+        check(0 < int(size), name + " has no memory")
+        check(storage in ["heap", "mapped"] + names, name + " has unknown storage " + storage)
+        check(("shared" if 1 < int(count) else "private") == sharing, name + " has wrong sharing")
+        if name.startswith("ldb-dump-"):
+            check(int(count) == user_count, name + " is used by " + count + " models, expected " + str(user_count))
+    return dict((item[0], item) for item in items)
+
+
+# the same file gives the same handle, the handles are released once per acquire
+h1 = acquire(args.model[0])
+h2 = acquire(args.model[0])
+check(h1 and h1 == h2, "the same model is loaded twice")
+memory1 = get_memory()
+check(0 < memory1, "the registry has no memory")
+check(memory1 == get_memory_size(h1), "the registry memory is not the one of GetModelMemoryInfo")
+check(1 == release(h1) and 1 == release(h2), "the acquired model is not released")
+check(0 == release(h1), "the model is released more times than acquired")
+
+h = load_model(args.model[0])
+check(0 == release(h), "the model not from the registry is released")
+info = check_memory_info(h, args.model[0], 1)
+check("ldb-image" in info and os.path.getsize(args.model[0]) == int(info["ldb-image"][1]), "the LDB image size is not the file size")
+free_model(h)
+
+# no budget, the released model is kept
+check(memory1 == get_memory(), "the model is freed without the budget")
+
+# the models in use are not freed, the least recently acquired is freed first
+h1 = acquire(args.model[0])
+h2 = acquire(args.model[1])
+memory12 = get_memory()
+check(memory1 < memory12, "the second model has no memory")
+set_max_memory(memory12 - 1)
+check(memory12 == get_memory(), "the model in use is freed")
+release(h1)
+check(memory12 - memory1 == get_memory(), "the least recently acquired model is not freed")
+release(h2)
+check(memory12 - memory1 == get_memory(), "the model within the budget is freed")
+set_max_memory(1)
+check(0 == get_memory(), "the models over the budget are not freed")
+set_max_memory(0)
+
+# the identical dumps are kept once
+h1 = blingfire.LoadModelWithSharedDumps(c_char_p(args.model[0].encode("utf-8")))
+h2 = blingfire.LoadModelWithSharedDumps(c_char_p(args.model[0].encode("utf-8")))
+check_memory_info(h1, args.model[0], 2)
+free_model(h2)
+info = check_memory_info(h1, args.model[0], 1)
+check("ldb-image" not in info, "the model with the shared dumps keeps the image")
+
+# the word cache is listed once it is used
+if 1 == blingfire.SetWordCacheSize(c_void_p(h1), c_int(1000)):
+    text_to_ids(h1, "hello world", 16)
+    check("word-cache" in check_memory_info(h1, args.model[0], 1), "the word cache is not listed")
+free_model(h1)
+
+for e in errors:
+    print(e)
+print("OK" if not errors else str(len(errors)) + " errors")
+sys.exit(1 if errors else 0)
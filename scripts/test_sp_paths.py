@@ -0,0 +1,130 @@
+import argparse
+import sys
+import threading
+from ctypes import *
+from blingfire import *
+
+# Checks for every line of the stdin that the segmentation of a unigram lm
+# model does not depend on the way it is computed:
+#   - the first of the N-best segmentations is the one TextToIds returns,
+#     the N-best segmentations are different
+#   - the same seed gives the same sampled segmentations
+#   - the word cache (SetWordCacheSize) does not change the ids, also when
+#     it is resized or disabled while other threads use the model
+#   - the dense states (LoadModelWithDenseStates) do not change the ids
+#   - the word by word Viterbi gives the same ids, also when the output is
+#     cut, as the Viterbi over the whole text (LoadModelWithWholeTextViterbi),
+#     the lines where a segment could cross U+2581 are added to the stdin
+#
+# Usage:
+#   python test_sp_paths.py -m ../ldbsrc/ldb/xlnet.bin ../ldbsrc/ldb/laser100k.bin < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-m", "--model", nargs="+", default=["../ldbsrc/ldb/xlnet.bin"], help="bin files with compiled unigram lm models")
+parser.add_argument("-n", "--nbest", type=int, default=4, help="the number of the N-best and the sampled segmentations, 4 by default")
+parser.add_argument("-a", "--alpha", type=float, default=0.1, help="the sampling smoothing parameter, 0.1 by default")
+parser.add_argument("-d", "--dense-memory", type=int, default=1000000, help="the memory for the dense states in bytes")
+parser.add_argument("-c", "--cache-size", type=int, default=10000, help="the word cache size in words")
+args = parser.parse_args()
+
+blingfire.LoadModelWithDenseStates.restype = c_void_p
+blingfire.LoadModelWithWholeTextViterbi.restype = c_void_p
+
+lines = [line.strip() for line in sys.stdin]
+lines = [line for line in lines if line]
+
+# several spaces, the spaces around the punctuation, the U+2581 characters,
+# the phrases with the frequent pieces and the words without spaces
+lines += ["a  b   c", "New York, New York.", " . , ; : ! ? ", "hello\u2581world", "\u2581\u2581\u2581 x",
+    "in the of and to", "ofthe inthe tothe andthe", "1 2 3 4 5 6 7 8 9 10", "a" * 100, "- -- --- ----",
+    "(a) [b] {c}", "http :// www . example . com", "don 't can 't won 't", "\u00e9t\u00e9 \u00e0 la plage"]
+
+failed = False
+
+for model in args.model:
+
+    h = load_model(model)
+    h_dense = blingfire.LoadModelWithDenseStates(c_char_p(model.encode("utf-8")), c_int(args.dense_memory))
+    h_cache = load_model(model)
+    h_whole = blingfire.LoadModelWithWholeTextViterbi(c_char_p(model.encode("utf-8")))
+
+    if 1 != blingfire.SetWordCacheSize(c_void_p(h_cache), c_int(args.cache_size)):
+        print(model + ": the word cache cannot be used")
+        failed = True
+
+    diff_count = 0
+
+    for line in lines:
+
+        max_len = 2 * len(line.encode("utf-8")) + 16
+        ids = list(text_to_ids(h, line, max_len, no_padding = True))
+
+        errors = []
+
+        nbest = [list(p) for p in text_to_ids_nbest(h, line, max_len, args.nbest)]
+        if not nbest or nbest[0] != ids:
+            errors.append("the first N-best is not the best")
+        if len(nbest) != len(set(tuple(p) for p in nbest)):
+            errors.append("the N-best are not different")
+
+        samples1 = [list(p) for p in text_to_ids_sample(h, line, max_len, args.nbest, args.alpha, seed = 7)]
+        samples2 = [list(p) for p in text_to_ids_sample(h, line, max_len, args.nbest, args.alpha, seed = 7)]
+        if samples1 != samples2:
+            errors.append("the same seed gives different samples")
+        if [] in samples1:
+            errors.append("an empty sample")
+
+        if list(text_to_ids(h_cache, line, max_len, no_padding = True)) != ids:
+            errors.append("the word cache changes the ids")
+
+        if list(text_to_ids(h_dense, line, max_len, no_padding = True)) != ids:
+            errors.append("the dense states change the ids")
+
+        if list(text_to_ids(h_whole, line, max_len, no_padding = True)) != ids:
+            errors.append("the word by word Viterbi changes the ids")
+        if list(text_to_ids(h_whole, line, 3)) != list(text_to_ids(h, line, 3)):
+            errors.append("the word by word Viterbi changes the cut ids")
+
+        if errors:
+            print("DIFF: " + line)
+            print("  " + ", ".join(errors))
+            diff_count += 1
+
+    hit_count = c_int64(0)
+    miss_count = c_int64(0)
+    blingfire.GetWordCacheCounts(c_void_p(h_cache), byref(hit_count), byref(miss_count))
+
+    # resize the cache while the other threads use the model
+    expected = [list(text_to_ids(h, line, 2 * len(line.encode("utf-8")) + 16, no_padding = True)) for line in lines]
+    thread_errors = []
+
+    def segment():
+        for line, ids in zip(lines, expected):
+            if list(text_to_ids(h_cache, line, 2 * len(line.encode("utf-8")) + 16, no_padding = True)) != ids:
+                thread_errors.append(line)
+
+    threads = [threading.Thread(target = segment) for i in range(4)]
+    for t in threads:
+        t.start()
+    resize_count = 0
+    while any(t.is_alive() for t in threads):
+        blingfire.SetWordCacheSize(c_void_p(h_cache), c_int((resize_count % 3) * args.cache_size))
+        resize_count += 1
+    for t in threads:
+        t.join()
+    if thread_errors:
+        print(model + ": the resized word cache changes the ids of " + str(len(thread_errors)) + " lines")
+        failed = True
+
+    free_model(h_whole)
+    free_model(h_cache)
+    free_model(h_dense)
+    free_model(h)
+
+    print(model + ": " + str(len(lines)) + " lines, " + str(diff_count) + " differences, " + \
+        str(hit_count.value) + " word cache hits, " + str(miss_count.value) + " misses")
+
+    if 0 < diff_count:
+        failed = True
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,90 @@
+import argparse
+import sys
+from ctypes import *
+from blingfire import *
+
+# Checks that the word breaker compiled into a UTF-8 byte automaton gives the
+# same words and offsets as the same rules compiled for UTF-32, for every
+# line of the stdin, both for UTF-8 and UTF-16 input. See utf8-input in
+# ldbsrc/wbd_utf8/ldb.conf.small. Also checks that both models read the
+# unpaired surrogates of UTF-16 input as U+FFFD.
+#
+# Usage:
+#   python test_utf8_wbd.py -m ../ldbsrc/ldb/wbd.bin -u ../ldbsrc/ldb/wbd_utf8.bin < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-m", "--model", default="../ldbsrc/ldb/wbd.bin", help="bin file with the rules compiled for UTF-32")
+parser.add_argument("-u", "--utf8-model", default="../ldbsrc/ldb/wbd_utf8.bin", help="bin file with the same rules compiled for UTF-8 bytes")
+args = parser.parse_args()
+
+
+def words_utf8(h, s):
+    s_bytes = s.encode("utf-8")
+    o_count = 3 * len(s_bytes) + 1
+    o_bytes = create_string_buffer(o_count)
+    o_starts = (c_int32 * o_count)()
+    o_ends = (c_int32 * o_count)()
+    o_len = blingfire.TextToWordsWithOffsetsWithModel(c_char_p(s_bytes), c_int(len(s_bytes)),
+        byref(o_bytes), byref(o_starts), byref(o_ends), c_int(o_count), c_void_p(h))
+    if -1 == o_len or o_len > o_count:
+        return None
+    words = o_bytes.value.decode("utf-8")
+    n = len(words.split(" ")) if words else 0
+    return words, o_starts[:n], o_ends[:n]
+
+
+def words_utf16(h, s):
+    s_units = s.encode("utf-16-le", "surrogatepass")
+    s_count = len(s_units) // 2
+    o_count = 2 * s_count + 1
+    s_buff = (c_uint16 * s_count).from_buffer_copy(s_units)
+    o_buff = (c_uint16 * o_count)()
+    o_starts = (c_int32 * o_count)()
+    o_ends = (c_int32 * o_count)()
+    o_len = blingfire.TextToWordsWithOffsetsWithModel_Utf16(byref(s_buff), c_int(s_count),
+        byref(o_buff), byref(o_starts), byref(o_ends), c_int(o_count), c_void_p(h))
+    if -1 == o_len or o_len > o_count:
+        return None
+    words = bytes(o_buff)[:2 * (o_len - 1)].decode("utf-16-le")
+    n = len(words.split(" ")) if words else 0
+    return words, o_starts[:n], o_ends[:n]
+
+
+h = load_model(args.model)
+h8 = load_model(args.utf8_model)
+
+line_count = 0
+diff_count = 0
+
+for line in sys.stdin:
+
+    line = line.strip()
+    if not line:
+        continue
+
+    line_count += 1
+
+    for f in (words_utf8, words_utf16):
+        expected = f(h, line)
+        actual = f(h8, line)
+        if expected != actual:
+            print("DIFF at line " + str(line_count) + " (" + f.__name__ + "): " + line)
+            print(expected)
+            print(actual)
+            diff_count += 1
+
+# unpaired surrogates, the first and the last character, inside and next to a word
+for line in ["\ud800", "a\udc00b", "hello \ud83d world", "\udc00 x \ud800", "\ud83d\ude00 ok\ud83d"]:
+    expected = words_utf16(h, line)
+    actual = words_utf16(h8, line)
+    if expected != actual or None == expected:
+        print("DIFF at the unpaired surrogates: " + repr(line))
+        print(expected)
+        print(actual)
+        diff_count += 1
+
+free_model(h8)
+free_model(h)
+
+print(str(line_count) + " lines, " + str(diff_count) + " differences")
+sys.exit(1 if 0 < diff_count else 0)
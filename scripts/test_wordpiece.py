@@ -0,0 +1,63 @@
+import argparse
+import random
+import sys
+from blingfire import *
+
+# Checks that the word-piece model (tokalgo wordpiece, LinMaxMatch) gives the
+# same ids and offsets as the lexer based model compiled from the same
+# vocabulary, for every line of the stdin and for the words around the
+# length limits and made of "#" characters.
+#
+# Usage:
+#   python test_wordpiece.py -m ../ldbsrc/ldb/bert_base_cased_tok.bin -w ../ldbsrc/ldb/bert_base_cased_tok_wp.bin < text.utf8
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-m", "--model", default="../ldbsrc/ldb/bert_base_cased_tok.bin", help="bin file with the lexer based model")
+parser.add_argument("-w", "--wordpiece-model", default="../ldbsrc/ldb/bert_base_cased_tok_wp.bin", help="bin file with the tokalgo wordpiece model")
+parser.add_argument("-u", "--unk", type=int, default=100, help="the id of the unknown words, 100 by default")
+args = parser.parse_args()
+
+
+def get_ids(h, s):
+    s_bytes = s.encode("utf-8")
+    ids, starts, ends = utf8text_to_ids_with_offsets(h, s_bytes, 2 * len(s_bytes) + 16, args.unk, no_padding = True)
+    return list(ids), list(starts), list(ends)
+
+
+# the words around the length limits and the words made of "#"
+random.seed(7)
+letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+special = ["#", "##", "###", "####", "a#", "a##", "##a", "#a#", "a##b", "# ## ###", "x ##y", "##ing"]
+for n in [99, 100, 101, 250, 300]:
+    special.append("a" * n)
+    special.append("##" + "a" * (n - 2))
+    special.append("#" * n)
+    special.append("".join(random.choice(letters) for i in range(n)))
+    special.append("un" + "believable" * (n // 10))
+
+h = load_model(args.model)
+h_wp = load_model(args.wordpiece_model)
+
+line_count = 0
+diff_count = 0
+
+for line in [l.strip() for l in sys.stdin] + special:
+
+    if not line:
+        continue
+
+    line_count += 1
+
+    expected = get_ids(h, line)
+    actual = get_ids(h_wp, line)
+    if expected != actual:
+        print("DIFF: " + line)
+        print(expected)
+        print(actual)
+        diff_count += 1
+
+free_model(h_wp)
+free_model(h)
+
+print(str(line_count) + " lines, " + str(diff_count) + " differences")
+sys.exit(1 if 0 < diff_count else 0)